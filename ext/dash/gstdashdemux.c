@@ -170,6 +170,11 @@ enum
   PROP_MAX_BUFFERING_TIME,
   PROP_BANDWIDTH_USAGE,
   PROP_MAX_BITRATE,
+  PROP_FRAGMENTS_IN_FLIGHT,
+  PROP_MAX_PREFETCH_BYTES,
+  PROP_SWITCH_HYSTERESIS,
+  PROP_LOW_BUFFER_TIME,
+  PROP_BANDWIDTH_ESTIMATE,
   PROP_LAST
 };
 
@@ -177,9 +182,10 @@ enum
 #define DEFAULT_MAX_BUFFERING_TIME       30     /* in seconds */
 #define DEFAULT_BANDWIDTH_USAGE         0.8     /* 0 to 1     */
 #define DEFAULT_MAX_BITRATE        24000000     /* in bit/s  */
+#define DEFAULT_FRAGMENTS_IN_FLIGHT       2
+#define DEFAULT_MAX_PREFETCH_BYTES (32 * 1024 * 1024)
 
 #define DEFAULT_FAILED_COUNT 3
-#define DOWNLOAD_RATE_HISTORY_MAX 3
 
 /* Custom internal event to signal end of period */
 #define GST_EVENT_DASH_EOP GST_EVENT_MAKE_TYPE(81, GST_EVENT_TYPE_DOWNSTREAM | GST_EVENT_TYPE_SERIALIZED)
@@ -216,22 +222,23 @@ static void gst_dash_demux_resume_stream_task (GstDashDemux * demux);
 static void gst_dash_demux_resume_download_task (GstDashDemux * demux);
 static gboolean gst_dash_demux_setup_all_streams (GstDashDemux * demux);
 static gboolean gst_dash_demux_select_representations (GstDashDemux * demux);
+static void gst_dash_demux_stream_rewind (GstDashDemux * demux,
+    GstDashDemuxStream * stream, GstActiveStream * active_stream);
 static gboolean gst_dash_demux_get_next_fragment (GstDashDemux * demux,
     GstActiveStream ** stream, GstClockTime * next_ts);
 static gboolean gst_dash_demux_advance_period (GstDashDemux * demux);
 static void gst_dash_demux_download_wait (GstDashDemux * demux,
     GstClockTime time_diff);
+static void gst_dash_demux_post_bandwidth (GstDashDemux * demux);
 
 static void gst_dash_demux_expose_streams (GstDashDemux * demux);
 static void gst_dash_demux_remove_streams (GstDashDemux * demux,
     GSList * streams);
 static void gst_dash_demux_stream_free (GstDashDemuxStream * stream);
 static void gst_dash_demux_reset (GstDashDemux * demux, gboolean dispose);
-#ifndef GST_DISABLE_GST_DEBUG
 static GstClockTime gst_dash_demux_get_buffering_time (GstDashDemux * demux);
 static GstClockTime gst_dash_demux_stream_get_buffering_time (GstDashDemuxStream
     * stream);
-#endif
 static GstCaps *gst_dash_demux_get_input_caps (GstDashDemux * demux,
     GstActiveStream * stream);
 static GstPad *gst_dash_demux_create_pad (GstDashDemux * demux);
@@ -267,6 +274,12 @@ gst_dash_demux_dispose (GObject * obj)
     demux->downloader = NULL;
   }
 
+  if (demux->scheduler != NULL) {
+    gst_object_unref (demux->scheduler);
+    demux->scheduler = NULL;
+  }
+
+  gst_bandwidth_estimator_deinit (&demux->bandwidth);
   g_mutex_clear (&demux->streams_lock);
 
   G_OBJECT_CLASS (parent_class)->dispose (obj);
@@ -304,6 +317,40 @@ gst_dash_demux_class_init (GstDashDemuxClass * klass)
           1000, G_MAXUINT, DEFAULT_MAX_BITRATE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_FRAGMENTS_IN_FLIGHT,
+      g_param_spec_uint ("fragments-in-flight", "Fragments in flight",
+          "Number of fragments of each stream downloaded in parallel",
+          1, 16, DEFAULT_FRAGMENTS_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_PREFETCH_BYTES,
+      g_param_spec_uint64 ("max-prefetch-bytes", "Max prefetch bytes",
+          "Maximum amount of downloaded data waiting to be queued before no "
+          "more fragments are downloaded ahead (0 = unlimited)",
+          0, G_MAXUINT64, DEFAULT_MAX_PREFETCH_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SWITCH_HYSTERESIS,
+      g_param_spec_float ("switch-hysteresis", "Switch hysteresis",
+          "How much the estimated bandwidth must exceed the current "
+          "representation bitrate before switching up (0.2 = 20%)",
+          0, 10, GST_BANDWIDTH_ESTIMATOR_DEFAULT_HYSTERESIS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOW_BUFFER_TIME,
+      g_param_spec_uint64 ("low-buffer-time", "Low buffer time",
+          "Below this amount of buffered data the demuxer does not switch up "
+          "and selects lower representations the emptier the buffer is "
+          "(in nanoseconds, 0 = ignore the buffer level)",
+          0, G_MAXUINT64, GST_BANDWIDTH_ESTIMATOR_DEFAULT_LOW_BUFFER_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BANDWIDTH_ESTIMATE,
+      g_param_spec_uint64 ("bandwidth-estimate", "Bandwidth estimate",
+          "Current estimate of the available bandwidth in bit/s "
+          "(0 = unknown)", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_dash_demux_change_state);
 
@@ -337,11 +384,20 @@ gst_dash_demux_init (GstDashDemux * demux)
 
   /* Downloader */
   demux->downloader = gst_uri_downloader_new ();
+  demux->scheduler = gst_uri_download_scheduler_new ();
 
   /* Properties */
   demux->max_buffering_time = DEFAULT_MAX_BUFFERING_TIME * GST_SECOND;
   demux->bandwidth_usage = DEFAULT_BANDWIDTH_USAGE;
   demux->max_bitrate = DEFAULT_MAX_BITRATE;
+  demux->fragments_in_flight = DEFAULT_FRAGMENTS_IN_FLIGHT;
+  demux->max_prefetch_bytes = DEFAULT_MAX_PREFETCH_BYTES;
+  gst_uri_download_scheduler_set_limits (demux->scheduler,
+      demux->fragments_in_flight, demux->max_prefetch_bytes);
+  gst_bandwidth_estimator_init (&demux->bandwidth);
+  /* the streams download in parallel, let the scheduler add the samples */
+  gst_uri_download_scheduler_set_bandwidth_estimator (demux->scheduler,
+      &demux->bandwidth);
   demux->last_manifest_update = GST_CLOCK_TIME_NONE;
 
   /* Updates task */
@@ -378,6 +434,24 @@ gst_dash_demux_set_property (GObject * object, guint prop_id,
     case PROP_MAX_BITRATE:
       demux->max_bitrate = g_value_get_uint (value);
       break;
+    case PROP_FRAGMENTS_IN_FLIGHT:
+      demux->fragments_in_flight = g_value_get_uint (value);
+      gst_uri_download_scheduler_set_limits (demux->scheduler,
+          demux->fragments_in_flight, demux->max_prefetch_bytes);
+      break;
+    case PROP_MAX_PREFETCH_BYTES:
+      demux->max_prefetch_bytes = g_value_get_uint64 (value);
+      gst_uri_download_scheduler_set_limits (demux->scheduler,
+          demux->fragments_in_flight, demux->max_prefetch_bytes);
+      break;
+    case PROP_SWITCH_HYSTERESIS:
+      gst_bandwidth_estimator_set_hysteresis (&demux->bandwidth,
+          g_value_get_float (value));
+      break;
+    case PROP_LOW_BUFFER_TIME:
+      gst_bandwidth_estimator_set_low_buffer_time (&demux->bandwidth,
+          g_value_get_uint64 (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -400,6 +474,24 @@ gst_dash_demux_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_MAX_BITRATE:
       g_value_set_uint (value, demux->max_bitrate);
       break;
+    case PROP_FRAGMENTS_IN_FLIGHT:
+      g_value_set_uint (value, demux->fragments_in_flight);
+      break;
+    case PROP_MAX_PREFETCH_BYTES:
+      g_value_set_uint64 (value, demux->max_prefetch_bytes);
+      break;
+    case PROP_SWITCH_HYSTERESIS:
+      g_value_set_float (value,
+          gst_bandwidth_estimator_get_hysteresis (&demux->bandwidth));
+      break;
+    case PROP_LOW_BUFFER_TIME:
+      g_value_set_uint64 (value,
+          gst_bandwidth_estimator_get_low_buffer_time (&demux->bandwidth));
+      break;
+    case PROP_BANDWIDTH_ESTIMATE:
+      g_value_set_uint64 (value,
+          gst_bandwidth_estimator_get_estimate (&demux->bandwidth));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -493,7 +585,7 @@ gst_dash_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       GstClockTime current_pos, target_pos;
       guint current_sequence, current_period;
       GstActiveStream *active_stream;
-      GstMediaSegment *chunk;
+      GstMediaSegment chunk;
       GstStreamPeriod *period;
       GSList *iter;
       gboolean update;
@@ -587,16 +679,19 @@ gst_dash_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
               stream->index);
           current_pos = 0;
           current_sequence = 0;
-          for (seg_i = 0; seg_i < active_stream->segments->len; seg_i++) {
-            chunk = g_ptr_array_index (active_stream->segments, seg_i);
-            current_pos = chunk->start_time;
-            /* current_sequence = chunk->number; */
+          /* the segments of a template are computed on demand, there might
+           * be no list of segments to walk */
+          for (seg_i = 0; gst_mpdparser_get_chunk_by_index (demux->client,
+                  stream->index, seg_i, &chunk) && chunk.duration > 0;
+              seg_i++) {
+            current_pos = chunk.start_time;
+            /* current_sequence = chunk.number; */
             GST_DEBUG_OBJECT (demux, "current_pos:%" GST_TIME_FORMAT
                 " <= target_pos:%" GST_TIME_FORMAT " duration:%"
                 GST_TIME_FORMAT, GST_TIME_ARGS (current_pos),
-                GST_TIME_ARGS (target_pos), GST_TIME_ARGS (chunk->duration));
+                GST_TIME_ARGS (target_pos), GST_TIME_ARGS (chunk.duration));
             if (current_pos <= target_pos
-                && target_pos < current_pos + chunk->duration) {
+                && target_pos < current_pos + chunk.duration) {
               GST_DEBUG_OBJECT (demux,
                   "selecting sequence %d for stream %" GST_PTR_FORMAT,
                   current_sequence, stream);
@@ -628,10 +723,13 @@ gst_dash_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
         for (iter = demux->streams; iter; iter = g_slist_next (iter)) {
           GstDashDemuxStream *stream = iter->data;
           gst_data_queue_set_flushing (stream->queue, FALSE);
+          stream->eop_queued = FALSE;
+          stream->headers_queued = 0;
         }
         demux->timestamp_offset = 0;
         demux->need_segment = TRUE;
         gst_uri_downloader_reset (demux->downloader);
+        gst_uri_download_scheduler_reset (demux->scheduler);
         GST_DEBUG_OBJECT (demux, "Resuming tasks after seeking");
         gst_dash_demux_resume_download_task (demux);
         gst_dash_demux_resume_stream_task (demux);
@@ -728,9 +826,6 @@ gst_dash_demux_setup_all_streams (GstDashDemux * demux)
     stream->input_caps = caps;
     stream->need_header = TRUE;
     stream->has_data_queued = FALSE;
-    gst_download_rate_init (&stream->dnl_rate);
-    gst_download_rate_set_max_length (&stream->dnl_rate,
-        DOWNLOAD_RATE_HISTORY_MAX);
 
     GST_LOG_OBJECT (demux, "Creating stream %d %" GST_PTR_FORMAT, i, caps);
     streams = g_slist_prepend (streams, stream);
@@ -816,6 +911,11 @@ gst_dash_demux_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
           GST_ELEMENT_ERROR (demux, STREAM, DECODE, ("Invalid manifest."),
               (NULL));
           ret = FALSE;
+        } else {
+          g_free (demux->last_manifest_checksum);
+          demux->last_manifest_checksum =
+              g_compute_checksum_for_data (G_CHECKSUM_SHA1, mapinfo.data,
+              mapinfo.size);
         }
         gst_buffer_unmap (demux->manifest, &mapinfo);
       } else {
@@ -1031,6 +1131,8 @@ gst_dash_demux_stop (GstDashDemux * demux)
 
   if (demux->downloader)
     gst_uri_downloader_cancel (demux->downloader);
+  if (demux->scheduler)
+    gst_uri_download_scheduler_cancel (demux->scheduler);
 
   for (iter = demux->streams; iter; iter = g_slist_next (iter)) {
     GstDashDemuxStream *stream = iter->data;
@@ -1354,7 +1456,6 @@ error_pushing:
 static void
 gst_dash_demux_stream_free (GstDashDemuxStream * stream)
 {
-  gst_download_rate_deinit (&stream->dnl_rate);
   if (stream->input_caps) {
     gst_caps_unref (stream->input_caps);
     stream->input_caps = NULL;
@@ -1385,6 +1486,9 @@ gst_dash_demux_reset (GstDashDemux * demux, gboolean dispose)
   gst_dash_demux_stop (demux);
   if (demux->downloader)
     gst_uri_downloader_reset (demux->downloader);
+  if (demux->scheduler)
+    gst_uri_download_scheduler_reset (demux->scheduler);
+  gst_bandwidth_estimator_reset (&demux->bandwidth);
 
   if (demux->next_periods) {
     g_assert (demux->next_periods->data == demux->streams);
@@ -1425,10 +1529,11 @@ gst_dash_demux_reset (GstDashDemux * demux, gboolean dispose)
 
   gst_segment_init (&demux->segment, GST_FORMAT_TIME);
   demux->last_manifest_update = GST_CLOCK_TIME_NONE;
+  g_free (demux->last_manifest_checksum);
+  demux->last_manifest_checksum = NULL;
   demux->cancelled = FALSE;
 }
 
-#ifndef GST_DISABLE_GST_DEBUG
 static GstClockTime
 gst_dash_demux_get_buffering_time (GstDashDemux * demux)
 {
@@ -1456,7 +1561,6 @@ gst_dash_demux_stream_get_buffering_time (GstDashDemuxStream * stream)
 
   return (GstClockTime) level.time;
 }
-#endif
 
 static gboolean
 gst_dash_demux_all_streams_have_data (GstDashDemux * demux)
@@ -1510,12 +1614,26 @@ gst_dash_demux_refresh_mpd (GstDashDemux * demux)
       /* parse the manifest file */
       if (buffer != NULL) {
         GstMapInfo mapinfo;
+        gchar *checksum;
+
+        gst_buffer_map (buffer, &mapinfo, GST_MAP_READ);
+
+        /* servers often return the same manifest until the next segment
+         * is available, nothing to update then */
+        checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, mapinfo.data,
+            mapinfo.size);
+        if (g_strcmp0 (checksum, demux->last_manifest_checksum) == 0) {
+          GST_DEBUG_OBJECT (demux, "Manifest is the same as the previous one");
+          g_free (checksum);
+          gst_buffer_unmap (buffer, &mapinfo);
+          gst_buffer_unref (buffer);
+          demux->last_manifest_update = gst_util_get_timestamp ();
+          return GST_FLOW_OK;
+        }
 
         new_client = gst_mpd_client_new ();
         new_client->mpd_uri = g_strdup (demux->client->mpd_uri);
 
-        gst_buffer_map (buffer, &mapinfo, GST_MAP_READ);
-
         if (gst_mpd_parse (new_client, (gchar *) mapinfo.data, mapinfo.size)) {
           const gchar *period_id;
           guint period_idx;
@@ -1541,12 +1659,16 @@ gst_dash_demux_refresh_mpd (GstDashDemux * demux)
             if (!gst_mpd_client_set_period_id (new_client, period_id)) {
               GST_DEBUG_OBJECT (demux,
                   "Error setting up the updated manifest file");
+              gst_mpd_client_free (new_client);
+              g_free (checksum);
               return GST_FLOW_EOS;
             }
           } else {
             if (!gst_mpd_client_set_period_index (new_client, period_idx)) {
               GST_DEBUG_OBJECT (demux,
                   "Error setting up the updated manifest file");
+              gst_mpd_client_free (new_client);
+              g_free (checksum);
               return GST_FLOW_EOS;
             }
           }
@@ -1554,6 +1676,8 @@ gst_dash_demux_refresh_mpd (GstDashDemux * demux)
           if (!gst_dash_demux_setup_mpdparser_streams (demux, new_client)) {
             GST_ERROR_OBJECT (demux, "Failed to setup streams on manifest "
                 "update");
+            gst_mpd_client_free (new_client);
+            g_free (checksum);
             return GST_FLOW_ERROR;
           }
 
@@ -1571,6 +1695,8 @@ gst_dash_demux_refresh_mpd (GstDashDemux * demux)
               GST_DEBUG_OBJECT (demux,
                   "Stream of index %d is missing from manifest update",
                   demux_stream->index);
+              gst_mpd_client_free (new_client);
+              g_free (checksum);
               return GST_FLOW_EOS;
             }
 
@@ -1588,6 +1714,10 @@ gst_dash_demux_refresh_mpd (GstDashDemux * demux)
           gst_mpd_client_free (demux->client);
           demux->client = new_client;
 
+          /* only skip the next identical manifests once this one is used */
+          g_free (demux->last_manifest_checksum);
+          demux->last_manifest_checksum = checksum;
+
           /* Send an updated duration message */
           duration =
               gst_mpd_client_get_media_presentation_duration (demux->client);
@@ -1611,6 +1741,8 @@ gst_dash_demux_refresh_mpd (GstDashDemux * demux)
           GST_WARNING_OBJECT (demux, "Error parsing the manifest.");
           gst_buffer_unmap (buffer, &mapinfo);
           gst_buffer_unref (buffer);
+          gst_mpd_client_free (new_client);
+          g_free (checksum);
         }
       } else {
         /* download suceeded, but resulting buffer is NULL */
@@ -1815,9 +1947,12 @@ gst_dash_demux_select_representations (GstDashDemux * demux)
   gboolean ret = FALSE;
   GSList *iter;
   GstDashDemuxStream *stream;
+  GstClockTime buffer_level;
 
   guint i = 0;
 
+  buffer_level = gst_dash_demux_get_buffering_time (demux);
+
 
   GST_MPD_CLIENT_LOCK (demux->client);
   for (iter = demux->streams; iter; iter = g_slist_next (iter)) {
@@ -1834,9 +1969,9 @@ gst_dash_demux_select_representations (GstDashDemux * demux)
     if (!rep_list)
       return FALSE;
 
-    bitrate =
-        gst_download_rate_get_current_rate (&stream->dnl_rate) *
-        demux->bandwidth_usage;
+    bitrate = gst_bandwidth_estimator_get_target_bitrate (&demux->bandwidth,
+        demux->bandwidth_usage, active_stream->cur_representation->bandwidth,
+        buffer_level);
     GST_DEBUG_OBJECT (demux, "Trying to change to bitrate: %" G_GUINT64_FORMAT,
         bitrate);
 
@@ -1855,6 +1990,8 @@ gst_dash_demux_select_representations (GstDashDemux * demux)
       if (gst_mpd_client_setup_representation (demux->client, active_stream,
               rep)) {
         ret = TRUE;
+        /* fragments of the previous representation were queued ahead */
+        gst_dash_demux_stream_rewind (demux, stream, active_stream);
         stream->need_header = TRUE;
         stream->has_data_queued = FALSE;
         GST_INFO_OBJECT (demux, "Switching bitrate to %d",
@@ -2036,13 +2173,141 @@ gst_dash_demux_get_input_caps (GstDashDemux * demux, GstActiveStream * stream)
   }
 }
 
+typedef struct _GstDashDemuxRequest GstDashDemuxRequest;
+
+/* A fragment download queued in the scheduler. Requests without an uri
+ * carry the event ending the period of their stream. */
+struct _GstDashDemuxRequest
+{
+  GstMediaFragmentInfo fragment;
+  GstBuffer *header;            /* fetched when the request was queued */
+  guint segment_index;
+  GstEvent *event;
+};
+
+static void
+gst_dash_demux_request_free (GstDashDemuxRequest * request)
+{
+  gst_media_fragment_info_clear (&request->fragment);
+  if (request->header)
+    gst_buffer_unref (request->header);
+  if (request->event)
+    gst_event_unref (request->event);
+  g_slice_free (GstDashDemuxRequest, request);
+}
+
+/* Drops the downloads queued ahead for @stream and moves the segment index
+ * back to the first of them so they are requested again */
+static void
+gst_dash_demux_stream_rewind (GstDashDemux * demux, GstDashDemuxStream * stream,
+    GstActiveStream * active_stream)
+{
+  GstDashDemuxRequest *request;
+
+  request = gst_uri_download_scheduler_peek (demux->scheduler, stream->index);
+  if (request) {
+    gst_mpd_client_set_segment_index (active_stream, request->segment_index);
+    gst_uri_download_scheduler_flush (demux->scheduler, stream->index);
+  }
+  if (stream->headers_queued > 0)
+    stream->need_header = TRUE;
+  stream->headers_queued = 0;
+  stream->eop_queued = FALSE;
+}
+
+/* Queues the next fragments of @stream until fragments-in-flight of them
+ * are pending, followed by the end of period event once there are no more
+ * fragments. Returns FALSE if the stream is live and waits for new
+ * fragments. */
+static gboolean
+gst_dash_demux_stream_fill (GstDashDemux * demux, GstDashDemuxStream * stream)
+{
+  GstActiveStream *active_stream;
+  GstDashDemuxRequest *request;
+  GstClockTime ts;
+
+  if (stream->download_end_of_period || stream->eop_queued)
+    return TRUE;
+
+  active_stream =
+      gst_mpdparser_get_active_stream_by_index (demux->client, stream->index);
+  if (active_stream == NULL)
+    return TRUE;
+
+  while (gst_uri_download_scheduler_get_n_pending (demux->scheduler,
+          stream->index) < demux->fragments_in_flight) {
+    request = g_slice_new0 (GstDashDemuxRequest);
+
+    if (!gst_mpd_client_get_next_fragment_timestamp (demux->client,
+            stream->index, &ts)) {
+      GST_INFO_OBJECT (demux,
+          "This Period doesn't contain more fragments for stream %u",
+          stream->index);
+
+      /* check if this is live and we should wait for more data */
+      if (gst_mpd_client_is_live (demux->client)
+          && demux->client->mpd_node->minimumUpdatePeriod != -1) {
+        g_slice_free (GstDashDemuxRequest, request);
+        return FALSE;
+      }
+
+      if (gst_mpd_client_has_next_period (demux->client)) {
+        request->event = gst_event_new_dash_eop ();
+      } else {
+        GST_DEBUG_OBJECT (demux,
+            "No more fragments or periods for this stream, setting EOS");
+        request->event = gst_event_new_eos ();
+      }
+      request->segment_index = gst_mpd_client_get_segment_index (active_stream);
+      stream->eop_queued = TRUE;
+      gst_uri_download_scheduler_push (demux->scheduler, stream->index, NULL,
+          0, -1, request, (GDestroyNotify) gst_dash_demux_request_free);
+      break;
+    }
+
+    request->segment_index = gst_mpd_client_get_segment_index (active_stream);
+    if (!gst_mpd_client_get_next_fragment (demux->client, stream->index,
+            &request->fragment)) {
+      GST_WARNING_OBJECT (demux, "Failed to get fragment for stream %p %d",
+          stream, stream->index);
+      g_slice_free (GstDashDemuxRequest, request);
+      break;
+    }
+
+    if (stream->need_header) {
+      /* We need to fetch a new header */
+      request->header = gst_dash_demux_get_next_header (demux, stream->index);
+      if (request->header)
+        stream->headers_queued++;
+      stream->need_header = FALSE;
+    }
+
+    GST_INFO_OBJECT (demux,
+        "Queueing fragment %s for stream #%i ts:%" GST_TIME_FORMAT " dur:%"
+        GST_TIME_FORMAT " Range:%" G_GINT64_FORMAT "-%" G_GINT64_FORMAT,
+        request->fragment.uri, stream->index,
+        GST_TIME_ARGS (request->fragment.timestamp),
+        GST_TIME_ARGS (request->fragment.duration),
+        request->fragment.range_start, request->fragment.range_end);
+
+    gst_uri_download_scheduler_push (demux->scheduler, stream->index,
+        request->fragment.uri, request->fragment.range_start,
+        request->fragment.range_end, request,
+        (GDestroyNotify) gst_dash_demux_request_free);
+  }
+
+  return TRUE;
+}
+
 /* gst_dash_demux_get_next_fragment:
  *
  * Get the next fragments for the stream with the earlier timestamp.
  * It returns the selected timestamp so the caller can deal with
  * sync issues in case the stream is live.
- * 
- * This function uses the generic URI downloader API.
+ *
+ * The following fragments of all streams are downloaded in parallel by the
+ * download scheduler, up to fragments-in-flight per stream, and handed
+ * back here in order.
  *
  * Returns FALSE if an error occured while downloading fragments
  * 
@@ -2052,11 +2317,9 @@ gst_dash_demux_get_next_fragment (GstDashDemux * demux,
     GstActiveStream ** stream, GstClockTime * selected_ts)
 {
   GstActiveStream *active_stream;
+  GstDashDemuxRequest *request;
   GstFragment *download;
-  GstBuffer *header_buffer;
-  GTimeVal now;
-  GTimeVal start;
-  GstClockTime diff;
+  GstClockTime diff = 0;
   guint64 size_buffer = 0;
   GSList *iter;
   gboolean end_of_period = TRUE;
@@ -2073,38 +2336,21 @@ gst_dash_demux_get_next_fragment (GstDashDemux * demux,
     GstDashDemuxStream *stream = iter->data;
     GstClockTime ts;
 
-    if (stream->download_end_of_period)
-      continue;
-
-    if (gst_mpd_client_get_next_fragment_timestamp (demux->client,
-            stream->index, &ts)) {
-      if (ts < best_time || !GST_CLOCK_TIME_IS_VALID (best_time)) {
-        selected_stream = stream;
-        best_time = ts;
-      }
-    } else {
-      GstEvent *event = NULL;
+    if (!gst_dash_demux_stream_fill (demux, stream))
+      end_of_period = FALSE;
 
-      GST_INFO_OBJECT (demux,
-          "This Period doesn't contain more fragments for stream %u",
-          stream->index);
+    request = gst_uri_download_scheduler_peek (demux->scheduler, stream->index);
+    if (request == NULL)
+      continue;
 
-      /* check if this is live and we should wait for more data */
-      if (gst_mpd_client_is_live (demux->client)
-          && demux->client->mpd_node->minimumUpdatePeriod != -1) {
-        end_of_period = FALSE;
-        continue;
-      }
+    /* got a fragment or event to handle, no end of period */
+    end_of_period = FALSE;
 
-      if (gst_mpd_client_has_next_period (demux->client)) {
-        event = gst_event_new_dash_eop ();
-      } else {
-        GST_DEBUG_OBJECT (demux,
-            "No more fragments or periods for this stream, setting EOS");
-        event = gst_event_new_eos ();
-      }
-      stream->download_end_of_period = TRUE;
-      gst_dash_demux_stream_push_event (stream, event);
+    /* events go out as soon as they are reached */
+    ts = request->event ? 0 : request->fragment.timestamp;
+    if (ts < best_time || !GST_CLOCK_TIME_IS_VALID (best_time)) {
+      selected_stream = stream;
+      best_time = ts;
     }
   }
   if (selected_ts)
@@ -2118,90 +2364,100 @@ gst_dash_demux_get_next_fragment (GstDashDemux * demux,
   if (selected_stream) {
     guint stream_idx = selected_stream->index;
     GstBuffer *buffer;
-    GstMediaFragmentInfo fragment;
 
-    if (gst_mpd_client_get_next_fragment (demux->client, stream_idx, &fragment)) {
+    GST_INFO_OBJECT (demux, "Next fragment for stream #%i", stream_idx);
 
-      g_get_current_time (&start);
-      GST_INFO_OBJECT (demux, "Next fragment for stream #%i", stream_idx);
-      GST_INFO_OBJECT (demux,
-          "Fetching next fragment %s ts:%" GST_TIME_FORMAT " dur:%"
-          GST_TIME_FORMAT " Range:%" G_GINT64_FORMAT "-%" G_GINT64_FORMAT,
-          fragment.uri, GST_TIME_ARGS (fragment.timestamp),
-          GST_TIME_ARGS (fragment.duration),
-          fragment.range_start, fragment.range_end);
+    if (!gst_uri_download_scheduler_pop (demux->scheduler, stream_idx, TRUE,
+            &download, (gpointer *) & request))
+      return FALSE;
 
-      /* got a fragment to fetch, no end of period */
-      end_of_period = FALSE;
+    if (request->event) {
+      selected_stream->download_end_of_period = TRUE;
+      selected_stream->eop_queued = FALSE;
+      gst_dash_demux_stream_push_event (selected_stream, request->event);
+      request->event = NULL;
+      gst_dash_demux_request_free (request);
+      GST_TASK_SIGNAL (demux->download_task);
+      return TRUE;
+    }
 
-      download = gst_uri_downloader_fetch_uri_with_range (demux->downloader,
-          fragment.uri, fragment.range_start, fragment.range_end);
+    if (request->header)
+      selected_stream->headers_queued--;
 
-      if (download == NULL) {
-        gst_media_fragment_info_clear (&fragment);
-        return FALSE;
+    active_stream =
+        gst_mpdparser_get_active_stream_by_index (demux->client, stream_idx);
+
+    if (download == NULL || active_stream == NULL) {
+      /* forget the fragments queued after this one and leave the segment
+       * index after the failed one, as if it was downloaded directly */
+      if (active_stream) {
+        gst_dash_demux_stream_rewind (demux, selected_stream, active_stream);
+        gst_mpd_client_set_segment_index (active_stream,
+            request->segment_index + 1);
       }
-
-      active_stream =
-          gst_mpdparser_get_active_stream_by_index (demux->client, stream_idx);
-      if (active_stream == NULL) {
-        gst_media_fragment_info_clear (&fragment);
+      if (request->header)
+        selected_stream->need_header = TRUE;
+      gst_dash_demux_request_free (request);
+      if (download)
         g_object_unref (download);
-        return FALSE;
-      }
+      return FALSE;
+    }
 
-      buffer = gst_fragment_get_buffer (download);
-      g_object_unref (download);
+    buffer = gst_fragment_get_buffer (download);
+    size_buffer = gst_buffer_get_size (buffer);
+    if (download->download_stop_time > download->download_start_time)
+      diff = download->download_stop_time - download->download_start_time;
+    g_object_unref (download);
 
-      /* it is possible to have an index per fragment, so check and download */
-      if (fragment.index_uri || fragment.index_range_start
-          || fragment.index_range_end != -1) {
-        const gchar *uri = fragment.index_uri;
-        GstBuffer *index_buffer;
+    /* it is possible to have an index per fragment, so check and download */
+    if (request->fragment.index_uri || request->fragment.index_range_start
+        || request->fragment.index_range_end != -1) {
+      const gchar *uri = request->fragment.index_uri;
+      GstBuffer *index_buffer;
 
-        if (!uri)               /* fallback to default media uri */
-          uri = fragment.uri;
+      if (!uri)                 /* fallback to default media uri */
+        uri = request->fragment.uri;
 
-        GST_DEBUG_OBJECT (demux,
-            "Fragment index download: %s %" G_GINT64_FORMAT "-%"
-            G_GINT64_FORMAT, uri, fragment.index_range_start,
-            fragment.index_range_end);
-        download =
-            gst_uri_downloader_fetch_uri_with_range (demux->downloader, uri,
-            fragment.index_range_start, fragment.index_range_end);
-        if (download) {
-          index_buffer = gst_fragment_get_buffer (download);
-          if (index_buffer)
-            buffer = gst_buffer_append (index_buffer, buffer);
-          g_object_unref (download);
-        }
+      GST_DEBUG_OBJECT (demux,
+          "Fragment index download: %s %" G_GINT64_FORMAT "-%"
+          G_GINT64_FORMAT, uri, request->fragment.index_range_start,
+          request->fragment.index_range_end);
+      download =
+          gst_uri_downloader_fetch_uri_with_range (demux->downloader, uri,
+          request->fragment.index_range_start,
+          request->fragment.index_range_end);
+      if (download) {
+        index_buffer = gst_fragment_get_buffer (download);
+        if (index_buffer)
+          buffer = gst_buffer_append (index_buffer, buffer);
+        g_object_unref (download);
       }
+    }
 
-      if (selected_stream->need_header) {
-        /* We need to fetch a new header */
-        if ((header_buffer =
-                gst_dash_demux_get_next_header (demux, stream_idx)) != NULL) {
-          buffer = gst_buffer_append (header_buffer, buffer);
-        }
-        selected_stream->need_header = FALSE;
-      }
-      g_get_current_time (&now);
+    if (request->header) {
+      buffer = gst_buffer_append (request->header, buffer);
+      request->header = NULL;
+    }
 
-      buffer = gst_buffer_make_writable (buffer);
+    buffer = gst_buffer_make_writable (buffer);
 
-      GST_BUFFER_TIMESTAMP (buffer) = fragment.timestamp;
-      GST_BUFFER_DURATION (buffer) = fragment.duration;
-      GST_BUFFER_OFFSET (buffer) =
-          gst_mpd_client_get_segment_index (active_stream) - 1;
+    GST_BUFFER_TIMESTAMP (buffer) = request->fragment.timestamp;
+    GST_BUFFER_DURATION (buffer) = request->fragment.duration;
+    GST_BUFFER_OFFSET (buffer) = request->segment_index;
 
-      gst_media_fragment_info_clear (&fragment);
+    gst_dash_demux_request_free (request);
 
-      gst_dash_demux_stream_push_data (selected_stream, buffer);
-      selected_stream->has_data_queued = TRUE;
-      size_buffer += gst_buffer_get_size (buffer);
-    } else {
-      GST_WARNING_OBJECT (demux, "Failed to download fragment for stream %p %d",
-          selected_stream, selected_stream->index);
+    gst_dash_demux_stream_push_data (selected_stream, buffer);
+    selected_stream->has_data_queued = TRUE;
+  }
+
+  if (end_of_period) {
+    /* only when all streams pushed their end of period event */
+    for (iter = streams; iter; iter = g_slist_next (iter)) {
+      GstDashDemuxStream *stream = iter->data;
+
+      if (!stream->download_end_of_period)
+        end_of_period = FALSE;
     }
   }
 
@@ -2211,13 +2467,12 @@ gst_dash_demux_get_next_fragment (GstDashDemux * demux,
 
   /* Wake the download task up */
   GST_TASK_SIGNAL (demux->download_task);
-  if (selected_stream) {
+  if (selected_stream && diff > 0) {
 #ifndef GST_DISABLE_GST_DEBUG
     guint64 brate;
 #endif
 
-    diff = (GST_TIMEVAL_TO_TIME (now) - GST_TIMEVAL_TO_TIME (start));
-    gst_download_rate_add_rate (&selected_stream->dnl_rate, size_buffer, diff);
+    gst_dash_demux_post_bandwidth (demux);
 
 #ifndef GST_DISABLE_GST_DEBUG
     brate = (size_buffer * 8) / ((double) diff / GST_SECOND);
@@ -2230,6 +2485,19 @@ gst_dash_demux_get_next_fragment (GstDashDemux * demux,
   return TRUE;
 }
 
+static void
+gst_dash_demux_post_bandwidth (GstDashDemux * demux)
+{
+  GstStructure *s;
+
+  s = gst_bandwidth_estimator_get_stats (&demux->bandwidth,
+      "bandwidth-estimate");
+  gst_structure_set (s, "buffer-level", G_TYPE_UINT64,
+      gst_dash_demux_get_buffering_time (demux), NULL);
+  gst_element_post_message (GST_ELEMENT_CAST (demux),
+      gst_message_new_element (GST_OBJECT_CAST (demux), s));
+}
+
 static void
 gst_dash_demux_download_wait (GstDashDemux * demux, GstClockTime time_diff)
 {
@@ -34,8 +34,9 @@
 #include <gst/base/gstadapter.h>
 #include <gst/base/gstdataqueue.h>
 #include "gstmpdparser.h"
-#include "gstdownloadrate.h"
 #include <gst/uridownloader/gsturidownloader.h>
+#include <gst/uridownloader/gsturidownloadscheduler.h>
+#include <gst/uridownloader/gstbandwidthestimator.h>
 
 G_BEGIN_DECLS
 #define GST_TYPE_DASH_DEMUX \
@@ -91,9 +92,11 @@ struct _GstDashDemuxStream
    */
   gboolean has_data_queued;
 
-  GstDataQueue *queue;
+  /* downloads queued ahead in the scheduler */
+  gboolean eop_queued;
+  guint headers_queued;
 
-  GstDownloadRate dnl_rate;
+  GstDataQueue *queue;
 };
 
 /**
@@ -119,6 +122,7 @@ struct _GstDashDemux
 
   GstBuffer *manifest;
   GstUriDownloader *downloader;
+  GstUriDownloadScheduler *scheduler;   /* Downloads fragments in parallel */
   GstMpdClient *client;         /* MPD client */
   gboolean end_of_period;
   gboolean end_of_manifest;
@@ -127,6 +131,10 @@ struct _GstDashDemux
   GstClockTime max_buffering_time;      /* Maximum buffering time accumulated during playback */
   gfloat bandwidth_usage;       /* Percentage of the available bandwidth to use       */
   guint64 max_bitrate;          /* max of bitrate supported by target decoder         */
+  guint fragments_in_flight;    /* fragments downloaded in parallel per stream        */
+  guint64 max_prefetch_bytes;   /* limit of the downloaded but not queued data        */
+
+  GstBandwidthEstimator bandwidth;      /* shared by all streams */
 
   /* Streaming task */
   GstTask *stream_task;
@@ -141,6 +149,7 @@ struct _GstDashDemux
 
   /* Manifest update */
   GstClockTime last_manifest_update;
+  gchar *last_manifest_checksum;        /* SHA-1 of the last parsed manifest */
 };
 
 struct _GstDashDemuxClass
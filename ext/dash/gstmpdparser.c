@@ -171,6 +171,8 @@ static GstSegmentListNode *gst_mpdparser_get_segment_list (GstPeriodNode *
 
 /* Segments */
 static guint gst_mpd_client_get_segments_counts (GstActiveStream * stream);
+static gboolean gst_mpdparser_get_segment_from_runs (GstActiveStream * stream,
+    guint index, GstMediaSegment * segment);
 
 /* Memory management */
 static GstSegmentTimelineNode *
@@ -1267,21 +1269,32 @@ gst_mpdparser_clone_s_node (GstSNode * pointer)
 static void
 gst_mpdparser_parse_s_node (GQueue * queue, xmlNode * a_node)
 {
-  GstSNode *new_s_node;
+  GstSNode *new_s_node, *prev_s_node;
+  guint64 t, d;
+  guint r;
+
+  GST_LOG ("attributes of S node:");
+  gst_mpdparser_get_xml_prop_unsigned_integer_64 (a_node, "t", 0, &t);
+  gst_mpdparser_get_xml_prop_unsigned_integer_64 (a_node, "d", 0, &d);
+  gst_mpdparser_get_xml_prop_unsigned_integer (a_node, "r", 0, &r);
+
+  /* long timelines often have an S node per segment, merge the ones
+   * continuing the previous node with the same duration */
+  prev_s_node = g_queue_peek_tail (queue);
+  if (prev_s_node && t == 0 && prev_s_node->d == d) {
+    prev_s_node->r += r + 1;
+    return;
+  }
 
   new_s_node = g_slice_new0 (GstSNode);
   if (new_s_node == NULL) {
     GST_WARNING ("Allocation of S node failed!");
     return;
   }
+  new_s_node->t = t;
+  new_s_node->d = d;
+  new_s_node->r = r;
   g_queue_push_tail (queue, new_s_node);
-
-  GST_LOG ("attributes of S node:");
-  gst_mpdparser_get_xml_prop_unsigned_integer_64 (a_node, "t", 0,
-      &new_s_node->t);
-  gst_mpdparser_get_xml_prop_unsigned_integer_64 (a_node, "d", 0,
-      &new_s_node->d);
-  gst_mpdparser_get_xml_prop_unsigned_integer (a_node, "r", 0, &new_s_node->r);
 }
 
 static GstSegmentTimelineNode *
@@ -2612,6 +2625,8 @@ gst_mpdparser_free_active_stream (GstActiveStream * active_stream)
     active_stream->queryURL = NULL;
     if (active_stream->segments)
       g_ptr_array_unref (active_stream->segments);
+    if (active_stream->segment_runs)
+      g_array_free (active_stream->segment_runs, TRUE);
     g_slice_free (GstActiveStream, active_stream);
   }
 }
@@ -2958,8 +2973,11 @@ gst_mpd_parse (GstMpdClient * client, const gchar * data, gint size)
      * library used
      */
     LIBXML_TEST_VERSION
-        /* parse "data" into a document (which is a libxml2 tree structure xmlDoc) */
-        doc = xmlReadMemory (data, size, "noname.xml", NULL, 0);
+        /* parse "data" into a document (which is a libxml2 tree structure xmlDoc),
+         * dropping the whitespace between the nodes, which is most of the
+         * document with long segment timelines */
+        doc = xmlReadMemory (data, size, "noname.xml", NULL,
+        XML_PARSE_NOBLANKS | XML_PARSE_COMPACT);
     if (doc == NULL) {
       GST_ERROR ("failed to parse the MPD file");
       GST_MPD_CLIENT_UNLOCK (client);
@@ -3000,6 +3018,37 @@ gst_mpdparser_get_baseURL (GstMpdClient * client, guint indexStream)
   return stream->baseURL;
 }
 
+/* Finds the run containing the segment of index @index with a binary
+ * search, and computes the segment from it */
+static gboolean
+gst_mpdparser_get_segment_from_runs (GstActiveStream * stream, guint index,
+    GstMediaSegment * segment)
+{
+  GstMediaSegmentRun *run;
+  guint lo = 0, hi = stream->segment_runs->len, mid, k;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    run = &g_array_index (stream->segment_runs, GstMediaSegmentRun, mid);
+    if (index < run->first) {
+      hi = mid;
+    } else if (index - run->first >= run->count) {
+      lo = mid + 1;
+    } else {
+      k = index - run->first;
+      segment->SegmentURL = NULL;
+      segment->number = index
+          + stream->cur_seg_template->MultSegBaseType->startNumber;
+      segment->start = run->start + k * run->d;
+      segment->start_time = run->start_time + k * run->duration;
+      segment->duration = run->duration;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
 gboolean
 gst_mpdparser_get_chunk_by_index (GstMpdClient * client, guint indexStream,
     guint indexChunk, GstMediaSegment * segment)
@@ -3012,7 +3061,10 @@ gst_mpdparser_get_chunk_by_index (GstMpdClient * client, guint indexStream,
   stream = g_list_nth_data (client->active_streams, indexStream);
   g_return_val_if_fail (stream != NULL, FALSE);
 
-  if (stream->segments) {
+  if (stream->segment_runs) {
+    /* segment timeline with a template */
+    return gst_mpdparser_get_segment_from_runs (stream, indexChunk, segment);
+  } else if (stream->segments) {
     GstMediaSegment *list_segment;
     /* fixed list of segments */
     if (indexChunk >= stream->segments->len)
@@ -3095,6 +3147,10 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
     g_ptr_array_unref (stream->segments);
     stream->segments = NULL;
   }
+  if (stream->segment_runs) {
+    g_array_free (stream->segment_runs, TRUE);
+    stream->segment_runs = NULL;
+  }
 
   stream_period = gst_mpdparser_get_stream_period (client);
   g_return_val_if_fail (stream_period != NULL, FALSE);
@@ -3229,11 +3285,17 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
         GstSegmentTimelineNode *timeline;
         GstSNode *S;
         GList *list;
+        guint first = 0;
 
+        /* the segments are computed from the runs when requested, long
+         * timelines would make a list of all the segments huge */
         timeline = stream->cur_seg_template->MultSegBaseType->SegmentTimeline;
-        gst_mpdparser_init_active_stream_segments (stream);
+        stream->segment_runs =
+            g_array_sized_new (FALSE, FALSE, sizeof (GstMediaSegmentRun),
+            timeline->S.length);
         for (list = g_queue_peek_head_link (&timeline->S); list; list = g_list_next (list)) {
-          guint j, timescale;
+          GstMediaSegmentRun run;
+          guint timescale;
 
           S = (GstSNode *) list->data;
           GST_LOG ("Processing S node: d=%" G_GUINT64_FORMAT " r=%u t=%"
@@ -3250,15 +3312,17 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
               start_time /= timescale;
           }
 
-          for (j = 0; j <= S->r; j++) {
-            if (!gst_mpd_client_add_media_segment (stream, NULL, i, start,
-                    start_time, duration)) {
-              return FALSE;
-            }
-            i++;
-            start += S->d;
-            start_time += duration;
-          }
+          run.first = first;
+          run.count = S->r + 1;
+          run.start = start;
+          run.d = S->d;
+          run.start_time = start_time;
+          run.duration = duration;
+          g_array_append_val (stream->segment_runs, run);
+
+          first += run.count;
+          start += S->d * run.count;
+          start_time += duration * run.count;
         }
       } else {
         /* NOP - The segment is created on demand with the template, no need
@@ -3279,6 +3343,32 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
           GST_TIME_ARGS (last_media_segment->duration));
     }
     GST_LOG ("Built a list of %d segments", last_media_segment->number);
+  } else if (stream->segment_runs && stream->segment_runs->len
+      && GST_CLOCK_TIME_IS_VALID (PeriodEnd)) {
+    GstMediaSegmentRun *last_run, fixed_run;
+
+    last_run = &g_array_index (stream->segment_runs, GstMediaSegmentRun,
+        stream->segment_runs->len - 1);
+    start_time = last_run->start_time + (last_run->count - 1) *
+        last_run->duration;
+    if (start_time + last_run->duration > PeriodEnd) {
+      /* the last segment gets a run of its own with the fixed duration */
+      if (last_run->count > 1) {
+        fixed_run = *last_run;
+        last_run->count--;
+        fixed_run.first += last_run->count;
+        fixed_run.count = 1;
+        fixed_run.start += last_run->count * last_run->d;
+        fixed_run.start_time = start_time;
+        fixed_run.duration = PeriodEnd - start_time;
+        g_array_append_val (stream->segment_runs, fixed_run);
+      } else {
+        last_run->duration = PeriodEnd - start_time;
+      }
+      GST_LOG ("Fixed duration of last segment: %" GST_TIME_FORMAT,
+          GST_TIME_ARGS (PeriodEnd - start_time));
+    }
+    GST_LOG ("Built %u runs of segments", stream->segment_runs->len);
   }
 
   g_free (stream->baseURL);
@@ -3531,7 +3621,29 @@ gst_mpd_client_stream_seek (GstMpdClient * client, GstActiveStream * stream,
   g_return_val_if_fail (stream != NULL, 0);
 
   GST_MPD_CLIENT_LOCK (client);
-  if (stream->segments) {
+  if (stream->segment_runs) {
+    for (i = 0; i < stream->segment_runs->len; i++) {
+      GstMediaSegmentRun *run = &g_array_index (stream->segment_runs,
+          GstMediaSegmentRun, i);
+      GstClockTime last_start =
+          run->start_time + (run->count - 1) * run->duration;
+
+      if (last_start >= ts) {
+        /* first segment of the run starting at or after ts */
+        if (run->start_time >= ts || run->duration == 0)
+          segment_idx = run->first;
+        else
+          segment_idx = run->first + (ts - run->start_time +
+              run->duration - 1) / run->duration;
+        break;
+      }
+    }
+
+    if (i == stream->segment_runs->len) {
+      GST_MPD_CLIENT_UNLOCK (client);
+      return FALSE;
+    }
+  } else if (stream->segments) {
     for (i = 0; i < stream->segments->len; i++, segment_idx++) {
       GstMediaSegment *segment = g_ptr_array_index (stream->segments, i);
       GST_DEBUG ("Looking at fragment sequence chunk %d", segment_idx);
@@ -3928,7 +4040,13 @@ gst_mpd_client_get_next_fragment_duration (GstMpdClient * client,
 
   seg_idx = gst_mpd_client_get_segment_index (stream);
 
-  if (stream->segments) {
+  if (stream->segment_runs) {
+    GstMediaSegment segment;
+
+    if (!gst_mpdparser_get_segment_from_runs (stream, seg_idx, &segment))
+      return 0;
+    return segment.duration;
+  } else if (stream->segments) {
     if (seg_idx < stream->segments->len)
       media_segment = g_ptr_array_index (stream->segments, seg_idx);
 
@@ -4094,6 +4212,15 @@ gst_mpd_client_get_segments_counts (GstActiveStream * stream)
 {
   g_return_val_if_fail (stream != NULL, 0);
 
+  if (stream->segment_runs) {
+    GstMediaSegmentRun *last_run;
+
+    if (stream->segment_runs->len == 0)
+      return 0;
+    last_run = &g_array_index (stream->segment_runs, GstMediaSegmentRun,
+        stream->segment_runs->len - 1);
+    return last_run->first + last_run->count;
+  }
   if (stream->segments)
     return stream->segments->len;
   g_return_val_if_fail (stream->cur_seg_template->MultSegBaseType->
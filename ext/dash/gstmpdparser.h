@@ -36,6 +36,7 @@ typedef struct _GstActiveStream           GstActiveStream;
 typedef struct _GstStreamPeriod           GstStreamPeriod;
 typedef struct _GstMediaFragmentInfo      GstMediaFragmentInfo;
 typedef struct _GstMediaSegment           GstMediaSegment;
+typedef struct _GstMediaSegmentRun        GstMediaSegmentRun;
 typedef struct _GstMPDNode                GstMPDNode;
 typedef struct _GstPeriodNode             GstPeriodNode;
 typedef struct _GstRepresentationBaseType GstRepresentationBaseType;
@@ -418,6 +419,23 @@ struct _GstMediaSegment
   GstClockTime duration;                      /* segment duration */
 };
 
+/**
+ * GstMediaSegmentRun:
+ *
+ * Consecutive segments of the same duration, from an S node of the
+ * SegmentTimeline of a SegmentTemplate. The segments of a run are computed
+ * when requested instead of being stored in a list of GstMediaSegment.
+ */
+struct _GstMediaSegmentRun
+{
+  guint first;                                /* index of the first segment */
+  guint count;                                /* number of segments */
+  guint64 start;                              /* first segment start time in timescale units */
+  guint64 d;                                  /* segment duration in timescale units */
+  GstClockTime start_time;                    /* first segment start time */
+  GstClockTime duration;                      /* segment duration */
+};
+
 struct _GstMediaFragmentInfo
 {
   gchar *uri;
@@ -455,6 +473,7 @@ struct _GstActiveStream
   GstSegmentTemplateNode *cur_seg_template;   /* active segment template */
   guint segment_idx;                          /* index of next sequence chunk */
   GPtrArray *segments;                        /* array of GstMediaSegment */
+  GArray *segment_runs;                       /* array of GstMediaSegmentRun, used instead of segments with a SegmentTemplate and a SegmentTimeline */
 };
 
 struct _GstMpdClient
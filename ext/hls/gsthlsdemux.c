@@ -49,6 +49,8 @@
 #include <gst/glib-compat-private.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
+#include <gst/base/gstadapter.h>
+#include <gst/base/gsttypefindhelper.h>
 #include "gsthlsdemux.h"
 
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src_%u",
@@ -71,6 +73,12 @@ enum
   PROP_FRAGMENTS_CACHE,
   PROP_BITRATE_LIMIT,
   PROP_CONNECTION_SPEED,
+  PROP_PROGRESSIVE,
+  PROP_FRAGMENTS_IN_FLIGHT,
+  PROP_MAX_PREFETCH_BYTES,
+  PROP_SWITCH_HYSTERESIS,
+  PROP_LOW_BUFFER_TIME,
+  PROP_BANDWIDTH_ESTIMATE,
   PROP_LAST
 };
 
@@ -78,6 +86,44 @@ enum
 #define DEFAULT_FAILED_COUNT 3
 #define DEFAULT_BITRATE_LIMIT 0.8
 #define DEFAULT_CONNECTION_SPEED    0
+#define DEFAULT_PROGRESSIVE TRUE
+#define DEFAULT_FRAGMENTS_IN_FLIGHT 2
+#define DEFAULT_MAX_PREFETCH_BYTES (32 * 1024 * 1024)
+
+/* Maximum amount of data held back to typefind the first fragment */
+#define TYPEFIND_MAX_SIZE (64 * 1024)
+
+/* Maximum amount of downloaded data waiting to be pushed in progressive mode,
+ * the download blocks until the streaming task pushed some when reached */
+#define MAX_CHUNKS_SIZE (2 * 1024 * 1024)
+
+typedef struct
+{
+  GstBuffer *buffer;
+  GstCaps *caps;                /* only set on the first chunk of a fragment */
+} GstHLSDemuxChunk;
+
+/* State of a fragment download in progressive mode */
+typedef struct
+{
+  GstHLSDemux *demux;
+  GstClockTime timestamp;
+  gboolean discont;
+  gboolean started;             /* the first chunk was queued */
+  guint64 size;                 /* bytes received so far */
+  guint64 offset;               /* bytes of the fragment data handled so far */
+  guint64 skip;                 /* bytes that were pushed by a previous
+                                 * attempt and must be dropped */
+  GstBuffer *pending;           /* data held back for typefinding */
+  GstBandwidthEstimatorDownload bandwidth;
+  gboolean timed;               /* the download is timed for the bandwidth
+                                 * estimate, i.e. not prefetched */
+
+  /* AES-128 decryption */
+  gboolean encrypted;
+  gnutls_cipher_hd_t aes_ctx;
+  GstAdapter *adapter;          /* received data that was not decrypted yet */
+} GstHLSDemuxDownload;
 
 /* GObject */
 static void gst_hls_demux_set_property (GObject * object, guint prop_id,
@@ -114,6 +160,8 @@ static void gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose);
 static gboolean gst_hls_demux_set_location (GstHLSDemux * demux,
     const gchar * uri);
 static gchar *gst_hls_src_buf_to_utf8_playlist (GstBuffer * buf);
+static void gst_hls_demux_flush_chunks (GstHLSDemux * demux);
+static void gst_hls_demux_cancel_downloads (GstHLSDemux * demux);
 
 #define gst_hls_demux_parent_class parent_class
 G_DEFINE_TYPE (GstHLSDemux, gst_hls_demux, GST_TYPE_ELEMENT);
@@ -139,8 +187,7 @@ gst_hls_demux_dispose (GObject * obj)
   if (demux->updates_task) {
     if (GST_TASK_STATE (demux->updates_task) != GST_TASK_STOPPED) {
       GST_DEBUG_OBJECT (demux, "Leaving updates task");
-      demux->cancelled = TRUE;
-      gst_uri_downloader_cancel (demux->downloader);
+      gst_hls_demux_cancel_downloads (demux);
       gst_task_stop (demux->updates_task);
       g_mutex_lock (&demux->updates_timed_lock);
       GST_TASK_SIGNAL (demux->updates_task);
@@ -160,9 +207,17 @@ gst_hls_demux_dispose (GObject * obj)
     demux->downloader = NULL;
   }
 
+  if (demux->scheduler != NULL) {
+    gst_object_unref (demux->scheduler);
+    demux->scheduler = NULL;
+  }
+
   gst_hls_demux_reset (demux, TRUE);
+  gst_bandwidth_estimator_deinit (&demux->bandwidth);
 
   g_queue_free (demux->queue);
+  g_mutex_clear (&demux->chunks_lock);
+  g_cond_clear (&demux->chunks_cond);
 
   G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
@@ -199,6 +254,46 @@ gst_hls_demux_class_init (GstHLSDemuxClass * klass)
           0, G_MAXUINT / 1000, DEFAULT_CONNECTION_SPEED,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_PROGRESSIVE,
+      g_param_spec_boolean ("progressive", "Progressive",
+          "Push the data of the fragments downstream while they are "
+          "downloaded instead of waiting for complete fragments",
+          DEFAULT_PROGRESSIVE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FRAGMENTS_IN_FLIGHT,
+      g_param_spec_uint ("fragments-in-flight", "Fragments in flight",
+          "Number of fragments downloaded in parallel, the next ones are "
+          "prefetched while the current one is downloaded (1 = no prefetch)",
+          1, 16, DEFAULT_FRAGMENTS_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_PREFETCH_BYTES,
+      g_param_spec_uint64 ("max-prefetch-bytes", "Max prefetch bytes",
+          "Maximum amount of prefetched data kept in memory (0 = unlimited)",
+          0, G_MAXUINT64, DEFAULT_MAX_PREFETCH_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SWITCH_HYSTERESIS,
+      g_param_spec_float ("switch-hysteresis", "Switch hysteresis",
+          "How much the estimated bandwidth must exceed the current "
+          "playlist bitrate before switching up (0.2 = 20%)",
+          0, 10, GST_BANDWIDTH_ESTIMATOR_DEFAULT_HYSTERESIS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOW_BUFFER_TIME,
+      g_param_spec_uint64 ("low-buffer-time", "Low buffer time",
+          "Below this amount of buffered data the demuxer does not switch up "
+          "and selects lower bitrates the emptier the buffer is "
+          "(in nanoseconds, 0 = ignore the buffer level)",
+          0, G_MAXUINT64, GST_BANDWIDTH_ESTIMATOR_DEFAULT_LOW_BUFFER_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BANDWIDTH_ESTIMATE,
+      g_param_spec_uint64 ("bandwidth-estimate", "Bandwidth estimate",
+          "Current estimate of the available bandwidth in bit/s "
+          "(0 = unknown)", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   element_class->change_state = GST_DEBUG_FUNCPTR (gst_hls_demux_change_state);
 
   gst_element_class_add_pad_template (element_class,
@@ -231,6 +326,7 @@ gst_hls_demux_init (GstHLSDemux * demux)
 
   /* Downloader */
   demux->downloader = gst_uri_downloader_new ();
+  demux->scheduler = gst_uri_download_scheduler_new ();
 
   demux->do_typefind = TRUE;
 
@@ -238,8 +334,21 @@ gst_hls_demux_init (GstHLSDemux * demux)
   demux->fragments_cache = DEFAULT_FRAGMENTS_CACHE;
   demux->bitrate_limit = DEFAULT_BITRATE_LIMIT;
   demux->connection_speed = DEFAULT_CONNECTION_SPEED;
+  demux->progressive = DEFAULT_PROGRESSIVE;
+  demux->fragments_in_flight = DEFAULT_FRAGMENTS_IN_FLIGHT;
+  demux->max_prefetch_bytes = DEFAULT_MAX_PREFETCH_BYTES;
+  gst_uri_download_scheduler_set_limits (demux->scheduler,
+      demux->fragments_in_flight, demux->max_prefetch_bytes);
+  gst_bandwidth_estimator_init (&demux->bandwidth);
+  /* the prefetches overlap the download of the next fragment, let the
+   * scheduler add their samples */
+  gst_uri_download_scheduler_set_bandwidth_estimator (demux->scheduler,
+      &demux->bandwidth);
 
   demux->queue = g_queue_new ();
+  g_queue_init (&demux->chunks);
+  g_mutex_init (&demux->chunks_lock);
+  g_cond_init (&demux->chunks_cond);
 
   /* Updates task */
   g_rec_mutex_init (&demux->updates_lock);
@@ -274,6 +383,27 @@ gst_hls_demux_set_property (GObject * object, guint prop_id,
     case PROP_CONNECTION_SPEED:
       demux->connection_speed = g_value_get_uint (value) * 1000;
       break;
+    case PROP_PROGRESSIVE:
+      demux->progressive = g_value_get_boolean (value);
+      break;
+    case PROP_FRAGMENTS_IN_FLIGHT:
+      demux->fragments_in_flight = g_value_get_uint (value);
+      gst_uri_download_scheduler_set_limits (demux->scheduler,
+          demux->fragments_in_flight, demux->max_prefetch_bytes);
+      break;
+    case PROP_MAX_PREFETCH_BYTES:
+      demux->max_prefetch_bytes = g_value_get_uint64 (value);
+      gst_uri_download_scheduler_set_limits (demux->scheduler,
+          demux->fragments_in_flight, demux->max_prefetch_bytes);
+      break;
+    case PROP_SWITCH_HYSTERESIS:
+      gst_bandwidth_estimator_set_hysteresis (&demux->bandwidth,
+          g_value_get_float (value));
+      break;
+    case PROP_LOW_BUFFER_TIME:
+      gst_bandwidth_estimator_set_low_buffer_time (&demux->bandwidth,
+          g_value_get_uint64 (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -296,6 +426,27 @@ gst_hls_demux_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_CONNECTION_SPEED:
       g_value_set_uint (value, demux->connection_speed / 1000);
       break;
+    case PROP_PROGRESSIVE:
+      g_value_set_boolean (value, demux->progressive);
+      break;
+    case PROP_FRAGMENTS_IN_FLIGHT:
+      g_value_set_uint (value, demux->fragments_in_flight);
+      break;
+    case PROP_MAX_PREFETCH_BYTES:
+      g_value_set_uint64 (value, demux->max_prefetch_bytes);
+      break;
+    case PROP_SWITCH_HYSTERESIS:
+      g_value_set_float (value,
+          gst_bandwidth_estimator_get_hysteresis (&demux->bandwidth));
+      break;
+    case PROP_LOW_BUFFER_TIME:
+      g_value_set_uint64 (value,
+          gst_bandwidth_estimator_get_low_buffer_time (&demux->bandwidth));
+      break;
+    case PROP_BANDWIDTH_ESTIMATE:
+      g_value_set_uint64 (value,
+          gst_bandwidth_estimator_get_estimate (&demux->bandwidth));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -312,6 +463,7 @@ gst_hls_demux_change_state (GstElement * element, GstStateChange transition)
     case GST_STATE_CHANGE_READY_TO_PAUSED:
       gst_hls_demux_reset (demux, FALSE);
       gst_uri_downloader_reset (demux->downloader);
+      gst_uri_download_scheduler_reset (demux->scheduler);
       break;
     default:
       break;
@@ -347,9 +499,10 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       GstSeekFlags flags;
       GstSeekType start_type, stop_type;
       gint64 start, stop;
-      GList *walk;
+      GPtrArray *files;
+      guint i;
       GstClockTime position, current_pos, target_pos;
-      gint current_sequence;
+      gint current_sequence = 0;
       GstM3U8MediaFile *file;
 
       GST_INFO_OBJECT (demux, "Received GST_EVENT_SEEK");
@@ -370,12 +523,11 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
           GST_TIME_ARGS (stop));
 
       GST_M3U8_CLIENT_LOCK (demux->client);
-      file = GST_M3U8_MEDIA_FILE (demux->client->current->files->data);
-      current_sequence = file->sequence;
+      files = demux->client->current->files;
       current_pos = 0;
       target_pos = (GstClockTime) start;
-      for (walk = demux->client->current->files; walk; walk = walk->next) {
-        file = walk->data;
+      for (i = 0; i < files->len; i++) {
+        file = g_ptr_array_index (files, i);
 
         current_sequence = file->sequence;
         if (current_pos <= target_pos
@@ -386,7 +538,7 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       }
       GST_M3U8_CLIENT_UNLOCK (demux->client);
 
-      if (walk == NULL) {
+      if (i == files->len) {
         GST_WARNING_OBJECT (demux, "Could not find seeked fragment");
         return FALSE;
       }
@@ -396,9 +548,8 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
         gst_pad_push_event (demux->srcpad, gst_event_new_flush_start ());
       }
 
-      demux->cancelled = TRUE;
+      gst_hls_demux_cancel_downloads (demux);
       gst_task_pause (demux->stream_task);
-      gst_uri_downloader_cancel (demux->downloader);
       gst_task_stop (demux->updates_task);
       g_mutex_lock (&demux->updates_timed_lock);
       GST_TASK_SIGNAL (demux->updates_task);
@@ -416,10 +567,15 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
         g_object_unref (fragment);
       }
       g_queue_clear (demux->queue);
+      gst_hls_demux_flush_chunks (demux);
+      g_free (demux->resume_uri);
+      demux->resume_uri = NULL;
+      demux->resume_offset = 0;
 
       GST_M3U8_CLIENT_LOCK (demux->client);
       GST_DEBUG_OBJECT (demux, "seeking to sequence %d", current_sequence);
       demux->client->sequence = current_sequence;
+      demux->download_position = GST_CLOCK_TIME_NONE;
       gst_m3u8_client_get_current_position (demux->client, &position);
       demux->position_shift = start - position;
       demux->need_segment = TRUE;
@@ -433,6 +589,7 @@ gst_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
 
       demux->cancelled = FALSE;
       gst_uri_downloader_reset (demux->downloader);
+      gst_uri_download_scheduler_reset (demux->scheduler);
       gst_task_start (demux->stream_task);
       g_rec_mutex_unlock (&demux->stream_lock);
 
@@ -598,8 +755,7 @@ static void
 gst_hls_demux_pause_tasks (GstHLSDemux * demux, gboolean caching)
 {
   if (GST_TASK_STATE (demux->updates_task) != GST_TASK_STOPPED) {
-    demux->cancelled = TRUE;
-    gst_uri_downloader_cancel (demux->downloader);
+    gst_hls_demux_cancel_downloads (demux);
     gst_task_pause (demux->updates_task);
     if (!caching)
       g_mutex_lock (&demux->updates_timed_lock);
@@ -618,10 +774,10 @@ static void
 gst_hls_demux_stop (GstHLSDemux * demux)
 {
   gst_uri_downloader_cancel (demux->downloader);
+  gst_uri_download_scheduler_cancel (demux->scheduler);
 
   if (GST_TASK_STATE (demux->updates_task) != GST_TASK_STOPPED) {
-    demux->cancelled = TRUE;
-    gst_uri_downloader_cancel (demux->downloader);
+    gst_hls_demux_cancel_downloads (demux);
     gst_task_stop (demux->updates_task);
     g_mutex_lock (&demux->updates_timed_lock);
     GST_TASK_SIGNAL (demux->updates_task);
@@ -708,39 +864,79 @@ gst_hls_demux_stream_loop (GstHLSDemux * demux)
   GST_DEBUG_OBJECT (demux, "Enter task");
 
   if (G_UNLIKELY (demux->need_cache)) {
-    if (!gst_hls_demux_cache_fragments (demux))
-      goto cache_error;
+    if (demux->progressive) {
+      /* The updates task caches the first fragments, their data is pushed
+       * from here while they are downloaded */
+      gst_task_start (demux->updates_task);
+    } else {
+      if (!gst_hls_demux_cache_fragments (demux))
+        goto cache_error;
 
-    /* we can start now the updates thread (only if on playing) */
-    gst_task_start (demux->updates_task);
-    GST_INFO_OBJECT (demux, "First fragments cached successfully");
+      /* we can start now the updates thread (only if on playing) */
+      gst_task_start (demux->updates_task);
+      GST_INFO_OBJECT (demux, "First fragments cached successfully");
+    }
   }
 
-  if (g_queue_is_empty (demux->queue)) {
-    if (demux->end_of_playlist)
-      goto end_of_playlist;
+  if (demux->progressive) {
+    GstHLSDemuxChunk *chunk;
 
-    goto pause_task;
-  }
+    g_mutex_lock (&demux->chunks_lock);
+    chunk = g_queue_pop_head (&demux->chunks);
+    if (chunk == NULL) {
+      if (demux->end_of_playlist) {
+        g_mutex_unlock (&demux->chunks_lock);
+        goto end_of_playlist;
+      }
+
+      /* Paused with the lock held so that a new chunk can't get lost */
+      GST_DEBUG_OBJECT (demux, "Pause task");
+      gst_task_pause (demux->stream_task);
+      g_mutex_unlock (&demux->chunks_lock);
+      return;
+    }
+    demux->chunks_size -= gst_buffer_get_size (chunk->buffer);
+    g_cond_signal (&demux->chunks_cond);
+    g_mutex_unlock (&demux->chunks_lock);
 
-  fragment = g_queue_pop_head (demux->queue);
-  buf = gst_fragment_get_buffer (fragment);
+    buf = chunk->buffer;
+    bufcaps = chunk->caps;
+    g_slice_free (GstHLSDemuxChunk, chunk);
 
-  /* Figure out if we need to create/switch pads */
-  if (G_LIKELY (demux->srcpad))
-    srccaps = gst_pad_get_current_caps (demux->srcpad);
-  bufcaps = gst_fragment_get_caps (fragment);
-  if (G_UNLIKELY (!srccaps || !gst_caps_is_equal_fixed (bufcaps, srccaps)
-          || demux->need_segment)) {
-    switch_pads (demux, bufcaps);
-    demux->need_segment = TRUE;
+    if (G_UNLIKELY (!bufcaps && !demux->srcpad)) {
+      gst_buffer_unref (buf);
+      goto type_not_found;
+    }
+  } else {
+    if (g_queue_is_empty (demux->queue)) {
+      if (demux->end_of_playlist)
+        goto end_of_playlist;
+
+      goto pause_task;
+    }
+
+    fragment = g_queue_pop_head (demux->queue);
+    buf = gst_fragment_get_buffer (fragment);
+    bufcaps = gst_fragment_get_caps (fragment);
+    g_object_unref (fragment);
+  }
+
+  /* Figure out if we need to create/switch pads. In progressive mode only
+   * the first chunk of a fragment has caps */
+  if (G_LIKELY (bufcaps)) {
+    if (G_LIKELY (demux->srcpad))
+      srccaps = gst_pad_get_current_caps (demux->srcpad);
+    if (G_UNLIKELY (!srccaps || !gst_caps_is_equal_fixed (bufcaps, srccaps)
+            || demux->need_segment)) {
+      switch_pads (demux, bufcaps);
+      demux->need_segment = TRUE;
+    }
+    gst_caps_unref (bufcaps);
+    if (G_LIKELY (srccaps))
+      gst_caps_unref (srccaps);
   }
-  gst_caps_unref (bufcaps);
-  if (G_LIKELY (srccaps))
-    gst_caps_unref (srccaps);
-  g_object_unref (fragment);
 
-  if (demux->need_segment) {
+  if (demux->need_segment && GST_BUFFER_PTS_IS_VALID (buf)) {
     GstSegment segment;
     GstClockTime start = GST_BUFFER_PTS (buf);
 
@@ -774,6 +970,14 @@ end_of_playlist:
     return;
   }
 
+type_not_found:
+  {
+    GST_ELEMENT_ERROR (demux, STREAM, TYPE_NOT_FOUND,
+        ("Could not determine type of stream"), (NULL));
+    gst_hls_demux_pause_tasks (demux, FALSE);
+    return;
+  }
+
 cache_error:
   {
     gst_task_pause (demux->stream_task);
@@ -839,6 +1043,14 @@ gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose)
     g_object_unref (fragment);
   }
   g_queue_clear (demux->queue);
+  gst_hls_demux_flush_chunks (demux);
+  demux->discont = FALSE;
+  g_free (demux->resume_uri);
+  demux->resume_uri = NULL;
+  demux->resume_offset = 0;
+  demux->last_fragment_size = 0;
+  demux->download_position = GST_CLOCK_TIME_NONE;
+  gst_bandwidth_estimator_reset (&demux->bandwidth);
 
   demux->position_shift = 0;
   demux->need_segment = TRUE;
@@ -847,6 +1059,52 @@ gst_hls_demux_reset (GstHLSDemux * demux, gboolean dispose)
   demux->group_id = G_MAXUINT;
 }
 
+static void
+gst_hls_demux_flush_chunks (GstHLSDemux * demux)
+{
+  GstHLSDemuxChunk *chunk;
+
+  g_mutex_lock (&demux->chunks_lock);
+  while ((chunk = g_queue_pop_head (&demux->chunks))) {
+    gst_buffer_unref (chunk->buffer);
+    if (chunk->caps)
+      gst_caps_unref (chunk->caps);
+    g_slice_free (GstHLSDemuxChunk, chunk);
+  }
+  demux->chunks_size = 0;
+  g_cond_signal (&demux->chunks_cond);
+  g_mutex_unlock (&demux->chunks_lock);
+}
+
+/* Makes the running downloads fail and wakes up a download waiting for the
+ * streaming task to push queued chunks */
+static void
+gst_hls_demux_cancel_downloads (GstHLSDemux * demux)
+{
+  g_mutex_lock (&demux->chunks_lock);
+  demux->cancelled = TRUE;
+  g_cond_signal (&demux->chunks_cond);
+  g_mutex_unlock (&demux->chunks_lock);
+
+  gst_uri_downloader_cancel (demux->downloader);
+  gst_uri_download_scheduler_cancel (demux->scheduler);
+}
+
+static gboolean
+gst_hls_demux_queue_is_empty (GstHLSDemux * demux)
+{
+  gboolean empty;
+
+  if (!demux->progressive)
+    return g_queue_is_empty (demux->queue);
+
+  g_mutex_lock (&demux->chunks_lock);
+  empty = g_queue_is_empty (&demux->chunks);
+  g_mutex_unlock (&demux->chunks_lock);
+
+  return empty;
+}
+
 static gboolean
 gst_hls_demux_set_location (GstHLSDemux * demux, const gchar * uri)
 {
@@ -869,6 +1127,20 @@ gst_hls_demux_updates_loop (GstHLSDemux * demux)
   /* block until the next scheduled update or the signal to quit this thread */
   g_mutex_lock (&demux->updates_timed_lock);
   GST_DEBUG_OBJECT (demux, "Started updates task");
+
+  /* In progressive mode the first fragments are cached from here, while
+   * the streaming task already pushes their data */
+  if (demux->progressive && demux->need_cache) {
+    if (!gst_hls_demux_cache_fragments (demux)) {
+      if (demux->cancelled)
+        goto quit;
+      GST_ELEMENT_ERROR (demux, RESOURCE, NOT_FOUND,
+          ("Could not cache the first fragments"), (NULL));
+      goto error;
+    }
+    GST_INFO_OBJECT (demux, "First fragments cached successfully");
+  }
+
   while (TRUE) {
     if (demux->cancelled)
       goto quit;
@@ -920,7 +1192,7 @@ gst_hls_demux_updates_loop (GstHLSDemux * demux)
       goto quit;
 
     /* fetch the next fragment */
-    if (g_queue_is_empty (demux->queue)) {
+    if (gst_hls_demux_queue_is_empty (demux)) {
       GST_DEBUG_OBJECT (demux, "queue empty, get next fragment");
       if (!gst_hls_demux_get_next_fragment (demux, FALSE)) {
         if (demux->cancelled) {
@@ -1004,10 +1276,13 @@ gst_hls_demux_cache_fragments (GstHLSDemux * demux)
   }
 
   /* Cache the first fragments */
+  /* In progressive mode the data is already flowing, downstream does the
+   * buffering */
   for (i = 0; i < demux->fragments_cache; i++) {
-    gst_element_post_message (GST_ELEMENT (demux),
-        gst_message_new_buffering (GST_OBJECT (demux),
-            100 * i / demux->fragments_cache));
+    if (!demux->progressive)
+      gst_element_post_message (GST_ELEMENT (demux),
+          gst_message_new_buffering (GST_OBJECT (demux),
+              100 * i / demux->fragments_cache));
     g_get_current_time (&demux->next_update);
     if (!gst_hls_demux_get_next_fragment (demux, TRUE)) {
       if (demux->end_of_playlist)
@@ -1021,8 +1296,9 @@ gst_hls_demux_cache_fragments (GstHLSDemux * demux)
       return FALSE;
     gst_hls_demux_switch_playlist (demux);
   }
-  gst_element_post_message (GST_ELEMENT (demux),
-      gst_message_new_buffering (GST_OBJECT (demux), 100));
+  if (!demux->progressive)
+    gst_element_post_message (GST_ELEMENT (demux),
+        gst_message_new_buffering (GST_OBJECT (demux), 100));
 
   g_get_current_time (&demux->next_update);
 
@@ -1089,11 +1365,13 @@ gst_hls_demux_update_playlist (GstHLSDemux * demux, gboolean update)
   if (updated && update == FALSE && demux->client->current &&
       gst_m3u8_client_is_live (demux->client)) {
     guint last_sequence;
+    GPtrArray *files;
 
     GST_M3U8_CLIENT_LOCK (demux->client);
+    files = demux->client->current->files;
     last_sequence =
-        GST_M3U8_MEDIA_FILE (g_list_last (demux->client->current->
-            files)->data)->sequence;
+        GST_M3U8_MEDIA_FILE (g_ptr_array_index (files,
+            files->len - 1))->sequence;
 
     if (demux->client->sequence >= last_sequence - 3) {
       GST_DEBUG_OBJECT (demux, "Sequence is beyond playlist. Moving back to %d",
@@ -1205,88 +1483,198 @@ gst_hls_demux_schedule (GstHLSDemux * demux)
   return TRUE;
 }
 
+/* Amount of downloaded data not played yet, or GST_CLOCK_TIME_NONE if
+ * downstream can't tell its position */
+static GstClockTime
+gst_hls_demux_get_buffer_level (GstHLSDemux * demux)
+{
+  GstPad *srcpad = NULL;
+  gint64 position = -1;
+
+  if (!GST_CLOCK_TIME_IS_VALID (demux->download_position))
+    return GST_CLOCK_TIME_NONE;
+
+  GST_OBJECT_LOCK (demux);
+  if (demux->srcpad)
+    srcpad = gst_object_ref (demux->srcpad);
+  GST_OBJECT_UNLOCK (demux);
+  if (srcpad == NULL)
+    return GST_CLOCK_TIME_NONE;
+
+  if (!gst_pad_peer_query_position (srcpad, GST_FORMAT_TIME, &position))
+    position = -1;
+  gst_object_unref (srcpad);
+
+  if (position < 0)
+    return GST_CLOCK_TIME_NONE;
+  if (demux->download_position <= position)
+    return 0;
+  return demux->download_position - position;
+}
+
 static gboolean
 gst_hls_demux_switch_playlist (GstHLSDemux * demux)
 {
-  GTimeVal now;
-  GstClockTime diff;
+  GstClockTime buffer_level;
+  GstStructure *s;
   gsize size;
-  gint bitrate;
-  GstFragment *fragment;
-  GstBuffer *buffer;
+  guint64 current_bitrate, bitrate;
 
   GST_M3U8_CLIENT_LOCK (demux->client);
-  fragment = g_queue_peek_tail (demux->queue);
-  if (!demux->client->main->lists || !fragment) {
+  size = demux->last_fragment_size;
+  if (!demux->client->main->lists || !size) {
     GST_M3U8_CLIENT_UNLOCK (demux->client);
     return TRUE;
   }
+  current_bitrate =
+      GST_M3U8 (demux->client->main->current_variant->data)->bandwidth;
   GST_M3U8_CLIENT_UNLOCK (demux->client);
 
-  /* compare the time when the fragment was downloaded with the time when it was
-   * scheduled */
-  g_get_current_time (&now);
-  diff = (GST_TIMEVAL_TO_TIME (now) - GST_TIMEVAL_TO_TIME (demux->next_update));
-  buffer = gst_fragment_get_buffer (fragment);
-  size = gst_buffer_get_size (buffer);
-  bitrate = (size * 8) / ((double) diff / G_USEC_PER_SEC);
+  /* the downloads added their samples already */
+  buffer_level = gst_hls_demux_get_buffer_level (demux);
+  bitrate = gst_bandwidth_estimator_get_target_bitrate (&demux->bandwidth,
+      demux->bitrate_limit, current_bitrate, buffer_level);
+
+  GST_DEBUG_OBJECT (demux, "Downloaded %u bytes, buffer level %"
+      GST_TIME_FORMAT ". Target bitrate is : %" G_GUINT64_FORMAT,
+      (guint) size, GST_TIME_ARGS (buffer_level), bitrate);
 
-  GST_DEBUG ("Downloaded %d bytes in %" GST_TIME_FORMAT ". Bitrate is : %d",
-      (guint) size, GST_TIME_ARGS (diff), bitrate);
+  s = gst_bandwidth_estimator_get_stats (&demux->bandwidth,
+      "bandwidth-estimate");
+  gst_structure_set (s, "buffer-level", G_TYPE_UINT64, buffer_level,
+      "target-bitrate", G_TYPE_UINT64, bitrate, NULL);
+  gst_element_post_message (GST_ELEMENT_CAST (demux),
+      gst_message_new_element (GST_OBJECT_CAST (demux), s));
 
-  gst_buffer_unref (buffer);
-  return gst_hls_demux_change_playlist (demux, bitrate * demux->bitrate_limit);
+  return gst_hls_demux_change_playlist (demux, MIN (bitrate, G_MAXUINT));
 }
 
-static GstFragment *
-gst_hls_demux_decrypt_fragment (GstHLSDemux * demux,
-    GstFragment * encrypted_fragment, const gchar * key, const guint8 * iv)
+static gboolean
+gst_hls_demux_init_cipher (GstHLSDemux * demux, const gchar * key,
+    const guint8 * iv, gnutls_cipher_hd_t * aes_ctx)
 {
-  GstFragment *key_fragment, *ret = NULL;
-  GstBuffer *key_buffer, *encrypted_buffer, *decrypted_buffer;
-  GstMapInfo key_info, encrypted_info, decrypted_info;
-  gnutls_cipher_hd_t aes_ctx;
+  GstFragment *key_fragment;
+  GstBuffer *key_buffer;
+  GstMapInfo key_info;
   gnutls_datum_t key_d, iv_d;
-  gsize unpadded_size;
+  gint ret;
 
   GST_INFO_OBJECT (demux, "Fetching key %s", key);
   key_fragment = gst_uri_downloader_fetch_uri (demux->downloader, key);
   if (key_fragment == NULL)
-    goto key_failed;
+    return FALSE;
 
   key_buffer = gst_fragment_get_buffer (key_fragment);
-  encrypted_buffer = gst_fragment_get_buffer (encrypted_fragment);
-  decrypted_buffer =
-      gst_buffer_new_allocate (NULL, gst_buffer_get_size (encrypted_buffer),
-      NULL);
+  g_object_unref (key_fragment);
+  if (key_buffer == NULL)
+    return FALSE;
 
   gst_buffer_map (key_buffer, &key_info, GST_MAP_READ);
+  if (key_info.size < 16) {
+    GST_WARNING_OBJECT (demux, "Invalid key of %" G_GSIZE_FORMAT " bytes",
+        key_info.size);
+    ret = -1;
+  } else {
+    key_d.data = key_info.data;
+    key_d.size = 16;
+    iv_d.data = (unsigned char *) iv;
+    iv_d.size = 16;
+    ret = gnutls_cipher_init (aes_ctx, gnutls_cipher_get_id ("AES-128-CBC"),
+        &key_d, &iv_d);
+  }
+  gst_buffer_unmap (key_buffer, &key_info);
+  gst_buffer_unref (key_buffer);
+
+  return ret == 0;
+}
+
+/* Decrypts all complete blocks in the adapter. Until the download is
+ * finished the last block is kept back as it might contain the padding. */
+static GstBuffer *
+gst_hls_demux_decrypt_available (GstHLSDemux * demux,
+    gnutls_cipher_hd_t aes_ctx, GstAdapter * adapter, gboolean last)
+{
+  GstBuffer *encrypted_buffer, *decrypted_buffer;
+  GstMapInfo encrypted_info, decrypted_info;
+  gsize avail, size, unpadded_size;
+
+  avail = gst_adapter_available (adapter);
+  if (last) {
+    if (avail == 0 || avail % 16 != 0) {
+      GST_WARNING_OBJECT (demux, "Encrypted data of %" G_GSIZE_FORMAT
+          " bytes is not a multiple of the block size", avail);
+      gst_adapter_clear (adapter);
+      return NULL;
+    }
+    size = avail;
+  } else {
+    size = avail > 16 ? ((avail - 1) / 16) * 16 : 0;
+    if (size == 0)
+      return NULL;
+  }
+
+  encrypted_buffer = gst_adapter_take_buffer (adapter, size);
+  decrypted_buffer = gst_buffer_new_allocate (NULL, size, NULL);
+
   gst_buffer_map (encrypted_buffer, &encrypted_info, GST_MAP_READ);
   gst_buffer_map (decrypted_buffer, &decrypted_info, GST_MAP_WRITE);
 
-  key_d.data = key_info.data;
-  key_d.size = 16;
-  iv_d.data = (unsigned char *) iv;
-  iv_d.size = 16;
-  gnutls_cipher_init (&aes_ctx, gnutls_cipher_get_id ("AES-128-CBC"), &key_d,
-      &iv_d);
-  gnutls_cipher_decrypt2 (aes_ctx, encrypted_info.data, encrypted_info.size,
-      decrypted_info.data, decrypted_info.size);
-  gnutls_cipher_deinit (aes_ctx);
+  /* The cipher keeps the CBC state between the calls */
+  gnutls_cipher_decrypt2 (aes_ctx, encrypted_info.data, size,
+      decrypted_info.data, size);
 
   /* Handle pkcs7 unpadding here */
-  unpadded_size =
-      decrypted_info.size - decrypted_info.data[decrypted_info.size - 1];
+  unpadded_size = size;
+  if (last) {
+    guint8 padding = decrypted_info.data[size - 1];
+
+    if (padding > 0 && padding <= 16)
+      unpadded_size -= padding;
+    else
+      GST_WARNING_OBJECT (demux, "Invalid padding %u", padding);
+  }
 
   gst_buffer_unmap (decrypted_buffer, &decrypted_info);
   gst_buffer_unmap (encrypted_buffer, &encrypted_info);
-  gst_buffer_unmap (key_buffer, &key_info);
+  gst_buffer_unref (encrypted_buffer);
+
+  if (unpadded_size == 0) {
+    gst_buffer_unref (decrypted_buffer);
+    return NULL;
+  }
 
   gst_buffer_resize (decrypted_buffer, 0, unpadded_size);
 
-  gst_buffer_unref (key_buffer);
-  gst_buffer_unref (encrypted_buffer);
-  g_object_unref (key_fragment);
+  return decrypted_buffer;
+}
+
+static GstFragment *
+gst_hls_demux_decrypt_fragment (GstHLSDemux * demux,
+    GstFragment * encrypted_fragment, const gchar * key, const guint8 * iv)
+{
+  GstFragment *ret = NULL;
+  GstBuffer *encrypted_buffer, *decrypted_buffer;
+  gnutls_cipher_hd_t aes_ctx;
+  GstAdapter *adapter;
+
+  if (!gst_hls_demux_init_cipher (demux, key, iv, &aes_ctx))
+    goto key_failed;
+
+  encrypted_buffer = gst_fragment_get_buffer (encrypted_fragment);
+  if (encrypted_buffer == NULL) {
+    gnutls_cipher_deinit (aes_ctx);
+    goto key_failed;
+  }
+
+  adapter = gst_adapter_new ();
+  gst_adapter_push (adapter, encrypted_buffer);
+  decrypted_buffer =
+      gst_hls_demux_decrypt_available (demux, aes_ctx, adapter, TRUE);
+  g_object_unref (adapter);
+  gnutls_cipher_deinit (aes_ctx);
+
+  if (decrypted_buffer == NULL)
+    goto key_failed;
 
   ret = gst_fragment_new ();
   gst_fragment_add_buffer (ret, decrypted_buffer);
@@ -1296,9 +1684,275 @@ key_failed:
   return ret;
 }
 
+/* Called with the data of the first fragment once it was typefound, and
+ * with all data after that. Blocks while more than MAX_CHUNKS_SIZE bytes
+ * are waiting to be pushed, the time spent there is left out of the
+ * download time of @bandwidth as it says nothing about the network */
+static void
+gst_hls_demux_queue_chunk (GstHLSDemux * demux, GstBuffer * buffer,
+    GstCaps * caps, GstBandwidthEstimatorDownload * bandwidth)
+{
+  GstHLSDemuxChunk *chunk;
+  gboolean paused = FALSE;
+
+  g_mutex_lock (&demux->chunks_lock);
+  while (demux->chunks_size >= MAX_CHUNKS_SIZE && !demux->cancelled) {
+    GST_LOG_OBJECT (demux, "Chunks queue full, waiting");
+    if (bandwidth && !paused) {
+      gst_bandwidth_estimator_download_pause (&demux->bandwidth, bandwidth,
+          gst_util_get_timestamp ());
+      paused = TRUE;
+    }
+    g_cond_wait (&demux->chunks_cond, &demux->chunks_lock);
+  }
+  if (paused)
+    gst_bandwidth_estimator_download_resume (&demux->bandwidth, bandwidth,
+        gst_util_get_timestamp ());
+
+  if (demux->cancelled) {
+    g_mutex_unlock (&demux->chunks_lock);
+    gst_buffer_unref (buffer);
+    if (caps)
+      gst_caps_unref (caps);
+    return;
+  }
+
+  chunk = g_slice_new (GstHLSDemuxChunk);
+  chunk->buffer = buffer;
+  chunk->caps = caps;
+  g_queue_push_tail (&demux->chunks, chunk);
+  demux->chunks_size += gst_buffer_get_size (buffer);
+  gst_task_start (demux->stream_task);
+  g_mutex_unlock (&demux->chunks_lock);
+}
+
+static void
+gst_hls_demux_download_push (GstHLSDemuxDownload * download,
+    GstBuffer * buffer, gboolean last)
+{
+  GstHLSDemux *demux = download->demux;
+  GstCaps *caps = NULL;
+
+  /* Drop what a previous attempt pushed already */
+  if (buffer && download->offset < download->skip) {
+    gsize size = gst_buffer_get_size (buffer);
+    guint64 drop = MIN (size, download->skip - download->offset);
+
+    download->offset += drop;
+    if (drop == size) {
+      gst_buffer_unref (buffer);
+      buffer = NULL;
+    } else {
+      buffer = gst_buffer_make_writable (buffer);
+      gst_buffer_resize (buffer, drop, -1);
+    }
+  }
+  if (buffer)
+    download->offset += gst_buffer_get_size (buffer);
+
+  if (download->pending) {
+    buffer = buffer ? gst_buffer_append (download->pending, buffer) :
+        download->pending;
+    download->pending = NULL;
+  }
+
+  if (buffer == NULL)
+    return;
+
+  if (!download->started) {
+    /* We actually need to do this every time we switch bitrate */
+    if (G_UNLIKELY (demux->do_typefind)) {
+      GstTypeFindProbability prob = GST_TYPE_FIND_NONE;
+
+      caps = gst_type_find_helper_for_buffer (NULL, buffer, &prob);
+
+      /* Wait for more data if the type is not clear yet */
+      if (!last && prob < GST_TYPE_FIND_LIKELY
+          && gst_buffer_get_size (buffer) < TYPEFIND_MAX_SIZE) {
+        if (caps)
+          gst_caps_unref (caps);
+        download->pending = buffer;
+        return;
+      }
+
+      if (caps) {
+        if (!demux->input_caps || !gst_caps_is_equal (caps, demux->input_caps)) {
+          gst_caps_replace (&demux->input_caps, caps);
+          GST_INFO_OBJECT (demux, "Input source caps: %" GST_PTR_FORMAT,
+              demux->input_caps);
+          demux->do_typefind = FALSE;
+        }
+        gst_caps_unref (caps);
+      }
+    }
+
+    buffer = gst_buffer_make_writable (buffer);
+    GST_BUFFER_PTS (buffer) = download->timestamp;
+    if (download->discont || demux->discont) {
+      GST_DEBUG_OBJECT (demux, "Marking fragment as discontinuous");
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+      demux->discont = FALSE;
+    }
+
+    caps = demux->input_caps ? gst_caps_ref (demux->input_caps) : NULL;
+    download->started = TRUE;
+  }
+
+  gst_hls_demux_queue_chunk (demux, buffer, caps,
+      download->timed ? &download->bandwidth : NULL);
+}
+
+static void
+gst_hls_demux_chunk_received (GstUriDownloader * downloader,
+    GstBuffer * buffer, GstHLSDemuxDownload * download)
+{
+  download->size += gst_buffer_get_size (buffer);
+
+  if (download->encrypted) {
+    gst_adapter_push (download->adapter, buffer);
+    buffer = gst_hls_demux_decrypt_available (download->demux,
+        download->aes_ctx, download->adapter, FALSE);
+    if (buffer == NULL)
+      return;
+  }
+
+  gst_hls_demux_download_push (download, buffer, FALSE);
+}
+
+/* Downloads the next fragment and queues its data for the streaming task
+ * while it arrives. A fragment that was prefetched already is queued at
+ * once */
+static gboolean
+gst_hls_demux_stream_fragment (GstHLSDemux * demux, const gchar * uri,
+    GstClockTime timestamp, gboolean discont, const gchar * key,
+    const guint8 * iv, GstFragment * prefetched)
+{
+  GstHLSDemuxDownload download = { 0, };
+  GstFragment *fragment;
+
+  download.demux = demux;
+  download.timestamp = timestamp;
+  download.discont = discont;
+
+  if (demux->resume_uri) {
+    if (strcmp (demux->resume_uri, uri) == 0) {
+      GST_DEBUG_OBJECT (demux, "Resuming fragment after %" G_GUINT64_FORMAT
+          " bytes", demux->resume_offset);
+      download.skip = demux->resume_offset;
+      download.started = TRUE;
+    } else {
+      /* the end of the previous fragment is lost */
+      demux->discont = TRUE;
+    }
+    g_free (demux->resume_uri);
+    demux->resume_uri = NULL;
+    demux->resume_offset = 0;
+  }
+
+  if (key) {
+    if (!gst_hls_demux_init_cipher (demux, key, iv, &download.aes_ctx))
+      return FALSE;
+    download.encrypted = TRUE;
+    download.adapter = gst_adapter_new ();
+  }
+
+  if (prefetched) {
+    GstBuffer *buffer = gst_fragment_get_buffer (prefetched);
+
+    fragment = prefetched;
+    if (buffer)
+      gst_hls_demux_chunk_received (NULL, buffer, &download);
+  } else {
+    gst_bandwidth_estimator_download_start (&demux->bandwidth,
+        &download.bandwidth, gst_util_get_timestamp ());
+    download.timed = TRUE;
+    fragment = gst_uri_downloader_fetch_uri_with_callback (demux->downloader,
+        uri, 0, -1, (GstUriDownloaderChunkFunc) gst_hls_demux_chunk_received,
+        &download);
+    download.timed = FALSE;
+    gst_bandwidth_estimator_download_stop (&demux->bandwidth,
+        &download.bandwidth, fragment ? download.size : 0,
+        gst_util_get_timestamp ());
+  }
+
+  if (fragment) {
+    GstBuffer *buffer = NULL;
+
+    if (download.encrypted)
+      buffer = gst_hls_demux_decrypt_available (demux, download.aes_ctx,
+          download.adapter, TRUE);
+    gst_hls_demux_download_push (&download, buffer, TRUE);
+
+    demux->last_fragment_size = download.size;
+    g_object_unref (fragment);
+  } else if (download.started && !demux->cancelled) {
+    /* Part of the fragment was pushed already, the next attempt downloads it
+     * again and only pushes the rest */
+    demux->resume_uri = g_strdup (uri);
+    demux->resume_offset = MAX (download.offset, download.skip);
+  }
+
+  if (download.pending)
+    gst_buffer_unref (download.pending);
+  if (download.encrypted) {
+    g_object_unref (download.adapter);
+    gnutls_cipher_deinit (download.aes_ctx);
+  }
+
+  return fragment != NULL;
+}
+
+/* Returns the prefetched download of @uri if it is the next one of the
+ * scheduler, dropping the prefetched fragments otherwise */
+static GstFragment *
+gst_hls_demux_take_prefetched (GstHLSDemux * demux, const gchar * uri)
+{
+  GstFragment *fragment = NULL;
+  gchar *next_uri;
+
+  next_uri = gst_uri_download_scheduler_peek (demux->scheduler, 0);
+  if (next_uri == NULL)
+    return NULL;
+
+  if (strcmp (next_uri, uri) != 0) {
+    /* the playlist was switched or reloaded with other fragments */
+    GST_DEBUG_OBJECT (demux, "Dropping prefetched fragments");
+    gst_uri_download_scheduler_flush (demux->scheduler, 0);
+    return NULL;
+  }
+
+  if (!gst_uri_download_scheduler_pop (demux->scheduler, 0, TRUE, &fragment,
+          (gpointer *) & next_uri))
+    return NULL;
+  g_free (next_uri);
+
+  return fragment;
+}
+
+/* Queues the downloads of the fragments following the next one until
+ * fragments-in-flight fragments are being downloaded */
+static void
+gst_hls_demux_prefetch (GstHLSDemux * demux)
+{
+  guint i;
+
+  for (i = gst_uri_download_scheduler_get_n_pending (demux->scheduler, 0);
+      i + 1 < demux->fragments_in_flight; i++) {
+    gchar *uri = gst_m3u8_client_peek_fragment_uri (demux->client, i);
+
+    if (uri == NULL)
+      break;
+
+    GST_DEBUG_OBJECT (demux, "Prefetching fragment %s", uri);
+    gst_uri_download_scheduler_push (demux->scheduler, 0, uri, 0, -1, uri,
+        g_free);
+  }
+}
+
 static gboolean
 gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
 {
+  GstFragment *prefetched;
   GstFragment *download;
   const gchar *next_fragment_uri;
   GstClockTime duration;
@@ -1307,19 +1961,69 @@ gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
   gboolean discont;
   const gchar *key = NULL;
   const guint8 *iv = NULL;
+  gint sequence;
+
+  GST_M3U8_CLIENT_LOCK (demux->client);
+  sequence = demux->client->sequence;
+  GST_M3U8_CLIENT_UNLOCK (demux->client);
 
   if (!gst_m3u8_client_get_next_fragment (demux->client, &discont,
           &next_fragment_uri, &duration, &timestamp, &key, &iv)) {
     GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
+    g_mutex_lock (&demux->chunks_lock);
     demux->end_of_playlist = TRUE;
     gst_task_start (demux->stream_task);
+    g_mutex_unlock (&demux->chunks_lock);
     return FALSE;
   }
 
   GST_INFO_OBJECT (demux, "Fetching next fragment %s", next_fragment_uri);
 
-  download = gst_uri_downloader_fetch_uri (demux->downloader,
-      next_fragment_uri);
+  /* A fragment being resumed is not the next prefetched one */
+  if (demux->resume_uri)
+    prefetched = NULL;
+  else
+    prefetched = gst_hls_demux_take_prefetched (demux, next_fragment_uri);
+  gst_hls_demux_prefetch (demux);
+
+  if (demux->progressive) {
+    if (!gst_hls_demux_stream_fragment (demux, next_fragment_uri, timestamp,
+            discont, key, iv, prefetched)) {
+      if (demux->resume_uri) {
+        /* retry the same fragment */
+        GST_M3U8_CLIENT_LOCK (demux->client);
+        demux->client->sequence = sequence;
+        GST_M3U8_CLIENT_UNLOCK (demux->client);
+      }
+      goto error;
+    }
+    demux->download_position = timestamp + duration;
+
+    if (!caching)
+      GST_TASK_SIGNAL (demux->updates_task);
+    return TRUE;
+  }
+
+  if (prefetched) {
+    download = prefetched;
+  } else {
+    GstBandwidthEstimatorDownload bandwidth;
+
+    gst_bandwidth_estimator_download_start (&demux->bandwidth, &bandwidth,
+        gst_util_get_timestamp ());
+    download = gst_uri_downloader_fetch_uri (demux->downloader,
+        next_fragment_uri);
+    if (download) {
+      buf = gst_fragment_get_buffer (download);
+      gst_bandwidth_estimator_download_stop (&demux->bandwidth, &bandwidth,
+          buf ? gst_buffer_get_size (buf) : 0, gst_util_get_timestamp ());
+      if (buf)
+        gst_buffer_unref (buf);
+    } else {
+      gst_bandwidth_estimator_download_stop (&demux->bandwidth, &bandwidth, 0,
+          gst_util_get_timestamp ());
+    }
+  }
 
   if (download && key)
     download = gst_hls_demux_decrypt_fragment (demux, download, key, iv);
@@ -1353,6 +2057,9 @@ gst_hls_demux_get_next_fragment (GstHLSDemux * demux, gboolean caching)
     GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
   }
 
+  demux->last_fragment_size = gst_buffer_get_size (buf);
+  demux->download_position = timestamp + duration;
+
   /* The buffer ref is still kept inside the fragment download */
   gst_buffer_unref (buf);
 
@@ -29,6 +29,8 @@
 #include "m3u8.h"
 #include "gstfragmented.h"
 #include <gst/uridownloader/gsturidownloader.h>
+#include <gst/uridownloader/gsturidownloadscheduler.h>
+#include <gst/uridownloader/gstbandwidthestimator.h>
 
 G_BEGIN_DECLS
 #define GST_TYPE_HLS_DEMUX \
@@ -64,6 +66,7 @@ struct _GstHLSDemux
   GstBuffer *playlist;
   GstCaps *input_caps;
   GstUriDownloader *downloader;
+  GstUriDownloadScheduler *scheduler;  /* Prefetches the next fragments */
   GstM3U8Client *client;        /* M3U8 client */
   GQueue *queue;                /* Queue storing the fetched fragments */
   gboolean need_cache;          /* Wheter we need to cache some fragments before starting to push data */
@@ -74,6 +77,24 @@ struct _GstHLSDemux
   guint fragments_cache;        /* number of fragments needed to be cached to start playing */
   gfloat bitrate_limit;         /* limit of the available bitrate to use */
   guint connection_speed;       /* Network connection speed in kbps (0 = unknown) */
+  gboolean progressive;         /* push fragments while they are downloaded */
+  guint fragments_in_flight;    /* number of fragments downloaded in parallel */
+  guint64 max_prefetch_bytes;   /* limit of the prefetched data */
+
+  /* Progressive download */
+  GQueue chunks;                /* Chunks of the fragments being pushed */
+  guint64 chunks_size;          /* Size of the queued chunks */
+  GMutex chunks_lock;
+  GCond chunks_cond;            /* Signalled when chunks are dequeued */
+  gboolean discont;             /* Previous fragment was not completely pushed */
+  gchar *resume_uri;            /* Fragment that failed after part of it was
+                                 * pushed */
+  guint64 resume_offset;        /* Size of its data that was pushed */
+  guint64 last_fragment_size;   /* Size of the last downloaded fragment */
+
+  /* Bitrate adaptation */
+  GstBandwidthEstimator bandwidth;
+  GstClockTime download_position;       /* End of the last downloaded fragment */
 
   /* Streaming task */
   GstTask *stream_task;
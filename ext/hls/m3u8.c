@@ -70,8 +70,8 @@ gst_m3u8_free (GstM3U8 * self)
   g_free (self->codecs);
   g_free (self->key);
 
-  g_list_foreach (self->files, (GFunc) gst_m3u8_media_file_free, NULL);
-  g_list_free (self->files);
+  if (self->files)
+    g_ptr_array_free (self->files, TRUE);
 
   g_free (self->last_data);
   g_list_foreach (self->lists, (GFunc) gst_m3u8_free, NULL);
@@ -106,6 +106,30 @@ gst_m3u8_media_file_free (GstM3U8MediaFile * self)
   g_free (self);
 }
 
+/* Takes the media file with sequence number @sequence out of @files, the
+ * media files of the previous update, if it is the same segment. @line is
+ * the uri line of the playlist, before it is joined with the playlist uri */
+static GstM3U8MediaFile *
+gst_m3u8_take_media_file (GPtrArray * files, guint first, guint sequence,
+    const gchar * line, const gchar * key, const guint8 * iv)
+{
+  GstM3U8MediaFile *file;
+
+  if (files == NULL || sequence < first || sequence - first >= files->len)
+    return NULL;
+
+  file = g_ptr_array_index (files, sequence - first);
+  if (file == NULL || !g_str_has_suffix (file->uri, line))
+    return NULL;
+  /* the segment was encrypted differently, e.g. the playlist restarted */
+  if (g_strcmp0 (file->key, key) != 0 || (file->key && iv
+          && memcmp (file->iv, iv, sizeof (file->iv)) != 0))
+    return NULL;
+
+  g_ptr_array_index (files, sequence - first) = NULL;
+  return file;
+}
+
 static gboolean
 int_from_string (gchar * ptr, gchar ** endptr, gint * val)
 {
@@ -288,6 +312,8 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
   GstM3U8 *list;
   gboolean have_iv = FALSE;
   guint8 iv[16] = { 0, };
+  GPtrArray *old_files;
+  guint old_first = 0, n_new = 0, i;
 
   g_return_val_if_fail (self != NULL, FALSE);
   g_return_val_if_fail (data != NULL, FALSE);
@@ -313,68 +339,86 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
   g_free (self->last_data);
   self->last_data = data;
 
-  if (self->files) {
-    g_list_foreach (self->files, (GFunc) gst_m3u8_media_file_free, NULL);
-    g_list_free (self->files);
-    self->files = NULL;
+  /* The media files of the previous update are kept around so that the
+   * segments still listed in a live playlist are not parsed again, only
+   * the ones appended since then are */
+  old_files = self->files;
+  if (old_files) {
+    g_ptr_array_set_free_func (old_files, NULL);
+    if (old_files->len > 0)
+      old_first =
+          GST_M3U8_MEDIA_FILE (g_ptr_array_index (old_files, 0))->sequence;
   }
+  self->files = g_ptr_array_new_full (old_files ? old_files->len : 0,
+      (GDestroyNotify) gst_m3u8_media_file_free);
 
   list = NULL;
   duration = 0;
   title = NULL;
   data += 7;
   while (TRUE) {
-    end = g_utf8_strchr (data, -1, '\n');
+    end = strchr (data, '\n');
     if (end)
       *end = '\0';
 
     if (data[0] != '#') {
-      gchar *r;
+      gchar *r, *uri;
 
       if (duration <= 0 && list == NULL) {
         GST_LOG ("%s: got line without EXTINF or EXTSTREAMINF, dropping", data);
         goto next_line;
       }
 
-      data = uri_join (self->uri, data);
-      if (data == NULL)
-        goto next_line;
-
-      r = g_utf8_strchr (data, -1, '\r');
+      r = strchr (data, '\r');
       if (r)
         *r = '\0';
 
       if (list != NULL) {
-        if (g_list_find_custom (self->lists, data,
+        uri = uri_join (self->uri, data);
+        if (uri == NULL)
+          goto next_line;
+
+        if (g_list_find_custom (self->lists, uri,
                 (GCompareFunc) _m3u8_compare_uri)) {
           GST_DEBUG ("Already have a list with this URI");
           gst_m3u8_free (list);
-          g_free (data);
+          g_free (uri);
         } else {
-          gst_m3u8_set_uri (list, data);
+          gst_m3u8_set_uri (list, uri);
           self->lists = g_list_append (self->lists, list);
         }
         list = NULL;
       } else {
         GstM3U8MediaFile *file;
-        file =
-            gst_m3u8_media_file_new (data, title, duration,
-            self->mediasequence++);
-
-        /* set encryption params */
-        file->key = g_strdup (self->key);
-        if (file->key) {
-          if (have_iv) {
-            memcpy (file->iv, iv, sizeof (iv));
-          } else {
-            guint8 *iv = file->iv + 12;
-            GST_WRITE_UINT32_BE (iv + 12, file->sequence);
+
+        file = gst_m3u8_take_media_file (old_files, old_first,
+            self->mediasequence, data, self->key, have_iv ? iv : NULL);
+        if (file == NULL) {
+          uri = uri_join (self->uri, data);
+          if (uri == NULL)
+            goto next_line;
+
+          file =
+              gst_m3u8_media_file_new (uri, g_strdup (title), duration,
+              self->mediasequence);
+          n_new++;
+
+          /* set encryption params */
+          file->key = g_strdup (self->key);
+          if (file->key) {
+            if (have_iv) {
+              memcpy (file->iv, iv, sizeof (iv));
+            } else {
+              guint8 *iv = file->iv + 12;
+              GST_WRITE_UINT32_BE (iv + 12, file->sequence);
+            }
           }
         }
 
+        self->mediasequence++;
         duration = 0;
         title = NULL;
-        self->files = g_list_append (self->files, file);
+        g_ptr_array_add (self->files, file);
       }
 
     } else if (g_str_has_prefix (data, "#EXT-X-ENDLIST")) {
@@ -497,10 +541,9 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
       if (!data || *data != ',')
         goto next_line;
       data = g_utf8_next_char (data);
-      if (data != end) {
-        g_free (title);
-        title = g_strdup (data);
-      }
+      /* only copied if a new media file is created */
+      if (data != end)
+        title = data;
     } else {
       GST_LOG ("Ignored line: %s", data);
     }
@@ -511,6 +554,18 @@ gst_m3u8_update (GstM3U8 * self, gchar * data, gboolean * updated)
     data = g_utf8_next_char (end);      /* skip \n */
   }
 
+  if (old_files) {
+    for (i = 0; i < old_files->len; i++) {
+      GstM3U8MediaFile *file = g_ptr_array_index (old_files, i);
+
+      if (file)
+        gst_m3u8_media_file_free (file);
+    }
+    g_ptr_array_free (old_files, TRUE);
+  }
+  GST_LOG ("Parsed %u new media files, %u in the playlist", n_new,
+      self->files->len);
+
   /* redorder playlists by bitrate */
   if (self->lists) {
     gchar *top_variant_uri = NULL;
@@ -601,9 +656,9 @@ gst_m3u8_client_update (GstM3U8Client * self, gchar * data)
     }
   }
 
-  if (m3u8->files && self->sequence == -1) {
+  if (m3u8->files->len > 0 && self->sequence == -1) {
     self->sequence =
-        GST_M3U8_MEDIA_FILE (g_list_first (m3u8->files)->data)->sequence;
+        GST_M3U8_MEDIA_FILE (g_ptr_array_index (m3u8->files, 0))->sequence;
     GST_DEBUG ("Setting first sequence at %d", self->sequence);
   }
 
@@ -613,31 +668,42 @@ out:
   return ret;
 }
 
-static gboolean
-_find_next (GstM3U8MediaFile * file, GstM3U8Client * client)
+/* Returns the index of the first media file of the current playlist with a
+ * sequence number of at least the client's one, or -1. The sequence numbers
+ * of a playlist are consecutive so this is a subtraction */
+static gint
+_find_next (GstM3U8Client * client)
 {
-  GST_DEBUG ("Found fragment %d", file->sequence);
-  if (file->sequence >= client->sequence)
-    return FALSE;
-  return TRUE;
+  GPtrArray *files = client->current->files;
+  guint first;
+
+  if (files == NULL || files->len == 0)
+    return -1;
+
+  first = GST_M3U8_MEDIA_FILE (g_ptr_array_index (files, 0))->sequence;
+  if (client->sequence <= (gint) first)
+    return 0;
+  if (client->sequence - first >= files->len)
+    return -1;
+
+  GST_DEBUG ("Found fragment %d", client->sequence);
+  return client->sequence - first;
 }
 
 void
 gst_m3u8_client_get_current_position (GstM3U8Client * client,
     GstClockTime * timestamp)
 {
-  GList *l;
-  GList *walk;
+  GPtrArray *files = client->current->files;
+  gint i, n;
 
-  l = g_list_find_custom (client->current->files, client,
-      (GCompareFunc) _find_next);
+  n = _find_next (client);
+  if (n < 0)
+    n = files ? files->len : 0;
 
   *timestamp = 0;
-  for (walk = client->current->files; walk; walk = walk->next) {
-    if (walk == l)
-      break;
-    *timestamp += GST_M3U8_MEDIA_FILE (walk->data)->duration;
-  }
+  for (i = 0; i < n; i++)
+    *timestamp += GST_M3U8_MEDIA_FILE (g_ptr_array_index (files, i))->duration;
 }
 
 gboolean
@@ -645,7 +711,7 @@ gst_m3u8_client_get_next_fragment (GstM3U8Client * client,
     gboolean * discontinuity, const gchar ** uri, GstClockTime * duration,
     GstClockTime * timestamp, const gchar ** key, const guint8 ** iv)
 {
-  GList *l;
+  gint n;
   GstM3U8MediaFile *file;
 
   g_return_val_if_fail (client != NULL, FALSE);
@@ -654,16 +720,15 @@ gst_m3u8_client_get_next_fragment (GstM3U8Client * client,
 
   GST_M3U8_CLIENT_LOCK (client);
   GST_DEBUG ("Looking for fragment %d", client->sequence);
-  l = g_list_find_custom (client->current->files, client,
-      (GCompareFunc) _find_next);
-  if (l == NULL) {
+  n = _find_next (client);
+  if (n < 0) {
     GST_M3U8_CLIENT_UNLOCK (client);
     return FALSE;
   }
 
   gst_m3u8_client_get_current_position (client, timestamp);
 
-  file = GST_M3U8_MEDIA_FILE (l->data);
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (client->current->files, n));
 
   *discontinuity = client->sequence != file->sequence;
   client->sequence = file->sequence + 1;
@@ -677,16 +742,35 @@ gst_m3u8_client_get_next_fragment (GstM3U8Client * client,
   return TRUE;
 }
 
-static void
-_sum_duration (GstM3U8MediaFile * self, GstClockTime * duration)
+/* Returns a copy of the uri of the fragment @n places after the one
+ * gst_m3u8_client_get_next_fragment() would return, or NULL */
+gchar *
+gst_m3u8_client_peek_fragment_uri (GstM3U8Client * client, guint n)
 {
-  *duration += self->duration;
+  GPtrArray *files;
+  gint next;
+  gchar *uri = NULL;
+
+  g_return_val_if_fail (client != NULL, NULL);
+  g_return_val_if_fail (client->current != NULL, NULL);
+
+  GST_M3U8_CLIENT_LOCK (client);
+  files = client->current->files;
+  next = _find_next (client);
+  if (next >= 0 && next + n < files->len)
+    uri = g_strdup (GST_M3U8_MEDIA_FILE (g_ptr_array_index (files,
+                next + n))->uri);
+  GST_M3U8_CLIENT_UNLOCK (client);
+
+  return uri;
 }
 
 GstClockTime
 gst_m3u8_client_get_duration (GstM3U8Client * client)
 {
   GstClockTime duration = 0;
+  GPtrArray *files;
+  guint i;
 
   g_return_val_if_fail (client != NULL, GST_CLOCK_TIME_NONE);
 
@@ -697,7 +781,9 @@ gst_m3u8_client_get_duration (GstM3U8Client * client)
     return GST_CLOCK_TIME_NONE;
   }
 
-  g_list_foreach (client->current->files, (GFunc) _sum_duration, &duration);
+  files = client->current->files;
+  for (i = 0; files && i < files->len; i++)
+    duration += GST_M3U8_MEDIA_FILE (g_ptr_array_index (files, i))->duration;
   GST_M3U8_CLIENT_UNLOCK (client);
   return duration;
 }
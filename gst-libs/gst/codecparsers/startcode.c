@@ -0,0 +1,101 @@
+/* Gstreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "startcode.h"
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Checking the third byte first lets most positions be skipped by 2 or 3
+ * bytes, since start codes are rare */
+static inline gint
+scan_for_start_codes_c (const guint8 * data, guint i, guint size)
+{
+  while (i + 4 <= size) {
+    if (data[i + 2] > 1) {
+      i += 3;
+    } else if (data[i + 1]) {
+      i += 2;
+    } else if (data[i] || data[i + 2] != 1) {
+      i++;
+    } else {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * scan_for_start_codes:
+ * @data: the data to scan
+ * @size: the size of @data
+ *
+ * Looks for a 00 00 01 start code prefix followed by at least one byte, like
+ * gst_byte_reader_masked_scan_uint32() with a 0xffffff00 mask and a
+ * 0x00000100 pattern, 16 positions at a time when SSE2 or NEON is available.
+ *
+ * Returns: the offset of the start code in @data, or -1
+ */
+gint
+scan_for_start_codes (const guint8 * data, guint size)
+{
+  guint i = 0;
+
+#if defined (__SSE2__)
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i one = _mm_set1_epi8 (1);
+
+  /* a start code at i + 15 ends at i + 18 */
+  while (i + 19 <= size) {
+    __m128i b0 = _mm_loadu_si128 ((const __m128i *) (data + i));
+    __m128i b1 = _mm_loadu_si128 ((const __m128i *) (data + i + 1));
+    __m128i b2 = _mm_loadu_si128 ((const __m128i *) (data + i + 2));
+    gint mask;
+
+    mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_and_si128 (_mm_cmpeq_epi8 (b0,
+                    zero), _mm_cmpeq_epi8 (b1, zero)), _mm_cmpeq_epi8 (b2,
+                one)));
+    if (mask)
+      return i + g_bit_nth_lsf (mask, -1);
+    i += 16;
+  }
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+  const uint8x16_t zero = vdupq_n_u8 (0);
+  const uint8x16_t one = vdupq_n_u8 (1);
+
+  while (i + 19 <= size) {
+    uint8x16_t m;
+    uint64x2_t m64;
+
+    m = vandq_u8 (vandq_u8 (vceqq_u8 (vld1q_u8 (data + i), zero),
+            vceqq_u8 (vld1q_u8 (data + i + 1), zero)),
+        vceqq_u8 (vld1q_u8 (data + i + 2), one));
+    m64 = vreinterpretq_u64_u8 (m);
+    /* there is no movemask, let the scalar code find the position */
+    if (vgetq_lane_u64 (m64, 0) | vgetq_lane_u64 (m64, 1))
+      break;
+    i += 16;
+  }
+#endif
+
+  return scan_for_start_codes_c (data, i, size);
+}
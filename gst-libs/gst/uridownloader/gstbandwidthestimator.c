@@ -0,0 +1,469 @@
+/* GStreamer
+ *
+ * gstbandwidthestimator.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "gstbandwidthestimator.h"
+
+/* downloads shorter than this mostly measure the request latency */
+#define MIN_SAMPLE_TIME (GST_MSECOND)
+
+void
+gst_bandwidth_estimator_init (GstBandwidthEstimator * estimator)
+{
+  g_mutex_init (&estimator->lock);
+  g_queue_init (&estimator->samples);
+
+  estimator->fast_half_life = GST_BANDWIDTH_ESTIMATOR_DEFAULT_FAST_HALF_LIFE;
+  estimator->slow_half_life = GST_BANDWIDTH_ESTIMATOR_DEFAULT_SLOW_HALF_LIFE;
+  estimator->window = GST_BANDWIDTH_ESTIMATOR_DEFAULT_WINDOW;
+  estimator->percentile = GST_BANDWIDTH_ESTIMATOR_DEFAULT_PERCENTILE;
+  estimator->hysteresis = GST_BANDWIDTH_ESTIMATOR_DEFAULT_HYSTERESIS;
+  estimator->low_buffer_time = GST_BANDWIDTH_ESTIMATOR_DEFAULT_LOW_BUFFER_TIME;
+
+  estimator->fast_ewma = 0;
+  estimator->slow_ewma = 0;
+  estimator->total_weight = 0;
+  estimator->last_bitrate = 0;
+  estimator->n_samples = 0;
+
+  estimator->n_running = 0;
+  estimator->running_since = 0;
+  estimator->running_time = 0;
+}
+
+void
+gst_bandwidth_estimator_deinit (GstBandwidthEstimator * estimator)
+{
+  gst_bandwidth_estimator_reset (estimator);
+  g_mutex_clear (&estimator->lock);
+}
+
+static void
+_free_sample (gpointer sample)
+{
+  g_slice_free (guint64, sample);
+}
+
+void
+gst_bandwidth_estimator_reset (GstBandwidthEstimator * estimator)
+{
+  g_mutex_lock (&estimator->lock);
+  g_queue_foreach (&estimator->samples, (GFunc) _free_sample, NULL);
+  g_queue_clear (&estimator->samples);
+  estimator->fast_ewma = 0;
+  estimator->slow_ewma = 0;
+  estimator->total_weight = 0;
+  estimator->last_bitrate = 0;
+  estimator->n_samples = 0;
+  g_mutex_unlock (&estimator->lock);
+}
+
+void
+gst_bandwidth_estimator_set_hysteresis (GstBandwidthEstimator * estimator,
+    gfloat hysteresis)
+{
+  g_mutex_lock (&estimator->lock);
+  estimator->hysteresis = hysteresis;
+  g_mutex_unlock (&estimator->lock);
+}
+
+gfloat
+gst_bandwidth_estimator_get_hysteresis (GstBandwidthEstimator * estimator)
+{
+  gfloat ret;
+
+  g_mutex_lock (&estimator->lock);
+  ret = estimator->hysteresis;
+  g_mutex_unlock (&estimator->lock);
+
+  return ret;
+}
+
+void
+gst_bandwidth_estimator_set_low_buffer_time (GstBandwidthEstimator *
+    estimator, GstClockTime time)
+{
+  g_mutex_lock (&estimator->lock);
+  estimator->low_buffer_time = time;
+  g_mutex_unlock (&estimator->lock);
+}
+
+GstClockTime
+gst_bandwidth_estimator_get_low_buffer_time (GstBandwidthEstimator *
+    estimator)
+{
+  GstClockTime ret;
+
+  g_mutex_lock (&estimator->lock);
+  ret = estimator->low_buffer_time;
+  g_mutex_unlock (&estimator->lock);
+
+  return ret;
+}
+
+/* Both averages weight each sample by its download time, so that a long
+ * download counts more than a short one, and decay by half after
+ * half_life seconds of downloading */
+static gdouble
+_update_ewma (gdouble ewma, gdouble sample, gdouble weight,
+    GstClockTime half_life)
+{
+  gdouble alpha;
+
+  alpha = pow (0.5, weight / ((gdouble) half_life / GST_SECOND));
+  return sample * (1 - alpha) + ewma * alpha;
+}
+
+/* The averages start at 0, remove that bias */
+static gdouble
+_get_ewma (gdouble ewma, gdouble total_weight, GstClockTime half_life)
+{
+  gdouble zero_factor;
+
+  zero_factor = 1 - pow (0.5, total_weight / ((gdouble) half_life / GST_SECOND));
+  return ewma / zero_factor;
+}
+
+/* called with the lock */
+static void
+_add_sample_unlocked (GstBandwidthEstimator * estimator, gdouble bytes,
+    GstClockTime time)
+{
+  guint64 *sample;
+  gdouble bitrate, weight;
+
+  time = MAX (time, MIN_SAMPLE_TIME);
+  bitrate = bytes * 8 * GST_SECOND / time;
+  weight = (gdouble) time / GST_SECOND;
+
+  estimator->fast_ewma = _update_ewma (estimator->fast_ewma, bitrate, weight,
+      estimator->fast_half_life);
+  estimator->slow_ewma = _update_ewma (estimator->slow_ewma, bitrate, weight,
+      estimator->slow_half_life);
+  estimator->total_weight += weight;
+
+  sample = g_slice_new (guint64);
+  *sample = bitrate;
+  g_queue_push_tail (&estimator->samples, sample);
+  while (g_queue_get_length (&estimator->samples) > estimator->window)
+    _free_sample (g_queue_pop_head (&estimator->samples));
+
+  estimator->last_bitrate = bitrate;
+  estimator->n_samples++;
+}
+
+/**
+ * gst_bandwidth_estimator_add_sample:
+ * @estimator: a #GstBandwidthEstimator
+ * @bytes: the size of a download
+ * @time: the time the download took
+ *
+ * Adds a download that had the link to itself. Downloads that can overlap
+ * others must use gst_bandwidth_estimator_download_start() and
+ * gst_bandwidth_estimator_download_stop() instead.
+ */
+void
+gst_bandwidth_estimator_add_sample (GstBandwidthEstimator * estimator,
+    guint64 bytes, GstClockTime time)
+{
+  if (bytes == 0 || !GST_CLOCK_TIME_IS_VALID (time))
+    return;
+
+  g_mutex_lock (&estimator->lock);
+  _add_sample_unlocked (estimator, bytes, time);
+  g_mutex_unlock (&estimator->lock);
+}
+
+/* Adds up the number of running downloads over time, called with the lock */
+static void
+_update_running_time (GstBandwidthEstimator * estimator, GstClockTime now)
+{
+  if (estimator->n_running > 0 && now > estimator->running_since)
+    estimator->running_time += estimator->n_running *
+        ((gdouble) (now - estimator->running_since) / GST_SECOND);
+  estimator->running_since = now;
+}
+
+/**
+ * gst_bandwidth_estimator_download_start:
+ * @estimator: a #GstBandwidthEstimator
+ * @download: the #GstBandwidthEstimatorDownload to start
+ * @now: the current time, from gst_util_get_timestamp()
+ *
+ * Marks the start of a download that may run at the same time as others.
+ * Every started download must be stopped with
+ * gst_bandwidth_estimator_download_stop().
+ */
+void
+gst_bandwidth_estimator_download_start (GstBandwidthEstimator * estimator,
+    GstBandwidthEstimatorDownload * download, GstClockTime now)
+{
+  g_mutex_lock (&estimator->lock);
+  _update_running_time (estimator, now);
+  estimator->n_running++;
+  download->start = now;
+  download->time = 0;
+  download->running_time = estimator->running_time;
+  download->shared_time = 0;
+  download->paused = FALSE;
+  g_mutex_unlock (&estimator->lock);
+}
+
+/* Ends a running period of @download, called with the lock */
+static void
+_download_pause_unlocked (GstBandwidthEstimator * estimator,
+    GstBandwidthEstimatorDownload * download, GstClockTime now)
+{
+  _update_running_time (estimator, now);
+  if (estimator->n_running > 0)
+    estimator->n_running--;
+  if (now > download->start)
+    download->time += now - download->start;
+  download->shared_time += estimator->running_time - download->running_time;
+  download->paused = TRUE;
+}
+
+/**
+ * gst_bandwidth_estimator_download_pause:
+ * @estimator: a #GstBandwidthEstimator
+ * @download: a started #GstBandwidthEstimatorDownload
+ * @now: the current time, from gst_util_get_timestamp()
+ *
+ * Stops counting the time of @download, while the receiver does not read
+ * the data and the transfer is held back by it rather than by the link.
+ */
+void
+gst_bandwidth_estimator_download_pause (GstBandwidthEstimator * estimator,
+    GstBandwidthEstimatorDownload * download, GstClockTime now)
+{
+  g_mutex_lock (&estimator->lock);
+  if (!download->paused)
+    _download_pause_unlocked (estimator, download, now);
+  g_mutex_unlock (&estimator->lock);
+}
+
+/**
+ * gst_bandwidth_estimator_download_resume:
+ * @estimator: a #GstBandwidthEstimator
+ * @download: a paused #GstBandwidthEstimatorDownload
+ * @now: the current time, from gst_util_get_timestamp()
+ *
+ * Counts the time of @download again after
+ * gst_bandwidth_estimator_download_pause().
+ */
+void
+gst_bandwidth_estimator_download_resume (GstBandwidthEstimator * estimator,
+    GstBandwidthEstimatorDownload * download, GstClockTime now)
+{
+  g_mutex_lock (&estimator->lock);
+  if (download->paused) {
+    _update_running_time (estimator, now);
+    estimator->n_running++;
+    download->start = now;
+    download->running_time = estimator->running_time;
+    download->paused = FALSE;
+  }
+  g_mutex_unlock (&estimator->lock);
+}
+
+/**
+ * gst_bandwidth_estimator_download_stop:
+ * @estimator: a #GstBandwidthEstimator
+ * @download: a started #GstBandwidthEstimatorDownload
+ * @bytes: the size of the download, 0 if it failed
+ * @now: the current time, from gst_util_get_timestamp()
+ *
+ * Marks the end of @download and adds it as a sample, leaving out the time
+ * it was paused. Downloads running at the same time share the link, so the
+ * sample is scaled up by the average number of downloads that ran along
+ * with this one.
+ */
+void
+gst_bandwidth_estimator_download_stop (GstBandwidthEstimator * estimator,
+    GstBandwidthEstimatorDownload * download, guint64 bytes, GstClockTime now)
+{
+  gdouble shared;
+
+  g_mutex_lock (&estimator->lock);
+  if (!download->paused)
+    _download_pause_unlocked (estimator, download, now);
+
+  if (bytes > 0 && download->time > 0) {
+    shared = download->shared_time / ((gdouble) download->time / GST_SECOND);
+    shared = MAX (shared, 1.0);
+    _add_sample_unlocked (estimator, bytes * shared, download->time);
+  }
+  g_mutex_unlock (&estimator->lock);
+}
+
+static gint
+_compare_bitrates (gconstpointer a, gconstpointer b)
+{
+  guint64 ba = *(const guint64 *) a;
+  guint64 bb = *(const guint64 *) b;
+
+  return ba < bb ? -1 : (ba > bb ? 1 : 0);
+}
+
+/* called with the lock */
+static guint64
+_get_percentile (GstBandwidthEstimator * estimator)
+{
+  guint64 *bitrates, ret;
+  guint n, i;
+  GList *walk;
+
+  n = g_queue_get_length (&estimator->samples);
+  if (n == 0)
+    return 0;
+
+  bitrates = g_newa (guint64, n);
+  for (walk = estimator->samples.head, i = 0; walk; walk = walk->next, i++)
+    bitrates[i] = *(guint64 *) walk->data;
+  qsort (bitrates, n, sizeof (guint64), _compare_bitrates);
+
+  ret = bitrates[(n - 1) * estimator->percentile / 100];
+
+  return ret;
+}
+
+/* called with the lock */
+static guint64
+_get_estimate (GstBandwidthEstimator * estimator)
+{
+  gdouble fast, slow, estimate;
+  guint64 percentile;
+
+  if (estimator->n_samples == 0)
+    return 0;
+
+  fast = _get_ewma (estimator->fast_ewma, estimator->total_weight,
+      estimator->fast_half_life);
+  slow = _get_ewma (estimator->slow_ewma, estimator->total_weight,
+      estimator->slow_half_life);
+  percentile = _get_percentile (estimator);
+
+  estimate = MIN (fast, slow);
+  estimate = MIN (estimate, (gdouble) percentile);
+
+  return (guint64) estimate;
+}
+
+/**
+ * gst_bandwidth_estimator_get_estimate:
+ * @estimator: a #GstBandwidthEstimator
+ *
+ * Returns: the estimated bandwidth in bits per second, or 0 if nothing was
+ * downloaded yet
+ */
+guint64
+gst_bandwidth_estimator_get_estimate (GstBandwidthEstimator * estimator)
+{
+  guint64 ret;
+
+  g_mutex_lock (&estimator->lock);
+  ret = _get_estimate (estimator);
+  g_mutex_unlock (&estimator->lock);
+
+  return ret;
+}
+
+/**
+ * gst_bandwidth_estimator_get_target_bitrate:
+ * @estimator: a #GstBandwidthEstimator
+ * @usage: the part of the bandwidth that can be used, 0 to 1
+ * @current_bitrate: the bitrate of the stream being downloaded
+ * @buffer_level: the amount of buffered data, or GST_CLOCK_TIME_NONE
+ *
+ * Computes the maximum bitrate of the stream to download next. Switching
+ * down happens as soon as the estimate drops below @current_bitrate, and
+ * the further the buffer level is below low-buffer-time the lower the
+ * target. Switching up needs an estimate above @current_bitrate by the
+ * hysteresis margin, and a buffer level of at least low-buffer-time.
+ *
+ * Returns: the target bitrate, @current_bitrate to keep the current stream
+ */
+guint64
+gst_bandwidth_estimator_get_target_bitrate (GstBandwidthEstimator * estimator,
+    gdouble usage, guint64 current_bitrate, GstClockTime buffer_level)
+{
+  gdouble target;
+  gboolean low_buffer = FALSE;
+
+  g_mutex_lock (&estimator->lock);
+  if (estimator->n_samples == 0) {
+    g_mutex_unlock (&estimator->lock);
+    return current_bitrate;
+  }
+
+  target = _get_estimate (estimator) * usage;
+
+  if (GST_CLOCK_TIME_IS_VALID (buffer_level)
+      && buffer_level < estimator->low_buffer_time) {
+    /* downloading slower than real time drains the buffer, the emptier it
+     * is the larger the margin we need */
+    target = target * buffer_level / estimator->low_buffer_time;
+    low_buffer = TRUE;
+  }
+
+  if (target > current_bitrate) {
+    if (low_buffer
+        || target < current_bitrate * (1.0 + estimator->hysteresis))
+      target = current_bitrate;
+  }
+  g_mutex_unlock (&estimator->lock);
+
+  return (guint64) target;
+}
+
+/**
+ * gst_bandwidth_estimator_get_stats:
+ * @estimator: a #GstBandwidthEstimator
+ * @name: the name of the structure
+ *
+ * Returns: (transfer full): a #GstStructure with the current statistics,
+ * all bitrates in bits per second
+ */
+GstStructure *
+gst_bandwidth_estimator_get_stats (GstBandwidthEstimator * estimator,
+    const gchar * name)
+{
+  GstStructure *s;
+  guint64 fast = 0, slow = 0;
+
+  g_mutex_lock (&estimator->lock);
+  if (estimator->n_samples > 0) {
+    fast = _get_ewma (estimator->fast_ewma, estimator->total_weight,
+        estimator->fast_half_life);
+    slow = _get_ewma (estimator->slow_ewma, estimator->total_weight,
+        estimator->slow_half_life);
+  }
+  s = gst_structure_new (name,
+      "estimate", G_TYPE_UINT64, _get_estimate (estimator),
+      "fast-average", G_TYPE_UINT64, fast,
+      "slow-average", G_TYPE_UINT64, slow,
+      "percentile", G_TYPE_UINT64, _get_percentile (estimator),
+      "last", G_TYPE_UINT64, estimator->last_bitrate,
+      "samples", G_TYPE_UINT64, estimator->n_samples, NULL);
+  g_mutex_unlock (&estimator->lock);
+
+  return s;
+}
@@ -0,0 +1,110 @@
+/* GStreamer
+ *
+ * gstbandwidthestimator.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_BANDWIDTH_ESTIMATOR_H__
+#define __GST_BANDWIDTH_ESTIMATOR_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_BANDWIDTH_ESTIMATOR_DEFAULT_FAST_HALF_LIFE    (2 * GST_SECOND)
+#define GST_BANDWIDTH_ESTIMATOR_DEFAULT_SLOW_HALF_LIFE    (10 * GST_SECOND)
+#define GST_BANDWIDTH_ESTIMATOR_DEFAULT_WINDOW            20
+#define GST_BANDWIDTH_ESTIMATOR_DEFAULT_PERCENTILE        20
+#define GST_BANDWIDTH_ESTIMATOR_DEFAULT_HYSTERESIS        0.2
+#define GST_BANDWIDTH_ESTIMATOR_DEFAULT_LOW_BUFFER_TIME   (5 * GST_SECOND)
+
+typedef struct _GstBandwidthEstimator GstBandwidthEstimator;
+typedef struct _GstBandwidthEstimatorDownload GstBandwidthEstimatorDownload;
+
+/**
+ * GstBandwidthEstimator:
+ *
+ * Estimates the available bandwidth from the downloads of an adaptive
+ * demuxer. Each download feeds two exponentially weighted moving averages
+ * with half lives in download time, and a window of the last samples. The
+ * estimate is the lowest of the two averages and a low percentile of the
+ * window, so a single fast download does not make the demuxer switch up.
+ */
+struct _GstBandwidthEstimator
+{
+  GMutex lock;
+
+  /* configuration */
+  GstClockTime fast_half_life;
+  GstClockTime slow_half_life;
+  guint window;                 /* number of samples kept */
+  guint percentile;
+  gfloat hysteresis;            /* margin above the current bitrate needed
+                                 * to switch up */
+  GstClockTime low_buffer_time; /* below this the estimate is scaled down */
+
+  /* state */
+  gdouble fast_ewma;
+  gdouble slow_ewma;
+  gdouble total_weight;         /* seconds of download fed to the averages */
+  GQueue samples;               /* guint64 bitrates, oldest first */
+  guint64 last_bitrate;
+  guint64 n_samples;
+
+  /* downloads running at the same time share the link, not reset */
+  guint n_running;
+  GstClockTime running_since;   /* last update of running_time */
+  gdouble running_time;         /* n_running added up over time, in seconds */
+};
+
+/**
+ * GstBandwidthEstimatorDownload:
+ *
+ * A download that may overlap others, see
+ * gst_bandwidth_estimator_download_start().
+ */
+struct _GstBandwidthEstimatorDownload
+{
+  /*< private >*/
+  GstClockTime start;           /* of the current running period */
+  GstClockTime time;            /* of the previous running periods */
+  gdouble running_time;         /* of the estimator at the start */
+  gdouble shared_time;          /* running_time of the previous periods */
+  gboolean paused;
+};
+
+void gst_bandwidth_estimator_init (GstBandwidthEstimator * estimator);
+void gst_bandwidth_estimator_deinit (GstBandwidthEstimator * estimator);
+void gst_bandwidth_estimator_reset (GstBandwidthEstimator * estimator);
+
+void gst_bandwidth_estimator_set_hysteresis (GstBandwidthEstimator * estimator, gfloat hysteresis);
+gfloat gst_bandwidth_estimator_get_hysteresis (GstBandwidthEstimator * estimator);
+void gst_bandwidth_estimator_set_low_buffer_time (GstBandwidthEstimator * estimator, GstClockTime time);
+GstClockTime gst_bandwidth_estimator_get_low_buffer_time (GstBandwidthEstimator * estimator);
+
+void gst_bandwidth_estimator_add_sample (GstBandwidthEstimator * estimator, guint64 bytes, GstClockTime time);
+void gst_bandwidth_estimator_download_start (GstBandwidthEstimator * estimator, GstBandwidthEstimatorDownload * download, GstClockTime now);
+void gst_bandwidth_estimator_download_pause (GstBandwidthEstimator * estimator, GstBandwidthEstimatorDownload * download, GstClockTime now);
+void gst_bandwidth_estimator_download_resume (GstBandwidthEstimator * estimator, GstBandwidthEstimatorDownload * download, GstClockTime now);
+void gst_bandwidth_estimator_download_stop (GstBandwidthEstimator * estimator, GstBandwidthEstimatorDownload * download, guint64 bytes, GstClockTime now);
+guint64 gst_bandwidth_estimator_get_estimate (GstBandwidthEstimator * estimator);
+guint64 gst_bandwidth_estimator_get_target_bitrate (GstBandwidthEstimator * estimator, gdouble usage, guint64 current_bitrate, GstClockTime buffer_level);
+GstStructure * gst_bandwidth_estimator_get_stats (GstBandwidthEstimator * estimator, const gchar * name);
+
+G_END_DECLS
+#endif /* __GST_BANDWIDTH_ESTIMATOR_H__ */
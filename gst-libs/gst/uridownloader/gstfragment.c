@@ -209,7 +209,8 @@ gst_fragment_get_buffer (GstFragment * fragment)
 {
   g_return_val_if_fail (fragment != NULL, NULL);
 
-  if (!fragment->completed)
+  /* Data that was passed to a chunk function is not kept */
+  if (!fragment->completed || fragment->priv->buffer == NULL)
     return NULL;
 
   gst_buffer_ref (fragment->priv->buffer);
@@ -235,10 +236,11 @@ gst_fragment_get_caps (GstFragment * fragment)
     return NULL;
 
   g_mutex_lock (&fragment->priv->lock);
-  if (fragment->priv->caps == NULL)
+  if (fragment->priv->caps == NULL && fragment->priv->buffer != NULL)
     fragment->priv->caps =
         gst_type_find_helper_for_buffer (NULL, fragment->priv->buffer, NULL);
-  gst_caps_ref (fragment->priv->caps);
+  if (fragment->priv->caps)
+    gst_caps_ref (fragment->priv->caps);
   g_mutex_unlock (&fragment->priv->lock);
 
   return fragment->priv->caps;
@@ -41,6 +41,10 @@ struct _GstUriDownloaderPrivate
   GstFragment *download;
   GMutex download_lock;         /* used to restrict to one download only */
 
+  /* Receives the data instead of the fragment if set */
+  GstUriDownloaderChunkFunc chunk_func;
+  gpointer chunk_data;
+
   GCond cond;
   gboolean cancelled;
 };
@@ -240,6 +244,17 @@ gst_uri_downloader_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 
   GST_LOG_OBJECT (downloader, "The uri fetcher received a new buffer "
       "of size %" G_GSIZE_FORMAT, gst_buffer_get_size (buf));
+
+  if (downloader->priv->chunk_func) {
+    GstUriDownloaderChunkFunc func = downloader->priv->chunk_func;
+    gpointer user_data = downloader->priv->chunk_data;
+
+    /* Don't block cancellation while the data is handled */
+    GST_OBJECT_UNLOCK (downloader);
+    func (downloader, buf, user_data);
+    return GST_FLOW_OK;
+  }
+
   if (!gst_fragment_add_buffer (downloader->priv->download, buf))
     GST_WARNING_OBJECT (downloader, "Could not add buffer to fragment");
   GST_OBJECT_UNLOCK (downloader);
@@ -349,6 +364,31 @@ gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri)
 GstFragment *
 gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader,
     const gchar * uri, gint64 range_start, gint64 range_end)
+{
+  return gst_uri_downloader_fetch_uri_with_callback (downloader, uri,
+      range_start, range_end, NULL, NULL);
+}
+
+/**
+ * gst_uri_downloader_fetch_uri_with_callback:
+ * @downloader: the #GstUriDownloader
+ * @uri: the uri
+ * @range_start: the starting byte index
+ * @range_end: the final byte index, use -1 for unspecified
+ * @func: (allow-none): function receiving the data as it arrives
+ * @user_data: user data for @func
+ *
+ * Like gst_uri_downloader_fetch_uri_with_range() but if @func is not %NULL
+ * every buffer is passed to it as soon as it is received instead of being
+ * collected in the returned fragment, which then has no buffer.
+ *
+ * Returns the downloaded #GstFragment, or %NULL if the download failed or
+ * was cancelled
+ */
+GstFragment *
+gst_uri_downloader_fetch_uri_with_callback (GstUriDownloader * downloader,
+    const gchar * uri, gint64 range_start, gint64 range_end,
+    GstUriDownloaderChunkFunc func, gpointer user_data)
 {
   GstStateChangeReturn ret;
   GstFragment *download = NULL;
@@ -358,6 +398,9 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader,
   g_mutex_lock (&downloader->priv->download_lock);
 
   GST_OBJECT_LOCK (downloader);
+  downloader->priv->chunk_func = func;
+  downloader->priv->chunk_data = user_data;
+
   if (downloader->priv->cancelled) {
     GST_DEBUG_OBJECT (downloader, "Cancelled, aborting fetch");
     goto quit;
@@ -463,6 +506,12 @@ quit:
       GST_OBJECT_UNLOCK (downloader);
     }
 
+    /* The source element is stopped, no more data can arrive */
+    GST_OBJECT_LOCK (downloader);
+    downloader->priv->chunk_func = NULL;
+    downloader->priv->chunk_data = NULL;
+    GST_OBJECT_UNLOCK (downloader);
+
     g_mutex_unlock (&downloader->priv->download_lock);
     return download;
   }
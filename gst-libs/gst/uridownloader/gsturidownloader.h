@@ -53,11 +53,23 @@ struct _GstUriDownloaderClass
   gpointer _gst_reserved[GST_PADDING];
 };
 
+/**
+ * GstUriDownloaderChunkFunc:
+ * @downloader: the #GstUriDownloader
+ * @buffer: (transfer full): the data that was just received
+ * @user_data: user data passed when starting the download
+ *
+ * Called from the streaming thread of the source element for every buffer
+ * of a download started with gst_uri_downloader_fetch_uri_with_callback().
+ */
+typedef void (*GstUriDownloaderChunkFunc) (GstUriDownloader * downloader, GstBuffer * buffer, gpointer user_data);
+
 GType gst_uri_downloader_get_type (void);
 
 GstUriDownloader * gst_uri_downloader_new (void);
 GstFragment * gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri);
 GstFragment * gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader, const gchar * uri, gint64 range_start, gint64 range_end);
+GstFragment * gst_uri_downloader_fetch_uri_with_callback (GstUriDownloader * downloader, const gchar * uri, gint64 range_start, gint64 range_end, GstUriDownloaderChunkFunc func, gpointer user_data);
 void gst_uri_downloader_reset (GstUriDownloader *downloader);
 void gst_uri_downloader_cancel (GstUriDownloader *downloader);
 void gst_uri_downloader_free (GstUriDownloader *downloader);
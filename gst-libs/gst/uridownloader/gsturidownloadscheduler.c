@@ -0,0 +1,628 @@
+/* GStreamer
+ *
+ * gsturidownloadscheduler.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* The scheduler runs several #GstUriDownloader in parallel on behalf of
+ * the adaptive demuxers. Requests are queued per stream and handed back in
+ * the order they were queued, whatever order the downloads finish in.
+ *
+ * At most max-in-flight requests of a stream are downloading at the same
+ * time, and no new request is started while the completed but not yet
+ * popped fragments hold more than max-bytes. The request at the head of a
+ * stream queue is always allowed to start, so a consumer waiting on it can
+ * never be blocked by data it has not popped from other streams. */
+
+#include <glib.h>
+#include "gsturidownloader.h"
+#include "gsturidownloadscheduler.h"
+#include "gstbandwidthestimator.h"
+
+GST_DEBUG_CATEGORY_STATIC (uridownloadscheduler_debug);
+#define GST_CAT_DEFAULT uridownloadscheduler_debug
+
+#define GST_URI_DOWNLOAD_SCHEDULER_GET_PRIVATE(obj)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+    GST_TYPE_URI_DOWNLOAD_SCHEDULER, GstUriDownloadSchedulerPrivate))
+
+typedef struct _GstUriDownloadStream GstUriDownloadStream;
+typedef struct _GstUriDownloadRequest GstUriDownloadRequest;
+
+struct _GstUriDownloadStream
+{
+  guint id;
+  GQueue requests;              /* GstUriDownloadRequest, in push order */
+  guint running;                /* requests being downloaded */
+};
+
+struct _GstUriDownloadRequest
+{
+  GstUriDownloadStream *stream;
+  gchar *uri;
+  gint64 range_start;
+  gint64 range_end;
+  gpointer user_data;
+  GDestroyNotify notify;
+
+  GstUriDownloader *downloader; /* set while a worker is fetching */
+  GstFragment *fragment;
+  guint64 size;
+  gboolean running;
+  gboolean done;
+  gboolean cancelled;           /* flushed while running, freed by the worker */
+};
+
+struct _GstUriDownloadSchedulerPrivate
+{
+  GMutex lock;
+  GCond cond;
+
+  GThreadPool *pool;
+  GQueue idle;                  /* GstUriDownloader not in use */
+  GList *streams;
+  GstBandwidthEstimator *estimator;     /* not owned */
+
+  guint max_in_flight;
+  guint64 max_bytes;
+  guint64 bytes;                /* size of the done requests not popped yet */
+  gboolean cancelled;
+};
+
+static void gst_uri_download_scheduler_dispose (GObject * object);
+static void gst_uri_download_scheduler_finalize (GObject * object);
+
+static void gst_uri_download_scheduler_worker (gpointer data,
+    gpointer user_data);
+
+#define _do_init \
+{ \
+  GST_DEBUG_CATEGORY_INIT (uridownloadscheduler_debug, "uridownloadscheduler", \
+      0, "URI download scheduler"); \
+}
+
+G_DEFINE_TYPE_WITH_CODE (GstUriDownloadScheduler, gst_uri_download_scheduler,
+    GST_TYPE_OBJECT, _do_init);
+
+static void
+gst_uri_download_scheduler_class_init (GstUriDownloadSchedulerClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  g_type_class_add_private (klass, sizeof (GstUriDownloadSchedulerPrivate));
+
+  gobject_class->dispose = gst_uri_download_scheduler_dispose;
+  gobject_class->finalize = gst_uri_download_scheduler_finalize;
+}
+
+static void
+gst_uri_download_scheduler_init (GstUriDownloadScheduler * scheduler)
+{
+  GstUriDownloadSchedulerPrivate *priv;
+
+  priv = scheduler->priv = GST_URI_DOWNLOAD_SCHEDULER_GET_PRIVATE (scheduler);
+
+  g_mutex_init (&priv->lock);
+  g_cond_init (&priv->cond);
+  g_queue_init (&priv->idle);
+
+  /* the number of threads is bounded by the in-flight limit */
+  priv->pool = g_thread_pool_new (gst_uri_download_scheduler_worker,
+      scheduler, -1, FALSE, NULL);
+
+  priv->max_in_flight = 1;
+  priv->max_bytes = 0;
+}
+
+static void
+gst_uri_download_request_free (GstUriDownloadRequest * req)
+{
+  if (req->notify)
+    req->notify (req->user_data);
+  if (req->fragment)
+    g_object_unref (req->fragment);
+  g_free (req->uri);
+  g_slice_free (GstUriDownloadRequest, req);
+}
+
+static void
+gst_uri_download_scheduler_dispose (GObject * object)
+{
+  GstUriDownloadScheduler *scheduler = GST_URI_DOWNLOAD_SCHEDULER (object);
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+
+  if (priv->pool) {
+    /* make the running downloads return and wait for the workers */
+    gst_uri_download_scheduler_cancel (scheduler);
+    g_thread_pool_free (priv->pool, FALSE, TRUE);
+    priv->pool = NULL;
+  }
+
+  while (!g_queue_is_empty (&priv->idle))
+    gst_object_unref (g_queue_pop_head (&priv->idle));
+
+  G_OBJECT_CLASS (gst_uri_download_scheduler_parent_class)->dispose (object);
+}
+
+static void
+gst_uri_download_scheduler_finalize (GObject * object)
+{
+  GstUriDownloadScheduler *scheduler = GST_URI_DOWNLOAD_SCHEDULER (object);
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GList *walk;
+
+  for (walk = priv->streams; walk; walk = walk->next) {
+    GstUriDownloadStream *stream = walk->data;
+
+    g_queue_foreach (&stream->requests,
+        (GFunc) gst_uri_download_request_free, NULL);
+    g_queue_clear (&stream->requests);
+    g_slice_free (GstUriDownloadStream, stream);
+  }
+  g_list_free (priv->streams);
+
+  g_mutex_clear (&priv->lock);
+  g_cond_clear (&priv->cond);
+
+  G_OBJECT_CLASS (gst_uri_download_scheduler_parent_class)->finalize (object);
+}
+
+GstUriDownloadScheduler *
+gst_uri_download_scheduler_new (void)
+{
+  return g_object_new (GST_TYPE_URI_DOWNLOAD_SCHEDULER, NULL);
+}
+
+static GstUriDownloadStream *
+gst_uri_download_scheduler_get_stream (GstUriDownloadScheduler * scheduler,
+    guint id)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GstUriDownloadStream *stream;
+  GList *walk;
+
+  for (walk = priv->streams; walk; walk = walk->next) {
+    stream = walk->data;
+    if (stream->id == id)
+      return stream;
+  }
+
+  stream = g_slice_new0 (GstUriDownloadStream);
+  stream->id = id;
+  g_queue_init (&stream->requests);
+  priv->streams = g_list_append (priv->streams, stream);
+
+  return stream;
+}
+
+/* called with the lock */
+static void
+gst_uri_download_scheduler_schedule (GstUriDownloadScheduler * scheduler)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GList *walk, *l;
+
+  if (priv->cancelled)
+    return;
+
+  for (walk = priv->streams; walk; walk = walk->next) {
+    GstUriDownloadStream *stream = walk->data;
+
+    for (l = stream->requests.head; l; l = l->next) {
+      GstUriDownloadRequest *req = l->data;
+
+      if (req->running || req->done)
+        continue;
+
+      /* start in queue order only */
+      if (stream->running >= priv->max_in_flight)
+        break;
+      if (l != stream->requests.head && priv->max_bytes > 0
+          && priv->bytes >= priv->max_bytes)
+        break;
+
+      GST_DEBUG_OBJECT (scheduler, "Starting download of %s for stream %u",
+          req->uri, stream->id);
+      req->running = TRUE;
+      stream->running++;
+      g_thread_pool_push (priv->pool, req, NULL);
+    }
+  }
+}
+
+static void
+gst_uri_download_scheduler_worker (gpointer data, gpointer user_data)
+{
+  GstUriDownloadScheduler *scheduler = user_data;
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GstUriDownloadRequest *req = data;
+  GstUriDownloader *downloader;
+  GstFragment *fragment = NULL;
+  GstBandwidthEstimator *estimator;
+  GstBandwidthEstimatorDownload download;
+  guint64 size = 0;
+  gboolean cancelled;
+
+  g_mutex_lock (&priv->lock);
+  downloader = g_queue_pop_head (&priv->idle);
+  if (downloader == NULL)
+    downloader = gst_uri_downloader_new ();
+  req->downloader = downloader;
+  estimator = priv->estimator;
+  cancelled = req->cancelled || priv->cancelled;
+  g_mutex_unlock (&priv->lock);
+
+  if (!cancelled) {
+    if (estimator)
+      gst_bandwidth_estimator_download_start (estimator, &download,
+          gst_util_get_timestamp ());
+
+    fragment = gst_uri_downloader_fetch_uri_with_range (downloader, req->uri,
+        req->range_start, req->range_end);
+    if (fragment) {
+      GstBuffer *buffer = gst_fragment_get_buffer (fragment);
+
+      if (buffer) {
+        size = gst_buffer_get_size (buffer);
+        gst_buffer_unref (buffer);
+      }
+    }
+
+    if (estimator)
+      gst_bandwidth_estimator_download_stop (estimator, &download, size,
+          gst_util_get_timestamp ());
+  }
+
+  g_mutex_lock (&priv->lock);
+  req->downloader = NULL;
+  gst_uri_downloader_reset (downloader);
+  g_queue_push_head (&priv->idle, downloader);
+
+  req->stream->running--;
+  req->running = FALSE;
+
+  if (req->cancelled) {
+    GST_DEBUG_OBJECT (scheduler, "Download of %s was flushed", req->uri);
+    if (fragment)
+      g_object_unref (fragment);
+    gst_uri_download_request_free (req);
+  } else {
+    req->done = TRUE;
+    req->fragment = fragment;
+    req->size = size;
+    priv->bytes += size;
+    GST_DEBUG_OBJECT (scheduler, "Download of %s %s (%" G_GUINT64_FORMAT
+        " bytes, %" G_GUINT64_FORMAT " bytes buffered)", req->uri,
+        fragment ? "done" : "failed", req->size, priv->bytes);
+  }
+
+  gst_uri_download_scheduler_schedule (scheduler);
+  g_cond_broadcast (&priv->cond);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_uri_download_scheduler_set_limits:
+ * @scheduler: a #GstUriDownloadScheduler
+ * @max_in_flight: maximum number of running downloads per stream
+ * @max_bytes: maximum number of downloaded bytes waiting to be popped before
+ *    downloads ahead of the stream heads are held back, or 0 for no limit
+ */
+void
+gst_uri_download_scheduler_set_limits (GstUriDownloadScheduler * scheduler,
+    guint max_in_flight, guint64 max_bytes)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->max_in_flight = MAX (max_in_flight, 1);
+  priv->max_bytes = max_bytes;
+  gst_uri_download_scheduler_schedule (scheduler);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_uri_download_scheduler_set_bandwidth_estimator:
+ * @scheduler: a #GstUriDownloadScheduler
+ * @estimator: (allow-none): the #GstBandwidthEstimator to feed, or %NULL
+ *
+ * Makes every download add a sample to @estimator, taking into account the
+ * other downloads running at the same time. @estimator must stay valid
+ * until the scheduler is disposed or another estimator is set.
+ */
+void
+gst_uri_download_scheduler_set_bandwidth_estimator (GstUriDownloadScheduler *
+    scheduler, GstBandwidthEstimator * estimator)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->estimator = estimator;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_uri_download_scheduler_push:
+ * @scheduler: a #GstUriDownloadScheduler
+ * @stream: the stream the request belongs to
+ * @uri: the uri to download, or %NULL for a request that completes at once
+ * @range_start: the start of the byte range
+ * @range_end: the end of the byte range, or -1
+ * @user_data: data handed back when the request is popped
+ * @notify: called on @user_data if the request is dropped
+ *
+ * Queues a download at the end of @stream. A %NULL @uri can be used to
+ * queue a marker that keeps its position relative to the downloads.
+ */
+void
+gst_uri_download_scheduler_push (GstUriDownloadScheduler * scheduler,
+    guint stream, const gchar * uri, gint64 range_start, gint64 range_end,
+    gpointer user_data, GDestroyNotify notify)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GstUriDownloadRequest *req;
+
+  req = g_slice_new0 (GstUriDownloadRequest);
+  req->uri = g_strdup (uri);
+  req->range_start = range_start;
+  req->range_end = range_end;
+  req->user_data = user_data;
+  req->notify = notify;
+  req->done = (uri == NULL);
+
+  g_mutex_lock (&priv->lock);
+  req->stream = gst_uri_download_scheduler_get_stream (scheduler, stream);
+  g_queue_push_tail (&req->stream->requests, req);
+  gst_uri_download_scheduler_schedule (scheduler);
+  if (req->done)
+    g_cond_broadcast (&priv->cond);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_uri_download_scheduler_pop:
+ * @scheduler: a #GstUriDownloadScheduler
+ * @stream: the stream to pop from
+ * @wait: whether to wait for the download at the head of @stream
+ * @fragment: (out) (transfer full): the downloaded fragment, or %NULL if the
+ *    download failed or the request was a marker
+ * @user_data: (out) (transfer full): the data given when pushing
+ *
+ * Returns: %TRUE if a request was popped, %FALSE if @stream is empty, its
+ * head is not done and @wait is %FALSE, or the scheduler was cancelled
+ */
+gboolean
+gst_uri_download_scheduler_pop (GstUriDownloadScheduler * scheduler,
+    guint stream, gboolean wait, GstFragment ** fragment, gpointer * user_data)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GstUriDownloadStream *s;
+  GstUriDownloadRequest *req;
+
+  g_mutex_lock (&priv->lock);
+  s = gst_uri_download_scheduler_get_stream (scheduler, stream);
+  while (TRUE) {
+    if (priv->cancelled)
+      goto not_popped;
+    req = g_queue_peek_head (&s->requests);
+    if (req == NULL)
+      goto not_popped;
+    if (req->done)
+      break;
+    if (!wait)
+      goto not_popped;
+    g_cond_wait (&priv->cond, &priv->lock);
+  }
+
+  g_queue_pop_head (&s->requests);
+  priv->bytes -= req->size;
+
+  if (fragment)
+    *fragment = req->fragment;
+  else if (req->fragment)
+    g_object_unref (req->fragment);
+  if (user_data)
+    *user_data = req->user_data;
+  else if (req->notify)
+    req->notify (req->user_data);
+
+  g_free (req->uri);
+  g_slice_free (GstUriDownloadRequest, req);
+
+  gst_uri_download_scheduler_schedule (scheduler);
+  g_mutex_unlock (&priv->lock);
+
+  return TRUE;
+
+not_popped:
+  g_mutex_unlock (&priv->lock);
+  return FALSE;
+}
+
+/**
+ * gst_uri_download_scheduler_peek:
+ * @scheduler: a #GstUriDownloadScheduler
+ * @stream: the stream to look at
+ *
+ * Returns: (transfer none): the user data of the request at the head of
+ * @stream, or %NULL if it is empty
+ */
+gpointer
+gst_uri_download_scheduler_peek (GstUriDownloadScheduler * scheduler,
+    guint stream)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GstUriDownloadRequest *req;
+  gpointer ret = NULL;
+
+  g_mutex_lock (&priv->lock);
+  req = g_queue_peek_head (&gst_uri_download_scheduler_get_stream (scheduler,
+          stream)->requests);
+  if (req)
+    ret = req->user_data;
+  g_mutex_unlock (&priv->lock);
+
+  return ret;
+}
+
+/**
+ * gst_uri_download_scheduler_get_n_pending:
+ * @scheduler: a #GstUriDownloadScheduler
+ * @stream: the stream to look at
+ *
+ * Returns: the number of requests of @stream that were not popped yet
+ */
+guint
+gst_uri_download_scheduler_get_n_pending (GstUriDownloadScheduler * scheduler,
+    guint stream)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  guint ret;
+
+  g_mutex_lock (&priv->lock);
+  ret = g_queue_get_length (&gst_uri_download_scheduler_get_stream (scheduler,
+          stream)->requests);
+  g_mutex_unlock (&priv->lock);
+
+  return ret;
+}
+
+/**
+ * gst_uri_download_scheduler_wait:
+ * @scheduler: a #GstUriDownloadScheduler
+ * @end_time: the monotonic time to wait until, or -1 to wait forever
+ *
+ * Waits until the request at the head of any stream is done.
+ *
+ * Returns: %TRUE if a request can be popped, %FALSE if the scheduler was
+ * cancelled, @end_time was reached or no request is pending
+ */
+gboolean
+gst_uri_download_scheduler_wait (GstUriDownloadScheduler * scheduler,
+    gint64 end_time)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  gboolean ret = FALSE;
+
+  g_mutex_lock (&priv->lock);
+  while (!priv->cancelled) {
+    gboolean pending = FALSE;
+    GList *walk;
+
+    for (walk = priv->streams; walk; walk = walk->next) {
+      GstUriDownloadStream *stream = walk->data;
+      GstUriDownloadRequest *req = g_queue_peek_head (&stream->requests);
+
+      if (req) {
+        pending = TRUE;
+        if (req->done)
+          break;
+      }
+    }
+    if (walk != NULL) {
+      ret = TRUE;
+      break;
+    }
+    if (!pending)
+      break;
+
+    if (end_time == -1)
+      g_cond_wait (&priv->cond, &priv->lock);
+    else if (!g_cond_wait_until (&priv->cond, &priv->lock, end_time)
+        && g_get_monotonic_time () >= end_time)
+      break;
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return ret;
+}
+
+/* called with the lock */
+static void
+gst_uri_download_scheduler_flush_stream (GstUriDownloadScheduler * scheduler,
+    GstUriDownloadStream * stream)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GstUriDownloadRequest *req;
+
+  while ((req = g_queue_pop_head (&stream->requests))) {
+    if (req->running) {
+      req->cancelled = TRUE;
+      if (req->downloader)
+        gst_uri_downloader_cancel (req->downloader);
+    } else {
+      priv->bytes -= req->size;
+      gst_uri_download_request_free (req);
+    }
+  }
+}
+
+/**
+ * gst_uri_download_scheduler_flush:
+ * @scheduler: a #GstUriDownloadScheduler
+ * @stream: the stream to flush
+ *
+ * Drops all requests of @stream. Running downloads are cancelled.
+ */
+void
+gst_uri_download_scheduler_flush (GstUriDownloadScheduler * scheduler,
+    guint stream)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+
+  g_mutex_lock (&priv->lock);
+  gst_uri_download_scheduler_flush_stream (scheduler,
+      gst_uri_download_scheduler_get_stream (scheduler, stream));
+  gst_uri_download_scheduler_schedule (scheduler);
+  g_cond_broadcast (&priv->cond);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_uri_download_scheduler_cancel:
+ * @scheduler: a #GstUriDownloadScheduler
+ *
+ * Drops all requests, cancels the running downloads and makes all waiting
+ * calls return. Nothing is downloaded until gst_uri_download_scheduler_reset()
+ * is called.
+ */
+void
+gst_uri_download_scheduler_cancel (GstUriDownloadScheduler * scheduler)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+  GList *walk;
+
+  g_mutex_lock (&priv->lock);
+  GST_DEBUG_OBJECT (scheduler, "Cancelling all downloads");
+  priv->cancelled = TRUE;
+  for (walk = priv->streams; walk; walk = walk->next)
+    gst_uri_download_scheduler_flush_stream (scheduler, walk->data);
+  g_cond_broadcast (&priv->cond);
+  g_mutex_unlock (&priv->lock);
+}
+
+void
+gst_uri_download_scheduler_reset (GstUriDownloadScheduler * scheduler)
+{
+  GstUriDownloadSchedulerPrivate *priv = scheduler->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->cancelled = FALSE;
+  g_mutex_unlock (&priv->lock);
+}
@@ -0,0 +1,71 @@
+/* GStreamer
+ *
+ * gsturidownloadscheduler.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GSTURI_DOWNLOAD_SCHEDULER_H__
+#define __GSTURI_DOWNLOAD_SCHEDULER_H__
+
+#include <glib-object.h>
+#include <gst/gst.h>
+#include "gstfragment.h"
+#include "gstbandwidthestimator.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_URI_DOWNLOAD_SCHEDULER (gst_uri_download_scheduler_get_type())
+#define GST_URI_DOWNLOAD_SCHEDULER(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_URI_DOWNLOAD_SCHEDULER,GstUriDownloadScheduler))
+#define GST_URI_DOWNLOAD_SCHEDULER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_URI_DOWNLOAD_SCHEDULER,GstUriDownloadSchedulerClass))
+#define GST_IS_URI_DOWNLOAD_SCHEDULER(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_URI_DOWNLOAD_SCHEDULER))
+#define GST_IS_URI_DOWNLOAD_SCHEDULER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_URI_DOWNLOAD_SCHEDULER))
+
+typedef struct _GstUriDownloadScheduler GstUriDownloadScheduler;
+typedef struct _GstUriDownloadSchedulerPrivate GstUriDownloadSchedulerPrivate;
+typedef struct _GstUriDownloadSchedulerClass GstUriDownloadSchedulerClass;
+
+struct _GstUriDownloadScheduler
+{
+  GstObject parent;
+
+  GstUriDownloadSchedulerPrivate *priv;
+};
+
+struct _GstUriDownloadSchedulerClass
+{
+  GstObjectClass parent_class;
+
+  /*< private >*/
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+GType gst_uri_download_scheduler_get_type (void);
+
+GstUriDownloadScheduler * gst_uri_download_scheduler_new (void);
+void gst_uri_download_scheduler_set_limits (GstUriDownloadScheduler * scheduler, guint max_in_flight, guint64 max_bytes);
+void gst_uri_download_scheduler_set_bandwidth_estimator (GstUriDownloadScheduler * scheduler, GstBandwidthEstimator * estimator);
+void gst_uri_download_scheduler_push (GstUriDownloadScheduler * scheduler, guint stream, const gchar * uri, gint64 range_start, gint64 range_end, gpointer user_data, GDestroyNotify notify);
+gboolean gst_uri_download_scheduler_pop (GstUriDownloadScheduler * scheduler, guint stream, gboolean wait, GstFragment ** fragment, gpointer * user_data);
+gpointer gst_uri_download_scheduler_peek (GstUriDownloadScheduler * scheduler, guint stream);
+guint gst_uri_download_scheduler_get_n_pending (GstUriDownloadScheduler * scheduler, guint stream);
+gboolean gst_uri_download_scheduler_wait (GstUriDownloadScheduler * scheduler, gint64 end_time);
+void gst_uri_download_scheduler_flush (GstUriDownloadScheduler * scheduler, guint stream);
+void gst_uri_download_scheduler_cancel (GstUriDownloadScheduler * scheduler);
+void gst_uri_download_scheduler_reset (GstUriDownloadScheduler * scheduler);
+
+G_END_DECLS
+#endif /* __GSTURI_DOWNLOAD_SCHEDULER_H__ */
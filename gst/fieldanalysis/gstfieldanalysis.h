@@ -63,6 +63,7 @@ typedef struct _GstFieldAnalysisClass GstFieldAnalysisClass;
 typedef struct _FieldAnalysisFields FieldAnalysisFields;
 typedef struct _FieldAnalysisHistory FieldAnalysisHistory;
 typedef struct _FieldAnalysis FieldAnalysis;
+typedef struct _FieldAnalysisStripe FieldAnalysisStripe;
 
 typedef enum
 {
@@ -108,6 +109,22 @@ typedef enum
   METHOD_5_TAP
 } FieldAnalysisCombMethod;
 
+/* the rows of the frame, or of blocks, a metric is computed on by one thread */
+struct _FieldAnalysisStripe
+{
+  gint start, end;
+  /* results */
+  guint64 sum;
+  guint64 max_block_score;
+  /* scratch for windowed comb detection */
+  guint8 *comb_mask;
+  guint *block_scores;
+  gint scratch_width;
+};
+
+typedef void (*FieldAnalysisStripeFunc) (GstFieldAnalysis *,
+    FieldAnalysisFields (*)[2], FieldAnalysisStripe *);
+
 struct _GstFieldAnalysis
 {
   GstElement element;
@@ -119,12 +136,9 @@ struct _GstFieldAnalysis
   GstVideoInfo vinfo;
   gfloat (*same_field) (GstFieldAnalysis *, FieldAnalysisFields (*)[2]);
   gfloat (*same_frame) (GstFieldAnalysis *, FieldAnalysisFields (*)[2]);
-  guint64 (*block_score_for_row) (GstFieldAnalysis *, FieldAnalysisFields (*)[2], guint8 *, guint8 *);
   gboolean is_telecine;
   gboolean first_buffer; /* indicates the first buffer for which a buffer will be output
                           * after a discont or flushing seek */
-  guint8 *comb_mask;
-  guint *block_scores;
   gboolean flushing;     /* indicates whether we are flushing or not */
 
   /* properties */
@@ -135,6 +149,20 @@ struct _GstFieldAnalysis
   guint64 block_width, block_height; /* width/height of window used for comb clusted detection */
   guint64 block_thresh;
   guint64 ignored_lines;
+  FieldAnalysisCombMethod comb_method;
+  guint threads;
+
+  /* the metrics are computed in stripes by the streaming thread and the
+   * threads of the pool */
+  FieldAnalysisStripe *stripes;
+  guint n_stripes;
+  GThreadPool *pool;
+  GMutex lock;
+  GCond cond;
+  guint n_pending;
+  /* the metric being computed, for the threads */
+  FieldAnalysisStripeFunc stripe_func;
+  FieldAnalysisFields (*history)[2];
 };
 
 struct _GstFieldAnalysisClass
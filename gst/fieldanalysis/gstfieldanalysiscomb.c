@@ -0,0 +1,258 @@
+/*
+ * GStreamer
+ * Copyright (C) 2011 Robert Swain <robert.swain@collabora.co.uk>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* The comb detection metrics of the windowed comb frame metric, computed a
+ * row at a time so that they can be vectorized. A sample is combed if it
+ * differs from the samples above and below it, which come from the other
+ * field, in the same direction by more than the spatial threshold, and the
+ * comb method agrees. The block score counts the combed samples whose left
+ * and right neighbours are combed too. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "gstfieldanalysiscomb.h"
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static inline gboolean
+comb_sample (FieldAnalysisCombMethod method, gint fjm2, gint fjm1, gint fj,
+    gint fjp1, gint fjp2, gint64 spatial_thresh)
+{
+  gint diff1 = fj - fjm1;
+  gint diff2 = fj - fjp1;
+
+  /* change in the same direction */
+  if (!((diff1 > spatial_thresh && diff2 > spatial_thresh)
+          || (diff1 < -spatial_thresh && diff2 < -spatial_thresh)))
+    return FALSE;
+
+  switch (method) {
+    case METHOD_32DETECT:
+      return abs (fj - fjm2) < 10 && abs (fj - fjm1) > 15;
+    case METHOD_IS_COMBED:
+      return (gint64) (fjm1 - fj) * (fjp1 - fj) >
+          spatial_thresh * spatial_thresh;
+    case METHOD_5_TAP:
+    default:
+      return abs (fjm2 + (fj << 2) + fjp2 - 3 * (fjm1 + fjp1)) >
+          6 * spatial_thresh;
+  }
+}
+
+#if defined (__SSE2__)
+/* loads 16 luma samples as two vectors of 8 16 bit values */
+static inline void
+load_samples (const guint8 * p, gint incr, __m128i * lo, __m128i * hi)
+{
+  if (incr == 1) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+
+    *lo = _mm_unpacklo_epi8 (v, _mm_setzero_si128 ());
+    *hi = _mm_unpackhi_epi8 (v, _mm_setzero_si128 ());
+  } else {
+    /* packed 4:2:2, luma is every other byte */
+    const __m128i mask = _mm_set1_epi16 (0x00ff);
+
+    *lo = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) p), mask);
+    *hi = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (p + 16)), mask);
+  }
+}
+
+static inline __m128i
+abs_epi16 (__m128i v)
+{
+  return _mm_max_epi16 (v, _mm_sub_epi16 (_mm_setzero_si128 (), v));
+}
+
+/* all bits set for the combed samples */
+static inline __m128i
+comb_samples (FieldAnalysisCombMethod method, __m128i fjm2, __m128i fjm1,
+    __m128i fj, __m128i fjp1, __m128i fjp2, __m128i thresh)
+{
+  const __m128i nthresh = _mm_sub_epi16 (_mm_setzero_si128 (), thresh);
+  __m128i diff1 = _mm_sub_epi16 (fj, fjm1);
+  __m128i diff2 = _mm_sub_epi16 (fj, fjp1);
+  __m128i same, res;
+
+  same = _mm_or_si128 (_mm_and_si128 (_mm_cmpgt_epi16 (diff1, thresh),
+          _mm_cmpgt_epi16 (diff2, thresh)),
+      _mm_and_si128 (_mm_cmplt_epi16 (diff1, nthresh),
+          _mm_cmplt_epi16 (diff2, nthresh)));
+
+  switch (method) {
+    case METHOD_32DETECT:
+      res = _mm_and_si128 (_mm_cmplt_epi16 (abs_epi16 (_mm_sub_epi16 (fj,
+                      fjm2)), _mm_set1_epi16 (10)),
+          _mm_cmpgt_epi16 (abs_epi16 (diff1), _mm_set1_epi16 (15)));
+      break;
+    case METHOD_IS_COMBED:{
+      /* where same is set both differences have the same sign, so the
+       * product is positive and fits in 16 bits, compare it unsigned */
+      const __m128i sign = _mm_set1_epi16 ((gint16) 0x8000);
+      __m128i prod = _mm_mullo_epi16 (diff1, diff2);
+
+      res = _mm_cmpgt_epi16 (_mm_xor_si128 (prod, sign),
+          _mm_xor_si128 (_mm_mullo_epi16 (thresh, thresh), sign));
+      break;
+    }
+    case METHOD_5_TAP:
+    default:{
+      __m128i sum;
+
+      sum = _mm_add_epi16 (_mm_add_epi16 (fjm2, fjp2),
+          _mm_slli_epi16 (fj, 2));
+      sum = _mm_sub_epi16 (sum, _mm_mullo_epi16 (_mm_add_epi16 (fjm1, fjp1),
+              _mm_set1_epi16 (3)));
+      res = _mm_cmpgt_epi16 (abs_epi16 (sum),
+          _mm_mullo_epi16 (thresh, _mm_set1_epi16 (6)));
+      break;
+    }
+  }
+
+  return _mm_and_si128 (same, res);
+}
+#endif
+
+/**
+ * fieldanalysis_comb_mask_row:
+ * @method: the comb detection method
+ * @mask: width + 2 bytes, set to 1 for the combed samples with one sample
+ *   of padding on each side
+ * @lines: the lines two and one above, the line, and the lines one and two
+ *   below in the woven frame
+ * @incr: the distance between two luma samples
+ * @width: the number of samples
+ * @spatial_thresh: the spatial threshold
+ */
+void
+fieldanalysis_comb_mask_row (FieldAnalysisCombMethod method, guint8 * mask,
+    const guint8 * const lines[5], gint incr, gint width,
+    gint64 spatial_thresh)
+{
+  gint i = 0;
+
+  /* the samples at the edges only need their inner neighbour combed */
+  mask[0] = 1;
+  mask[width + 1] = 1;
+  mask++;
+
+#if defined (__SSE2__)
+  if (incr == 1 || incr == 2) {
+    /* differences of samples are at most 255, a larger threshold is never
+     * reached */
+    const __m128i thresh = _mm_set1_epi16 (CLAMP (spatial_thresh, 0, 255));
+    const __m128i one = _mm_set1_epi8 (1);
+
+    for (; i + 16 <= width; i += 16) {
+      __m128i v[5][2], lo, hi;
+      gint l;
+
+      for (l = 0; l < 5; l++)
+        load_samples (lines[l] + i * incr, incr, &v[l][0], &v[l][1]);
+
+      lo = comb_samples (method, v[0][0], v[1][0], v[2][0], v[3][0], v[4][0],
+          thresh);
+      hi = comb_samples (method, v[0][1], v[1][1], v[2][1], v[3][1], v[4][1],
+          thresh);
+      _mm_storeu_si128 ((__m128i *) (mask + i),
+          _mm_and_si128 (_mm_packs_epi16 (lo, hi), one));
+    }
+  }
+#endif
+
+  for (; i < width; i++) {
+    const gint idx = i * incr;
+
+    mask[i] = comb_sample (method, lines[0][idx], lines[1][idx],
+        lines[2][idx], lines[3][idx], lines[4][idx], spatial_thresh);
+  }
+}
+
+/**
+ * fieldanalysis_comb_score_row:
+ * @block_scores: the scores of the blocks of the row, width / block_width
+ *   values
+ * @mask: the mask from fieldanalysis_comb_mask_row()
+ * @width: the number of samples, a multiple of @block_width
+ * @block_width: the width of the blocks
+ *
+ * Adds the combed samples whose neighbours are combed to the block scores.
+ */
+void
+fieldanalysis_comb_score_row (guint * block_scores, const guint8 * mask,
+    gint width, gint block_width)
+{
+  gint b, i;
+
+  for (b = 0; b < width / block_width; b++) {
+    const guint8 *m = mask + b * block_width;
+    guint score = 0;
+
+    i = 0;
+#if defined (__SSE2__)
+    {
+      __m128i acc = _mm_setzero_si128 ();
+
+      for (; i + 16 <= block_width; i += 16) {
+        __m128i c = _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (m + i)),
+            _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (m + i + 1)),
+                _mm_loadu_si128 ((const __m128i *) (m + i + 2))));
+
+        acc = _mm_add_epi64 (acc, _mm_sad_epu8 (c, _mm_setzero_si128 ()));
+      }
+      score = _mm_cvtsi128_si32 (acc) +
+          _mm_cvtsi128_si32 (_mm_unpackhi_epi64 (acc, acc));
+    }
+#endif
+    for (; i < block_width; i++)
+      score += m[i] & m[i + 1] & m[i + 2];
+
+    block_scores[b] += score;
+  }
+}
@@ -49,7 +49,9 @@ static GstVideoFilterClass *parent_class = NULL;
 enum
 {
   PROP_0,
-  PROP_OFF_EDGE_PIXELS
+  PROP_OFF_EDGE_PIXELS,
+  PROP_INTERPOLATION,
+  PROP_THREADS
 };
 
 #define GST_GT_OFF_EDGES_PIXELS_METHOD_TYPE ( \
@@ -76,6 +78,78 @@ gst_geometric_transform_off_edges_pixels_method_get_type (void)
 
 #define DEFAULT_OFF_EDGE_PIXELS GST_GT_OFF_EDGES_PIXELS_IGNORE
 
+#define GST_GT_INTERPOLATION_METHOD_TYPE ( \
+    gst_geometric_transform_interpolation_method_get_type())
+static GType
+gst_geometric_transform_interpolation_method_get_type (void)
+{
+  static GType method_type = 0;
+
+  static const GEnumValue method_types[] = {
+    {GST_GT_INTERPOLATION_NEAREST, "Nearest neighbour", "nearest"},
+    {GST_GT_INTERPOLATION_BILINEAR, "Bilinear", "bilinear"},
+    {0, NULL, NULL}
+  };
+
+  if (!method_type) {
+    method_type =
+        g_enum_register_static ("GstGeometricTransformInterpolationMethod",
+        method_types);
+  }
+  return method_type;
+}
+
+#define DEFAULT_INTERPOLATION GST_GT_INTERPOLATION_NEAREST
+#define DEFAULT_THREADS 0
+
+/* Stores the map entry of the input position (in_x,in_y) in @entry, with the
+ * off edge pixels method applied */
+static void
+gst_geometric_transform_map_entry (GstGeometricTransform * gt,
+    gdouble in_x, gdouble in_y, gint32 * entry)
+{
+  gint trunc_x, trunc_y;
+
+  /* operate on out of edge pixels */
+  switch (gt->off_edge_pixels) {
+    case GST_GT_OFF_EDGES_PIXELS_CLAMP:
+      in_x = CLAMP (in_x, 0, gt->width - 1);
+      in_y = CLAMP (in_y, 0, gt->height - 1);
+      break;
+
+    case GST_GT_OFF_EDGES_PIXELS_WRAP:
+      in_x = mod_float (in_x, gt->width);
+      in_y = mod_float (in_y, gt->height);
+      if (in_x < 0)
+        in_x += gt->width;
+      if (in_y < 0)
+        in_y += gt->height;
+      break;
+
+    default:
+      break;
+  }
+
+  /* only map to valid pixels */
+  trunc_x = (gint) in_x;
+  trunc_y = (gint) in_y;
+  if (trunc_x < 0 || trunc_x >= gt->width || trunc_y < 0 ||
+      trunc_y >= gt->height) {
+    entry[0] = -1;
+    if (gt->interpolation == GST_GT_INTERPOLATION_BILINEAR)
+      entry[1] = -1;
+    return;
+  }
+
+  if (gt->interpolation == GST_GT_INTERPOLATION_BILINEAR) {
+    /* (gint) rounds towards 0, positions in ]-1, 0[ are pixel 0 */
+    entry[0] = MIN ((gint32) (MAX (in_x, 0) * 65536), (trunc_x << 16) | 0xffff);
+    entry[1] = MIN ((gint32) (MAX (in_y, 0) * 65536), (trunc_y << 16) | 0xffff);
+  } else {
+    entry[0] = trunc_y * gt->row_stride + trunc_x * gt->pixel_stride;
+  }
+}
+
 /* must be called with the object lock */
 static gboolean
 gst_geometric_transform_generate_map (GstGeometricTransform * gt)
@@ -84,23 +158,26 @@ gst_geometric_transform_generate_map (GstGeometricTransform * gt)
   gdouble in_x, in_y;
   gboolean ret = TRUE;
   GstGeometricTransformClass *klass;
-  gdouble *ptr;
+  gint32 *ptr;
+  gint n_entries;
+  gsize size;
 
   GST_INFO_OBJECT (gt, "Generating new transform map");
 
-  /* cleanup old map */
-  g_free (gt->map);
-  gt->map = NULL;
-
   klass = GST_GEOMETRIC_TRANSFORM_GET_CLASS (gt);
 
   /* subclass must have defined the map_func */
   g_return_val_if_fail (klass->map_func, FALSE);
 
-  /*
-   * (x,y) pairs of the inverse mapping
-   */
-  gt->map = g_malloc0 (sizeof (gdouble) * gt->width * gt->height * 2);
+  /* one entry per pixel, two with bilinear interpolation. Subclasses that
+   * generate a map for each frame reuse it */
+  n_entries = gt->interpolation == GST_GT_INTERPOLATION_BILINEAR ? 2 : 1;
+  size = sizeof (gint32) * gt->width * gt->height * n_entries;
+  if (gt->map == NULL || gt->map_size != size) {
+    g_free (gt->map);
+    gt->map = g_malloc (size);
+    gt->map_size = size;
+  }
   ptr = gt->map;
 
   for (y = 0; y < gt->height; y++) {
@@ -111,9 +188,8 @@ gst_geometric_transform_generate_map (GstGeometricTransform * gt)
         goto end;
       }
 
-      ptr[0] = in_x;
-      ptr[1] = in_y;
-      ptr += 2;
+      gst_geometric_transform_map_entry (gt, in_x, in_y, ptr);
+      ptr += n_entries;
     }
   }
 
@@ -122,11 +198,154 @@ end:
     GST_WARNING_OBJECT (gt, "Generating transform map failed");
     g_free (gt->map);
     gt->map = NULL;
+    gt->map_size = 0;
   } else
     gt->needs_remap = FALSE;
   return ret;
 }
 
+/* Nearest neighbour gathers, one for each pixel size */
+#define GATHER_NEAREST(size)                                            \
+static void                                                             \
+gst_geometric_transform_gather_##size (const gint32 * map,             \
+    const guint8 * in, guint8 * out, gint width, const guint8 * black)  \
+{                                                                       \
+  gint x;                                                               \
+                                                                        \
+  for (x = 0; x < width; x++) {                                         \
+    const guint8 *src = map[x] >= 0 ? in + map[x] : black;              \
+                                                                        \
+    memcpy (out + x * size, src, size);                                 \
+  }                                                                     \
+}
+
+GATHER_NEAREST (1);
+GATHER_NEAREST (2);
+GATHER_NEAREST (3);
+GATHER_NEAREST (4);
+
+#undef GATHER_NEAREST
+
+/* target attributes on functions using AVX2 intrinsics need GCC 4.9 */
+#if defined (HAVE_CPU_X86_64) && defined (__GNUC__) && !defined (__clang__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#include <immintrin.h>
+
+#define HAVE_AVX2_INTRINSICS 1
+
+/* gathers 8 pixels of 4 bytes at once, pixels without input pixel are
+ * masked out of the gather */
+static __attribute__ ((target ("avx2"))) void
+gst_geometric_transform_gather_4_avx2 (const gint32 * map, const guint8 * in,
+    guint8 * out, gint width, const guint8 * black)
+{
+  __m256i minus_one = _mm256_set1_epi32 (-1);
+  __m256i b;
+  gint32 black32;
+  gint x;
+
+  memcpy (&black32, black, 4);
+  b = _mm256_set1_epi32 (black32);
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m256i idx = _mm256_loadu_si256 ((const __m256i *) (map + x));
+    __m256i mask = _mm256_cmpgt_epi32 (idx, minus_one);
+
+    _mm256_storeu_si256 ((__m256i *) (out + 4 * x),
+        _mm256_mask_i32gather_epi32 (b, (const int *) in, idx, mask, 1));
+  }
+  gst_geometric_transform_gather_4 (map + x, in, out + 4 * x, width - x,
+      black);
+}
+#endif
+
+static gpointer
+gst_geometric_transform_init_gather_4 (gpointer data)
+{
+#if HAVE_AVX2_INTRINSICS
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    return gst_geometric_transform_gather_4_avx2;
+#endif
+
+  return gst_geometric_transform_gather_4;
+}
+
+static GstGeometricTransformGatherFunc
+gst_geometric_transform_get_gather (gint pixel_stride)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  switch (pixel_stride) {
+    case 1:
+      return gst_geometric_transform_gather_1;
+    case 2:
+      return gst_geometric_transform_gather_2;
+    case 3:
+      return gst_geometric_transform_gather_3;
+    case 4:
+      g_once (&once, gst_geometric_transform_init_gather_4, NULL);
+      return (GstGeometricTransformGatherFunc) once.retval;
+    default:
+      g_return_val_if_reached (NULL);
+  }
+}
+
+/* Interpolates each component from the 4 input pixels around the 16.16
+ * position, with 8 bits of fraction */
+static void
+gst_geometric_transform_bilinear_row (GstGeometricTransform * gt,
+    const gint32 * map, const guint8 * in, guint8 * out)
+{
+  gint ps = gt->pixel_stride, rs = gt->row_stride;
+  gboolean wrap = gt->off_edge_pixels == GST_GT_OFF_EDGES_PIXELS_WRAP;
+  gint x, c;
+
+  for (x = 0; x < gt->width; x++, map += 2, out += ps) {
+    const guint8 *p00, *p01, *p10, *p11;
+    guint fx, fy, x0, y0, x1, y1;
+
+    if (map[0] < 0) {
+      memcpy (out, gt->black, ps);
+      continue;
+    }
+
+    x0 = map[0] >> 16;
+    y0 = map[1] >> 16;
+    fx = (map[0] >> 8) & 0xff;
+    fy = (map[1] >> 8) & 0xff;
+    x1 = x0 + 1 < gt->width ? x0 + 1 : (wrap ? 0 : x0);
+    y1 = y0 + 1 < gt->height ? y0 + 1 : (wrap ? 0 : y0);
+
+    p00 = in + y0 * rs + x0 * ps;
+    p01 = in + y0 * rs + x1 * ps;
+    p10 = in + y1 * rs + x0 * ps;
+    p11 = in + y1 * rs + x1 * ps;
+
+    /* at most 16 + 8 + 8 bits */
+#define LERP(a, b, c, d) \
+    ((((a) * (256 - fx) + (b) * fx) * (256 - fy) + \
+        ((c) * (256 - fx) + (d) * fx) * fy + 32768) >> 16)
+    switch (gt->format) {
+      case GST_VIDEO_FORMAT_GRAY16_LE:
+        GST_WRITE_UINT16_LE (out, LERP (GST_READ_UINT16_LE (p00),
+                GST_READ_UINT16_LE (p01), GST_READ_UINT16_LE (p10),
+                GST_READ_UINT16_LE (p11)));
+        break;
+      case GST_VIDEO_FORMAT_GRAY16_BE:
+        GST_WRITE_UINT16_BE (out, LERP (GST_READ_UINT16_BE (p00),
+                GST_READ_UINT16_BE (p01), GST_READ_UINT16_BE (p10),
+                GST_READ_UINT16_BE (p11)));
+        break;
+      default:
+        for (c = 0; c < ps; c++)
+          out[c] = LERP (p00[c], p01[c], p10[c], p11[c]);
+        break;
+    }
+#undef LERP
+  }
+}
+
 static gboolean
 gst_geometric_transform_set_info (GstVideoFilter * vfilter, GstCaps * incaps,
     GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
@@ -145,8 +364,17 @@ gst_geometric_transform_set_info (GstVideoFilter * vfilter, GstCaps * incaps,
 
   gt->width = in_info->width;
   gt->height = in_info->height;
+  gt->format = GST_VIDEO_INFO_FORMAT (in_info);
   gt->row_stride = in_info->stride[0];
   gt->pixel_stride = GST_VIDEO_INFO_COMP_PSTRIDE (in_info, 0);
+  gt->gather = gst_geometric_transform_get_gather (gt->pixel_stride);
+
+  /* in AYUV black is not just all zeros:
+   * 0x10 is black for Y,
+   * 0x80 is black for Cr and Cb */
+  memset (gt->black, 0, sizeof (gt->black));
+  if (gt->format == GST_VIDEO_FORMAT_AYUV)
+    GST_WRITE_UINT32_BE (gt->black, 0xff108080);
 
   /* regenerate the map */
   GST_OBJECT_LOCK (gt);
@@ -164,46 +392,66 @@ gst_geometric_transform_set_info (GstVideoFilter * vfilter, GstCaps * incaps,
   return ret;
 }
 
+/* maps the rows of slice @slice of the frame */
 static void
-gst_geometric_transform_do_map (GstGeometricTransform * gt, guint8 * in_data,
-    guint8 * out_data, gint x, gint y, gdouble in_x, gdouble in_y)
+gst_geometric_transform_map_slice (GstGeometricTransform * gt, guint slice)
 {
-  gint in_offset;
-  gint out_offset;
+  gint y, y0, y1;
+  gint n_entries;
 
-  out_offset = y * gt->row_stride + x * gt->pixel_stride;
+  n_entries = gt->interpolation == GST_GT_INTERPOLATION_BILINEAR ? 2 : 1;
+  y0 = gt->height * slice / gt->n_slices;
+  y1 = gt->height * (slice + 1) / gt->n_slices;
 
-  /* operate on out of edge pixels */
-  switch (gt->off_edge_pixels) {
-    case GST_GT_OFF_EDGES_PIXELS_CLAMP:
-      in_x = CLAMP (in_x, 0, gt->width - 1);
-      in_y = CLAMP (in_y, 0, gt->height - 1);
-      break;
+  for (y = y0; y < y1; y++) {
+    const gint32 *map = gt->map + y * gt->width * n_entries;
+    guint8 *out = gt->out_data + y * gt->row_stride;
 
-    case GST_GT_OFF_EDGES_PIXELS_WRAP:
-      in_x = mod_float (in_x, gt->width);
-      in_y = mod_float (in_y, gt->height);
-      if (in_x < 0)
-        in_x += gt->width;
-      if (in_y < 0)
-        in_y += gt->height;
-      break;
-
-    default:
-      break;
+    if (gt->interpolation == GST_GT_INTERPOLATION_BILINEAR)
+      gst_geometric_transform_bilinear_row (gt, map, gt->in_data, out);
+    else
+      gt->gather (map, gt->in_data, out, gt->width, gt->black);
   }
+}
 
-  {
-    gint trunc_x = (gint) in_x;
-    gint trunc_y = (gint) in_y;
-    /* only set the values if the values are valid */
-    if (trunc_x >= 0 && trunc_x < gt->width && trunc_y >= 0 &&
-        trunc_y < gt->height) {
-      in_offset = trunc_y * gt->row_stride + trunc_x * gt->pixel_stride;
+static void
+gst_geometric_transform_slice_func (gpointer data, gpointer user_data)
+{
+  GstGeometricTransform *gt = user_data;
 
-      memcpy (out_data + out_offset, in_data + in_offset, gt->pixel_stride);
-    }
+  gst_geometric_transform_map_slice (gt, GPOINTER_TO_UINT (data));
+
+  g_mutex_lock (&gt->lock);
+  if (--gt->n_pending == 0)
+    g_cond_signal (&gt->cond);
+  g_mutex_unlock (&gt->lock);
+}
+
+/* maps the whole frame, the streaming thread maps the first slice */
+static void
+gst_geometric_transform_map_frame (GstGeometricTransform * gt,
+    const guint8 * in_data, guint8 * out_data)
+{
+  guint i;
+
+  gt->in_data = in_data;
+  gt->out_data = out_data;
+
+  if (!gt->pool) {
+    gst_geometric_transform_map_slice (gt, 0);
+    return;
   }
+
+  gt->n_pending = gt->n_slices - 1;
+  for (i = 1; i < gt->n_slices; i++)
+    g_thread_pool_push (gt->pool, GUINT_TO_POINTER (i), NULL);
+
+  gst_geometric_transform_map_slice (gt, 0);
+
+  g_mutex_lock (&gt->lock);
+  while (gt->n_pending > 0)
+    g_cond_wait (&gt->cond, &gt->lock);
+  g_mutex_unlock (&gt->lock);
 }
 
 static void
@@ -229,64 +477,29 @@ gst_geometric_transform_transform_frame (GstVideoFilter * vfilter,
 {
   GstGeometricTransform *gt;
   GstGeometricTransformClass *klass;
-  gint x, y;
   GstFlowReturn ret = GST_FLOW_OK;
-  gdouble *ptr;
-  guint8 *in_data;
-  guint8 *out_data;
 
   gt = GST_GEOMETRIC_TRANSFORM_CAST (vfilter);
   klass = GST_GEOMETRIC_TRANSFORM_GET_CLASS (gt);
 
-  in_data = GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0);
-  out_data = GST_VIDEO_FRAME_PLANE_DATA (out_frame, 0);
-
-  if (GST_VIDEO_FRAME_FORMAT (out_frame) == GST_VIDEO_FORMAT_AYUV) {
-    /* in AYUV black is not just all zeros:
-     * 0x10 is black for Y,
-     * 0x80 is black for Cr and Cb */
-    for (int i = 0; i < out_frame->map[0].size; i += 4)
-      GST_WRITE_UINT32_BE (out_data + i, 0xff108080);
-  } else {
-    memset (out_data, 0, out_frame->map[0].size);
-  }
-
   GST_OBJECT_LOCK (gt);
-  if (gt->precalc_map) {
-    if (gt->needs_remap) {
-      if (klass->prepare_func)
-        if (!klass->prepare_func (gt)) {
-          ret = FALSE;
-          goto end;
-        }
-      gst_geometric_transform_generate_map (gt);
-    }
-    g_return_val_if_fail (gt->map, GST_FLOW_ERROR);
-    ptr = gt->map;
-    for (y = 0; y < gt->height; y++) {
-      for (x = 0; x < gt->width; x++) {
-        /* do the mapping */
-        gst_geometric_transform_do_map (gt, in_data, out_data, x, y, ptr[0],
-            ptr[1]);
-        ptr += 2;
-      }
-    }
-  } else {
-    for (y = 0; y < gt->height; y++) {
-      for (x = 0; x < gt->width; x++) {
-        gdouble in_x, in_y;
-
-        if (klass->map_func (gt, x, y, &in_x, &in_y)) {
-          gst_geometric_transform_do_map (gt, in_data, out_data, x, y, in_x,
-              in_y);
-        } else {
-          GST_WARNING_OBJECT (gt, "Failed to do mapping for %d %d", x, y);
-          ret = GST_FLOW_ERROR;
-          goto end;
-        }
+  /* subclasses without precalculated map get a new one for each frame */
+  if (gt->needs_remap || !gt->precalc_map) {
+    if (gt->precalc_map && klass->prepare_func)
+      if (!klass->prepare_func (gt)) {
+        ret = GST_FLOW_ERROR;
+        goto end;
       }
+    if (!gst_geometric_transform_generate_map (gt)) {
+      ret = GST_FLOW_ERROR;
+      goto end;
     }
   }
+
+  gst_geometric_transform_map_frame (gt,
+      GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0),
+      GST_VIDEO_FRAME_PLANE_DATA (out_frame, 0));
+
 end:
   GST_OBJECT_UNLOCK (gt);
   return ret;
@@ -304,8 +517,19 @@ gst_geometric_transform_set_property (GObject * object, guint prop_id,
     case PROP_OFF_EDGE_PIXELS:
       GST_OBJECT_LOCK (gt);
       gt->off_edge_pixels = g_value_get_enum (value);
+      /* the map depends on it */
+      gt->needs_remap = TRUE;
+      GST_OBJECT_UNLOCK (gt);
+      break;
+    case PROP_INTERPOLATION:
+      GST_OBJECT_LOCK (gt);
+      gt->interpolation = g_value_get_enum (value);
+      gt->needs_remap = TRUE;
       GST_OBJECT_UNLOCK (gt);
       break;
+    case PROP_THREADS:
+      gt->threads = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -324,6 +548,12 @@ gst_geometric_transform_get_property (GObject * object, guint prop_id,
     case PROP_OFF_EDGE_PIXELS:
       g_value_set_enum (value, gt->off_edge_pixels);
       break;
+    case PROP_INTERPOLATION:
+      g_value_set_enum (value, gt->interpolation);
+      break;
+    case PROP_THREADS:
+      g_value_set_uint (value, gt->threads);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -331,6 +561,36 @@ gst_geometric_transform_get_property (GObject * object, guint prop_id,
 }
 
 
+static gboolean
+gst_geometric_transform_start (GstBaseTransform * trans)
+{
+  GstGeometricTransform *gt = GST_GEOMETRIC_TRANSFORM_CAST (trans);
+  GError *err = NULL;
+
+  gt->n_slices = gt->threads;
+  if (gt->n_slices == 0) {
+#if GLIB_CHECK_VERSION (2, 36, 0)
+    gt->n_slices = g_get_num_processors ();
+#else
+    gt->n_slices = 1;
+#endif
+  }
+  GST_DEBUG_OBJECT (gt, "mapping with %u threads", gt->n_slices);
+
+  /* the streaming thread maps the first slice */
+  if (gt->n_slices > 1) {
+    gt->pool = g_thread_pool_new (gst_geometric_transform_slice_func, gt,
+        gt->n_slices - 1, TRUE, &err);
+    if (!gt->pool) {
+      GST_WARNING_OBJECT (gt, "could not create threads: %s", err->message);
+      g_clear_error (&err);
+      gt->n_slices = 1;
+    }
+  }
+
+  return TRUE;
+}
+
 static gboolean
 gst_geometric_transform_stop (GstBaseTransform * trans)
 {
@@ -338,15 +598,32 @@ gst_geometric_transform_stop (GstBaseTransform * trans)
 
   GST_INFO_OBJECT (gt, "Deleting transform map");
 
+  if (gt->pool) {
+    g_thread_pool_free (gt->pool, FALSE, TRUE);
+    gt->pool = NULL;
+  }
+
   gt->width = 0;
   gt->height = 0;
 
   g_free (gt->map);
   gt->map = NULL;
+  gt->map_size = 0;
 
   return TRUE;
 }
 
+static void
+gst_geometric_transform_finalize (GObject * object)
+{
+  GstGeometricTransform *gt = GST_GEOMETRIC_TRANSFORM_CAST (object);
+
+  g_mutex_clear (&gt->lock);
+  g_cond_clear (&gt->cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 static void
 gst_geometric_transform_base_init (gpointer g_class)
 {
@@ -375,7 +652,9 @@ gst_geometric_transform_class_init (gpointer klass, gpointer class_data)
       GST_DEBUG_FUNCPTR (gst_geometric_transform_set_property);
   obj_class->get_property =
       GST_DEBUG_FUNCPTR (gst_geometric_transform_get_property);
+  obj_class->finalize = GST_DEBUG_FUNCPTR (gst_geometric_transform_finalize);
 
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_geometric_transform_start);
   trans_class->stop = GST_DEBUG_FUNCPTR (gst_geometric_transform_stop);
   trans_class->before_transform =
       GST_DEBUG_FUNCPTR (gst_geometric_transform_before_transform);
@@ -390,6 +669,19 @@ gst_geometric_transform_class_init (gpointer klass, gpointer class_data)
           "What to do with off edge pixels",
           GST_GT_OFF_EDGES_PIXELS_METHOD_TYPE, DEFAULT_OFF_EDGE_PIXELS,
           GST_PARAM_CONTROLLABLE | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (obj_class, PROP_INTERPOLATION,
+      g_param_spec_enum ("interpolation", "Interpolation",
+          "How output pixels are computed from the input pixels around the "
+          "mapped position", GST_GT_INTERPOLATION_METHOD_TYPE,
+          DEFAULT_INTERPOLATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (obj_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Number of threads mapping rows of each frame, 0 for one per "
+          "processor. Takes effect when the element starts",
+          0, 64, DEFAULT_THREADS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -398,8 +690,12 @@ gst_geometric_transform_init (GTypeInstance * instance, gpointer g_class)
   GstGeometricTransform *gt = GST_GEOMETRIC_TRANSFORM_CAST (instance);
 
   gt->off_edge_pixels = DEFAULT_OFF_EDGE_PIXELS;
+  gt->interpolation = DEFAULT_INTERPOLATION;
+  gt->threads = DEFAULT_THREADS;
   gt->precalc_map = TRUE;
   gt->needs_remap = TRUE;
+  g_mutex_init (&gt->lock);
+  g_cond_init (&gt->cond);
 }
 
 GType
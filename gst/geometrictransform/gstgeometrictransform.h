@@ -46,6 +46,12 @@ enum
   GST_GT_OFF_EDGES_PIXELS_WRAP
 };
 
+enum
+{
+  GST_GT_INTERPOLATION_NEAREST = 0,
+  GST_GT_INTERPOLATION_BILINEAR
+};
+
 typedef struct _GstGeometricTransform GstGeometricTransform;
 typedef struct _GstGeometricTransformClass GstGeometricTransformClass;
 
@@ -77,6 +83,9 @@ typedef gboolean (*GstGeometricTransformMapFunc) (GstGeometricTransform * gt,
 typedef gboolean (*GstGeometricTransformPrepareFunc) (
     GstGeometricTransform * gt);
 
+typedef void (*GstGeometricTransformGatherFunc) (const gint32 * map,
+    const guint8 * in, guint8 * out, gint width, const guint8 * black);
+
 /**
  * GstGeometricTransform:
  *
@@ -99,8 +108,28 @@ struct _GstGeometricTransform {
 
   /* properties */
   gint off_edge_pixels;
-
-  gdouble *map;
+  gint interpolation;
+  guint threads;
+
+  /* The inverse mapping for off_edge_pixels and interpolation. With nearest
+   * interpolation the byte offset of the input pixel of each output pixel,
+   * with bilinear interpolation the 16.16 fixed point (x,y) input position.
+   * Negative for output pixels without input pixel. */
+  gint32 *map;
+  gsize map_size;
+
+  /* the value of an output pixel without input pixel */
+  guint8 black[8];
+  GstGeometricTransformGatherFunc gather;
+
+  /* rows are mapped in parallel by the streaming thread and the pool */
+  guint n_slices;
+  GThreadPool *pool;
+  GMutex lock;
+  GCond cond;
+  guint n_pending;
+  const guint8 *in_data;
+  guint8 *out_data;
 };
 
 struct _GstGeometricTransformClass {
@@ -48,6 +48,7 @@ gst_inter_surface_get (const char *name)
   surface = g_malloc0 (sizeof (GstInterSurface));
   surface->name = g_strdup (name);
   g_mutex_init (&surface->mutex);
+  g_cond_init (&surface->video_cond);
   surface->audio_adapter = gst_adapter_new ();
 
   list = g_list_append (list, surface);
@@ -61,3 +62,60 @@ gst_inter_surface_unref (GstInterSurface * surface)
 {
 
 }
+
+/* Called with the surface mutex */
+void
+gst_inter_surface_publish_video (GstInterSurface * surface, GstBuffer * buffer)
+{
+  guint seqnum = surface->video_seqnum;
+
+  gst_buffer_replace (&surface->video_slots[seqnum %
+          GST_INTER_SURFACE_VIDEO_SLOTS], buffer);
+  g_atomic_int_set (&surface->video_seqnum, seqnum + 1);
+  g_cond_broadcast (&surface->video_cond);
+}
+
+/* Called with the surface mutex. The seqnum keeps counting so that the
+ * sources don't take the next frames for old ones. */
+void
+gst_inter_surface_clear_video (GstInterSurface * surface)
+{
+  gint i;
+
+  for (i = 0; i < GST_INTER_SURFACE_VIDEO_SLOTS; i++)
+    gst_buffer_replace (&surface->video_slots[i], NULL);
+}
+
+/* Can be called without the surface mutex */
+gboolean
+gst_inter_surface_has_new_video (GstInterSurface * surface, guint seqnum)
+{
+  return g_atomic_int_get (&surface->video_seqnum) != seqnum;
+}
+
+/* Called with the surface mutex. Returns the oldest frame published from
+ * *seqnum on, or the newest one if @latest, and advances *seqnum past it.
+ * Returns NULL if there is none. Frames that are skipped or were already
+ * overwritten by newer ones are added to *dropped. */
+GstBuffer *
+gst_inter_surface_consume_video (GstInterSurface * surface, guint * seqnum,
+    gboolean latest, guint * dropped)
+{
+  GstBuffer *buffer;
+  guint pending, keep;
+
+  pending = surface->video_seqnum - *seqnum;
+  if (pending == 0)
+    return NULL;
+
+  keep = latest ? 1 : GST_INTER_SURFACE_VIDEO_SLOTS;
+  if (pending > keep) {
+    *dropped += pending - keep;
+    *seqnum = surface->video_seqnum - keep;
+  }
+
+  buffer = surface->video_slots[*seqnum % GST_INTER_SURFACE_VIDEO_SLOTS];
+  (*seqnum)++;
+
+  return buffer ? gst_buffer_ref (buffer) : NULL;
+}
@@ -27,6 +27,9 @@ G_BEGIN_DECLS
 
 typedef struct _GstInterSurface GstInterSurface;
 
+/* number of video frames kept for the sources of a surface */
+#define GST_INTER_SURFACE_VIDEO_SLOTS 8
+
 struct _GstInterSurface
 {
   GMutex mutex;
@@ -39,13 +42,20 @@ struct _GstInterSurface
   int width;
   int height;
   int n_frames;
-  int video_buffer_count;
+
+  /* frame seqnum is published in slot seqnum % GST_INTER_SURFACE_VIDEO_SLOTS,
+   * video_seqnum is the seqnum of the next frame. Slots are changed with the
+   * mutex, video_seqnum is also written atomically so that sources can check
+   * for a new frame without locking. video_cond is signalled on each new
+   * frame. */
+  GstBuffer *video_slots[GST_INTER_SURFACE_VIDEO_SLOTS];
+  volatile guint video_seqnum;
+  GCond video_cond;
 
   /* audio */
   int sample_rate;
   int n_channels;
 
-  GstBuffer *video_buffer;
   GstBuffer *sub_buffer;
   GstAdapter *audio_adapter;
 };
@@ -54,6 +64,14 @@ struct _GstInterSurface
 GstInterSurface * gst_inter_surface_get (const char *name);
 void gst_inter_surface_unref (GstInterSurface *surface);
 
+void gst_inter_surface_publish_video (GstInterSurface *surface,
+    GstBuffer *buffer);
+void gst_inter_surface_clear_video (GstInterSurface *surface);
+gboolean gst_inter_surface_has_new_video (GstInterSurface *surface,
+    guint seqnum);
+GstBuffer * gst_inter_surface_consume_video (GstInterSurface *surface,
+    guint *seqnum, gboolean latest, guint *dropped);
+
 
 G_END_DECLS
 
@@ -23,6 +23,9 @@
  * in connection with an intervideosrc element in a different pipeline,
  * similar to interaudiosink and interaudiosrc.
  *
+ * The last frames are kept in a small ring, any number of intervideosrc
+ * elements can read them from the same channel.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -207,10 +210,7 @@ gst_inter_video_sink_stop (GstBaseSink * sink)
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
   g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = NULL;
+  gst_inter_surface_clear_video (intervideosink->surface);
   g_mutex_unlock (&intervideosink->surface->mutex);
 
   gst_inter_surface_unref (intervideosink->surface);
@@ -225,11 +225,7 @@ gst_inter_video_sink_render (GstBaseSink * sink, GstBuffer * buffer)
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
   g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = gst_buffer_ref (buffer);
-  intervideosink->surface->video_buffer_count = 0;
+  gst_inter_surface_publish_video (intervideosink->surface, buffer);
   g_mutex_unlock (&intervideosink->surface->mutex);
 
   return GST_FLOW_OK;
@@ -23,6 +23,16 @@
  * in connection with a intervideosink element in a different pipeline,
  * similar to interaudiosink and interaudiosrc.
  *
+ * Several intervideosrc elements can read from the same channel, each one
+ * outputs the newest frame rendered by the intervideosink, or with
+ * #GstInterVideoSrc:all-frames the frames in the order they were rendered,
+ * as long as it does not fall behind by more than a few frames. When no new
+ * frame is available the last one is sent again, or with
+ * #GstInterVideoSrc:wait-for-frame the element waits for the next one. The
+ * #GstInterVideoSrc:drop and #GstInterVideoSrc:duplicate properties count
+ * the frames that were skipped or missed because the element was too slow
+ * and the frames that were sent again.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -59,6 +69,8 @@ static void gst_inter_video_src_finalize (GObject * object);
 static gboolean gst_inter_video_src_set_caps (GstBaseSrc * src, GstCaps * caps);
 static gboolean gst_inter_video_src_start (GstBaseSrc * src);
 static gboolean gst_inter_video_src_stop (GstBaseSrc * src);
+static gboolean gst_inter_video_src_unlock (GstBaseSrc * src);
+static gboolean gst_inter_video_src_unlock_stop (GstBaseSrc * src);
 static void
 gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end);
@@ -70,9 +82,19 @@ static GstCaps *gst_inter_video_src_fixate (GstBaseSrc * src, GstCaps * caps);
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_WAIT_FOR_FRAME,
+  PROP_ALL_FRAMES,
+  PROP_DROP,
+  PROP_DUPLICATE
 };
 
+#define DEFAULT_WAIT_FOR_FRAME FALSE
+#define DEFAULT_ALL_FRAMES FALSE
+
+/* the last frame is sent again this many times before black frames */
+#define MAX_REPEATS 30
+
 /* pad templates */
 
 static GstStaticPadTemplate gst_inter_video_src_src_template =
@@ -112,6 +134,9 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
   base_src_class->set_caps = GST_DEBUG_FUNCPTR (gst_inter_video_src_set_caps);
   base_src_class->start = GST_DEBUG_FUNCPTR (gst_inter_video_src_start);
   base_src_class->stop = GST_DEBUG_FUNCPTR (gst_inter_video_src_stop);
+  base_src_class->unlock = GST_DEBUG_FUNCPTR (gst_inter_video_src_unlock);
+  base_src_class->unlock_stop =
+      GST_DEBUG_FUNCPTR (gst_inter_video_src_unlock_stop);
   base_src_class->get_times = GST_DEBUG_FUNCPTR (gst_inter_video_src_get_times);
   base_src_class->create = GST_DEBUG_FUNCPTR (gst_inter_video_src_create);
   base_src_class->fixate = GST_DEBUG_FUNCPTR (gst_inter_video_src_fixate);
@@ -121,6 +146,26 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
           "Channel name to match inter src and sink elements",
           "default", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_WAIT_FOR_FRAME,
+      g_param_spec_boolean ("wait-for-frame", "Wait for frame",
+          "Wait for a new frame instead of sending the last one again",
+          DEFAULT_WAIT_FOR_FRAME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALL_FRAMES,
+      g_param_spec_boolean ("all-frames", "All frames",
+          "Send the frames in the order they were rendered instead of "
+          "skipping to the newest one",
+          DEFAULT_ALL_FRAMES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DROP,
+      g_param_spec_uint64 ("drop", "Drop",
+          "Number of frames skipped or overwritten before they could be read",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DUPLICATE,
+      g_param_spec_uint64 ("duplicate", "Duplicate",
+          "Number of frames sent again because no new frame was available", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -130,6 +175,8 @@ gst_inter_video_src_init (GstInterVideoSrc * intervideosrc)
   gst_base_src_set_live (GST_BASE_SRC (intervideosrc), TRUE);
 
   intervideosrc->channel = g_strdup ("default");
+  intervideosrc->wait_for_frame = DEFAULT_WAIT_FOR_FRAME;
+  intervideosrc->all_frames = DEFAULT_ALL_FRAMES;
 }
 
 void
@@ -143,6 +190,12 @@ gst_inter_video_src_set_property (GObject * object, guint property_id,
       g_free (intervideosrc->channel);
       intervideosrc->channel = g_value_dup_string (value);
       break;
+    case PROP_WAIT_FOR_FRAME:
+      intervideosrc->wait_for_frame = g_value_get_boolean (value);
+      break;
+    case PROP_ALL_FRAMES:
+      intervideosrc->all_frames = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -159,6 +212,22 @@ gst_inter_video_src_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, intervideosrc->channel);
       break;
+    case PROP_WAIT_FOR_FRAME:
+      g_value_set_boolean (value, intervideosrc->wait_for_frame);
+      break;
+    case PROP_ALL_FRAMES:
+      g_value_set_boolean (value, intervideosrc->all_frames);
+      break;
+    case PROP_DROP:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->dropped);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
+    case PROP_DUPLICATE:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->duplicated);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -201,6 +270,21 @@ gst_inter_video_src_start (GstBaseSrc * src)
 
   intervideosrc->surface = gst_inter_surface_get (intervideosrc->channel);
 
+  /* start with the latest frame */
+  g_mutex_lock (&intervideosrc->surface->mutex);
+  intervideosrc->video_seqnum = intervideosrc->surface->video_seqnum;
+  if (intervideosrc->surface->video_slots[(intervideosrc->video_seqnum - 1) %
+          GST_INTER_SURFACE_VIDEO_SLOTS])
+    intervideosrc->video_seqnum--;
+  intervideosrc->flushing = FALSE;
+  g_mutex_unlock (&intervideosrc->surface->mutex);
+
+  intervideosrc->n_repeats = 0;
+  GST_OBJECT_LOCK (intervideosrc);
+  intervideosrc->dropped = 0;
+  intervideosrc->duplicated = 0;
+  GST_OBJECT_UNLOCK (intervideosrc);
+
   return TRUE;
 }
 
@@ -211,12 +295,47 @@ gst_inter_video_src_stop (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (intervideosrc, "stop");
 
+  gst_buffer_replace (&intervideosrc->last_buffer, NULL);
+
   gst_inter_surface_unref (intervideosrc->surface);
   intervideosrc->surface = NULL;
 
   return TRUE;
 }
 
+static gboolean
+gst_inter_video_src_unlock (GstBaseSrc * src)
+{
+  GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
+
+  GST_DEBUG_OBJECT (intervideosrc, "unlock");
+
+  if (intervideosrc->surface) {
+    g_mutex_lock (&intervideosrc->surface->mutex);
+    intervideosrc->flushing = TRUE;
+    g_cond_broadcast (&intervideosrc->surface->video_cond);
+    g_mutex_unlock (&intervideosrc->surface->mutex);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_inter_video_src_unlock_stop (GstBaseSrc * src)
+{
+  GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
+
+  GST_DEBUG_OBJECT (intervideosrc, "unlock_stop");
+
+  if (intervideosrc->surface) {
+    g_mutex_lock (&intervideosrc->surface->mutex);
+    intervideosrc->flushing = FALSE;
+    g_mutex_unlock (&intervideosrc->surface->mutex);
+  }
+
+  return TRUE;
+}
+
 static void
 gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end)
@@ -248,22 +367,55 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
     GstBuffer ** buf)
 {
   GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
+  GstInterSurface *surface = intervideosrc->surface;
   GstBuffer *buffer;
+  guint dropped = 0;
+  gboolean duplicate = FALSE;
 
   GST_DEBUG_OBJECT (intervideosrc, "create");
 
   buffer = NULL;
 
-  g_mutex_lock (&intervideosrc->surface->mutex);
-  if (intervideosrc->surface->video_buffer) {
-    buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
-    intervideosrc->surface->video_buffer_count++;
-    if (intervideosrc->surface->video_buffer_count >= 30) {
-      gst_buffer_unref (intervideosrc->surface->video_buffer);
-      intervideosrc->surface->video_buffer = NULL;
+  /* only lock the surface when there is something to read or wait for */
+  if (intervideosrc->wait_for_frame ||
+      gst_inter_surface_has_new_video (surface, intervideosrc->video_seqnum)) {
+    g_mutex_lock (&surface->mutex);
+    while (intervideosrc->wait_for_frame && !intervideosrc->flushing &&
+        surface->video_seqnum == intervideosrc->video_seqnum)
+      g_cond_wait (&surface->video_cond, &surface->mutex);
+    if (intervideosrc->flushing) {
+      g_mutex_unlock (&surface->mutex);
+      return GST_FLOW_FLUSHING;
     }
+    buffer = gst_inter_surface_consume_video (surface,
+        &intervideosrc->video_seqnum, !intervideosrc->all_frames, &dropped);
+    g_mutex_unlock (&surface->mutex);
+  }
+
+  if (buffer) {
+    GST_LOG_OBJECT (intervideosrc, "new frame %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
+    gst_buffer_replace (&intervideosrc->last_buffer, buffer);
+    intervideosrc->n_repeats = 0;
+  } else if (intervideosrc->last_buffer) {
+    if (intervideosrc->n_repeats < MAX_REPEATS) {
+      buffer = gst_buffer_ref (intervideosrc->last_buffer);
+      intervideosrc->n_repeats++;
+      duplicate = TRUE;
+    } else {
+      gst_buffer_replace (&intervideosrc->last_buffer, NULL);
+    }
+  }
+
+  if (dropped || duplicate) {
+    GST_DEBUG_OBJECT (intervideosrc, "dropped %u frames, duplicate %d",
+        dropped, duplicate);
+    GST_OBJECT_LOCK (intervideosrc);
+    intervideosrc->dropped += dropped;
+    if (duplicate)
+      intervideosrc->duplicated++;
+    GST_OBJECT_UNLOCK (intervideosrc);
   }
-  g_mutex_unlock (&intervideosrc->surface->mutex);
 
   if (buffer == NULL) {
     GstMapInfo map;
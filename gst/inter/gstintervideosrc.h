@@ -45,6 +45,19 @@ struct _GstInterVideoSrc
 
   GstVideoInfo info;
   int n_frames;
+
+  /* seqnum of the next frame to read from the surface */
+  guint video_seqnum;
+  GstBuffer *last_buffer;
+  int n_repeats;
+  gboolean flushing;
+
+  gboolean wait_for_frame;
+  gboolean all_frames;
+
+  /* protected by the object lock */
+  guint64 dropped;
+  guint64 duplicated;
 };
 
 struct _GstInterVideoSrcClass
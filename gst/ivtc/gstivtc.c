@@ -37,6 +37,11 @@
  * stream is inversed telecine'd back to 24 fps, yielding approximately
  * the original videotestsrc content.
  * </refsect2>
+ *
+ * Once the fields have been paired the same way for a few cadence periods,
+ * ivtc locks onto the cadence and only verifies the expected pairing on a
+ * part of the lines of each frame, until it no longer matches.  This can be
+ * disabled with the #GstIvtc:cadence-lock property.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -59,6 +64,10 @@ GST_DEBUG_CATEGORY_STATIC (gst_ivtc_debug_category);
 /* prototypes */
 
 
+static void gst_ivtc_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_ivtc_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
 static GstCaps *gst_ivtc_transform_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * filter);
 static GstCaps *gst_ivtc_fixate_caps (GstBaseTransform * trans,
@@ -74,12 +83,17 @@ static void gst_ivtc_retire_fields (GstIvtc * ivtc, int n_fields);
 static void gst_ivtc_construct_frame (GstIvtc * itvc, GstBuffer * outbuf);
 
 static int get_comb_score (GstVideoFrame * top, GstVideoFrame * bottom);
+static int get_comb_score_sampled (GstVideoFrame * top,
+    GstVideoFrame * bottom, int phase);
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_CADENCE_LOCK
 };
 
+#define DEFAULT_CADENCE_LOCK TRUE
+
 /* pad templates */
 
 #define MAX_WIDTH 2048
@@ -114,6 +128,7 @@ G_DEFINE_TYPE_WITH_CODE (GstIvtc, gst_ivtc, GST_TYPE_BASE_TRANSFORM,
 static void
 gst_ivtc_class_init (GstIvtcClass * klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   GstBaseTransformClass *base_transform_class =
       GST_BASE_TRANSFORM_CLASS (klass);
 
@@ -128,17 +143,58 @@ gst_ivtc_class_init (GstIvtcClass * klass)
       "Inverse Telecine", "Video/Filter", "Inverse Telecine Filter",
       "David Schleef <ds@schleef.org>");
 
+  gobject_class->set_property = gst_ivtc_set_property;
+  gobject_class->get_property = gst_ivtc_get_property;
   base_transform_class->transform_caps =
       GST_DEBUG_FUNCPTR (gst_ivtc_transform_caps);
   base_transform_class->fixate_caps = GST_DEBUG_FUNCPTR (gst_ivtc_fixate_caps);
   base_transform_class->set_caps = GST_DEBUG_FUNCPTR (gst_ivtc_set_caps);
   base_transform_class->sink_event = GST_DEBUG_FUNCPTR (gst_ivtc_sink_event);
   base_transform_class->transform = GST_DEBUG_FUNCPTR (gst_ivtc_transform);
+
+  g_object_class_install_property (gobject_class, PROP_CADENCE_LOCK,
+      g_param_spec_boolean ("cadence-lock", "Cadence lock",
+          "Lock onto a steady cadence and only verify it on a part of each "
+          "frame instead of comparing all the field pairings",
+          DEFAULT_CADENCE_LOCK, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
 gst_ivtc_init (GstIvtc * ivtc)
 {
+  ivtc->cadence_lock = DEFAULT_CADENCE_LOCK;
+}
+
+static void
+gst_ivtc_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstIvtc *ivtc = GST_IVTC (object);
+
+  switch (property_id) {
+    case PROP_CADENCE_LOCK:
+      ivtc->cadence_lock = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_ivtc_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstIvtc *ivtc = GST_IVTC (object);
+
+  switch (property_id) {
+    case PROP_CADENCE_LOCK:
+      g_value_set_boolean (value, ivtc->cadence_lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
 }
 
 static GstCaps *
@@ -271,6 +327,10 @@ gst_ivtc_flush (GstIvtc * ivtc)
   }
 
   gst_ivtc_retire_fields (ivtc, ivtc->n_fields);
+
+  /* the cadence has to be found again after a discontinuity */
+  ivtc->n_history = 0;
+  ivtc->cadence = 0;
 }
 
 enum
@@ -560,14 +620,149 @@ gst_ivtc_transform (GstBaseTransform * trans, GstBuffer * inbuf,
   return GST_FLOW_OK;
 }
 
+/* how the anchor field is made into a frame */
+typedef enum
+{
+  PAIRING_PREV,                 /* with the previous field */
+  PAIRING_NEXT,                 /* with the next field */
+  PAIRING_NEXT_KEEP,            /* with the next field, which is kept */
+  PAIRING_SINGLE                /* alone, interpolating the other field */
+} IvtcPairing;
+
+#define THRESHOLD 100
+
+/* compares the anchor with both neighbours */
+static IvtcPairing
+gst_ivtc_find_pairing (GstIvtc * ivtc, int anchor_index, gboolean forward_ok)
+{
+  int prev_score, next_score;
+
+  prev_score = similarity (ivtc, anchor_index - 1, anchor_index);
+  next_score = similarity (ivtc, anchor_index, anchor_index + 1);
+
+  if (prev_score < THRESHOLD) {
+    if (forward_ok && next_score < prev_score) {
+      return PAIRING_NEXT;
+    }
+    if (prev_score >= THRESHOLD / 2) {
+      GST_INFO ("borderline prev (%d, %d)", prev_score, next_score);
+    }
+    return PAIRING_PREV;
+  } else if (next_score < THRESHOLD) {
+    if (next_score >= THRESHOLD / 2) {
+      GST_INFO ("borderline prev (%d, %d)", prev_score, next_score);
+    }
+    return forward_ok ? PAIRING_NEXT : PAIRING_NEXT_KEEP;
+  }
+
+  if (prev_score < THRESHOLD * 2 || next_score < THRESHOLD * 2) {
+    GST_INFO ("borderline single (%d, %d)", prev_score, next_score);
+  }
+  return PAIRING_SINGLE;
+}
+
+/* the comb score of the pairing, on a part of the lines of the frame that
+ * changes from frame to frame */
+static int
+quick_similarity (GstIvtc * ivtc, int i1, int i2)
+{
+  GstIvtcField *f1, *f2;
+  int phase = ivtc->n_verified++;
+
+  f1 = &ivtc->fields[i1];
+  f2 = &ivtc->fields[i2];
+
+  if (f1->parity == TOP_FIELD) {
+    return get_comb_score_sampled (&f1->frame, &f2->frame, phase);
+  } else {
+    return get_comb_score_sampled (&f2->frame, &f1->frame, phase);
+  }
+}
+
+/* When locked onto a cadence, the anchor is expected to be paired like it was
+ * a cadence period ago. Only that pairing is verified, and the timing has to
+ * allow it. Returns FALSE when not locked or when the cadence broke. */
+static gboolean
+gst_ivtc_follow_cadence (GstIvtc * ivtc, int anchor_index,
+    gboolean forward_ok, IvtcPairing * pairing)
+{
+  IvtcPairing expected;
+  int score;
+
+  if (!ivtc->cadence_lock)
+    ivtc->cadence = 0;
+  if (ivtc->cadence == 0)
+    return FALSE;
+
+  expected = ivtc->history[ivtc->n_history - ivtc->cadence];
+  if (expected == PAIRING_PREV) {
+    score = quick_similarity (ivtc, anchor_index - 1, anchor_index);
+  } else if ((expected == PAIRING_NEXT) == forward_ok) {
+    score = quick_similarity (ivtc, anchor_index, anchor_index + 1);
+  } else {
+    score = G_MAXINT;
+  }
+
+  if (score >= THRESHOLD) {
+    GST_DEBUG_OBJECT (ivtc, "cadence of %d frames broken (%d)",
+        ivtc->cadence, score);
+    ivtc->cadence = 0;
+    return FALSE;
+  }
+
+  *pairing = expected;
+  return TRUE;
+}
+
+/* the cadence is locked when the pairings of the last frames repeat with the
+ * shortest period, a frame without a matching field prevents it */
+#define LOCK_FRAMES 8
+#define MAX_CADENCE (GST_IVTC_HISTORY_LENGTH / 2)
+
+static void
+gst_ivtc_update_cadence (GstIvtc * ivtc, IvtcPairing pairing)
+{
+  int period, i;
+
+  if (ivtc->n_history == GST_IVTC_HISTORY_LENGTH) {
+    memmove (ivtc->history, ivtc->history + 1,
+        sizeof (int) * (GST_IVTC_HISTORY_LENGTH - 1));
+    ivtc->n_history--;
+  }
+  ivtc->history[ivtc->n_history++] = pairing;
+
+  if (ivtc->cadence > 0 || !ivtc->cadence_lock)
+    return;
+
+  for (period = 1; period <= MAX_CADENCE; period++) {
+    int n = MAX (2 * period, LOCK_FRAMES);
+    int start = ivtc->n_history - n;
+
+    if (start < 0)
+      break;
+
+    for (i = start; i < ivtc->n_history; i++) {
+      if (ivtc->history[i] == PAIRING_SINGLE)
+        return;
+      if (i >= start + period && ivtc->history[i] != ivtc->history[i - period])
+        break;
+    }
+    if (i == ivtc->n_history) {
+      GST_DEBUG_OBJECT (ivtc, "locked onto a cadence of %d frames", period);
+      ivtc->cadence = period;
+      return;
+    }
+  }
+}
+
 static void
 gst_ivtc_construct_frame (GstIvtc * ivtc, GstBuffer * outbuf)
 {
   int anchor_index;
-  int prev_score, next_score;
   GstVideoFrame dest_frame;
   int n_retire;
   gboolean forward_ok;
+  IvtcPairing pairing;
 
   anchor_index = 1;
   if (ivtc->fields[anchor_index].ts < ivtc->current_ts) {
@@ -576,40 +771,31 @@ gst_ivtc_construct_frame (GstIvtc * ivtc, GstBuffer * outbuf)
     forward_ok = FALSE;
   }
 
-  prev_score = similarity (ivtc, anchor_index - 1, anchor_index);
-  next_score = similarity (ivtc, anchor_index, anchor_index + 1);
+  if (!gst_ivtc_follow_cadence (ivtc, anchor_index, forward_ok, &pairing))
+    pairing = gst_ivtc_find_pairing (ivtc, anchor_index, forward_ok);
+  gst_ivtc_update_cadence (ivtc, pairing);
 
   gst_video_frame_map (&dest_frame, &ivtc->src_video_info, outbuf,
       GST_MAP_WRITE);
 
-#define THRESHOLD 100
-  if (prev_score < THRESHOLD) {
-    if (forward_ok && next_score < prev_score) {
-      reconstruct (ivtc, &dest_frame, anchor_index, anchor_index + 1);
-      n_retire = anchor_index + 2;
-    } else {
-      if (prev_score >= THRESHOLD / 2) {
-        GST_INFO ("borderline prev (%d, %d)", prev_score, next_score);
-      }
+  switch (pairing) {
+    case PAIRING_PREV:
       reconstruct (ivtc, &dest_frame, anchor_index, anchor_index - 1);
       n_retire = anchor_index + 1;
-    }
-  } else if (next_score < THRESHOLD) {
-    if (next_score >= THRESHOLD / 2) {
-      GST_INFO ("borderline prev (%d, %d)", prev_score, next_score);
-    }
-    reconstruct (ivtc, &dest_frame, anchor_index, anchor_index + 1);
-    if (forward_ok) {
+      break;
+    case PAIRING_NEXT:
+      reconstruct (ivtc, &dest_frame, anchor_index, anchor_index + 1);
       n_retire = anchor_index + 2;
-    } else {
+      break;
+    case PAIRING_NEXT_KEEP:
+      reconstruct (ivtc, &dest_frame, anchor_index, anchor_index + 1);
       n_retire = anchor_index + 1;
-    }
-  } else {
-    if (prev_score < THRESHOLD * 2 || next_score < THRESHOLD * 2) {
-      GST_INFO ("borderline single (%d, %d)", prev_score, next_score);
-    }
-    reconstruct_single (ivtc, &dest_frame, anchor_index);
-    n_retire = anchor_index + 1;
+      break;
+    case PAIRING_SINGLE:
+    default:
+      reconstruct_single (ivtc, &dest_frame, anchor_index);
+      n_retire = anchor_index + 1;
+      break;
   }
 
   GST_DEBUG ("retiring %d", n_retire);
@@ -629,25 +815,23 @@ gst_ivtc_construct_frame (GstIvtc * ivtc, GstBuffer * outbuf)
 
 }
 
+/* the comb score of lines j_start to j_end - 1 */
 static int
-get_comb_score (GstVideoFrame * top, GstVideoFrame * bottom)
+get_comb_score_lines (GstVideoFrame * top, GstVideoFrame * bottom,
+    int j_start, int j_end)
 {
   int j;
   int thisline[MAX_WIDTH];
   int score = 0;
-  int height;
   int width;
   int k;
 
-  height = GST_VIDEO_FRAME_COMP_HEIGHT (top, 0);
   width = GST_VIDEO_FRAME_COMP_WIDTH (top, 0);
 
   memset (thisline, 0, sizeof (thisline));
 
   k = 0;
-  /* remove a few lines from top and bottom, as they sometimes contain
-   * artifacts */
-  for (j = 2; j < height - 2; j++) {
+  for (j = j_start; j < j_end; j++) {
     guint8 *src1 = GET_LINE_IL (top, bottom, 0, j - 1);
     guint8 *src2 = GET_LINE_IL (top, bottom, 0, j);
     guint8 *src3 = GET_LINE_IL (top, bottom, 0, j + 1);
@@ -671,11 +855,60 @@ get_comb_score (GstVideoFrame * top, GstVideoFrame * bottom)
     }
   }
 
+  return score;
+}
+
+static int
+get_comb_score (GstVideoFrame * top, GstVideoFrame * bottom)
+{
+  int score;
+  int height;
+
+  height = GST_VIDEO_FRAME_COMP_HEIGHT (top, 0);
+
+  /* remove a few lines from top and bottom, as they sometimes contain
+   * artifacts */
+  score = get_comb_score_lines (top, bottom, 2, height - 2);
+
   GST_DEBUG ("score %d", score);
 
   return score;
 }
 
+/* every SAMPLED_BANDS-th band of SAMPLED_BAND_HEIGHT lines, starting with
+ * band @phase, and scaled up to the lines of get_comb_score() */
+#define SAMPLED_BAND_HEIGHT 32
+#define SAMPLED_BANDS 4
+
+static int
+get_comb_score_sampled (GstVideoFrame * top, GstVideoFrame * bottom,
+    int phase)
+{
+  int j;
+  int score = 0;
+  int n_lines = 0;
+  int height;
+
+  height = GST_VIDEO_FRAME_COMP_HEIGHT (top, 0);
+
+  for (j = 2 + (phase % SAMPLED_BANDS) * SAMPLED_BAND_HEIGHT; j < height - 2;
+      j += SAMPLED_BANDS * SAMPLED_BAND_HEIGHT) {
+    int j_end = MIN (j + SAMPLED_BAND_HEIGHT, height - 2);
+
+    score += get_comb_score_lines (top, bottom, j, j_end);
+    n_lines += j_end - j;
+  }
+
+  /* small frames */
+  if (n_lines == 0)
+    return get_comb_score (top, bottom);
+
+  score = (gint64) score * (height - 4) / n_lines;
+  GST_DEBUG ("sampled score %d", score);
+
+  return score;
+}
+
 
 
 static gboolean
@@ -44,6 +44,8 @@ struct _GstIvtcField
 };
 
 #define GST_IVTC_MAX_FIELDS 10
+/* pairings of the last output frames remembered to find the cadence */
+#define GST_IVTC_HISTORY_LENGTH 10
 
 struct _GstIvtc
 {
@@ -58,6 +60,17 @@ struct _GstIvtc
 
   int n_fields;
   GstIvtcField fields[GST_IVTC_MAX_FIELDS];
+
+  /* properties */
+  gboolean cadence_lock;
+
+  /* the pairings chosen for the last frames, the period of the cadence
+   * they follow or 0 when not locked, and the number of frames verified
+   * since */
+  int history[GST_IVTC_HISTORY_LENGTH];
+  int n_history;
+  int cadence;
+  guint n_verified;
 };
 
 struct _GstIvtcClass
@@ -76,6 +76,24 @@ typedef enum
   SCAN_PTS
 } SCAN_MODE;
 
+/* The seek index keeps at most one point per half second of SCR */
+#define INDEX_INTERVAL              (CLOCK_FREQ / 2)
+/* The index scan probes the file at up to this many evenly spaced places */
+#define INDEX_SCAN_POINTS           1024
+#define INDEX_SCAN_MIN_STEP         (1024 * 1024)
+
+/* Index file: magic, file length, first and last SCR, number of points and
+ * the points as SCR/offset pairs, all big endian */
+#define INDEX_FILE_MAGIC            "MPSINDX1"
+#define INDEX_FILE_HEADER_SZ        36
+#define INDEX_FILE_ENTRY_SZ         16
+
+typedef struct
+{
+  guint64 scr;
+  guint64 offset;
+} GstFluPSDemuxIndexEntry;
+
 /* We clamp scr delta with 0 so negative bytes won't be possible */
 #define GSTTIME_TO_BYTES(time) \
   ((time != -1) ? gst_util_uint64_scale (MAX(0,(gint64) (GSTTIME_TO_MPEGTIME(time))), demux->scr_rate_n, demux->scr_rate_d) : -1)
@@ -97,9 +115,14 @@ enum
 {
   ARG_0,
   ARG_SYNC,
+  ARG_INDEX_LOCATION,
+  ARG_SCAN_INDEX,
   /* FILL ME */
 };
 
+#define DEFAULT_INDEX_LOCATION NULL
+#define DEFAULT_SCAN_INDEX FALSE
+
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
@@ -145,6 +168,10 @@ static void gst_flups_demux_class_init (GstFluPSDemuxClass * klass);
 static void gst_flups_demux_init (GstFluPSDemux * demux);
 static void gst_flups_demux_finalize (GstFluPSDemux * demux);
 static void gst_flups_demux_reset (GstFluPSDemux * demux);
+static void gst_flups_demux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_flups_demux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
 
 static gboolean gst_flups_demux_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event);
@@ -251,6 +278,39 @@ gst_flups_demux_class_init (GstFluPSDemuxClass * klass)
   gstelement_class = (GstElementClass *) klass;
 
   gobject_class->finalize = (GObjectFinalizeFunc) gst_flups_demux_finalize;
+  gobject_class->set_property = gst_flups_demux_set_property;
+  gobject_class->get_property = gst_flups_demux_get_property;
+
+  /**
+   * GstMpegPSDemux:index-location:
+   *
+   * File to keep the seek index of the input in. When the file exists and
+   * matches the input, it is loaded on startup so that the first seeks
+   * don't have to search the input. The index is written back when the
+   * element goes to READY and new points were added to it.
+   *
+   * The index is only used in pull mode.
+   *
+   * Since: 1.4
+   */
+  g_object_class_install_property (gobject_class, ARG_INDEX_LOCATION,
+      g_param_spec_string ("index-location", "Index location",
+          "File to load the seek index from and save it to (NULL = none)",
+          DEFAULT_INDEX_LOCATION, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstMpegPSDemux:scan-index:
+   *
+   * Fill the seek index while playing by probing the SCR at evenly spaced
+   * places of the input, one probe for every block read, so that seeks to
+   * parts that weren't played yet are fast too.
+   *
+   * Since: 1.4
+   */
+  g_object_class_install_property (gobject_class, ARG_SCAN_INDEX,
+      g_param_spec_boolean ("scan-index", "Scan index",
+          "Build the seek index of the whole input in the background",
+          DEFAULT_SCAN_INDEX, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   gstelement_class->change_state = gst_flups_demux_change_state;
 }
@@ -281,6 +341,10 @@ gst_flups_demux_init (GstFluPSDemux * demux)
   demux->adapter = gst_adapter_new ();
   demux->rev_adapter = gst_adapter_new ();
 
+  demux->index = g_array_new (FALSE, FALSE, sizeof (GstFluPSDemuxIndexEntry));
+  demux->index_location = DEFAULT_INDEX_LOCATION;
+  demux->scan_index = DEFAULT_SCAN_INDEX;
+
   gst_flups_demux_reset (demux);
 }
 
@@ -294,6 +358,9 @@ gst_flups_demux_finalize (GstFluPSDemux * demux)
   g_object_unref (demux->adapter);
   g_object_unref (demux->rev_adapter);
 
+  g_array_free (demux->index, TRUE);
+  g_free (demux->index_location);
+
   G_OBJECT_CLASS (parent_class)->finalize (G_OBJECT (demux));
 }
 
@@ -343,6 +410,52 @@ gst_flups_demux_reset (GstFluPSDemux * demux)
   gst_flups_demux_flush (demux);
   demux->have_group_id = FALSE;
   demux->group_id = G_MAXUINT;
+  g_array_set_size (demux->index, 0);
+  demux->index_dirty = FALSE;
+  demux->index_scan_pos = 0;
+}
+
+static void
+gst_flups_demux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstFluPSDemux *demux = GST_FLUPS_DEMUX (object);
+
+  switch (prop_id) {
+    case ARG_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_free (demux->index_location);
+      demux->index_location = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_SCAN_INDEX:
+      demux->scan_index = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_flups_demux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstFluPSDemux *demux = GST_FLUPS_DEMUX (object);
+
+  switch (prop_id) {
+    case ARG_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_string (value, demux->index_location);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case ARG_SCAN_INDEX:
+      g_value_set_boolean (value, demux->scan_index);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static GstFluPSStream *
@@ -1080,6 +1193,223 @@ not_supported:
   }
 }
 
+/* Returns the position of the first index point at or after @offset */
+static guint
+gst_flups_demux_index_find_offset (GstFluPSDemux * demux, guint64 offset)
+{
+  guint lo = 0, hi = demux->index->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (demux->index, GstFluPSDemuxIndexEntry, mid).offset <
+        offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Returns the position of the first index point with an SCR after @scr */
+static guint
+gst_flups_demux_index_find_scr (GstFluPSDemux * demux, guint64 scr)
+{
+  guint lo = 0, hi = demux->index->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (demux->index, GstFluPSDemuxIndexEntry, mid).scr <= scr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void
+gst_flups_demux_index_add (GstFluPSDemux * demux, guint64 scr, guint64 offset)
+{
+  GstFluPSDemuxIndexEntry entry, *prev = NULL, *next = NULL;
+  guint i;
+
+  i = gst_flups_demux_index_find_offset (demux, offset);
+  if (i > 0)
+    prev = &g_array_index (demux->index, GstFluPSDemuxIndexEntry, i - 1);
+  if (i < demux->index->len)
+    next = &g_array_index (demux->index, GstFluPSDemuxIndexEntry, i);
+
+  /* Keep the points apart, and both the SCR and the offset increasing so
+   * that the index can be searched on either. Points after an SCR
+   * discontinuity are left out by this too. */
+  if (prev && scr < prev->scr + INDEX_INTERVAL)
+    return;
+  if (next && (next->offset == offset || scr + INDEX_INTERVAL > next->scr))
+    return;
+
+  entry.scr = scr;
+  entry.offset = offset;
+  g_array_insert_val (demux->index, i, entry);
+  demux->index_dirty = TRUE;
+
+  GST_LOG_OBJECT (demux, "index point SCR %" G_GUINT64_FORMAT " at offset %"
+      G_GUINT64_FORMAT ", %u points", scr, offset, demux->index->len);
+}
+
+/* Narrows the range to search for @scr down to the index points around it */
+static void
+gst_flups_demux_index_lookup (GstFluPSDemux * demux, guint64 scr,
+    guint64 * min_scr, guint64 * min_scr_offset,
+    guint64 * max_scr, guint64 * max_scr_offset)
+{
+  GstFluPSDemuxIndexEntry *entry;
+  guint i;
+
+  i = gst_flups_demux_index_find_scr (demux, scr);
+
+  if (i < demux->index->len) {
+    entry = &g_array_index (demux->index, GstFluPSDemuxIndexEntry, i);
+    if (entry->scr < *max_scr && entry->offset < *max_scr_offset) {
+      *max_scr = entry->scr;
+      *max_scr_offset = entry->offset;
+    }
+  }
+  if (i > 0) {
+    entry = &g_array_index (demux->index, GstFluPSDemuxIndexEntry, i - 1);
+    if (entry->scr > *min_scr && entry->scr < *max_scr &&
+        entry->offset > *min_scr_offset && entry->offset < *max_scr_offset) {
+      *min_scr = entry->scr;
+      *min_scr_offset = entry->offset;
+    }
+  }
+}
+
+static void
+gst_flups_demux_load_index (GstFluPSDemux * demux)
+{
+  GError *err = NULL;
+  gchar *location, *contents = NULL;
+  const guint8 *data;
+  gsize size;
+  guint i, n;
+
+  if (demux->sink_segment.stop == (guint64) - 1 ||
+      demux->first_scr == G_MAXUINT64 || demux->last_scr == G_MAXUINT64)
+    return;
+
+  GST_OBJECT_LOCK (demux);
+  location = g_strdup (demux->index_location);
+  GST_OBJECT_UNLOCK (demux);
+
+  if (location == NULL || !g_file_test (location, G_FILE_TEST_EXISTS))
+    goto done;
+
+  if (!g_file_get_contents (location, &contents, &size, &err))
+    goto read_error;
+
+  data = (const guint8 *) contents;
+  if (size < INDEX_FILE_HEADER_SZ ||
+      memcmp (data, INDEX_FILE_MAGIC, strlen (INDEX_FILE_MAGIC)) != 0)
+    goto invalid;
+
+  n = GST_READ_UINT32_BE (data + 32);
+  if (size != INDEX_FILE_HEADER_SZ + (gsize) n * INDEX_FILE_ENTRY_SZ)
+    goto invalid;
+
+  /* the index has to be of this very file */
+  if (GST_READ_UINT64_BE (data + 8) != demux->sink_segment.stop ||
+      GST_READ_UINT64_BE (data + 16) != demux->first_scr ||
+      GST_READ_UINT64_BE (data + 24) != demux->last_scr)
+    goto mismatch;
+
+  data += INDEX_FILE_HEADER_SZ;
+  for (i = 0; i < n; i++, data += INDEX_FILE_ENTRY_SZ) {
+    guint64 offset = GST_READ_UINT64_BE (data + 8);
+
+    if (offset < demux->sink_segment.stop)
+      gst_flups_demux_index_add (demux, GST_READ_UINT64_BE (data), offset);
+  }
+  demux->index_dirty = FALSE;
+
+  GST_DEBUG_OBJECT (demux, "loaded %u index points from %s",
+      demux->index->len, location);
+
+done:
+  g_free (contents);
+  g_free (location);
+  return;
+
+  /* ERRORS */
+read_error:
+  {
+    GST_WARNING_OBJECT (demux, "could not read index: %s", err->message);
+    g_error_free (err);
+    goto done;
+  }
+invalid:
+  {
+    GST_WARNING_OBJECT (demux, "%s is not a valid index file", location);
+    goto done;
+  }
+mismatch:
+  {
+    GST_DEBUG_OBJECT (demux, "index in %s is of another file, ignoring it",
+        location);
+    goto done;
+  }
+}
+
+static void
+gst_flups_demux_save_index (GstFluPSDemux * demux)
+{
+  GError *err = NULL;
+  gchar *location;
+  guint8 *contents, *data;
+  gsize size;
+  guint i;
+
+  if (!demux->index_dirty || demux->index->len == 0)
+    return;
+
+  GST_OBJECT_LOCK (demux);
+  location = g_strdup (demux->index_location);
+  GST_OBJECT_UNLOCK (demux);
+
+  if (location == NULL)
+    return;
+
+  size = INDEX_FILE_HEADER_SZ + (gsize) demux->index->len * INDEX_FILE_ENTRY_SZ;
+  data = contents = g_malloc (size);
+
+  memcpy (data, INDEX_FILE_MAGIC, strlen (INDEX_FILE_MAGIC));
+  GST_WRITE_UINT64_BE (data + 8, demux->sink_segment.stop);
+  GST_WRITE_UINT64_BE (data + 16, demux->first_scr);
+  GST_WRITE_UINT64_BE (data + 24, demux->last_scr);
+  GST_WRITE_UINT32_BE (data + 32, demux->index->len);
+  data += INDEX_FILE_HEADER_SZ;
+
+  for (i = 0; i < demux->index->len; i++, data += INDEX_FILE_ENTRY_SZ) {
+    GstFluPSDemuxIndexEntry *entry =
+        &g_array_index (demux->index, GstFluPSDemuxIndexEntry, i);
+
+    GST_WRITE_UINT64_BE (data, entry->scr);
+    GST_WRITE_UINT64_BE (data + 8, entry->offset);
+  }
+
+  if (g_file_set_contents (location, (const gchar *) contents, size, &err)) {
+    GST_DEBUG_OBJECT (demux, "saved %u index points to %s",
+        demux->index->len, location);
+    demux->index_dirty = FALSE;
+  } else {
+    GST_WARNING_OBJECT (demux, "could not save index: %s", err->message);
+    g_error_free (err);
+  }
+
+  g_free (contents);
+  g_free (location);
+}
+
 #define MAX_RECURSION_COUNT 100
 
 /* Binary search for requested SCR */
@@ -1109,6 +1439,10 @@ find_offset (GstFluPSDemux * demux, guint64 scr,
         gst_flups_demux_scan_backward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
   }
 
+  /* remember the pack for the next seeks */
+  if (found)
+    gst_flups_demux_index_add (demux, fscr, offset);
+
   if (fscr == scr || fscr == min_scr || fscr == max_scr) {
     return offset;
   }
@@ -1128,6 +1462,7 @@ gst_flups_demux_do_seek (GstFluPSDemux * demux, GstSegment * seeksegment)
   gboolean found = FALSE;
   guint64 fscr, offset;
   guint64 scr = GSTTIME_TO_MPEGTIME (seeksegment->position + demux->base_time);
+  guint64 min_scr, min_scr_offset, max_scr, max_scr_offset;
 
   /* In some clips the PTS values are completely unaligned with SCR values.
    * To improve the seek in that situation we apply a factor considering the
@@ -1142,9 +1477,19 @@ gst_flups_demux_do_seek (GstFluPSDemux * demux, GstSegment * seeksegment)
   GST_INFO_OBJECT (demux, "sink segment configured %" GST_SEGMENT_FORMAT
       ", trying to go at SCR: %" G_GUINT64_FORMAT, &demux->sink_segment, scr);
 
-  offset =
-      find_offset (demux, scr, demux->first_scr, demux->first_scr_offset,
-      demux->last_scr, demux->last_scr_offset, 0);
+  /* only search between the index points around the SCR */
+  min_scr = demux->first_scr;
+  min_scr_offset = demux->first_scr_offset;
+  max_scr = demux->last_scr;
+  max_scr_offset = demux->last_scr_offset;
+  gst_flups_demux_index_lookup (demux, scr, &min_scr, &min_scr_offset,
+      &max_scr, &max_scr_offset);
+
+  GST_DEBUG_OBJECT (demux, "searching between offsets %" G_GUINT64_FORMAT
+      " and %" G_GUINT64_FORMAT, min_scr_offset, max_scr_offset);
+
+  offset = find_offset (demux, scr, min_scr, min_scr_offset, max_scr,
+      max_scr_offset, 0);
 
   if (offset == (guint64) - 1) {
     return FALSE;
@@ -1784,6 +2129,11 @@ gst_flups_demux_parse_pack_start (GstFluPSDemux * demux)
    * adapter */
   demux->bytes_since_scr = avail;
 
+  /* remember where the pack is for seeking */
+  if (demux->random_access && demux->sink_segment.rate >= 0.0 &&
+      demux->adapter_offset != G_MAXUINT64)
+    gst_flups_demux_index_add (demux, scr, demux->adapter_offset);
+
   gst_adapter_unmap (demux->adapter);
   gst_adapter_flush (demux->adapter, length);
   ADAPTER_OFFSET_FLUSH (length);
@@ -2805,6 +3155,37 @@ beach:
   return ret;
 }
 
+/* Probes the SCR at the next place of the index scan */
+static void
+gst_flups_demux_scan_index_step (GstFluPSDemux * demux)
+{
+  guint64 stop = demux->sink_segment.stop;
+  guint64 offset, step, scr;
+  guint i;
+
+  if (stop == (guint64) - 1 || demux->index_scan_pos >= stop)
+    return;
+
+  step = MAX (stop / INDEX_SCAN_POINTS, INDEX_SCAN_MIN_STEP);
+  offset = demux->index_scan_pos;
+  demux->index_scan_pos += step;
+
+  /* nothing to do if the index already has a point there */
+  i = gst_flups_demux_index_find_offset (demux, offset);
+  if (i < demux->index->len &&
+      g_array_index (demux->index, GstFluPSDemuxIndexEntry, i).offset <
+      offset + step)
+    goto done;
+
+  if (gst_flups_demux_scan_forward_ts (demux, &offset, SCAN_SCR, &scr,
+          BLOCK_SZ))
+    gst_flups_demux_index_add (demux, scr, offset);
+
+done:
+  if (demux->index_scan_pos >= stop)
+    GST_DEBUG_OBJECT (demux, "index scan done, %u points", demux->index->len);
+}
+
 static void
 gst_flups_demux_loop (GstPad * pad)
 {
@@ -2819,8 +3200,10 @@ gst_flups_demux_loop (GstPad * pad)
     goto pause;
   }
 
-  if (G_UNLIKELY (demux->sink_segment.format == GST_FORMAT_UNDEFINED))
+  if (G_UNLIKELY (demux->sink_segment.format == GST_FORMAT_UNDEFINED)) {
     gst_flups_sink_get_duration (demux);
+    gst_flups_demux_load_index (demux);
+  }
 
   offset = demux->sink_segment.position;
   if (demux->sink_segment.rate >= 0) {
@@ -2839,6 +3222,9 @@ gst_flups_demux_loop (GstPad * pad)
     offset += size;
     gst_segment_set_position (&demux->sink_segment, GST_FORMAT_BYTES, offset);
 
+    if (demux->scan_index)
+      gst_flups_demux_scan_index_step (demux);
+
     /* check EOS condition */
     if ((demux->src_segment.flags & GST_SEEK_FLAG_SEGMENT) &&
         ((demux->sink_segment.position >= demux->sink_segment.stop) ||
@@ -3224,6 +3610,7 @@ gst_flups_demux_change_state (GstElement * element, GstStateChange transition)
 
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_flups_demux_save_index (demux);
       gst_flups_demux_reset (demux);
       break;
     case GST_STATE_CHANGE_READY_TO_NULL:
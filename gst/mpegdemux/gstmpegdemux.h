@@ -151,6 +151,15 @@ struct _GstFluPSDemux
 
   /* Indicates an MPEG-2 stream */
   gboolean is_mpeg2_pack;
+
+  /* sparse SCR to byte offset index, sorted on offset, pull mode only */
+  GArray *index;
+  gboolean index_dirty;
+  guint64 index_scan_pos;
+
+  /* properties */
+  gchar *index_location;
+  gboolean scan_index;
 };
 
 struct _GstFluPSDemuxClass
@@ -213,6 +213,8 @@ mpegts_base_reset (MpegTSBase * base)
 
   if (klass->reset)
     klass->reset (base);
+
+  mpegts_base_invalidate_pid_table (base);
 }
 
 static void
@@ -234,6 +236,7 @@ mpegts_base_init (MpegTSBase * base)
   base->parse_private_sections = FALSE;
   base->is_pes = g_new0 (guint8, 1024);
   base->known_psi = g_new0 (guint8, 1024);
+  base->pid_table = g_new0 (MpegTSBasePidEntry, 0x2000);
   base->program_size = sizeof (MpegTSBaseProgram);
   base->stream_size = sizeof (MpegTSBaseStream);
 
@@ -253,6 +256,7 @@ mpegts_base_dispose (GObject * object)
     base->disposed = TRUE;
     g_free (base->known_psi);
     g_free (base->is_pes);
+    g_free (base->pid_table);
   }
 
   if (G_OBJECT_CLASS (parent_class)->dispose)
@@ -376,6 +380,7 @@ mpegts_base_add_program (MpegTSBase * base,
         pmt_pid);
   }
   MPEGTS_BIT_SET (base->known_psi, pmt_pid);
+  mpegts_base_invalidate_pid_table (base);
 
   g_hash_table_insert (base->programs,
       GINT_TO_POINTER (program_number), program);
@@ -587,6 +592,7 @@ mpegts_base_deactivate_program (MpegTSBase * base, MpegTSBaseProgram * program)
   GST_DEBUG_OBJECT (base, "Deactivating PMT");
 
   program->active = FALSE;
+  mpegts_base_invalidate_pid_table (base);
 
   if (program->pmt) {
     for (i = 0; i < program->pmt->streams->len; ++i) {
@@ -703,6 +709,7 @@ mpegts_base_activate_program (MpegTSBase * base, MpegTSBaseProgram * program,
 
   program->active = TRUE;
   program->initial_program = initial_program;
+  mpegts_base_invalidate_pid_table (base);
 
   klass = GST_MPEGTS_BASE_GET_CLASS (base);
   if (klass->program_started != NULL)
@@ -897,6 +904,7 @@ mpegts_base_handle_psi (MpegTSBase * base, GstMpegTsSection * section)
   switch (section->section_type) {
     case GST_MPEGTS_SECTION_PAT:
       post_message = mpegts_base_apply_pat (base, section);
+      mpegts_base_invalidate_pid_table (base);
       if (base->seen_pat == FALSE) {
         base->seen_pat = TRUE;
         GST_DEBUG ("First PAT offset: %" G_GUINT64_FORMAT, section->offset);
@@ -906,6 +914,7 @@ mpegts_base_handle_psi (MpegTSBase * base, GstMpegTsSection * section)
       break;
     case GST_MPEGTS_SECTION_PMT:
       post_message = mpegts_base_apply_pmt (base, section);
+      mpegts_base_invalidate_pid_table (base);
       break;
     case GST_MPEGTS_SECTION_EIT:
       /* some tag xtraction + posting */
@@ -1070,15 +1079,79 @@ query_upstream_latency (MpegTSBase * base)
   base->queried_latency = TRUE;
 }
 
+static void
+mpegts_base_rebuild_pid_table (MpegTSBase * base)
+{
+  guint pid;
+
+  GST_DEBUG_OBJECT (base, "Rebuilding PID dispatch table");
+
+  for (pid = 0; pid < 0x2000; pid++) {
+    MpegTSBasePidEntry *entry = &base->pid_table[pid];
+
+    if (MPEGTS_BIT_IS_SET (base->is_pes, pid))
+      entry->role = MPEGTS_BASE_PID_PES;
+    else if (MPEGTS_BIT_IS_SET (base->known_psi, pid))
+      entry->role = MPEGTS_BASE_PID_PSI;
+    else if (pid == 0x1fff)
+      entry->role = MPEGTS_BASE_PID_NULL;
+    else
+      entry->role = MPEGTS_BASE_PID_UNKNOWN;
+  }
+
+  base->pid_table_dirty = FALSE;
+}
+
+static inline GstFlowReturn
+mpegts_base_handle_packet (MpegTSBase * base, MpegTSBaseClass * klass,
+    MpegTSPacketizerPacket * packet)
+{
+  GstFlowReturn res = GST_FLOW_OK;
+  const MpegTSBasePidEntry *entry;
+
+  if (G_UNLIKELY (base->pid_table_dirty))
+    mpegts_base_rebuild_pid_table (base);
+  entry = &base->pid_table[packet->pid];
+
+  /* If it's a known PES, push it */
+  if (entry->role == MPEGTS_BASE_PID_PES) {
+    /* push the packet downstream */
+    if (base->push_data)
+      res = klass->push (base, packet, NULL);
+  } else if (packet->payload && entry->role == MPEGTS_BASE_PID_PSI) {
+    /* base PSI data */
+    GList *others, *tmp;
+    GstMpegTsSection *section;
+
+    section =
+        mpegts_packetizer_push_section (base->packetizer, packet, &others);
+    if (section)
+      mpegts_base_handle_psi (base, section);
+    if (G_UNLIKELY (others)) {
+      for (tmp = others; tmp; tmp = tmp->next)
+        mpegts_base_handle_psi (base, (GstMpegTsSection *) tmp->data);
+      g_list_free (others);
+    }
+
+    /* we need to push section packet downstream */
+    if (base->push_section)
+      res = klass->push (base, packet, section);
+
+  } else if (packet->payload && entry->role == MPEGTS_BASE_PID_UNKNOWN)
+    GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle", packet->pid);
+
+  return res;
+}
+
 static GstFlowReturn
 mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 {
   GstFlowReturn res = GST_FLOW_OK;
   MpegTSBase *base;
-  MpegTSPacketizerPacketReturn pret;
   MpegTSPacketizer2 *packetizer;
-  MpegTSPacketizerPacket packet;
+  MpegTSPacketizerPacketBatch batch;
   MpegTSBaseClass *klass;
+  guint i;
 
   base = GST_MPEGTS_BASE (parent);
   klass = GST_MPEGTS_BASE_GET_CLASS (base);
@@ -1095,47 +1168,22 @@ mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
   mpegts_packetizer_push (base->packetizer, buf);
 
   while (res == GST_FLOW_OK) {
-    pret = mpegts_packetizer_next_packet (base->packetizer, &packet);
-
     /* If we don't have enough data, return */
-    if (G_UNLIKELY (pret == PACKET_NEED_MORE))
+    if (!mpegts_packetizer_next_packets (packetizer, &batch))
       break;
 
-    if (G_UNLIKELY (pret == PACKET_BAD)) {
-      /* bad header, skip the packet */
-      GST_DEBUG_OBJECT (base, "bad packet, skipping");
-      goto next;
-    }
-
-    /* If it's a known PES, push it */
-    if (MPEGTS_BIT_IS_SET (base->is_pes, packet.pid)) {
-      /* push the packet downstream */
-      if (base->push_data)
-        res = klass->push (base, &packet, NULL);
-    } else if (packet.payload
-        && MPEGTS_BIT_IS_SET (base->known_psi, packet.pid)) {
-      /* base PSI data */
-      GList *others, *tmp;
-      GstMpegTsSection *section;
-
-      section = mpegts_packetizer_push_section (packetizer, &packet, &others);
-      if (section)
-        mpegts_base_handle_psi (base, section);
-      if (G_UNLIKELY (others)) {
-        for (tmp = others; tmp; tmp = tmp->next)
-          mpegts_base_handle_psi (base, (GstMpegTsSection *) tmp->data);
-        g_list_free (others);
+    for (i = 0; i < batch.n_packets && res == GST_FLOW_OK; i++) {
+      if (G_UNLIKELY (batch.ret[i] == PACKET_BAD)) {
+        /* bad header, skip the packet */
+        GST_DEBUG_OBJECT (base, "bad packet, skipping");
+        continue;
       }
 
-      /* we need to push section packet downstream */
-      if (base->push_section)
-        res = klass->push (base, &packet, section);
-
-    } else if (packet.payload && packet.pid != 0x1fff)
-      GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle", packet.pid);
+      res = mpegts_base_handle_packet (base, klass,
+          mpegts_packetizer_consume_packet (packetizer, &batch, i));
+    }
 
-  next:
-    mpegts_packetizer_clear_packet (base->packetizer, &packet);
+    mpegts_packetizer_clear_packets (packetizer, &batch, i);
   }
 
   if (klass->input_done) {
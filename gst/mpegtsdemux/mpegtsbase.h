@@ -92,6 +92,19 @@ struct _MpegTSBaseProgram
   gboolean initial_program;
 };
 
+typedef enum {
+  MPEGTS_BASE_PID_UNKNOWN = 0,	/* Not handled */
+  MPEGTS_BASE_PID_NULL,		/* Stuffing (0x1fff) */
+  MPEGTS_BASE_PID_PSI,		/* Sections, handled by MpegTSBase */
+  MPEGTS_BASE_PID_PES		/* Data, passed on to the subclass */
+} MpegTSBasePidRole;
+
+/* Entry of the per-PID dispatch table, derived from known_psi/is_pes.
+ * Stored as a byte (one of MpegTSBasePidRole) to keep the table small */
+typedef struct {
+  guint8 role;
+} MpegTSBasePidEntry;
+
 typedef enum {
   /* PULL MODE */
   BASE_MODE_SCANNING,		/* Looking for PAT/PMT */
@@ -128,6 +141,11 @@ struct _MpegTSBase {
   guint8 *known_psi;
   guint8 *is_pes;
 
+  /* 0x2000 entries dispatch table, indexed by PID. Rebuilt when marked dirty
+   * (i.e. when the PAT/PMT or the above arrays changed) */
+  MpegTSBasePidEntry *pid_table;
+  gboolean pid_table_dirty;
+
   gboolean disposed;
 
   /* size of the MpegTSBaseProgram structure, can be overridden
@@ -221,6 +239,9 @@ G_GNUC_INTERNAL gboolean gst_mpegtsbase_plugin_init (GstPlugin * plugin);
 G_GNUC_INTERNAL void mpegts_base_program_remove_stream (MpegTSBase * base, MpegTSBaseProgram * program, guint16 pid);
 
 G_GNUC_INTERNAL void mpegts_base_remove_program(MpegTSBase *base, gint program_number);
+
+/* Call whenever known_psi/is_pes change */
+#define mpegts_base_invalidate_pid_table(base) ((base)->pid_table_dirty = TRUE)
 G_END_DECLS
 
 #endif /* GST_MPEG_TS_BASE_H */
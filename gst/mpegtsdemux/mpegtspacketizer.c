@@ -91,6 +91,17 @@ struct _MpegTSPacketizerPrivate
   gsize map_size;
   gboolean need_sync;
 
+  /* The buffers currently in the adapter, and the number of bytes already
+   * flushed from the first one. Used to find the memory backing the mapped
+   * region */
+  GQueue buffers;
+  gsize buffers_skip;
+
+  /* Buffer whose (single) memory contains the mapped region, NULL if
+   * the mapped data was copied by the adapter */
+  GstBuffer *map_buffer;
+  gsize map_buffer_offset;
+
   /* Reference offset */
   guint64 refoffset;
 
@@ -305,6 +316,10 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   priv->map_size = 0;
   priv->map_offset = 0;
   priv->need_sync = FALSE;
+  g_queue_init (&priv->buffers);
+  priv->buffers_skip = 0;
+  priv->map_buffer = NULL;
+  priv->map_buffer_offset = 0;
 
   memset (priv->pcrtablelut, 0xff, 0x2000);
   memset (priv->observations, 0x0, sizeof (priv->observations));
@@ -315,6 +330,18 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   priv->last_in_time = GST_CLOCK_TIME_NONE;
 }
 
+static void
+mpegts_packetizer_clear_buffers (MpegTSPacketizer2 * packetizer)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_head (&priv->buffers)))
+    gst_buffer_unref (buf);
+  priv->buffers_skip = 0;
+  priv->map_buffer = NULL;
+}
+
 static void
 mpegts_packetizer_dispose (GObject * object)
 {
@@ -334,6 +361,7 @@ mpegts_packetizer_dispose (GObject * object)
 
     gst_adapter_clear (packetizer->adapter);
     g_object_unref (packetizer->adapter);
+    mpegts_packetizer_clear_buffers (packetizer);
     packetizer->disposed = TRUE;
     packetizer->offset = 0;
     packetizer->empty = TRUE;
@@ -367,9 +395,28 @@ mpegts_packetizer_compute_pcr (const guint8 * data)
   return pcr * 300 + pcr_ext % 300;
 }
 
+/* Feeds the PCR of @packet to the skew and offset estimation */
+static void
+mpegts_packetizer_handle_pcr (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packet)
+{
+  MpegTSPCR *pcrtable = NULL;
+
+  if (packetizer->calculate_skew
+      && GST_CLOCK_TIME_IS_VALID (packetizer->priv->last_in_time)) {
+    pcrtable = get_pcr_table (packetizer, packet->pid);
+    calculate_skew (pcrtable, packet->pcr, packetizer->priv->last_in_time);
+  }
+  if (packetizer->calculate_offset) {
+    if (!pcrtable)
+      pcrtable = get_pcr_table (packetizer, packet->pid);
+    record_pcr (packetizer, pcrtable, packet->pcr, packet->offset);
+  }
+}
+
 static gboolean
 mpegts_packetizer_parse_adaptation_field_control (MpegTSPacketizer2 *
-    packetizer, MpegTSPacketizerPacket * packet)
+    packetizer, MpegTSPacketizerPacket * packet, gboolean handle_pcr)
 {
   guint8 length, afcflags;
   guint8 *data;
@@ -423,23 +470,14 @@ mpegts_packetizer_parse_adaptation_field_control (MpegTSPacketizer2 *
 
   /* PCR */
   if (afcflags & MPEGTS_AFC_PCR_FLAG) {
-    MpegTSPCR *pcrtable = NULL;
     packet->pcr = mpegts_packetizer_compute_pcr (data);
     data += 6;
     GST_DEBUG ("pcr 0x%04x %" G_GUINT64_FORMAT " (%" GST_TIME_FORMAT
         ") offset:%" G_GUINT64_FORMAT, packet->pid, packet->pcr,
         GST_TIME_ARGS (PCRTIME_TO_GSTTIME (packet->pcr)), packet->offset);
 
-    if (packetizer->calculate_skew
-        && GST_CLOCK_TIME_IS_VALID (packetizer->priv->last_in_time)) {
-      pcrtable = get_pcr_table (packetizer, packet->pid);
-      calculate_skew (pcrtable, packet->pcr, packetizer->priv->last_in_time);
-    }
-    if (packetizer->calculate_offset) {
-      if (!pcrtable)
-        pcrtable = get_pcr_table (packetizer, packet->pid);
-      record_pcr (packetizer, pcrtable, packet->pcr, packet->offset);
-    }
+    if (handle_pcr)
+      mpegts_packetizer_handle_pcr (packetizer, packet);
   }
 #ifndef GST_DISABLE_GST_DEBUG
   /* OPCR */
@@ -481,7 +519,7 @@ mpegts_packetizer_parse_adaptation_field_control (MpegTSPacketizer2 *
 
 static MpegTSPacketizerPacketReturn
 mpegts_packetizer_parse_packet (MpegTSPacketizer2 * packetizer,
-    MpegTSPacketizerPacket * packet)
+    MpegTSPacketizerPacket * packet, gboolean handle_pcr)
 {
   guint8 *data;
   guint8 tmp;
@@ -510,7 +548,8 @@ mpegts_packetizer_parse_packet (MpegTSPacketizer2 * packetizer,
   packet->data = data;
 
   if (FLAGS_HAS_AFC (tmp))
-    if (!mpegts_packetizer_parse_adaptation_field_control (packetizer, packet))
+    if (!mpegts_packetizer_parse_adaptation_field_control (packetizer, packet,
+            handle_pcr))
       return FALSE;
 
   if (FLAGS_HAS_PAYLOAD (tmp))
@@ -601,6 +640,7 @@ mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
   }
 
   gst_adapter_clear (packetizer->adapter);
+  mpegts_packetizer_clear_buffers (packetizer);
   packetizer->offset = 0;
   packetizer->empty = TRUE;
   packetizer->priv->need_sync = FALSE;
@@ -624,6 +664,7 @@ mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer, gboolean hard)
     }
   }
   gst_adapter_clear (packetizer->adapter);
+  mpegts_packetizer_clear_buffers (packetizer);
 
   packetizer->offset = 0;
   packetizer->empty = TRUE;
@@ -671,6 +712,9 @@ mpegts_packetizer_push (MpegTSPacketizer2 * packetizer, GstBuffer * buffer)
   GST_DEBUG ("Pushing %" G_GSIZE_FORMAT " byte from offset %"
       G_GUINT64_FORMAT, gst_buffer_get_size (buffer),
       GST_BUFFER_OFFSET (buffer));
+  /* The adapter drops empty buffers */
+  if (gst_buffer_get_size (buffer) > 0)
+    g_queue_push_tail (&packetizer->priv->buffers, gst_buffer_ref (buffer));
   gst_adapter_push (packetizer->adapter, buffer);
   /* If buffer timestamp is valid, store it */
   if (GST_CLOCK_TIME_IS_VALID (GST_BUFFER_TIMESTAMP (buffer)))
@@ -687,16 +731,64 @@ mpegts_packetizer_flush_bytes (MpegTSPacketizer2 * packetizer, gsize size)
     gst_adapter_flush (packetizer->adapter, size);
   }
 
+  /* Keep our list of buffers in sync with the adapter */
+  while (size > 0) {
+    GstBuffer *head = g_queue_peek_head (&priv->buffers);
+    gsize left = gst_buffer_get_size (head) - priv->buffers_skip;
+
+    if (size < left) {
+      priv->buffers_skip += size;
+      break;
+    }
+    size -= left;
+    priv->buffers_skip = 0;
+    gst_buffer_unref (g_queue_pop_head (&priv->buffers));
+  }
+
   priv->map_data = NULL;
   priv->map_size = 0;
   priv->map_offset = 0;
+  priv->map_buffer = NULL;
+}
+
+/* Checks whether the freshly mapped region lies within the first buffer of
+ * the adapter (i.e. was not copied by the adapter), and remembers it so
+ * that mpegts_packetizer_share_memory() can be used on it */
+static void
+mpegts_packetizer_find_map_buffer (MpegTSPacketizer2 * packetizer)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+  GstBuffer *head;
+  GstMemory *mem;
+  GstMapInfo info;
+
+  priv->map_buffer = NULL;
+
+  head = g_queue_peek_head (&priv->buffers);
+  if (head == NULL || gst_buffer_n_memory (head) != 1)
+    return;
+
+  mem = gst_buffer_peek_memory (head, 0);
+  if (GST_MEMORY_FLAG_IS_SET (mem, GST_MEMORY_FLAG_NO_SHARE))
+    return;
+
+  if (!gst_memory_map (mem, &info, GST_MAP_READ))
+    return;
+
+  if (priv->map_data == info.data + priv->buffers_skip &&
+      priv->buffers_skip + priv->map_size <= info.size) {
+    priv->map_buffer = head;
+    priv->map_buffer_offset = priv->buffers_skip;
+  }
+
+  gst_memory_unmap (mem, &info);
 }
 
 static gboolean
 mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
 {
   MpegTSPacketizerPrivate *priv = packetizer->priv;
-  gsize available;
+  gsize available, fast;
 
   if (priv->map_size - priv->map_offset >= size)
     return TRUE;
@@ -707,6 +799,16 @@ mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
   if (available < size)
     return FALSE;
 
+  /* If the first buffer contains enough data, only map that one. This
+   * avoids having the adapter merge everything into a temporary copy, and
+   * allows sharing the memory of the mapped region. Otherwise only the
+   * straddling data is copied. */
+  fast = gst_adapter_available_fast (packetizer->adapter);
+  if (fast >= size)
+    available = fast;
+  else
+    available = size;
+
   priv->map_data = (guint8 *) gst_adapter_map (packetizer->adapter, available);
   if (!priv->map_data)
     return FALSE;
@@ -714,17 +816,36 @@ mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
   priv->map_size = available;
   priv->map_offset = 0;
 
+  if (fast >= size)
+    mpegts_packetizer_find_map_buffer (packetizer);
+
   GST_LOG ("mapped %" G_GSIZE_FORMAT " bytes from adapter", available);
 
   return TRUE;
 }
 
+/* Returns the offset of the first sync byte within the @size first bytes of
+ * @data, or @size if there is none.
+ *
+ * memchr() is vectorized (SSE2/AVX2/NEON, selected at runtime) by all the C
+ * libraries we care about, which makes resyncing on corrupted input or
+ * skipping over garbage a lot cheaper than testing every byte ourselves. */
+static inline gsize
+mpegts_packetizer_find_sync_byte (const guint8 * data, gsize size)
+{
+  const guint8 *sync;
+
+  sync = memchr (data, PACKET_SYNC_BYTE, size);
+
+  return sync ? sync - data : size;
+}
+
 static gboolean
 mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
 {
   MpegTSPacketizerPrivate *priv = packetizer->priv;
   guint8 *data;
-  gsize size, i, j;
+  gsize size, limit, i, j;
 
   static const guint psizes[] = {
     MPEGTS_NORMAL_PACKETSIZE,
@@ -733,40 +854,42 @@ mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
     MPEGTS_ATSC_PACKETSIZE
   };
 
-  if (!mpegts_packetizer_map (packetizer, 4 * MPEGTS_MAX_PACKETSIZE))
-    return FALSE;
-
-  size = priv->map_size - priv->map_offset;
-  data = priv->map_data + priv->map_offset;
-
-  for (i = 0; i + 3 * MPEGTS_MAX_PACKETSIZE < size; i++) {
-    /* find a sync byte */
-    if (data[i] != PACKET_SYNC_BYTE)
-      continue;
-
-    /* check for 4 consecutive sync bytes with each possible packet size */
-    for (j = 0; j < G_N_ELEMENTS (psizes); j++) {
-      guint packet_size = psizes[j];
-
-      if (data[i + packet_size] == PACKET_SYNC_BYTE &&
-          data[i + 2 * packet_size] == PACKET_SYNC_BYTE &&
-          data[i + 3 * packet_size] == PACKET_SYNC_BYTE) {
-        packetizer->packet_size = packet_size;
-        goto out;
+  /* Only part of the adapter is mapped at once, keep scanning the following
+   * parts until the packet size is found or too little data is left */
+  while (mpegts_packetizer_map (packetizer, 4 * MPEGTS_MAX_PACKETSIZE)) {
+    size = priv->map_size - priv->map_offset;
+    data = priv->map_data + priv->map_offset;
+    limit = size - 3 * MPEGTS_MAX_PACKETSIZE;
+
+    for (i = 0; i < limit; i++) {
+      /* find a sync byte */
+      i += mpegts_packetizer_find_sync_byte (data + i, limit - i);
+      if (i == limit)
+        break;
+
+      /* check for 4 consecutive sync bytes with each possible packet size */
+      for (j = 0; j < G_N_ELEMENTS (psizes); j++) {
+        guint packet_size = psizes[j];
+
+        if (data[i + packet_size] == PACKET_SYNC_BYTE &&
+            data[i + 2 * packet_size] == PACKET_SYNC_BYTE &&
+            data[i + 3 * packet_size] == PACKET_SYNC_BYTE) {
+          packetizer->packet_size = packet_size;
+          goto out;
+        }
       }
     }
+
+    GST_DEBUG ("Could not determine packet size in %" G_GSIZE_FORMAT
+        " bytes, flush %" G_GSIZE_FORMAT " bytes", size, i);
+    mpegts_packetizer_flush_bytes (packetizer, priv->map_offset + i);
   }
 
+  return FALSE;
+
 out:
   priv->map_offset += i;
 
-  if (packetizer->packet_size == 0) {
-    GST_DEBUG ("Could not determine packet size in %" G_GSIZE_FORMAT
-        " bytes buffer, flush %" G_GSIZE_FORMAT " bytes", size, i);
-    mpegts_packetizer_flush_bytes (packetizer, priv->map_offset);
-    return FALSE;
-  }
-
   GST_INFO ("have packetsize detected: %u bytes", packetizer->packet_size);
 
   if (packetizer->packet_size == MPEGTS_M2TS_PACKETSIZE &&
@@ -780,39 +903,41 @@ static gboolean
 mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
 {
   MpegTSPacketizerPrivate *priv = packetizer->priv;
-  gboolean found;
   guint8 *data;
   guint packet_size;
-  gsize size, sync_offset, i;
+  gsize size, limit, sync_offset, i;
 
   packet_size = packetizer->packet_size;
 
-  if (!mpegts_packetizer_map (packetizer, 3 * packet_size))
-    return FALSE;
-
-  size = priv->map_size - priv->map_offset;
-  data = priv->map_data + priv->map_offset;
-
   if (packet_size == MPEGTS_M2TS_PACKETSIZE)
     sync_offset = 4;
   else
     sync_offset = 0;
 
-  for (i = sync_offset; i + 2 * packet_size < size; i++) {
-    if (data[i] == PACKET_SYNC_BYTE &&
-        data[i + packet_size] == PACKET_SYNC_BYTE &&
-        data[i + 2 * packet_size] == PACKET_SYNC_BYTE) {
-      found = TRUE;
-      break;
-    }
-  }
+  /* Like above, scan the adapter part by part until sync is found or less
+   * than three packets are left */
+  while (mpegts_packetizer_map (packetizer, 3 * packet_size)) {
+    size = priv->map_size - priv->map_offset;
+    data = priv->map_data + priv->map_offset;
+    limit = size - 2 * packet_size;
 
-  priv->map_offset += i - sync_offset;
+    for (i = sync_offset; i < limit; i++) {
+      i += mpegts_packetizer_find_sync_byte (data + i, limit - i);
+      if (i == limit)
+        break;
+
+      if (data[i + packet_size] == PACKET_SYNC_BYTE &&
+          data[i + 2 * packet_size] == PACKET_SYNC_BYTE) {
+        priv->map_offset += i - sync_offset;
+        return TRUE;
+      }
+    }
 
-  if (!found)
-    mpegts_packetizer_flush_bytes (packetizer, priv->map_offset);
+    mpegts_packetizer_flush_bytes (packetizer,
+        priv->map_offset + i - sync_offset);
+  }
 
-  return found;
+  return FALSE;
 }
 
 MpegTSPacketizerPacketReturn
@@ -864,11 +989,144 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
       packetizer->offset += packet_size;
       GST_MEMDUMP ("data_start", packet->data_start, 16);
 
-      return mpegts_packetizer_parse_packet (packetizer, packet);
+      return mpegts_packetizer_parse_packet (packetizer, packet, TRUE);
     }
   }
 }
 
+/*
+ * mpegts_packetizer_next_packets:
+ * @packetizer: a #MpegTSPacketizer2
+ * @batch: a #MpegTSPacketizerPacketBatch to fill
+ *
+ * Parses as many consecutive packets as possible (up to
+ * %MPEGTS_PACKETIZER_BATCH_SIZE) from the currently mapped region.
+ *
+ * The first packet goes through the regular mpegts_packetizer_next_packet()
+ * path (which takes care of packet size discovery and resyncing), the
+ * following ones are parsed in place as long as they start with a sync byte.
+ * The batch stops at the first packet which lost sync, the next call will
+ * then resync from there.
+ *
+ * The PCR of the first packet is handled right away like for
+ * mpegts_packetizer_next_packet(), the ones of the following packets only
+ * when they are passed to mpegts_packetizer_consume_packet(). Packets handed
+ * back by mpegts_packetizer_clear_packets() are parsed again by the next call,
+ * this way each PCR is fed to the skew and offset estimation exactly once.
+ *
+ * The packets stay valid until mpegts_packetizer_clear_packets() is called.
+ *
+ * Returns: the number of packets in @batch, 0 if more data is needed.
+ */
+guint
+mpegts_packetizer_next_packets (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacketBatch * batch)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+  MpegTSPacketizerPacket *packet;
+  guint8 *packet_data;
+  guint packet_size;
+  gsize sync_offset, offset;
+  guint n;
+
+  batch->n_packets = 0;
+
+  batch->ret[0] = mpegts_packetizer_next_packet (packetizer, batch->packets);
+  if (batch->ret[0] == PACKET_NEED_MORE)
+    return 0;
+
+  packet_size = packetizer->packet_size;
+  if (packet_size == MPEGTS_M2TS_PACKETSIZE)
+    sync_offset = 4;
+  else
+    sync_offset = 0;
+
+  offset = priv->map_offset + packet_size;
+
+  for (n = 1; n < MPEGTS_PACKETIZER_BATCH_SIZE; n++) {
+    if (offset + packet_size > priv->map_size)
+      break;
+
+    packet_data = &priv->map_data[offset + sync_offset];
+    if (G_UNLIKELY (*packet_data != PACKET_SYNC_BYTE))
+      break;
+
+    packet = &batch->packets[n];
+    packet->data_start = packet_data;
+    packet->data_end = packet->data_start + 188;
+    packet->offset = packetizer->offset;
+    packetizer->offset += packet_size;
+
+    /* The PCR is only handled once the packet is actually consumed, see
+     * mpegts_packetizer_consume_packet() */
+    batch->ret[n] = mpegts_packetizer_parse_packet (packetizer, packet, FALSE);
+    offset += packet_size;
+  }
+
+  GST_LOG ("parsed %u packets", n);
+
+  batch->n_packets = n;
+
+  return n;
+}
+
+/*
+ * mpegts_packetizer_consume_packet:
+ * @packetizer: a #MpegTSPacketizer2
+ * @batch: a #MpegTSPacketizerPacketBatch filled by
+ *   mpegts_packetizer_next_packets()
+ * @n: the index of the packet in @batch
+ *
+ * Must be called on each valid packet of @batch, in order, right before it is
+ * processed.
+ *
+ * Returns: the @n-th packet of @batch.
+ */
+MpegTSPacketizerPacket *
+mpegts_packetizer_consume_packet (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacketBatch * batch, guint n)
+{
+  MpegTSPacketizerPacket *packet = &batch->packets[n];
+
+  /* the first packet had its PCR handled when it was parsed */
+  if (n > 0 && FLAGS_HAS_AFC (packet->scram_afc_cc)
+      && (packet->afc_flags & MPEGTS_AFC_PCR_FLAG))
+    mpegts_packetizer_handle_pcr (packetizer, packet);
+
+  return packet;
+}
+
+/*
+ * mpegts_packetizer_clear_packets:
+ * @packetizer: a #MpegTSPacketizer2
+ * @batch: a #MpegTSPacketizerPacketBatch filled by
+ *   mpegts_packetizer_next_packets()
+ * @n_consumed: the number of packets of @batch that were handled
+ *
+ * Releases the first @n_consumed packets of @batch. The remaining ones (if
+ * processing was interrupted) will be returned again by the next call to
+ * mpegts_packetizer_next_packets().
+ */
+void
+mpegts_packetizer_clear_packets (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacketBatch * batch, guint n_consumed)
+{
+  guint packet_size = packetizer->packet_size;
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+
+  g_return_if_fail (n_consumed <= batch->n_packets);
+
+  /* rewind the offset of the packets we are giving back */
+  packetizer->offset -= (batch->n_packets - n_consumed) * packet_size;
+  batch->n_packets = 0;
+
+  if (priv->map_data) {
+    priv->map_offset += n_consumed * packet_size;
+    if (priv->map_size - priv->map_offset < packet_size)
+      mpegts_packetizer_flush_bytes (packetizer, priv->map_offset);
+  }
+}
+
 MpegTSPacketizerPacketReturn
 mpegts_packetizer_process_next_packet (MpegTSPacketizer2 * packetizer)
 {
@@ -906,6 +1164,33 @@ mpegts_packetizer_has_packets (MpegTSPacketizer2 * packetizer)
   return gst_adapter_available (packetizer->adapter) >= packetizer->packet_size;
 }
 
+/*
+ * mpegts_packetizer_share_memory:
+ * @packetizer: a #MpegTSPacketizer2
+ * @data: the start of the data to share, must be within the packets
+ *   returned by the last call to mpegts_packetizer_next_packet(s)
+ * @size: the number of bytes to share
+ *
+ * Returns: (transfer full): a #GstMemory sharing the input memory which
+ * contains @data, or %NULL if the data was copied when it was mapped (for
+ * example because a packet was spread over several input buffers).
+ */
+GstMemory *
+mpegts_packetizer_share_memory (MpegTSPacketizer2 * packetizer,
+    const guint8 * data, gsize size)
+{
+  MpegTSPacketizerPrivate *priv = packetizer->priv;
+
+  if (priv->map_buffer == NULL)
+    return NULL;
+
+  g_return_val_if_fail (data >= priv->map_data &&
+      data + size <= priv->map_data + priv->map_size, NULL);
+
+  return gst_memory_share (gst_buffer_peek_memory (priv->map_buffer, 0),
+      priv->map_buffer_offset + (data - priv->map_data), size);
+}
+
 /*
  * Ideally it should just return a section if:
  * * The section is complete
@@ -165,6 +165,16 @@ typedef enum {
   PACKET_NEED_MORE
 } MpegTSPacketizerPacketReturn;
 
+/* Maximum number of packets returned by mpegts_packetizer_next_packets() */
+#define MPEGTS_PACKETIZER_BATCH_SIZE 64
+
+typedef struct
+{
+  MpegTSPacketizerPacket       packets[MPEGTS_PACKETIZER_BATCH_SIZE];
+  MpegTSPacketizerPacketReturn ret[MPEGTS_PACKETIZER_BATCH_SIZE];
+  guint                        n_packets;
+} MpegTSPacketizerPacketBatch;
+
 G_GNUC_INTERNAL GType mpegts_packetizer_get_type(void);
 
 G_GNUC_INTERNAL MpegTSPacketizer2 *mpegts_packetizer_new (void);
@@ -176,10 +186,18 @@ G_GNUC_INTERNAL MpegTSPacketizerPacketReturn mpegts_packetizer_next_packet (Mpeg
   MpegTSPacketizerPacket *packet);
 G_GNUC_INTERNAL MpegTSPacketizerPacketReturn
 mpegts_packetizer_process_next_packet(MpegTSPacketizer2 * packetizer);
+G_GNUC_INTERNAL guint mpegts_packetizer_next_packets (MpegTSPacketizer2 *packetizer,
+  MpegTSPacketizerPacketBatch *batch);
+G_GNUC_INTERNAL MpegTSPacketizerPacket *mpegts_packetizer_consume_packet (MpegTSPacketizer2 *packetizer,
+  MpegTSPacketizerPacketBatch *batch, guint n);
+G_GNUC_INTERNAL void mpegts_packetizer_clear_packets (MpegTSPacketizer2 *packetizer,
+  MpegTSPacketizerPacketBatch *batch, guint n_consumed);
 G_GNUC_INTERNAL void mpegts_packetizer_clear_packet (MpegTSPacketizer2 *packetizer,
 				     MpegTSPacketizerPacket *packet);
 G_GNUC_INTERNAL void mpegts_packetizer_remove_stream(MpegTSPacketizer2 *packetizer,
   gint16 pid);
+G_GNUC_INTERNAL GstMemory *mpegts_packetizer_share_memory (MpegTSPacketizer2 *packetizer,
+  const guint8 *data, gsize size);
 
 G_GNUC_INTERNAL GstMpegTsSection *mpegts_packetizer_push_section (MpegTSPacketizer2 *packetzer,
 								  MpegTSPacketizerPacket *packet, GList **remaining);
@@ -35,6 +35,7 @@
 #include <string.h>
 
 #include <glib.h>
+#include <gst/base/gstdataqueue.h>
 #include <gst/tag/tag.h>
 #include <gst/pbutils/pbutils.h>
 
@@ -54,6 +55,17 @@
 #define CONTINUITY_UNSET 255
 #define MAX_CONTINUITY 15
 
+/* A GstBuffer merges its memories once it holds more than 16 of them, which
+ * would defeat the purpose of sharing the input memory. So only PES packets
+ * of up to 16 TS packets (2944 bytes: audio, subtitles, ...) are shared;
+ * bigger ones, which is any HD video frame, are copied once into an area
+ * sized for the whole packet. */
+#define MAX_SHARED_MEMORIES 16
+#define TS_PAYLOAD_SIZE 184
+
+#define DEFAULT_THREADED_OUTPUT FALSE
+#define DEFAULT_OUTPUT_QUEUE_SIZE (4 * 1024 * 1024)
+
 /* Seeking/Scanning related variables */
 
 /* seek to SEEK_TIMESTAMP_OFFSET before the desired offset and search then
@@ -107,7 +119,8 @@ struct _TSDemuxStream
   /* Whether the pad was added or not */
   gboolean active;
 
-  /* the return of the latest push */
+  /* the return of the latest push, only accessed atomically as it is set
+   * by the output task in threaded-output mode */
   GstFlowReturn flow_return;
 
   /* Output data */
@@ -116,6 +129,10 @@ struct _TSDemuxStream
   /* Data to push (allocated) */
   guint8 *data;
 
+  /* Data to push as shares of the input memory (zero-copy mode).
+   * Only one of data and buffer is used at a time */
+  GstBuffer *buffer;
+
   /* Size of data to push (if known) */
   guint expected_size;
 
@@ -123,6 +140,14 @@ struct _TSDemuxStream
   guint current_size;
   guint allocated_size;
 
+  /* How much of the queued data was shared/copied */
+  guint shared_size;
+  guint copied_size;
+
+  /* Decaying maximum of the previous PES packet sizes, used to size the
+   * output when the PES header doesn't give it (zero-copy mode) */
+  guint size_hint;
+
   /* Current PTS/DTS for this stream */
   GstClockTime pts;
   GstClockTime dts;
@@ -133,6 +158,20 @@ struct _TSDemuxStream
   GstTagList *taglist;
 
   gint continuity_counter;
+
+  /* Threaded output: buffers and serialized events are queued and pushed
+   * downstream by a dedicated task, so that a blocking downstream only
+   * stalls this stream. queue is NULL when not used */
+  GstDataQueue *queue;
+  guint queue_size;
+  GstTask *task;
+  GRecMutex task_lock;
+
+  /* Protects drained/output_flushing, signalled with output_cond */
+  GMutex output_lock;
+  GCond output_cond;
+  gboolean drained;
+  gboolean output_flushing;
 };
 
 #define VIDEO_CAPS \
@@ -202,6 +241,11 @@ enum
   ARG_0,
   PROP_PROGRAM_NUMBER,
   PROP_EMIT_STATS,
+  PROP_ZERO_COPY,
+  PROP_BYTES_SHARED,
+  PROP_BYTES_COPIED,
+  PROP_THREADED_OUTPUT,
+  PROP_OUTPUT_QUEUE_SIZE,
   /* FILL ME */
 };
 
@@ -232,6 +276,8 @@ static void gst_ts_demux_flush_streams (GstTSDemux * tsdemux);
 static GstFlowReturn
 gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream);
 static void gst_ts_demux_stream_flush (TSDemuxStream * stream);
+static GstFlowReturn tsdemux_combine_flows (GstTSDemux * demux,
+    TSDemuxStream * stream, GstFlowReturn ret);
 
 static gboolean push_event (MpegTSBase * base, GstEvent * event);
 
@@ -272,6 +318,38 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
           "Emit messages for every pcr/opcr/pts/dts", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_ZERO_COPY,
+      g_param_spec_boolean ("zero-copy", "Zero copy",
+          "Build the output buffers of PES packets of up to 2944 bytes "
+          "from shares of the input memory, and copy bigger ones once into "
+          "an area sized from the previous packets instead of growing it",
+          FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BYTES_SHARED,
+      g_param_spec_uint64 ("bytes-shared", "Bytes shared",
+          "Number of output bytes pushed as shares of the input memory", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BYTES_COPIED,
+      g_param_spec_uint64 ("bytes-copied", "Bytes copied",
+          "Number of output bytes pushed after being copied", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_THREADED_OUTPUT,
+      g_param_spec_boolean ("threaded-output", "Threaded output",
+          "Push each stream from its own thread, so that a slow downstream "
+          "doesn't block the other streams (applies to new pads)",
+          DEFAULT_THREADED_OUTPUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_QUEUE_SIZE,
+      g_param_spec_uint ("output-queue-size", "Output queue size",
+          "Maximum number of bytes queued per stream in threaded-output mode "
+          "(0 = unlimited)",
+          0, G_MAXUINT, DEFAULT_OUTPUT_QUEUE_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&video_template));
@@ -322,6 +400,11 @@ gst_ts_demux_reset (MpegTSBase * base)
 
   demux->have_group_id = FALSE;
   demux->group_id = G_MAXUINT;
+
+  GST_OBJECT_LOCK (demux);
+  demux->bytes_shared = 0;
+  demux->bytes_copied = 0;
+  GST_OBJECT_UNLOCK (demux);
 }
 
 static void
@@ -336,6 +419,8 @@ gst_ts_demux_init (GstTSDemux * demux)
 
   demux->requested_program_number = -1;
   demux->program_number = -1;
+  demux->threaded_output = DEFAULT_THREADED_OUTPUT;
+  demux->output_queue_size = DEFAULT_OUTPUT_QUEUE_SIZE;
   gst_ts_demux_reset (base);
 }
 
@@ -355,6 +440,15 @@ gst_ts_demux_set_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       demux->emit_statistics = g_value_get_boolean (value);
       break;
+    case PROP_ZERO_COPY:
+      demux->zero_copy = g_value_get_boolean (value);
+      break;
+    case PROP_THREADED_OUTPUT:
+      demux->threaded_output = g_value_get_boolean (value);
+      break;
+    case PROP_OUTPUT_QUEUE_SIZE:
+      demux->output_queue_size = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -373,6 +467,25 @@ gst_ts_demux_get_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       g_value_set_boolean (value, demux->emit_statistics);
       break;
+    case PROP_ZERO_COPY:
+      g_value_set_boolean (value, demux->zero_copy);
+      break;
+    case PROP_BYTES_SHARED:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->bytes_shared);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_BYTES_COPIED:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->bytes_copied);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_THREADED_OUTPUT:
+      g_value_set_boolean (value, demux->threaded_output);
+      break;
+    case PROP_OUTPUT_QUEUE_SIZE:
+      g_value_set_uint (value, demux->output_queue_size);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -583,6 +696,202 @@ gst_ts_demux_srcpad_event (GstPad * pad, GstObject * parent, GstEvent * event)
   return res;
 }
 
+/* Threaded output */
+
+static void
+gst_ts_demux_output_item_free (GstDataQueueItem * item)
+{
+  if (item->object)
+    gst_mini_object_unref (item->object);
+  g_slice_free (GstDataQueueItem, item);
+}
+
+static gboolean
+gst_ts_demux_output_queue_full (GstDataQueue * queue, guint visible,
+    guint bytes, guint64 time, TSDemuxStream * stream)
+{
+  /* 0 means unlimited */
+  return stream->queue_size != 0 && bytes >= stream->queue_size;
+}
+
+static void
+gst_ts_demux_stream_set_output_flushing (TSDemuxStream * stream,
+    gboolean flushing)
+{
+  gst_data_queue_set_flushing (stream->queue, flushing);
+
+  g_mutex_lock (&stream->output_lock);
+  stream->output_flushing = flushing;
+  g_cond_broadcast (&stream->output_cond);
+  g_mutex_unlock (&stream->output_lock);
+}
+
+static void
+gst_ts_demux_stream_output_loop (TSDemuxStream * stream)
+{
+  GstDataQueueItem *item;
+  GstMiniObject *object;
+
+  if (!gst_data_queue_pop (stream->queue, &item)) {
+    GST_DEBUG_OBJECT (stream->pad, "flushing, pausing output task");
+    gst_task_pause (stream->task);
+    return;
+  }
+
+  object = item->object;
+  item->object = NULL;
+  item->destroy (item);
+
+  if (GST_IS_BUFFER (object)) {
+    GstFlowReturn res;
+
+    res = gst_pad_push (stream->pad, GST_BUFFER_CAST (object));
+    GST_LOG_OBJECT (stream->pad, "Returned %s", gst_flow_get_name (res));
+    /* Picked up (and combined) by the next push from the streaming thread */
+    g_atomic_int_set ((gint *) & stream->flow_return, res);
+  } else {
+    GstEvent *event = GST_EVENT_CAST (object);
+    gboolean is_eos = GST_EVENT_TYPE (event) == GST_EVENT_EOS;
+
+    gst_pad_push_event (stream->pad, event);
+
+    if (is_eos) {
+      g_mutex_lock (&stream->output_lock);
+      stream->drained = TRUE;
+      g_cond_broadcast (&stream->output_cond);
+      g_mutex_unlock (&stream->output_lock);
+    }
+  }
+}
+
+static void
+gst_ts_demux_stream_start_output (GstTSDemux * demux, TSDemuxStream * stream)
+{
+  GST_DEBUG_OBJECT (stream->pad, "Starting output task");
+
+  stream->queue_size = demux->output_queue_size;
+  stream->queue = gst_data_queue_new ((GstDataQueueCheckFullFunction)
+      gst_ts_demux_output_queue_full, NULL, NULL, stream);
+  stream->drained = FALSE;
+  stream->output_flushing = FALSE;
+  g_mutex_init (&stream->output_lock);
+  g_cond_init (&stream->output_cond);
+
+  g_rec_mutex_init (&stream->task_lock);
+  stream->task = gst_task_new ((GstTaskFunction)
+      gst_ts_demux_stream_output_loop, stream, NULL);
+  gst_task_set_lock (stream->task, &stream->task_lock);
+  gst_task_start (stream->task);
+}
+
+/* If @drain is TRUE, waits for everything queued up to EOS to be pushed */
+static void
+gst_ts_demux_stream_stop_output (TSDemuxStream * stream, gboolean drain)
+{
+  if (stream->queue == NULL)
+    return;
+
+  GST_DEBUG_OBJECT (stream->pad, "Stopping output task (drain:%d)", drain);
+
+  if (drain) {
+    g_mutex_lock (&stream->output_lock);
+    while (!stream->drained && !stream->output_flushing)
+      g_cond_wait (&stream->output_cond, &stream->output_lock);
+    g_mutex_unlock (&stream->output_lock);
+  }
+
+  gst_ts_demux_stream_set_output_flushing (stream, TRUE);
+  gst_task_stop (stream->task);
+  gst_task_join (stream->task);
+  gst_object_unref (stream->task);
+  stream->task = NULL;
+  g_rec_mutex_clear (&stream->task_lock);
+
+  gst_data_queue_flush (stream->queue);
+  g_object_unref (stream->queue);
+  stream->queue = NULL;
+  g_mutex_clear (&stream->output_lock);
+  g_cond_clear (&stream->output_cond);
+}
+
+static GstFlowReturn
+gst_ts_demux_stream_push_buffer (GstTSDemux * demux, TSDemuxStream * stream,
+    GstBuffer * buffer)
+{
+  GstDataQueueItem *item;
+  GstFlowReturn res;
+
+  if (stream->queue == NULL) {
+    res = gst_pad_push (stream->pad, buffer);
+    GST_DEBUG_OBJECT (stream->pad, "Returned %s", gst_flow_get_name (res));
+  } else {
+    item = g_slice_new0 (GstDataQueueItem);
+    item->object = GST_MINI_OBJECT_CAST (buffer);
+    item->size = gst_buffer_get_size (buffer);
+    item->visible = TRUE;
+    item->destroy = (GDestroyNotify) gst_ts_demux_output_item_free;
+
+    /* Blocks if the queue is full */
+    if (!gst_data_queue_push (stream->queue, item)) {
+      item->destroy (item);
+      res = GST_FLOW_FLUSHING;
+    } else {
+      /* Return what the output task got from downstream so far */
+      res = g_atomic_int_get ((gint *) & stream->flow_return);
+    }
+  }
+
+  return tsdemux_combine_flows (demux, stream, res);
+}
+
+static gboolean
+gst_ts_demux_stream_push_event (TSDemuxStream * stream, GstEvent * event)
+{
+  GstDataQueueItem *item;
+  gboolean res;
+
+  if (stream->queue == NULL)
+    return gst_pad_push_event (stream->pad, event);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      gst_ts_demux_stream_set_output_flushing (stream, TRUE);
+      return gst_pad_push_event (stream->pad, event);
+    case GST_EVENT_FLUSH_STOP:
+      /* Taking the task lock waits for the task to be paused */
+      g_rec_mutex_lock (&stream->task_lock);
+      gst_data_queue_flush (stream->queue);
+      g_rec_mutex_unlock (&stream->task_lock);
+      res = gst_pad_push_event (stream->pad, event);
+      gst_ts_demux_stream_set_output_flushing (stream, FALSE);
+      gst_task_start (stream->task);
+      return res;
+    default:
+      break;
+  }
+
+  if (!GST_EVENT_IS_SERIALIZED (event))
+    return gst_pad_push_event (stream->pad, event);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+    g_mutex_lock (&stream->output_lock);
+    stream->drained = FALSE;
+    g_mutex_unlock (&stream->output_lock);
+  }
+
+  item = g_slice_new0 (GstDataQueueItem);
+  item->object = GST_MINI_OBJECT_CAST (event);
+  item->visible = TRUE;
+  item->destroy = (GDestroyNotify) gst_ts_demux_output_item_free;
+
+  if (!gst_data_queue_push (stream->queue, item)) {
+    item->destroy (item);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 static gboolean
 push_event (MpegTSBase * base, GstEvent * event)
 {
@@ -609,7 +918,7 @@ push_event (MpegTSBase * base, GstEvent * event)
         gst_ts_demux_push_pending_data (demux, stream);
 
       gst_event_ref (event);
-      gst_pad_push_event (stream->pad, event);
+      gst_ts_demux_stream_push_event (stream, event);
     }
   }
 
@@ -624,8 +933,9 @@ tsdemux_combine_flows (GstTSDemux * demux, TSDemuxStream * stream,
 {
   GList *tmp;
 
-  /* Store the value */
-  stream->flow_return = ret;
+  /* Store the value, the output task does that in threaded-output mode */
+  if (stream->queue == NULL)
+    g_atomic_int_set ((gint *) & stream->flow_return, ret);
 
   /* any other error that is not-linked can be returned right away */
   if (ret != GST_FLOW_NOT_LINKED)
@@ -635,7 +945,7 @@ tsdemux_combine_flows (GstTSDemux * demux, TSDemuxStream * stream,
   for (tmp = demux->program->stream_list; tmp; tmp = tmp->next) {
     stream = (TSDemuxStream *) tmp->data;
     if (stream->pad) {
-      ret = stream->flow_return;
+      ret = g_atomic_int_get ((gint *) & stream->flow_return);
       /* some other return value (must be SUCCESS but we can return
        * other values as well) */
       if (ret != GST_FLOW_NOT_LINKED)
@@ -1061,7 +1371,7 @@ gst_ts_demux_stream_added (MpegTSBase * base, MpegTSBaseStream * bstream,
     stream->dts = GST_CLOCK_TIME_NONE;
     stream->continuity_counter = CONTINUITY_UNSET;
   }
-  stream->flow_return = GST_FLOW_OK;
+  g_atomic_int_set ((gint *) & stream->flow_return, GST_FLOW_OK);
 }
 
 static void
@@ -1076,16 +1386,18 @@ gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
       gst_ts_demux_push_pending_data ((GstTSDemux *) base, stream);
 
       GST_DEBUG_OBJECT (stream->pad, "Pushing out EOS");
-      gst_pad_push_event (stream->pad, gst_event_new_eos ());
+      gst_ts_demux_stream_push_event (stream, gst_event_new_eos ());
+      gst_ts_demux_stream_stop_output (stream, TRUE);
       GST_DEBUG_OBJECT (stream->pad, "Deactivating and removing pad");
       gst_pad_set_active (stream->pad, FALSE);
       gst_element_remove_pad (GST_ELEMENT_CAST (base), stream->pad);
       stream->active = FALSE;
     }
+    gst_ts_demux_stream_stop_output (stream, FALSE);
     stream->pad = NULL;
   }
   gst_ts_demux_stream_flush (stream);
-  stream->flow_return = GST_FLOW_NOT_LINKED;
+  g_atomic_int_set ((gint *) & stream->flow_return, GST_FLOW_NOT_LINKED);
 }
 
 static void
@@ -1101,6 +1413,9 @@ activate_pad_for_stream (GstTSDemux * tsdemux, TSDemuxStream * stream)
     stream->active = TRUE;
     GST_DEBUG_OBJECT (stream->pad, "done adding pad");
 
+    if (tsdemux->threaded_output)
+      gst_ts_demux_stream_start_output (tsdemux, stream);
+
     /* Check if all pads were activated, and if so emit no-more-pads */
     for (tmp = tsdemux->program->stream_list; tmp; tmp = tmp->next) {
       stream = (TSDemuxStream *) tmp->data;
@@ -1128,16 +1443,20 @@ gst_ts_demux_stream_flush (TSDemuxStream * stream)
   if (stream->data)
     g_free (stream->data);
   stream->data = NULL;
+  if (stream->buffer)
+    gst_buffer_unref (stream->buffer);
+  stream->buffer = NULL;
   stream->state = PENDING_PACKET_EMPTY;
   stream->expected_size = 0;
   stream->allocated_size = 0;
   stream->current_size = 0;
+  stream->shared_size = 0;
+  stream->copied_size = 0;
   stream->need_newsegment = TRUE;
   stream->pts = GST_CLOCK_TIME_NONE;
   stream->dts = GST_CLOCK_TIME_NONE;
-  if (stream->flow_return == GST_FLOW_FLUSHING) {
-    stream->flow_return = GST_FLOW_OK;
-  }
+  g_atomic_int_compare_and_exchange ((gint *) & stream->flow_return,
+      GST_FLOW_FLUSHING, GST_FLOW_OK);
   stream->continuity_counter = CONTINUITY_UNSET;
 }
 
@@ -1250,6 +1569,76 @@ gst_ts_demux_record_dts (GstTSDemux * demux, TSDemuxStream * stream,
   }
 }
 
+/* Whether the pending PES packet is expected to fit in a buffer of shared
+ * memories (one per TS packet) */
+static inline gboolean
+gst_ts_demux_stream_can_share (TSDemuxStream * stream)
+{
+  guint size;
+
+  size = stream->expected_size ? stream->expected_size : stream->size_hint;
+
+  return size <= MAX_SHARED_MEMORIES * TS_PAYLOAD_SIZE;
+}
+
+/* Moves the shared data of the pending PES packet to an allocated area big
+ * enough for what we expect the complete packet to be */
+static void
+gst_ts_demux_stream_unshare (TSDemuxStream * stream, guint size)
+{
+  GST_LOG ("pid: 0x%04x copying %u shared bytes", stream->stream.pid,
+      stream->current_size);
+
+  stream->allocated_size = MAX (stream->expected_size, stream->size_hint);
+  stream->allocated_size = MAX (stream->allocated_size, 8192);
+  stream->allocated_size =
+      MAX (stream->allocated_size, stream->current_size + size);
+
+  stream->data = g_malloc (stream->allocated_size);
+  gst_buffer_extract (stream->buffer, 0, stream->data, stream->current_size);
+  gst_buffer_unref (stream->buffer);
+  stream->buffer = NULL;
+
+  stream->copied_size += stream->current_size;
+  stream->shared_size = 0;
+}
+
+static void
+gst_ts_demux_stream_append_data (GstTSDemux * demux, TSDemuxStream * stream,
+    guint8 * data, guint size)
+{
+  if (G_UNLIKELY (size == 0))
+    return;
+
+  if (stream->buffer) {
+    GstMemory *mem = NULL;
+
+    if (gst_buffer_n_memory (stream->buffer) < MAX_SHARED_MEMORIES)
+      mem = mpegts_packetizer_share_memory (((MpegTSBase *) demux)->packetizer,
+          data, size);
+
+    if (mem) {
+      gst_buffer_append_memory (stream->buffer, mem);
+      stream->current_size += size;
+      stream->shared_size += size;
+      return;
+    }
+
+    gst_ts_demux_stream_unshare (stream, size);
+  }
+
+  if (G_UNLIKELY (stream->current_size + size > stream->allocated_size)) {
+    GST_LOG ("resizing buffer");
+    do {
+      stream->allocated_size *= 2;
+    } while (stream->current_size + size > stream->allocated_size);
+    stream->data = g_realloc (stream->data, stream->allocated_size);
+  }
+  memcpy (stream->data + stream->current_size, data, size);
+  stream->current_size += size;
+  stream->copied_size += size;
+}
+
 static void
 gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
     guint8 * data, guint32 length, guint64 bufferoffset)
@@ -1291,16 +1680,25 @@ gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
   data += header.header_size;
   length -= header.header_size;
 
-  /* Create the output buffer */
-  if (stream->expected_size)
-    stream->allocated_size = MAX (stream->expected_size, length);
-  else
-    stream->allocated_size = MAX (8192, length);
+  g_assert (stream->data == NULL && stream->buffer == NULL);
 
-  g_assert (stream->data == NULL);
-  stream->data = g_malloc (stream->allocated_size);
-  memcpy (stream->data, data, length);
-  stream->current_size = length;
+  /* Create the output buffer */
+  if (demux->zero_copy && gst_ts_demux_stream_can_share (stream)) {
+    stream->buffer = gst_buffer_new ();
+  } else {
+    if (stream->expected_size)
+      stream->allocated_size = MAX (stream->expected_size, length);
+    else if (demux->zero_copy)
+      stream->allocated_size = MAX (MAX (8192, stream->size_hint), length);
+    else
+      stream->allocated_size = MAX (8192, length);
+
+    stream->data = g_malloc (stream->allocated_size);
+  }
+  stream->current_size = 0;
+  stream->shared_size = 0;
+  stream->copied_size = 0;
+  gst_ts_demux_stream_append_data (demux, stream, data, length);
 
   stream->state = PENDING_PACKET_BUFFER;
 
@@ -1362,15 +1760,7 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
     case PENDING_PACKET_BUFFER:
     {
       GST_LOG ("BUFFER: appending data");
-      if (G_UNLIKELY (stream->current_size + size > stream->allocated_size)) {
-        GST_LOG ("resizing buffer");
-        do {
-          stream->allocated_size *= 2;
-        } while (stream->current_size + size > stream->allocated_size);
-        stream->data = g_realloc (stream->data, stream->allocated_size);
-      }
-      memcpy (stream->data + stream->current_size, data, size);
-      stream->current_size += size;
+      gst_ts_demux_stream_append_data (demux, stream, data, size);
       break;
     }
     case PENDING_PACKET_DISCONT:
@@ -1380,6 +1770,13 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
         g_free (stream->data);
         stream->data = NULL;
       }
+      if (G_UNLIKELY (stream->buffer)) {
+        gst_buffer_unref (stream->buffer);
+        stream->buffer = NULL;
+      }
+      stream->current_size = 0;
+      stream->shared_size = 0;
+      stream->copied_size = 0;
       stream->continuity_counter = CONTINUITY_UNSET;
       break;
     }
@@ -1467,20 +1864,21 @@ push_new_segment:
   if (demux->update_segment) {
     GST_DEBUG_OBJECT (stream->pad, "Pushing update segment");
     gst_event_ref (demux->update_segment);
-    gst_pad_push_event (stream->pad, demux->update_segment);
+    gst_ts_demux_stream_push_event (stream, demux->update_segment);
   }
 
   if (demux->segment_event) {
     GST_DEBUG_OBJECT (stream->pad, "Pushing newsegment event");
     gst_event_ref (demux->segment_event);
-    gst_pad_push_event (stream->pad, demux->segment_event);
+    gst_ts_demux_stream_push_event (stream, demux->segment_event);
   }
 
   /* Push pending tags */
   if (stream->taglist) {
     GST_DEBUG_OBJECT (stream->pad, "Sending tags %" GST_PTR_FORMAT,
         stream->taglist);
-    gst_pad_push_event (stream->pad, gst_event_new_tag (stream->taglist));
+    gst_ts_demux_stream_push_event (stream,
+        gst_event_new_tag (stream->taglist));
     stream->taglist = NULL;
   }
 
@@ -1500,7 +1898,7 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
       "stream:%p, pid:0x%04x stream_type:%d state:%d", stream, bs->pid,
       bs->stream_type, stream->state);
 
-  if (G_UNLIKELY (stream->data == NULL)) {
+  if (G_UNLIKELY (stream->data == NULL && stream->buffer == NULL)) {
     GST_LOG ("stream->data == NULL");
     goto beach;
   }
@@ -1520,19 +1918,34 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
 
   if (G_UNLIKELY (stream->pad == NULL)) {
     g_free (stream->data);
+    if (stream->buffer)
+      gst_buffer_unref (stream->buffer);
     goto beach;
   }
 
   if (G_UNLIKELY (demux->program == NULL)) {
     GST_LOG_OBJECT (demux, "No program");
     g_free (stream->data);
+    if (stream->buffer)
+      gst_buffer_unref (stream->buffer);
     goto beach;
   }
 
   if (G_UNLIKELY (stream->need_newsegment))
     calculate_and_push_newsegment (demux, stream);
 
-  buffer = gst_buffer_new_wrapped (stream->data, stream->current_size);
+  if (stream->buffer)
+    buffer = stream->buffer;
+  else
+    buffer = gst_buffer_new_wrapped (stream->data, stream->current_size);
+
+  stream->size_hint = MAX (stream->current_size,
+      stream->size_hint - stream->size_hint / 8);
+
+  GST_OBJECT_LOCK (demux);
+  demux->bytes_shared += stream->shared_size;
+  demux->bytes_copied += stream->copied_size;
+  GST_OBJECT_UNLOCK (demux);
 
   GST_DEBUG_OBJECT (stream->pad, "stream->pts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (stream->pts));
@@ -1546,9 +1959,7 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
       GST_TIME_ARGS (GST_BUFFER_PTS (buffer)),
       GST_TIME_ARGS (GST_BUFFER_DTS (buffer)));
 
-  res = gst_pad_push (stream->pad, buffer);
-  GST_DEBUG_OBJECT (stream->pad, "Returned %s", gst_flow_get_name (res));
-  res = tsdemux_combine_flows (demux, stream, res);
+  res = gst_ts_demux_stream_push_buffer (demux, stream, buffer);
   GST_DEBUG_OBJECT (stream->pad, "combined %s", gst_flow_get_name (res));
 
 beach:
@@ -1556,8 +1967,11 @@ beach:
   GST_LOG ("Resetting to EMPTY, returning %s", gst_flow_get_name (res));
   stream->state = PENDING_PACKET_EMPTY;
   stream->data = NULL;
+  stream->buffer = NULL;
   stream->expected_size = 0;
   stream->current_size = 0;
+  stream->shared_size = 0;
+  stream->copied_size = 0;
 
   return res;
 }
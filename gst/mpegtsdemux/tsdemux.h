@@ -61,6 +61,11 @@ struct _GstTSDemux
   gint requested_program_number; /* Required program number (ignore:-1) */
   guint program_number;
   gboolean emit_statistics;
+  gboolean zero_copy;
+  guint64 bytes_shared;
+  guint64 bytes_copied;
+  gboolean threaded_output;
+  guint output_queue_size;
 
   /*< private >*/
   MpegTSBaseProgram *program;	/* Current program */
@@ -109,11 +109,16 @@ enum
   ARG_M2TS_MODE,
   ARG_PAT_INTERVAL,
   ARG_PMT_INTERVAL,
-  ARG_ALIGNMENT
+  ARG_ALIGNMENT,
+  ARG_BITRATE
 };
 
 #define MPEGTSMUX_DEFAULT_ALIGNMENT    -1
 #define MPEGTSMUX_DEFAULT_M2TS         FALSE
+#define MPEGTSMUX_DEFAULT_BITRATE      0
+
+/* packets per output buffer if no alignment is requested */
+#define MPEGTSMUX_DEFAULT_CHUNK_PACKETS 64
 
 static GstStaticPadTemplate mpegtsmux_sink_factory =
     GST_STATIC_PAD_TEMPLATE ("sink_%d",
@@ -152,14 +157,12 @@ static void gst_mpegtsmux_get_property (GObject * object, guint prop_id,
 
 static void mpegtsmux_reset (MpegTsMux * mux, gboolean alloc);
 static void mpegtsmux_dispose (GObject * object);
-static void alloc_packet_cb (GstBuffer ** _buf, void *user_data);
-static gboolean new_packet_cb (GstBuffer * buf, void *user_data,
-    gint64 new_pcr);
+static guint8 *alloc_packet_cb (void *user_data);
+static gboolean new_packet_cb (guint8 * data, void *user_data, gint64 new_pcr);
 static void release_buffer_cb (guint8 * data, void *user_data);
-static GstFlowReturn mpegtsmux_collect_packet (MpegTsMux * mux,
-    GstBuffer * buf);
+static void mpegtsmux_clear_output (MpegTsMux * mux);
 static GstFlowReturn mpegtsmux_push_packets (MpegTsMux * mux, gboolean force);
-static gboolean new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf,
+static gboolean new_packet_m2ts (MpegTsMux * mux, guint8 * data,
     gint64 new_pcr);
 
 static void mpegtsdemux_prepare_srcpad (MpegTsMux * mux);
@@ -272,10 +275,21 @@ mpegtsmux_class_init (MpegTsMuxClass * klass)
 
   g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_ALIGNMENT,
       g_param_spec_int ("alignment", "packet alignment",
-          "Number of packets per buffer (padded with dummy packets on EOS) "
+          "Number of packets per buffer (padded with dummy packets on EOS), "
+          "e.g. 7 for UDP or several thousand for file output. All buffers "
+          "completed for an input buffer are pushed as one buffer list "
           "(-1 = auto, 0 = all available packets)",
           -1, G_MAXINT, MPEGTSMUX_DEFAULT_ALIGNMENT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_BITRATE,
+      g_param_spec_uint64 ("bitrate", "Bitrate",
+          "Constant output bitrate in bits per second, gaps are filled with "
+          "null packets and PCR follows the output position. M2TS headers "
+          "are not counted (0 = variable bitrate)",
+          0, G_MAXUINT64, MPEGTSMUX_DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
 }
 
 static void
@@ -302,8 +316,7 @@ mpegtsmux_init (MpegTsMux * mux)
   mux->tsmux = tsmux_new ();
   tsmux_set_write_func (mux->tsmux, new_packet_cb, mux);
 
-  mux->adapter = gst_adapter_new ();
-  mux->out_adapter = gst_adapter_new ();
+  mux->m2ts_pending = g_byte_array_new ();
 
   /* properties */
   mux->m2ts_mode = MPEGTSMUX_DEFAULT_M2TS;
@@ -311,6 +324,7 @@ mpegtsmux_init (MpegTsMux * mux)
   mux->pmt_interval = TSMUX_DEFAULT_PMT_INTERVAL;
   mux->prog_map = NULL;
   mux->alignment = MPEGTSMUX_DEFAULT_ALIGNMENT;
+  mux->bitrate = MPEGTSMUX_DEFAULT_BITRATE;
 
   /* initial state */
   mpegtsmux_reset (mux, TRUE);
@@ -365,8 +379,12 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->element_index = NULL;
   }
 #endif
-  gst_adapter_clear (mux->adapter);
-  gst_adapter_clear (mux->out_adapter);
+  mpegtsmux_clear_output (mux);
+  if (mux->out_pool) {
+    gst_buffer_pool_set_active (mux->out_pool, FALSE);
+    gst_object_unref (mux->out_pool);
+    mux->out_pool = NULL;
+  }
 
   if (mux->tsmux) {
     tsmux_free (mux->tsmux);
@@ -389,7 +407,6 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->streamheader = NULL;
   }
   gst_event_replace (&mux->force_key_unit_event, NULL);
-  gst_buffer_replace (&mux->out_buffer, NULL);
 
   GST_COLLECT_PADS_STREAM_LOCK (mux->collect);
   for (walk = mux->collect->data; walk != NULL; walk = g_slist_next (walk))
@@ -400,6 +417,7 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
     mux->tsmux = tsmux_new ();
     tsmux_set_write_func (mux->tsmux, new_packet_cb, mux);
     tsmux_set_alloc_func (mux->tsmux, alloc_packet_cb, mux);
+    tsmux_set_bitrate (mux->tsmux, mux->bitrate);
   }
 }
 
@@ -410,13 +428,9 @@ mpegtsmux_dispose (GObject * object)
 
   mpegtsmux_reset (mux, FALSE);
 
-  if (mux->adapter) {
-    g_object_unref (mux->adapter);
-    mux->adapter = NULL;
-  }
-  if (mux->out_adapter) {
-    g_object_unref (mux->out_adapter);
-    mux->out_adapter = NULL;
+  if (mux->m2ts_pending) {
+    g_byte_array_free (mux->m2ts_pending, TRUE);
+    mux->m2ts_pending = NULL;
   }
   if (mux->collect) {
     gst_object_unref (mux->collect);
@@ -472,6 +486,20 @@ gst_mpegtsmux_set_property (GObject * object, guint prop_id,
     case ARG_ALIGNMENT:
       mux->alignment = g_value_get_int (value);
       break;
+    case ARG_BITRATE:
+      /* the muxer is not locked against the streaming thread */
+      GST_OBJECT_LOCK (mux);
+      if (GST_STATE (mux) > GST_STATE_READY) {
+        GST_OBJECT_UNLOCK (mux);
+        GST_WARNING_OBJECT (mux, "The bitrate can only be changed in the "
+            "NULL or READY state");
+        break;
+      }
+      GST_OBJECT_UNLOCK (mux);
+      mux->bitrate = g_value_get_uint64 (value);
+      if (mux->tsmux)
+        tsmux_set_bitrate (mux->tsmux, mux->bitrate);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -500,6 +528,9 @@ gst_mpegtsmux_get_property (GObject * object, guint prop_id,
     case ARG_ALIGNMENT:
       g_value_set_int (value, mux->alignment);
       break;
+    case ARG_BITRATE:
+      g_value_set_uint64 (value, mux->bitrate);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1268,25 +1299,19 @@ mpegtsmux_release_pad (GstElement * element, GstPad * pad)
   gst_element_remove_pad (element, pad);
 }
 
-static void
-new_packet_common_init (MpegTsMux * mux, GstBuffer * buf, guint8 * data,
-    guint len)
+static gboolean
+new_packet_common_init (MpegTsMux * mux, const guint8 * data, guint len)
 {
-  /* Packets should be at least 188 bytes, but check anyway */
-  g_return_if_fail (len >= 2 || !data);
+  gboolean delta;
 
-  if (!mux->streamheader_sent && data) {
+  if (!mux->streamheader_sent) {
     guint pid = ((data[1] & 0x1f) << 8) | data[2];
     /* if it's a PAT or a PMT */
     if (pid == 0x00 || (pid >= TSMUX_START_PMT_PID && pid < TSMUX_START_ES_PID)) {
       GstBuffer *hbuf;
 
-      if (!buf) {
-        hbuf = gst_buffer_new_and_alloc (len);
-        gst_buffer_fill (hbuf, 0, data, len);
-      } else {
-        hbuf = gst_buffer_copy (buf);
-      }
+      hbuf = gst_buffer_new_and_alloc (len);
+      gst_buffer_fill (hbuf, 0, data, len);
       mux->streamheader = g_list_append (mux->streamheader, hbuf);
     } else if (mux->streamheader) {
       mpegtsdemux_set_header_on_caps (mux);
@@ -1294,86 +1319,185 @@ new_packet_common_init (MpegTsMux * mux, GstBuffer * buf, guint8 * data,
     }
   }
 
-  if (buf) {
-    if (mux->is_delta) {
-      GST_LOG_OBJECT (mux, "marking as delta unit");
-      GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
-    } else {
-      GST_DEBUG_OBJECT (mux, "marking as non-delta unit");
-      mux->is_delta = TRUE;
-    }
+  delta = mux->is_delta;
+  if (delta) {
+    GST_LOG_OBJECT (mux, "marking as delta unit");
+  } else {
+    GST_DEBUG_OBJECT (mux, "marking as non-delta unit");
+    mux->is_delta = TRUE;
   }
+
+  return delta;
 }
 
-static GstFlowReturn
-mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
+/* number of packets that are aggregated into one output buffer, 0 if
+ * whatever is available should be pushed after each input buffer */
+static gint
+mpegtsmux_get_alignment (MpegTsMux * mux)
 {
   gint align = mux->alignment;
-  gint av, packet_size;
-  GstBuffer *buf;
-  GstFlowReturn ret = GST_FLOW_OK;
-  GstClockTime ts;
 
-  if (mux->m2ts_mode) {
-    packet_size = M2TS_PACKET_LENGTH;
-    if (align < 0)
-      align = 32;
-  } else {
-    packet_size = NORMAL_TS_PACKET_LENGTH;
-    if (align < 0)
-      align = 0;
+  if (align < 0)
+    align = mux->m2ts_mode ? 32 : 0;
+
+  return align;
+}
+
+static gboolean
+mpegtsmux_start_output_buffer (MpegTsMux * mux)
+{
+  GstBuffer *buf = NULL;
+  gint align, packet_size;
+  guint size;
+
+  packet_size = mux->m2ts_mode ? M2TS_PACKET_LENGTH : NORMAL_TS_PACKET_LENGTH;
+  align = mpegtsmux_get_alignment (mux);
+  size = (align ? align : MPEGTSMUX_DEFAULT_CHUNK_PACKETS) * packet_size;
+
+  if (mux->out_pool && mux->out_buffer_size != size) {
+    gst_buffer_pool_set_active (mux->out_pool, FALSE);
+    gst_object_unref (mux->out_pool);
+    mux->out_pool = NULL;
   }
 
-  av = gst_adapter_available (mux->out_adapter);
-  GST_LOG_OBJECT (mux, "align %d, av %d", align, av);
+  if (!mux->out_pool) {
+    GstStructure *config;
+
+    GST_DEBUG_OBJECT (mux, "creating pool of %u byte output buffers", size);
+    mux->out_pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (mux->out_pool);
+    gst_buffer_pool_config_set_params (config, NULL, size, 0, 0);
+    if (!gst_buffer_pool_set_config (mux->out_pool, config) ||
+        !gst_buffer_pool_set_active (mux->out_pool, TRUE)) {
+      GST_ERROR_OBJECT (mux, "failed to configure output buffer pool");
+      gst_object_unref (mux->out_pool);
+      mux->out_pool = NULL;
+      return FALSE;
+    }
+    mux->out_buffer_size = size;
+  }
 
-  if (!align)
-    align = av;
-  else
-    align *= packet_size;
+  if (gst_buffer_pool_acquire_buffer (mux->out_pool, &buf,
+          NULL) != GST_FLOW_OK)
+    return FALSE;
 
-  /* FIXME: what about DTS here? */
-  GST_LOG_OBJECT (mux, "aligning to %d bytes", align);
-  if (G_LIKELY ((align <= av) && av)) {
-    GST_LOG_OBJECT (mux, "pushing %d aligned bytes", av - (av % align));
-    ts = gst_adapter_prev_pts (mux->out_adapter, NULL);
-    buf = gst_adapter_take_buffer (mux->out_adapter, av - (av % align));
-    g_assert (buf);
-    GST_BUFFER_PTS (buf) = ts;
+  /* a recycled buffer may have been trimmed when it was last pushed */
+  gst_buffer_set_size (buf, size);
+  if (!gst_buffer_map (buf, &mux->out_map, GST_MAP_WRITE)) {
+    gst_buffer_unref (buf);
+    return FALSE;
+  }
 
-    ret = gst_pad_push (mux->srcpad, buf);
-    av = av % align;
+  GST_BUFFER_PTS (buf) = mux->last_ts;
+  GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  mux->out_buffer = buf;
+  mux->out_offset = 0;
+
+  return TRUE;
+}
+
+/* queue the current output buffer for pushing, trimmed to the packets
+ * that were actually written into it */
+static void
+mpegtsmux_finish_output_buffer (MpegTsMux * mux)
+{
+  GstBuffer *buf = mux->out_buffer;
+
+  if (!buf)
+    return;
+
+  gst_buffer_unmap (buf, &mux->out_map);
+  mux->out_buffer = NULL;
+
+  if (mux->out_offset == 0) {
+    gst_buffer_unref (buf);
+    return;
   }
 
-  if (av && force) {
-    guint8 *data;
-    guint32 header;
-    gint dummy;
-    GstMapInfo map;
+  gst_buffer_set_size (buf, mux->out_offset);
+  GST_LOG_OBJECT (mux, "queueing output buffer of %u bytes", mux->out_offset);
+  if (!mux->out_list)
+    mux->out_list = gst_buffer_list_new ();
+  gst_buffer_list_add (mux->out_list, buf);
+}
+
+static void
+mpegtsmux_clear_output (MpegTsMux * mux)
+{
+  if (mux->out_buffer) {
+    gst_buffer_unmap (mux->out_buffer, &mux->out_map);
+    gst_buffer_replace (&mux->out_buffer, NULL);
+  }
+  if (mux->out_list) {
+    gst_buffer_list_unref (mux->out_list);
+    mux->out_list = NULL;
+  }
+  if (mux->m2ts_pending)
+    g_byte_array_set_size (mux->m2ts_pending, 0);
+  mux->m2ts_pending_delta = TRUE;
+}
 
-    GST_LOG_OBJECT (mux, "handling %d leftover bytes", av);
-    buf = gst_buffer_new_and_alloc (align);
-    gst_buffer_map (buf, &map, GST_MAP_READ);
-    data = map.data;
-    ts = gst_adapter_prev_pts (mux->out_adapter, NULL);
+/* copy already finished packets into the output buffers */
+static gboolean
+mpegtsmux_write_output (MpegTsMux * mux, const guint8 * data, guint len,
+    gboolean delta)
+{
+  while (len > 0) {
+    guint avail;
 
-    gst_adapter_copy (mux->out_adapter, data, 0, av);
-    gst_adapter_clear (mux->out_adapter);
-    GST_BUFFER_PTS (buf) = ts;
+    if (!mux->out_buffer && !mpegtsmux_start_output_buffer (mux))
+      return FALSE;
 
-    data += av;
-    header = GST_READ_UINT32_BE (data - packet_size);
+    if (!delta) {
+      GST_BUFFER_FLAG_UNSET (mux->out_buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+      delta = TRUE;
+    }
 
-    dummy = (map.size - av) / packet_size;
-    GST_LOG_OBJECT (mux, "adding %d null packets", dummy);
+    avail = MIN (len, mux->out_map.size - mux->out_offset);
+    memcpy (mux->out_map.data + mux->out_offset, data, avail);
+    mux->out_offset += avail;
+    data += avail;
+    len -= avail;
 
-    for (; dummy > 0; dummy--) {
+    if (mux->out_offset == mux->out_map.size)
+      mpegtsmux_finish_output_buffer (mux);
+  }
+
+  return TRUE;
+}
+
+static GstFlowReturn
+mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
+{
+  gint align = mpegtsmux_get_alignment (mux);
+  GstBufferList *list;
+  GstBuffer *buf;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  GST_LOG_OBJECT (mux, "align %d, pending %u bytes", align,
+      mux->out_buffer ? mux->out_offset : 0);
+
+  if (mux->out_buffer && mux->out_offset && align && force) {
+    guint8 *data, *end;
+    guint32 header = 0;
+    gint packet_size;
+
+    packet_size = mux->m2ts_mode ? M2TS_PACKET_LENGTH : NORMAL_TS_PACKET_LENGTH;
+    data = mux->out_map.data + mux->out_offset;
+    end = mux->out_map.data + mux->out_map.size;
+    if (packet_size > NORMAL_TS_PACKET_LENGTH)
+      header = GST_READ_UINT32_BE (data - packet_size);
+
+    GST_LOG_OBJECT (mux, "adding %d null packets",
+        (gint) ((end - data) / packet_size));
+
+    while (data < end) {
       gint offset;
 
       if (packet_size > NORMAL_TS_PACKET_LENGTH) {
-        GST_WRITE_UINT32_BE (data, header);
         /* simply increase header a bit and never mind too much */
         header++;
+        GST_WRITE_UINT32_BE (data, header);
         offset = 4;
       } else {
         offset = 0;
@@ -1387,43 +1511,55 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
       memset (data + offset + 4, 0, NORMAL_TS_PACKET_LENGTH - 4);
       data += packet_size;
     }
+    mux->out_offset = mux->out_map.size;
+  }
 
-    gst_buffer_unmap (buf, &map);
+  /* without alignment, or when draining, whatever we have goes out now */
+  if (!align || force)
+    mpegtsmux_finish_output_buffer (mux);
 
+  if (!mux->out_list)
+    return ret;
+
+  list = mux->out_list;
+  mux->out_list = NULL;
+
+  /* all buffers completed for this input buffer go out in one go */
+  if (gst_buffer_list_length (list) == 1) {
+    buf = gst_buffer_ref (gst_buffer_list_get (list, 0));
+    gst_buffer_list_unref (list);
+    GST_LOG_OBJECT (mux, "pushing buffer of %" G_GSIZE_FORMAT " bytes",
+        gst_buffer_get_size (buf));
     ret = gst_pad_push (mux->srcpad, buf);
+  } else {
+    GST_LOG_OBJECT (mux, "pushing list of %u buffers",
+        gst_buffer_list_length (list));
+    ret = gst_pad_push_list (mux->srcpad, list);
   }
 
   return ret;
 }
 
-static GstFlowReturn
-mpegtsmux_collect_packet (MpegTsMux * mux, GstBuffer * buf)
-{
-  GST_LOG_OBJECT (mux, "collecting packet size %" G_GSIZE_FORMAT,
-      gst_buffer_get_size (buf));
-  gst_adapter_push (mux->out_adapter, buf);
-
-  return GST_FLOW_OK;
-}
-
 static gboolean
-new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
+new_packet_m2ts (MpegTsMux * mux, guint8 * data, gint64 new_pcr)
 {
-  GstBuffer *out_buf;
-  int chunk_bytes;
-  GstMapInfo map;
+  GByteArray *pending = mux->m2ts_pending;
+  guint chunk_bytes;
+  gboolean ret;
 
-  GST_LOG_OBJECT (mux, "Have buffer %p with new_pcr=%" G_GINT64_FORMAT,
-      buf, new_pcr);
+  GST_LOG_OBJECT (mux, "Have packet %p with new_pcr=%" G_GINT64_FORMAT,
+      data, new_pcr);
 
-  chunk_bytes = gst_adapter_available (mux->adapter);
+  /* the packet itself was written right behind the pending data */
+  chunk_bytes = pending->len;
 
-  if (G_LIKELY (buf)) {
+  if (G_LIKELY (data)) {
     if (new_pcr < 0) {
-      /* If there is no pcr in current ts packet then just add the packet
-         to the adapter for later output when we see a PCR */
+      /* If there is no pcr in current ts packet then just keep the packet
+         for later output when we see a PCR */
       GST_LOG_OBJECT (mux, "Accumulating non-PCR packet");
-      gst_adapter_push (mux->adapter, buf);
+      GST_WRITE_UINT32_BE (data - 4, 0);
+      g_byte_array_set_size (pending, chunk_bytes + M2TS_PACKET_LENGTH);
       goto exit;
     }
 
@@ -1433,7 +1569,8 @@ new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
       mux->previous_pcr = new_pcr;
       mux->previous_offset = chunk_bytes;
       GST_LOG_OBJECT (mux, "Accumulating non-PCR packet");
-      gst_adapter_push (mux->adapter, buf);
+      GST_WRITE_UINT32_BE (data - 4, 0);
+      g_byte_array_set_size (pending, chunk_bytes + M2TS_PACKET_LENGTH);
       goto exit;
     }
   } else {
@@ -1458,10 +1595,10 @@ new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
     }
 
     while (offset < chunk_bytes) {
-      guint64 cur_pcr, ts;
+      guint64 cur_pcr;
 
-      /* Loop, pulling packets of the adapter, updating their 4 byte
-       * timestamp header and pushing */
+      /* Loop over the pending packets, updating their 4 byte
+       * timestamp header in place */
 
       /* interpolate PCR */
       if (G_LIKELY (offset >= mux->previous_offset))
@@ -1473,107 +1610,99 @@ new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf, gint64 new_pcr)
             gst_util_uint64_scale (mux->previous_offset - offset,
             mux->pcr_rate_num, mux->pcr_rate_den);
 
-      /* FIXME: what about DTS here? */
-      ts = gst_adapter_prev_pts (mux->adapter, NULL);
-      out_buf = gst_adapter_take_buffer (mux->adapter, M2TS_PACKET_LENGTH);
-      g_assert (out_buf);
-      offset += M2TS_PACKET_LENGTH;
-
-      GST_BUFFER_PTS (out_buf) = ts;
-
-      gst_buffer_map (out_buf, &map, GST_MAP_WRITE);
-
       /* The header is the bottom 30 bits of the PCR, apparently not
        * encoded into base + ext as in the packets themselves */
-      GST_WRITE_UINT32_BE (map.data, cur_pcr & 0x3FFFFFFF);
-      gst_buffer_unmap (out_buf, &map);
+      GST_WRITE_UINT32_BE (pending->data + offset, cur_pcr & 0x3FFFFFFF);
+      offset += M2TS_PACKET_LENGTH;
 
       GST_LOG_OBJECT (mux, "Outputting a packet of length %d PCR %"
           G_GUINT64_FORMAT, M2TS_PACKET_LENGTH, cur_pcr);
-      mpegtsmux_collect_packet (mux, out_buf);
     }
   }
 
-  if (G_UNLIKELY (!buf))
-    goto exit;
+  if (G_LIKELY (data)) {
+    /* Finally, output the passed in packet */
+    /* Only write the bottom 30 bits of the PCR */
+    GST_WRITE_UINT32_BE (data - 4, new_pcr & 0x3FFFFFFF);
+    g_byte_array_set_size (pending, chunk_bytes + M2TS_PACKET_LENGTH);
 
-  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+    GST_LOG_OBJECT (mux, "Outputting a packet of length %d PCR %"
+        G_GUINT64_FORMAT, M2TS_PACKET_LENGTH, new_pcr);
 
-  /* Finally, output the passed in packet */
-  /* Only write the bottom 30 bits of the PCR */
-  GST_WRITE_UINT32_BE (map.data, new_pcr & 0x3FFFFFFF);
-
-  gst_buffer_unmap (buf, &map);
+    if (new_pcr != mux->previous_pcr) {
+      mux->previous_pcr = new_pcr;
+      mux->previous_offset = -M2TS_PACKET_LENGTH;
+    }
+  }
 
-  GST_LOG_OBJECT (mux, "Outputting a packet of length %d PCR %"
-      G_GUINT64_FORMAT, M2TS_PACKET_LENGTH, new_pcr);
-  mpegtsmux_collect_packet (mux, buf);
+  ret = mpegtsmux_write_output (mux, pending->data, pending->len,
+      mux->m2ts_pending_delta);
+  g_byte_array_set_size (pending, 0);
+  mux->m2ts_pending_delta = TRUE;
 
-  if (new_pcr != mux->previous_pcr) {
-    mux->previous_pcr = new_pcr;
-    mux->previous_offset = -M2TS_PACKET_LENGTH;
-  }
+  return ret;
 
 exit:
   return TRUE;
 }
 
-/* Called when the TsMux has prepared a packet for output. Return FALSE
- * on error */
+/* Called when the TsMux has written a packet into the memory returned by
+ * alloc_packet_cb(). Return FALSE on error */
 static gboolean
-new_packet_cb (GstBuffer * buf, void *user_data, gint64 new_pcr)
+new_packet_cb (guint8 * data, void *user_data, gint64 new_pcr)
 {
   MpegTsMux *mux = (MpegTsMux *) user_data;
-  gint offset = 0;
-  GstMapInfo map;
+  gboolean delta;
 
 #if 0
   GST_LOG_OBJECT (mux, "handling packet %d", mux->spn_count);
   mux->spn_count++;
 #endif
 
-  if (mux->m2ts_mode) {
-    offset = 4;
-    gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH + offset);
-  }
-
-  gst_buffer_map (buf, &map, GST_MAP_READWRITE);
+  /* do common init (flags and streamheaders) */
+  delta = new_packet_common_init (mux, data, NORMAL_TS_PACKET_LENGTH);
 
-  if (offset) {
-    /* there should be a better way to do this */
-    memmove (map.data + offset, map.data, map.size - offset);
+  /* all is meant for downstream, including any prefix */
+  if (mux->m2ts_mode) {
+    mux->m2ts_pending_delta &= delta;
+    return new_packet_m2ts (mux, data, new_pcr);
   }
 
-  GST_BUFFER_PTS (buf) = mux->last_ts;
-  /* do common init (flags and streamheaders) */
-  new_packet_common_init (mux, buf, map.data + offset, map.size);
+  if (!delta)
+    GST_BUFFER_FLAG_UNSET (mux->out_buffer, GST_BUFFER_FLAG_DELTA_UNIT);
 
-  gst_buffer_unmap (buf, &map);
-
-  /* all is meant for downstream, including any prefix */
-  if (offset)
-    return new_packet_m2ts (mux, buf, new_pcr);
-  else
-    mpegtsmux_collect_packet (mux, buf);
+  mux->out_offset += NORMAL_TS_PACKET_LENGTH;
+  if (mux->out_offset == mux->out_map.size)
+    mpegtsmux_finish_output_buffer (mux);
 
   return TRUE;
 }
 
-/* called when TsMux needs new packet to write into */
-static void
-alloc_packet_cb (GstBuffer ** _buf, void *user_data)
+/* called when TsMux needs memory to write a new packet into. Packets are
+ * written straight into a large output buffer; m2ts packets are staged
+ * first since their timestamp header is only known at the next PCR */
+static guint8 *
+alloc_packet_cb (void *user_data)
 {
   MpegTsMux *mux = (MpegTsMux *) user_data;
-  GstBuffer *buf;
-  gint offset = 0;
 
-  if (mux->m2ts_mode == TRUE)
-    offset = 4;
+  if (mux->m2ts_mode) {
+    GByteArray *pending = mux->m2ts_pending;
+    guint len = pending->len;
+
+    /* grow and shrink again, so that the packet memory is allocated but
+     * only becomes part of the pending data once it has been written;
+     * shrinking a GByteArray never reallocates */
+    g_byte_array_set_size (pending, len + M2TS_PACKET_LENGTH);
+    g_byte_array_set_size (pending, len);
 
-  buf = gst_buffer_new_and_alloc (NORMAL_TS_PACKET_LENGTH + offset);
-  gst_buffer_set_size (buf, NORMAL_TS_PACKET_LENGTH);
+    return pending->data + len + 4;
+  }
+
+  if (!mux->out_buffer && !mpegtsmux_start_output_buffer (mux))
+    return NULL;
 
-  *_buf = buf;
+  return mux->out_map.data + mux->out_offset;
 }
 
 static void
@@ -140,6 +140,7 @@ struct MpegTsMux {
   guint pat_interval;
   guint pmt_interval;
   gint alignment;
+  guint64 bitrate;
 
   /* state */
   gboolean first;
@@ -158,11 +159,18 @@ struct MpegTsMux {
   gint64 previous_offset;
   gint64 pcr_rate_num;
   gint64 pcr_rate_den;
-  GstAdapter *adapter;
-
-  /* output buffer aggregation */
-  GstAdapter *out_adapter;
+  /* packets waiting for the next PCR to get their timestamp header */
+  GByteArray *m2ts_pending;
+  gboolean m2ts_pending_delta;
+
+  /* output buffer aggregation: packets are written straight into
+   * out_buffer, complete buffers wait in out_list to be pushed */
+  GstBufferPool *out_pool;
+  guint out_buffer_size;
   GstBuffer *out_buffer;
+  GstMapInfo out_map;
+  guint out_offset;
+  GstBufferList *out_list;
 
 #if 0
   /* SPN/PTS index handling */
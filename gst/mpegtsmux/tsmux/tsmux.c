@@ -108,11 +108,18 @@
 /* Times per second to write PCR */
 #define TSMUX_DEFAULT_PCR_FREQ (25)
 
+/* CBR mode: the largest gap between the output position and the PCR at
+ * which the next packet is due that is filled with stuffing, or that the
+ * output may run late by. Larger gaps come from timestamp jumps, the output
+ * is resynced to them instead */
+#define TSMUX_CBR_MAX_STUFFING (TSMUX_SYS_CLOCK_FREQ / 2)
+
 /* Base for all written PCR and DTS/PTS,
  * so we have some slack to go backwards */
 #define CLOCK_BASE (TSMUX_CLOCK_FREQ * 10 * 360)
 
 static gboolean tsmux_write_pat (TsMux * mux);
+static gint64 tsmux_get_current_pcr (TsMux * mux);
 static gboolean tsmux_write_pmt (TsMux * mux, TsMuxProgram * program);
 
 /**
@@ -139,6 +146,8 @@ tsmux_new (void)
   mux->last_pat_ts = -1;
   mux->pat_interval = TSMUX_DEFAULT_PAT_INTERVAL;
 
+  mux->first_pcr = -1;
+
   return mux;
 }
 
@@ -149,7 +158,9 @@ tsmux_new (void)
  * @user_data: user data passed to @func
  *
  * Set the callback function and user data to be called when @mux has output to
- * produce. @user_data will be passed as user data in @func.
+ * produce. @func is passed the packet previously returned by the alloc
+ * function, which has been completely written at that point.
+ * @user_data will be passed as user data in @func.
  */
 void
 tsmux_set_write_func (TsMux * mux, TsMuxWriteFunc func, void *user_data)
@@ -167,7 +178,10 @@ tsmux_set_write_func (TsMux * mux, TsMuxWriteFunc func, void *user_data)
  * @user_data: user data passed to @func
  *
  * Set the callback function and user data to be called when @mux needs
- * a new buffer to write a packet into.
+ * memory to write a packet into. @func must return a pointer to at least
+ * %TSMUX_PACKET_LENGTH writable bytes, which stay valid until the packet
+ * is handed to the write function. If the packet can not be completed, the
+ * write function is not called and the same memory may be returned again.
  * @user_data will be passed as user data in @func.
  */
 void
@@ -214,6 +228,54 @@ tsmux_get_pat_interval (TsMux * mux)
   return mux->pat_interval;
 }
 
+/**
+ * tsmux_set_bitrate:
+ * @mux: a #TsMux
+ * @bitrate: the output bitrate in bits per second, or 0
+ *
+ * Enable constant bitrate output at @bitrate. Gaps in the input are filled
+ * with null packets, PCR values are derived from the position of the packet
+ * in the output and PAT/PMT are spread at their configured intervals of
+ * output time. A @bitrate of 0 produces variable bitrate output, which is
+ * the default.
+ *
+ * When the bitrate changes after packets were written, the PCR carries on
+ * from the current position at the new bitrate.
+ */
+void
+tsmux_set_bitrate (TsMux * mux, guint64 bitrate)
+{
+  g_return_if_fail (mux != NULL);
+
+  if (bitrate == mux->bitrate)
+    return;
+
+  if (mux->bitrate && bitrate && mux->first_pcr != -1) {
+    mux->first_pcr = tsmux_get_current_pcr (mux);
+    mux->n_bytes = 0;
+  } else {
+    /* picked up from the next timestamp */
+    mux->first_pcr = -1;
+  }
+  mux->bitrate = bitrate;
+}
+
+/**
+ * tsmux_get_bitrate:
+ * @mux: a #TsMux
+ *
+ * Get the configured output bitrate. See also tsmux_set_bitrate().
+ *
+ * Returns: the configured bitrate, 0 for variable bitrate output
+ */
+guint64
+tsmux_get_bitrate (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, 0);
+
+  return mux->bitrate;
+}
+
 /**
  * tsmux_free:
  * @mux: a #TsMux
@@ -472,33 +534,24 @@ tsmux_find_stream (TsMux * mux, guint16 pid)
   return found;
 }
 
-static gboolean
-tsmux_get_buffer (TsMux * mux, GstBuffer ** buf)
+static guint8 *
+tsmux_get_packet (TsMux * mux)
 {
-  g_return_val_if_fail (buf, FALSE);
-
   if (G_UNLIKELY (!mux->alloc_func))
-    return FALSE;
-
-  mux->alloc_func (buf, mux->alloc_func_data);
-
-  if (!*buf)
-    return FALSE;
+    return NULL;
 
-  g_assert (gst_buffer_get_size (*buf) == TSMUX_PACKET_LENGTH);
-  return TRUE;
+  return mux->alloc_func (mux->alloc_func_data);
 }
 
 static gboolean
-tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
+tsmux_packet_out (TsMux * mux, guint8 * data, gint64 pcr)
 {
-  if (G_UNLIKELY (mux->write_func == NULL)) {
-    if (buf)
-      gst_buffer_unref (buf);
+  mux->n_bytes += TSMUX_PACKET_LENGTH;
+
+  if (G_UNLIKELY (mux->write_func == NULL))
     return TRUE;
-  }
 
-  return mux->write_func (buf, mux->write_func_data, pcr);
+  return mux->write_func (data, mux->write_func_data, pcr);
 }
 
 /*
@@ -748,6 +801,201 @@ tsmux_write_ts_header (guint8 * buf, TsMuxPacketInfo * pi,
   return TRUE;
 }
 
+/* CBR mode: the PCR of the next packet written */
+static gint64
+tsmux_get_current_pcr (TsMux * mux)
+{
+  return mux->first_pcr + gst_util_uint64_scale (mux->n_bytes * 8,
+      TSMUX_SYS_CLOCK_FREQ, mux->bitrate);
+}
+
+static gboolean
+tsmux_write_null_packet (TsMux * mux)
+{
+  guint8 *data;
+
+  if (!(data = tsmux_get_packet (mux)))
+    return FALSE;
+
+  data[0] = TSMUX_SYNC_BYTE;
+  /* null packet PID */
+  data[1] = 0x1f;
+  data[2] = 0xff;
+  /* payload only, continuity counter undefined */
+  data[3] = 0x10;
+  memset (data + TSMUX_HEADER_LENGTH, 0xff, TSMUX_PAYLOAD_LENGTH);
+
+  return tsmux_packet_out (mux, data, -1);
+}
+
+/* write a packet on the PID of @stream that only carries a PCR in its
+ * adaptation field, which leaves the continuity counter alone */
+static gboolean
+tsmux_write_pcr_packet (TsMux * mux, TsMuxStream * stream, gint64 pcr)
+{
+  TsMuxPacketInfo pi = stream->pi;
+  guint payload_len, payload_offs;
+  guint8 *data;
+
+  pi.flags = TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
+  if (stream->pcr_discont)
+    pi.flags |= TSMUX_PACKET_FLAG_DISCONT;
+  pi.pcr = pcr;
+  pi.packet_start_unit_indicator = FALSE;
+  pi.stream_avail = 0;
+  pi.private_data_len = 0;
+
+  if (!(data = tsmux_get_packet (mux)))
+    return FALSE;
+
+  if (!tsmux_write_ts_header (data, &pi, &payload_len, &payload_offs))
+    return FALSE;
+
+  stream->last_pcr = pcr;
+  stream->pcr_discont = FALSE;
+
+  return tsmux_packet_out (mux, data, pcr);
+}
+
+/* CBR mode: whether @stream needs a new PCR at @cur_pcr */
+static inline gboolean
+tsmux_cbr_pcr_due (TsMuxStream * stream, gint64 cur_pcr)
+{
+  return stream->last_pcr == -1 || cur_pcr - stream->last_pcr >=
+      TSMUX_SYS_CLOCK_FREQ / TSMUX_DEFAULT_PCR_FREQ;
+}
+
+/* CBR mode: the next time at which something scheduled every @interval
+ * is due after it was last written at @last. Normally this is exactly one
+ * interval later, unless we have fallen more than an interval behind */
+static gint64
+tsmux_next_cbr_ts (gint64 last, gint64 interval, gint64 cur)
+{
+  if (last == -1 || last + 2 * interval <= cur)
+    return cur;
+  return last + interval;
+}
+
+/* CBR mode: write the PAT, PMTs and PCRs that are due at the current
+ * position. The PCR of @stream is left to the caller, as it can go into
+ * the packet about to be written for it */
+static gboolean
+tsmux_write_cbr_si (TsMux * mux, TsMuxStream * stream)
+{
+  gint64 cur_pcr = tsmux_get_current_pcr (mux);
+  gint64 cur_ts = cur_pcr / 300;
+  GList *cur;
+
+  if (mux->last_pat_ts == -1 || mux->pat_changed ||
+      cur_ts >= mux->last_pat_ts + mux->pat_interval) {
+    mux->last_pat_ts = mux->pat_changed ? cur_ts :
+        tsmux_next_cbr_ts (mux->last_pat_ts, mux->pat_interval, cur_ts);
+    if (!tsmux_write_pat (mux))
+      return FALSE;
+  }
+
+  for (cur = mux->programs; cur; cur = cur->next) {
+    TsMuxProgram *program = (TsMuxProgram *) cur->data;
+    TsMuxStream *pcr_stream = program->pcr_stream;
+
+    cur_ts = tsmux_get_current_pcr (mux) / 300;
+    if (program->last_pmt_ts == -1 || program->pmt_changed ||
+        cur_ts >= program->last_pmt_ts + program->pmt_interval) {
+      program->last_pmt_ts = program->pmt_changed ? cur_ts :
+          tsmux_next_cbr_ts (program->last_pmt_ts, program->pmt_interval,
+          cur_ts);
+      if (!tsmux_write_pmt (mux, program))
+        return FALSE;
+    }
+
+    if (pcr_stream == NULL || pcr_stream == stream)
+      continue;
+
+    cur_pcr = tsmux_get_current_pcr (mux);
+    if (tsmux_cbr_pcr_due (pcr_stream, cur_pcr)) {
+      if (!tsmux_write_pcr_packet (mux, pcr_stream, cur_pcr))
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* CBR mode: restart the PCR at @pcr after a timestamp jump. The PCRs of all
+ * programs are written again at once with the discontinuity_indicator set,
+ * followed by the PAT and PMTs */
+static void
+tsmux_resync_cbr_pcr (TsMux * mux, gint64 pcr)
+{
+  GList *cur;
+
+  mux->first_pcr = pcr;
+  mux->n_bytes = 0;
+  mux->last_pat_ts = -1;
+
+  for (cur = mux->programs; cur; cur = cur->next) {
+    TsMuxProgram *program = (TsMuxProgram *) cur->data;
+
+    program->last_pmt_ts = -1;
+    if (program->pcr_stream) {
+      program->pcr_stream->last_pcr = -1;
+      program->pcr_stream->pcr_discont = TRUE;
+    }
+  }
+}
+
+/* CBR mode: get the output to the position where the next packet of
+ * @stream is due, stuffing with null packets (and any PSI or PCR that
+ * becomes due meanwhile). If the input has more data than fits the
+ * bitrate, the packet is just written late */
+static gboolean
+tsmux_write_cbr_padding (TsMux * mux, TsMuxStream * stream)
+{
+  gint64 cur_pts = tsmux_stream_get_pts (stream);
+  gint64 target = -1;
+
+  /* same relation between PTS and PCR as in VBR mode */
+  if (cur_pts != -1)
+    target = (cur_pts + CLOCK_BASE - TSMUX_PCR_OFFSET) *
+        (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+
+  if (G_UNLIKELY (mux->first_pcr == -1)) {
+    mux->first_pcr = target != -1 ? target :
+        (CLOCK_BASE - TSMUX_PCR_OFFSET) * (TSMUX_SYS_CLOCK_FREQ /
+        TSMUX_CLOCK_FREQ);
+    mux->n_bytes = 0;
+  }
+
+  /* far ahead can not be stuffed, far behind can not be caught up with */
+  if (target != -1 && ABS (target - tsmux_get_current_pcr (mux)) >
+      TSMUX_CBR_MAX_STUFFING) {
+    GST_WARNING ("PTS jumped %" G_GINT64_FORMAT " ticks away from the "
+        "output, resyncing the PCR", target - tsmux_get_current_pcr (mux));
+    tsmux_resync_cbr_pcr (mux, target);
+  }
+
+  while (TRUE) {
+    gint64 cur_pcr;
+
+    if (!tsmux_write_cbr_si (mux, stream))
+      return FALSE;
+
+    cur_pcr = tsmux_get_current_pcr (mux);
+    if (cur_pcr >= target)
+      break;
+
+    /* the PCR of @stream itself can not wait for its next packet */
+    if (tsmux_stream_is_pcr (stream) && tsmux_cbr_pcr_due (stream, cur_pcr)) {
+      if (!tsmux_write_pcr_packet (mux, stream, cur_pcr))
+        return FALSE;
+    } else if (!tsmux_write_null_packet (mux)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
 /**
  * tsmux_write_stream_packet:
  * @mux: a #TsMux
@@ -764,13 +1012,30 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   TsMuxPacketInfo *pi = &stream->pi;
   gboolean res;
   gint64 cur_pcr = -1;
-  GstBuffer *buf = NULL;
-  GstMapInfo map;
+  guint8 *data;
 
   g_return_val_if_fail (mux != NULL, FALSE);
   g_return_val_if_fail (stream != NULL, FALSE);
 
-  if (tsmux_stream_is_pcr (stream)) {
+  if (mux->bitrate) {
+    if (!tsmux_write_cbr_padding (mux, stream))
+      return FALSE;
+
+    if (tsmux_stream_is_pcr (stream)) {
+      cur_pcr = tsmux_get_current_pcr (mux);
+      if (tsmux_cbr_pcr_due (stream, cur_pcr)) {
+        stream->pi.flags |=
+            TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
+        if (stream->pcr_discont)
+          stream->pi.flags |= TSMUX_PACKET_FLAG_DISCONT;
+        stream->pi.pcr = cur_pcr;
+        stream->last_pcr = cur_pcr;
+        stream->pcr_discont = FALSE;
+      } else {
+        cur_pcr = -1;
+      }
+    }
+  } else if (tsmux_stream_is_pcr (stream)) {
     gint64 cur_pts = tsmux_stream_get_pts (stream);
     gboolean write_pat;
     GList *cur;
@@ -846,36 +1111,22 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   }
   pi->stream_avail = tsmux_stream_bytes_avail (stream);
 
-  /* obtain buffer */
-  if (!tsmux_get_buffer (mux, &buf))
+  /* obtain packet memory */
+  if (!(data = tsmux_get_packet (mux)))
     return FALSE;
 
-  gst_buffer_map (buf, &map, GST_MAP_READ);
-
-  if (!tsmux_write_ts_header (map.data, pi, &payload_len, &payload_offs))
-    goto fail;
-
-
-  if (!tsmux_stream_get_data (stream, map.data + payload_offs, payload_len))
-    goto fail;
+  if (!tsmux_write_ts_header (data, pi, &payload_len, &payload_offs))
+    return FALSE;
 
-  gst_buffer_unmap (buf, &map);
+  if (!tsmux_stream_get_data (stream, data + payload_offs, payload_len))
+    return FALSE;
 
-  res = tsmux_packet_out (mux, buf, cur_pcr);
+  res = tsmux_packet_out (mux, data, cur_pcr);
 
   /* Reset all dynamic flags */
   stream->pi.flags &= TSMUX_PACKET_FLAG_PES_FULL_HEADER;
 
   return res;
-
-  /* ERRORS */
-fail:
-  {
-    gst_buffer_unmap (buf, &map);
-    if (buf)
-      gst_buffer_unref (buf);
-    return FALSE;
-  }
 }
 
 /**
@@ -901,8 +1152,7 @@ tsmux_write_section (TsMux * mux, TsMuxSection * section)
   guint payload_remain;
   guint payload_len, payload_offs;
   TsMuxPacketInfo *pi;
-  GstBuffer *buf = NULL;
-  GstMapInfo map;
+  guint8 *data;
 
   pi = &section->pi;
 
@@ -913,64 +1163,45 @@ tsmux_write_section (TsMux * mux, TsMuxSection * section)
 
   while (payload_remain > 0) {
 
-    /* obtain buffer */
-    map.data = NULL;
-    if (!tsmux_get_buffer (mux, &buf))
-      goto fail;
-
-    gst_buffer_map (buf, &map, GST_MAP_WRITE);
+    /* obtain packet memory */
+    if (!(data = tsmux_get_packet (mux)))
+      return FALSE;
 
     if (pi->packet_start_unit_indicator) {
       /* Need to write an extra single byte start pointer */
       pi->stream_avail++;
 
-      if (!tsmux_write_ts_header (map.data, pi, &payload_len, &payload_offs)) {
+      if (!tsmux_write_ts_header (data, pi, &payload_len, &payload_offs)) {
         pi->stream_avail--;
-        goto fail;
+        return FALSE;
       }
       pi->stream_avail--;
 
       /* Write the pointer byte */
-      map.data[payload_offs] = 0x00;
+      data[payload_offs] = 0x00;
 
       payload_offs++;
       payload_len--;
       pi->packet_start_unit_indicator = FALSE;
     } else {
-      if (!tsmux_write_ts_header (map.data, pi, &payload_len, &payload_offs))
-        goto fail;
+      if (!tsmux_write_ts_header (data, pi, &payload_len, &payload_offs))
+        return FALSE;
     }
 
     TS_DEBUG ("Outputting %d bytes to section. %d remaining after",
         payload_len, payload_remain - payload_len);
 
-    memcpy (map.data + payload_offs, cur_in, payload_len);
+    memcpy (data + payload_offs, cur_in, payload_len);
 
     cur_in += payload_len;
     payload_remain -= payload_len;
 
-    gst_buffer_unmap (buf, &map);
-
     /* we do not write PCR in section */
-    if (G_UNLIKELY (!tsmux_packet_out (mux, buf, -1))) {
-      /* buffer given away */
-      buf = NULL;
-      goto fail;
-    }
-    buf = NULL;
+    if (G_UNLIKELY (!tsmux_packet_out (mux, data, -1)))
+      return FALSE;
   }
 
   return TRUE;
-
-  /* ERRORS */
-fail:
-  {
-    if (map.data && buf)
-      gst_buffer_unmap (buf, &map);
-    if (buf)
-      gst_buffer_unref (buf);
-    return FALSE;
-  }
 }
 
 static void
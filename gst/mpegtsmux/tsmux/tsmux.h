@@ -99,8 +99,8 @@ G_BEGIN_DECLS
 typedef struct TsMuxSection TsMuxSection;
 typedef struct TsMux TsMux;
 
-typedef gboolean (*TsMuxWriteFunc) (GstBuffer * buf, void *user_data, gint64 new_pcr);
-typedef void (*TsMuxAllocFunc) (GstBuffer ** buf, void *user_data);
+typedef gboolean (*TsMuxWriteFunc) (guint8 * data, void *user_data, gint64 new_pcr);
+typedef guint8 * (*TsMuxAllocFunc) (void *user_data);
 
 struct TsMuxSection {
   TsMuxPacketInfo pi;
@@ -163,10 +163,18 @@ struct TsMux {
   /* callback to write finished packet */
   TsMuxWriteFunc write_func;
   void *write_func_data;
-  /* callback to alloc new packet buffer */
+  /* callback to get memory for the next packet */
   TsMuxAllocFunc alloc_func;
   void *alloc_func_data;
 
+  /* CBR mode: output bitrate in bits per second, 0 for VBR */
+  guint64 bitrate;
+  /* number of packets written so far, in bytes */
+  guint64 n_bytes;
+  /* CBR mode: PCR of the first byte, the PCR of any later byte follows
+   * from its position */
+  gint64 first_pcr;
+
   /* scratch space for writing ES_info descriptors */
   guint8 es_info_buf[TSMUX_MAX_ES_INFO_LENGTH];
 };
@@ -180,6 +188,8 @@ void 		tsmux_set_write_func 		(TsMux *mux, TsMuxWriteFunc func, void *user_data)
 void 		tsmux_set_alloc_func 		(TsMux *mux, TsMuxAllocFunc func, void *user_data);
 void 		tsmux_set_pat_interval          (TsMux *mux, guint interval);
 guint 		tsmux_get_pat_interval          (TsMux *mux);
+void 		tsmux_set_bitrate               (TsMux *mux, guint64 bitrate);
+guint64 	tsmux_get_bitrate               (TsMux *mux);
 guint16		tsmux_get_new_pid 		(TsMux *mux);
 
 /* pid/program management */
@@ -197,6 +197,8 @@ struct TsMuxStream {
   gint   pcr_ref;
   /* last time PCR written */
   gint64 last_pcr;
+  /* CBR mode: the PCR was resynced, flag it on the next one */
+  gboolean pcr_discont;
 
   /* audio parameters for stream
    * (used in stream descriptor) */
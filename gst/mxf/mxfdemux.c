@@ -112,9 +112,12 @@ enum
   PROP_0,
   PROP_PACKAGE,
   PROP_MAX_DRIFT,
-  PROP_STRUCTURE
+  PROP_STRUCTURE,
+  PROP_PRESCAN_INDEX
 };
 
+#define DEFAULT_PRESCAN_INDEX FALSE
+
 static gboolean gst_mxf_demux_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event);
 static gboolean gst_mxf_demux_src_event (GstPad * pad, GstObject * parent,
@@ -262,6 +265,7 @@ gst_mxf_demux_reset (GstMXFDemux * demux)
     g_array_free (demux->random_index_pack, TRUE);
     demux->random_index_pack = NULL;
   }
+  demux->index_prescanned = FALSE;
 
   if (demux->pending_index_table_segments) {
     GList *l;
@@ -392,6 +396,47 @@ gst_mxf_demux_partition_compare (GstMXFDemuxPartition * a,
   return (a->partition.this_partition - b->partition.this_partition);
 }
 
+/* Returns the position of the essence element at offset in the index
+ * of the track, or -1 if it is not in there */
+static gint64
+gst_mxf_demux_essence_track_find_position (GstMXFDemuxEssenceTrack * etrack,
+    guint64 offset)
+{
+  guint i;
+
+  if (!etrack->offsets)
+    return -1;
+
+  /* A complete index is sorted by offset */
+  if (etrack->offsets_complete) {
+    guint lo = 0, hi = etrack->offsets->len;
+
+    while (lo < hi) {
+      guint mid = lo + (hi - lo) / 2;
+      GstMXFDemuxIndex *idx =
+          &g_array_index (etrack->offsets, GstMXFDemuxIndex, mid);
+
+      if (idx->offset == offset)
+        return mid;
+      else if (idx->offset < offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return -1;
+  }
+
+  for (i = 0; i < etrack->offsets->len; i++) {
+    GstMXFDemuxIndex *idx =
+        &g_array_index (etrack->offsets, GstMXFDemuxIndex, i);
+
+    if (idx->offset != 0 && idx->offset == offset)
+      return i;
+  }
+
+  return -1;
+}
+
 static GstFlowReturn
 gst_mxf_demux_handle_partition_pack (GstMXFDemux * demux, const MXFUL * key,
     GstBuffer * buffer)
@@ -1667,17 +1712,9 @@ gst_mxf_demux_handle_generic_container_essence_element (GstMXFDemux * demux,
   if (etrack->position == -1) {
     GST_DEBUG_OBJECT (demux,
         "Unknown essence track position, looking into index");
-    if (etrack->offsets) {
-      for (i = 0; i < etrack->offsets->len; i++) {
-        GstMXFDemuxIndex *idx =
-            &g_array_index (etrack->offsets, GstMXFDemuxIndex, i);
-
-        if (idx->offset != 0 && idx->offset == demux->offset - demux->run_in) {
-          etrack->position = i;
-          break;
-        }
-      }
-    }
+    etrack->position =
+        gst_mxf_demux_essence_track_find_position (etrack,
+        demux->offset - demux->run_in);
 
     if (etrack->position == -1) {
       GST_WARNING_OBJECT (demux, "Essence track position not in index");
@@ -1735,6 +1772,10 @@ gst_mxf_demux_handle_generic_container_essence_element (GstMXFDemux * demux,
     } else {
       GstMXFDemuxIndex index;
 
+      /* Leaves a hole */
+      if (etrack->position != etrack->offsets->len)
+        etrack->offsets_complete = FALSE;
+
       index.offset = demux->offset - demux->run_in;
       index.keyframe = keyframe;
       g_array_insert_val (etrack->offsets, etrack->position, index);
@@ -2346,6 +2387,443 @@ out:
   demux->current_partition = old_partition;
 }
 
+typedef struct
+{
+  MXFUL key;
+  GstBuffer *buffer;
+  MXFIndexTableSegment segment;
+  gboolean parsed;
+} GstMXFDemuxIndexJob;
+
+typedef struct
+{
+  guint64 body_offset;
+  /* offset of the first essence byte of the partition, without run-in */
+  guint64 offset;
+} GstMXFDemuxEssenceRange;
+
+static void
+gst_mxf_demux_index_job_func (GstMXFDemuxIndexJob * job,
+    const MXFPrimerPack * primer)
+{
+  GstMapInfo map;
+
+  gst_buffer_map (job->buffer, &map, GST_MAP_READ);
+  job->parsed = mxf_index_table_segment_parse (&job->key, &job->segment,
+      primer, map.data, map.size);
+  gst_buffer_unmap (job->buffer, &map);
+
+  if (!job->parsed) {
+    /* the entries might not have been allocated yet */
+    if (!job->segment.index_entries)
+      job->segment.n_index_entries = 0;
+    mxf_index_table_segment_reset (&job->segment);
+  }
+}
+
+/* Splits a block of KLV packets in memory and queues a job for every
+ * index table segment in it */
+static void
+gst_mxf_demux_queue_index_jobs (GstMXFDemux * demux, GstBuffer * buffer,
+    GPtrArray * jobs)
+{
+  GstMapInfo map;
+  gsize pos = 0;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+
+  while (pos + 17 <= map.size) {
+    const MXFUL *key = (const MXFUL *) (map.data + pos);
+    guint64 length = map.data[pos + 16];
+    guint hlen = 17;
+
+    if (length & 0x80) {
+      guint slen = length & 0x7f;
+
+      if (slen > 8 || pos + 17 + slen > map.size)
+        break;
+
+      length = 0;
+      while (slen--)
+        length = (length << 8) | map.data[pos + hlen++];
+    }
+
+    if (length > map.size - pos - hlen)
+      break;
+
+    if (mxf_is_index_table_segment (key)) {
+      GstMXFDemuxIndexJob *job = g_new0 (GstMXFDemuxIndexJob, 1);
+
+      memcpy (&job->key, key, 16);
+      job->buffer = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_MEMORY,
+          pos + hlen, length);
+      g_ptr_array_add (jobs, job);
+    } else if (!mxf_is_fill (key)) {
+      break;
+    }
+
+    pos += hlen + length;
+  }
+
+  gst_buffer_unmap (buffer, &map);
+}
+
+/* Pulls the partition pack at offset and the index table segments that
+ * follow its header metadata in one go */
+static void
+gst_mxf_demux_prescan_partition (GstMXFDemux * demux,
+    GstMXFDemuxPartition * p, GPtrArray * jobs)
+{
+  guint64 offset = demux->run_in + p->partition.this_partition;
+  GstBuffer *buffer = NULL;
+  MXFUL key;
+  guint read = 0;
+  GstMapInfo map;
+  gboolean ret;
+
+  if (p->partition.major_version == 0) {
+    MXFPartitionPack partition;
+
+    if (gst_mxf_demux_pull_klv_packet (demux, offset, &key, &buffer,
+            &read) != GST_FLOW_OK || !mxf_is_partition_pack (&key))
+      goto out;
+
+    gst_buffer_map (buffer, &map, GST_MAP_READ);
+    ret = mxf_partition_pack_parse (&key, &partition, map.data, map.size);
+    gst_buffer_unmap (buffer, &map);
+    gst_buffer_unref (buffer);
+    buffer = NULL;
+
+    if (!ret)
+      goto out;
+
+    partition.this_partition = p->partition.this_partition;
+    partition.prev_partition = p->partition.prev_partition;
+    memcpy (&p->partition, &partition, sizeof (MXFPartitionPack));
+  } else {
+    /* only the size of the partition pack is needed */
+    if (gst_mxf_demux_pull_klv_packet (demux, offset, &key, &buffer,
+            &read) != GST_FLOW_OK)
+      goto out;
+    gst_buffer_unref (buffer);
+    buffer = NULL;
+  }
+
+  if (p->essence_container_offset == 0)
+    p->essence_container_offset = read + p->partition.header_byte_count +
+        p->partition.index_byte_count;
+
+  if (p->partition.index_byte_count == 0 ||
+      p->partition.index_byte_count > G_MAXUINT)
+    goto out;
+
+  if (gst_mxf_demux_pull_range (demux,
+          offset + read + p->partition.header_byte_count,
+          p->partition.index_byte_count, &buffer) != GST_FLOW_OK)
+    goto out;
+
+  gst_mxf_demux_queue_index_jobs (demux, buffer, jobs);
+
+out:
+  if (buffer)
+    gst_buffer_unref (buffer);
+}
+
+static gint
+gst_mxf_demux_essence_range_compare (const GstMXFDemuxEssenceRange * a,
+    const GstMXFDemuxEssenceRange * b)
+{
+  return a->body_offset < b->body_offset ? -1 : a->body_offset >
+      b->body_offset ? 1 : 0;
+}
+
+/* Maps an offset in the essence container to an offset in the file */
+static guint64
+gst_mxf_demux_essence_ranges_lookup (GArray * ranges, guint64 stream_offset)
+{
+  guint lo = 0, hi = ranges->len;
+  GstMXFDemuxEssenceRange *r;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    r = &g_array_index (ranges, GstMXFDemuxEssenceRange, mid);
+    if (r->body_offset <= stream_offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    return -1;
+
+  r = &g_array_index (ranges, GstMXFDemuxEssenceRange, lo - 1);
+  return r->offset + (stream_offset - r->body_offset);
+}
+
+/* Finds the number of the essence element of etrack in the content
+ * packages by looking at the first one, which starts at offset */
+static gint
+gst_mxf_demux_prescan_element_number (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack, guint64 offset, guint n_elements)
+{
+  gint n = 0;
+  guint i;
+
+  for (i = 0; i < 2 * MAX (n_elements, 1) + 2; i++) {
+    GstBuffer *buffer = NULL;
+    MXFUL key;
+    guint read = 0;
+
+    if (gst_mxf_demux_pull_klv_packet (demux, demux->run_in + offset, &key,
+            &buffer, &read) != GST_FLOW_OK)
+      return -1;
+    gst_buffer_unref (buffer);
+    offset += read;
+
+    if (mxf_is_fill (&key))
+      continue;
+
+    if ((mxf_is_generic_container_essence_element (&key) ||
+            mxf_is_avid_essence_container_essence_element (&key)) &&
+        (etrack->track_number == 0 ||
+            etrack->track_number == GST_READ_UINT32_BE (&key.u[12])))
+      return n;
+
+    if (!mxf_is_generic_container_system_item (&key) &&
+        !mxf_is_generic_container_essence_element (&key) &&
+        !mxf_is_avid_essence_container_essence_element (&key))
+      return -1;
+
+    if (++n >= MAX (n_elements, 1))
+      return -1;
+  }
+
+  return -1;
+}
+
+static void
+gst_mxf_demux_prescan_fill_track (GstMXFDemux * demux,
+    GstMXFDemuxEssenceTrack * etrack, GPtrArray * jobs, GArray * ranges)
+{
+  MXFIndexTableSegment *first = NULL;
+  GArray *offsets;
+  guint64 first_offset;
+  gint element = -1;
+  guint i, j;
+
+  /* The first segment tells us where our element is in the content
+   * packages, all others have to use the same layout */
+  for (i = 0; i < jobs->len; i++) {
+    GstMXFDemuxIndexJob *job = g_ptr_array_index (jobs, i);
+
+    if (!job->parsed || job->segment.body_sid != etrack->body_sid)
+      continue;
+    if (!first || job->segment.index_start_position <
+        first->index_start_position)
+      first = &job->segment;
+  }
+
+  if (!first || first->index_start_position != 0)
+    return;
+
+  first_offset = gst_mxf_demux_essence_ranges_lookup (ranges,
+      first->n_index_entries ? first->index_entries[0].stream_offset : 0);
+  if (first_offset == -1)
+    return;
+
+  element = gst_mxf_demux_prescan_element_number (demux, etrack, first_offset,
+      first->n_delta_entries);
+  if (element < 0 || (first->n_delta_entries == 0 && element != 0)) {
+    GST_DEBUG_OBJECT (demux, "Could not find track %u in the content "
+        "packages", etrack->track_id);
+    return;
+  }
+
+  offsets = g_array_new (FALSE, TRUE, sizeof (GstMXFDemuxIndex));
+
+  for (i = 0; i < jobs->len; i++) {
+    GstMXFDemuxIndexJob *job = g_ptr_array_index (jobs, i);
+    MXFIndexTableSegment *segment = &job->segment;
+    guint32 element_delta = 0;
+    guint8 slice = 0;
+    guint n;
+
+    if (!job->parsed || segment->body_sid != etrack->body_sid ||
+        segment->index_start_position < 0)
+      continue;
+
+    if (segment->n_delta_entries) {
+      if (segment->n_delta_entries <= element)
+        continue;
+      element_delta = segment->delta_entries[element].element_delta;
+      slice = segment->delta_entries[element].slice;
+    }
+
+    n = segment->n_index_entries;
+    if (n == 0 && segment->edit_unit_byte_count != 0)
+      n = segment->index_duration;
+
+    if (segment->index_start_position + n > G_MAXUINT)
+      continue;
+
+    if (offsets->len < segment->index_start_position + n)
+      g_array_set_size (offsets, segment->index_start_position + n);
+
+    for (j = 0; j < n; j++) {
+      GstMXFDemuxIndex *idx = &g_array_index (offsets, GstMXFDemuxIndex,
+          segment->index_start_position + j);
+      guint64 stream_offset;
+      gboolean keyframe = TRUE;
+
+      if (segment->n_index_entries) {
+        MXFIndexEntry *entry = &segment->index_entries[j];
+
+        stream_offset = entry->stream_offset;
+        if (slice > 0 && slice <= segment->slice_count)
+          stream_offset += entry->slice_offset[slice - 1];
+        /* random access flag */
+        keyframe = (entry->flags & 0x80) != 0;
+      } else {
+        stream_offset = (segment->index_start_position + j) *
+            segment->edit_unit_byte_count;
+      }
+
+      idx->offset = gst_mxf_demux_essence_ranges_lookup (ranges,
+          stream_offset + element_delta);
+      if (idx->offset == -1)
+        idx->offset = 0;
+      idx->keyframe = keyframe;
+    }
+  }
+
+  for (i = 0; i < offsets->len; i++) {
+    GstMXFDemuxIndex *idx = &g_array_index (offsets, GstMXFDemuxIndex, i);
+
+    if (idx->offset == 0 || (i > 0 && idx->offset <=
+            g_array_index (offsets, GstMXFDemuxIndex, i - 1).offset))
+      break;
+  }
+
+  if (offsets->len == 0 || i != offsets->len) {
+    GST_WARNING_OBJECT (demux, "Index tables of track %u are incomplete or "
+        "not in order, building the index while playing", etrack->track_id);
+    g_array_free (offsets, TRUE);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (demux, "Prescanned index of track %u has %u entries",
+      etrack->track_id, offsets->len);
+
+  if (etrack->offsets)
+    g_array_free (etrack->offsets, TRUE);
+  etrack->offsets = offsets;
+  etrack->offsets_complete = TRUE;
+  if (etrack->duration <= 0)
+    etrack->duration = offsets->len;
+}
+
+/* Reads the index table segments of all partitions listed in the random
+ * index pack, parses them in parallel and builds the complete index of all
+ * essence tracks from them. */
+static void
+gst_mxf_demux_prescan_index (GstMXFDemux * demux)
+{
+  GstClockTime start = gst_util_get_timestamp ();
+  GPtrArray *jobs;
+  GHashTable *ranges;
+  MXFPrimerPack primer;
+  GList *l;
+  guint i;
+
+  demux->index_prescanned = TRUE;
+
+  if (!demux->random_index_pack) {
+    GST_DEBUG_OBJECT (demux, "No random index pack, can't prescan index");
+    return;
+  }
+
+  jobs = g_ptr_array_new ();
+
+  for (l = demux->partitions; l; l = l->next)
+    gst_mxf_demux_prescan_partition (demux, l->data, jobs);
+
+  /* Index table segments only use static local tags, an empty primer is
+   * enough and can be shared by all threads */
+  memset (&primer, 0, sizeof (primer));
+
+  if (jobs->len > 1) {
+    GThreadPool *pool;
+    gint n_threads;
+
+#if GLIB_CHECK_VERSION (2, 36, 0)
+    n_threads = g_get_num_processors ();
+#else
+    n_threads = 4;
+#endif
+
+    pool = g_thread_pool_new ((GFunc) gst_mxf_demux_index_job_func, &primer,
+        MIN (n_threads, jobs->len), FALSE, NULL);
+    for (i = 0; i < jobs->len; i++)
+      g_thread_pool_push (pool, g_ptr_array_index (jobs, i), NULL);
+    g_thread_pool_free (pool, FALSE, TRUE);
+  } else if (jobs->len == 1) {
+    gst_mxf_demux_index_job_func (g_ptr_array_index (jobs, 0), &primer);
+  }
+
+  /* Where the essence of each body sid is in the file */
+  ranges = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_array_unref);
+  for (l = demux->partitions; l; l = l->next) {
+    GstMXFDemuxPartition *p = l->data;
+    GstMXFDemuxEssenceRange r;
+    GArray *array;
+
+    if (p->partition.body_sid == 0 || p->essence_container_offset == 0)
+      continue;
+
+    array = g_hash_table_lookup (ranges,
+        GUINT_TO_POINTER (p->partition.body_sid));
+    if (!array) {
+      array = g_array_new (FALSE, FALSE, sizeof (GstMXFDemuxEssenceRange));
+      g_hash_table_insert (ranges, GUINT_TO_POINTER (p->partition.body_sid),
+          array);
+    }
+
+    r.body_offset = p->partition.body_offset;
+    r.offset = p->partition.this_partition + p->essence_container_offset;
+    g_array_append_val (array, r);
+  }
+
+  for (i = 0; i < demux->essence_tracks->len; i++) {
+    GstMXFDemuxEssenceTrack *etrack =
+        &g_array_index (demux->essence_tracks, GstMXFDemuxEssenceTrack, i);
+    GArray *array = g_hash_table_lookup (ranges,
+        GUINT_TO_POINTER (etrack->body_sid));
+
+    if (!array)
+      continue;
+
+    g_array_sort (array, (GCompareFunc) gst_mxf_demux_essence_range_compare);
+    gst_mxf_demux_prescan_fill_track (demux, etrack, jobs, array);
+  }
+
+  GST_DEBUG_OBJECT (demux, "Prescanned %u index table segments in %"
+      GST_TIME_FORMAT, jobs->len,
+      GST_TIME_ARGS (gst_util_get_timestamp () - start));
+
+  for (i = 0; i < jobs->len; i++) {
+    GstMXFDemuxIndexJob *job = g_ptr_array_index (jobs, i);
+
+    if (job->parsed)
+      mxf_index_table_segment_reset (&job->segment);
+    gst_buffer_unref (job->buffer);
+    g_free (job);
+  }
+  g_ptr_array_free (jobs, TRUE);
+  g_hash_table_destroy (ranges);
+}
+
 static GstFlowReturn
 gst_mxf_demux_handle_klv_packet (GstMXFDemux * demux, const MXFUL * key,
     GstBuffer * buffer, gboolean peek)
@@ -2655,6 +3133,11 @@ gst_mxf_demux_pull_and_handle_klv_packet (GstMXFDemux * demux)
   GstFlowReturn ret = GST_FLOW_OK;
   guint read = 0;
 
+  /* Once all tracks are known, build their complete index if requested */
+  if (demux->prescan_index && !demux->index_prescanned && demux->src->len > 0
+      && demux->random_access)
+    gst_mxf_demux_prescan_index (demux);
+
   if (demux->src->len > 0) {
     if (!gst_mxf_demux_get_earliest_pad (demux)) {
       ret = GST_FLOW_EOS;
@@ -4012,6 +4495,9 @@ gst_mxf_demux_set_property (GObject * object, guint prop_id,
     case PROP_MAX_DRIFT:
       demux->max_drift = g_value_get_uint64 (value);
       break;
+    case PROP_PRESCAN_INDEX:
+      demux->prescan_index = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -4031,6 +4517,9 @@ gst_mxf_demux_get_property (GObject * object, guint prop_id,
     case PROP_MAX_DRIFT:
       g_value_set_uint64 (value, demux->max_drift);
       break;
+    case PROP_PRESCAN_INDEX:
+      g_value_set_boolean (value, demux->prescan_index);
+      break;
     case PROP_STRUCTURE:{
       GstStructure *s;
 
@@ -4118,6 +4607,12 @@ gst_mxf_demux_class_init (GstMXFDemuxClass * klass)
           "Structural metadata of the MXF file",
           GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_PRESCAN_INDEX,
+      g_param_spec_boolean ("prescan-index", "Prescan index",
+          "Read all index table segments listed in the random index pack "
+          "before playback to build a complete seek index (pull mode only)",
+          DEFAULT_PRESCAN_INDEX, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_mxf_demux_change_state);
   gstelement_class->query = GST_DEBUG_FUNCPTR (gst_mxf_demux_query);
@@ -4149,6 +4644,7 @@ gst_mxf_demux_init (GstMXFDemux * demux)
   gst_element_add_pad (GST_ELEMENT (demux), demux->sinkpad);
 
   demux->max_drift = 500 * GST_MSECOND;
+  demux->prescan_index = DEFAULT_PRESCAN_INDEX;
 
   demux->adapter = gst_adapter_new ();
   g_rw_lock_init (&demux->metadata_lock);
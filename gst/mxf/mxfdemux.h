@@ -73,6 +73,8 @@ typedef struct
   gint64 duration;
 
   GArray *offsets;
+  /* offsets has no holes, e.g. because it comes from the index tables */
+  gboolean offsets_complete;
 
   MXFMetadataSourcePackage *source_package;
   MXFMetadataTimelineTrack *source_track;
@@ -154,6 +156,7 @@ struct _GstMXFDemux
   GList *pending_index_table_segments;
 
   GArray *random_index_pack;
+  gboolean index_prescanned;
 
   /* Metadata */
   GRWLock metadata_lock;
@@ -173,6 +176,7 @@ struct _GstMXFDemux
   /* Properties */
   gchar *requested_package_string;
   GstClockTime max_drift;
+  gboolean prescan_index;
 };
 
 struct _GstMXFDemuxClass
@@ -32,6 +32,91 @@
  *
  * The scenechange element does not work with compressed video.
  *
+ * The "GstForceKeyUnit" event also carries the
+ * <classname>&quot;scene-change-score&quot;</classname> and
+ * <classname>&quot;scene-change-confidence&quot;</classname> #gdouble fields
+ * of the frame, so that encoders can use the analysis without doing it
+ * again.
+ *
+ * If the #GstSceneChange:post-messages property is #TRUE, an element message
+ * called <classname>&quot;GstSceneChange&quot;</classname> is posted for
+ * every frame.  The message's structure contains these fields:
+ * <itemizedlist>
+ * <listitem>
+ *   <para>
+ *   #GstClockTime
+ *   <classname>&quot;timestamp&quot;</classname>:
+ *   the timestamp of the buffer that triggered the message.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstClockTime
+ *   <classname>&quot;stream-time&quot;</classname>:
+ *   the stream time of the buffer.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstClockTime
+ *   <classname>&quot;running-time&quot;</classname>:
+ *   the running_time of the buffer.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #GstClockTime
+ *   <classname>&quot;duration&quot;</classname>:
+ *   the duration of the buffer.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #gdouble
+ *   <classname>&quot;score&quot;</classname>:
+ *   the mean absolute luma difference to the previous frame, 0 to 255.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #gdouble
+ *   <classname>&quot;threshold&quot;</classname>:
+ *   the threshold the score was compared with.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #gdouble
+ *   <classname>&quot;histogram-diff&quot;</classname>:
+ *   the part of the luma histogram that changed, 0 to 1.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #gdouble
+ *   <classname>&quot;confidence&quot;</classname>:
+ *   how likely the frame starts a new scene, 0 to 1.  At least 0.5 for
+ *   scene changes and below 0.5 for the other frames.
+ *   </para>
+ * </listitem>
+ * <listitem>
+ *   <para>
+ *   #gboolean
+ *   <classname>&quot;scene-change&quot;</classname>:
+ *   whether the frame was detected as the first of a new scene.
+ *   </para>
+ * </listitem>
+ * </itemizedlist>
+ *
+ * Within the plugin the same values are attached to every buffer as a
+ * "GstSceneChangeMeta" meta.
+ *
+ * The frames can be analysed on a subsampled grid with the
+ * #GstSceneChange:subsample property, and by several threads with the
+ * #GstSceneChange:threads property.  When many streams are analysed at
+ * once, a subsample of 2 or 4 usually gives the same scene changes for a
+ * quarter or a sixteenth of the work.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -82,6 +167,8 @@
 #include <gst/video/gstvideofilter.h>
 #include <string.h>
 #include "gstscenechange.h"
+#include "gstscenechangemeta.h"
+#include "gstscenechangerow.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_scene_change_debug_category);
 #define GST_CAT_DEFAULT gst_scene_change_debug_category
@@ -89,6 +176,13 @@ GST_DEBUG_CATEGORY_STATIC (gst_scene_change_debug_category);
 /* prototypes */
 
 
+static void gst_scene_change_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_scene_change_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_scene_change_finalize (GObject * object);
+static gboolean gst_scene_change_start (GstBaseTransform * trans);
+static gboolean gst_scene_change_stop (GstBaseTransform * trans);
 static GstFlowReturn gst_scene_change_transform_frame_ip (GstVideoFilter *
     filter, GstVideoFrame * frame);
 
@@ -99,9 +193,20 @@ static gboolean is_shot_change (int frame_number);
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_SUBSAMPLE,
+  PROP_THREADS,
+  PROP_POST_MESSAGES
 };
 
+#define DEFAULT_SUBSAMPLE 1
+#define DEFAULT_THREADS 1
+#define DEFAULT_POST_MESSAGES FALSE
+
+/* the histogram only needs a rough sampling of the picture, it uses at most
+ * a sixteenth of the samples */
+#define SC_HIST_STEP 4
+
 #define VIDEO_CAPS \
     GST_VIDEO_CAPS_MAKE("{ I420, Y42B, Y41B, Y444 }")
 
@@ -115,6 +220,9 @@ G_DEFINE_TYPE_WITH_CODE (GstSceneChange, gst_scene_change,
 static void
 gst_scene_change_class_init (GstSceneChangeClass * klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstBaseTransformClass *base_transform_class =
+      GST_BASE_TRANSFORM_CLASS (klass);
   GstVideoFilterClass *video_filter_class = GST_VIDEO_FILTER_CLASS (klass);
 
   gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
@@ -129,39 +237,245 @@ gst_scene_change_class_init (GstSceneChangeClass * klass)
       "Video/Filter", "Detects scene changes in video",
       "David Schleef <ds@entropywave.com>");
 
+  gobject_class->set_property = gst_scene_change_set_property;
+  gobject_class->get_property = gst_scene_change_get_property;
+  gobject_class->finalize = gst_scene_change_finalize;
+  base_transform_class->start = GST_DEBUG_FUNCPTR (gst_scene_change_start);
+  base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_scene_change_stop);
   video_filter_class->transform_frame_ip =
       GST_DEBUG_FUNCPTR (gst_scene_change_transform_frame_ip);
 
+  g_object_class_install_property (gobject_class, PROP_SUBSAMPLE,
+      g_param_spec_int ("subsample", "Subsample",
+          "Analyse every n-th luma sample of every n-th row, 2 uses a "
+          "quarter and 4 a sixteenth of the samples", 1, 4, DEFAULT_SUBSAMPLE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Number of threads analysing rows of each frame, 0 for one per "
+          "processor. Takes effect when the element starts",
+          0, 64, DEFAULT_THREADS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+      g_param_spec_boolean ("post-messages", "Post Messages",
+          "Post an element message with the analysis of every frame",
+          DEFAULT_POST_MESSAGES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
 gst_scene_change_init (GstSceneChange * scenechange)
 {
+  scenechange->subsample = DEFAULT_SUBSAMPLE;
+  scenechange->threads = DEFAULT_THREADS;
+  scenechange->post_messages = DEFAULT_POST_MESSAGES;
+  g_mutex_init (&scenechange->lock);
+  g_cond_init (&scenechange->cond);
 }
 
+static void
+gst_scene_change_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstSceneChange *scenechange = GST_SCENE_CHANGE (object);
+
+  switch (property_id) {
+    case PROP_SUBSAMPLE:
+      GST_OBJECT_LOCK (scenechange);
+      scenechange->subsample = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (scenechange);
+      break;
+    case PROP_THREADS:
+      scenechange->threads = g_value_get_uint (value);
+      break;
+    case PROP_POST_MESSAGES:
+      scenechange->post_messages = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_scene_change_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstSceneChange *scenechange = GST_SCENE_CHANGE (object);
+
+  switch (property_id) {
+    case PROP_SUBSAMPLE:
+      GST_OBJECT_LOCK (scenechange);
+      g_value_set_int (value, scenechange->subsample);
+      GST_OBJECT_UNLOCK (scenechange);
+      break;
+    case PROP_THREADS:
+      g_value_set_uint (value, scenechange->threads);
+      break;
+    case PROP_POST_MESSAGES:
+      g_value_set_boolean (value, scenechange->post_messages);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_scene_change_finalize (GObject * object)
+{
+  GstSceneChange *scenechange = GST_SCENE_CHANGE (object);
+
+  g_mutex_clear (&scenechange->lock);
+  g_cond_clear (&scenechange->cond);
 
+  G_OBJECT_CLASS (gst_scene_change_parent_class)->finalize (object);
+}
+
+
+/* analyses the rows of @band, frame1 is NULL for the first frame */
+static void
+gst_scene_change_compute_band (GstSceneChange * scenechange,
+    GstSceneChangeBand * band)
+{
+  GstVideoFrame *f1 = scenechange->frame1, *f2 = scenechange->frame2;
+  guint32 hist[4][SC_HIST_BINS];
+  gint width, step, hstep, y, i;
+
+  width = GST_VIDEO_FRAME_WIDTH (f2);
+  step = scenechange->step;
+  hstep = MAX (step, SC_HIST_STEP);
+
+  band->sad = 0;
+  if (f1) {
+    for (y = (band->y_start + step - 1) / step * step; y < band->y_end;
+        y += step) {
+      band->sad +=
+          scene_change_sad_row ((guint8 *) f1->data[0] +
+          f1->info.stride[0] * y,
+          (guint8 *) f2->data[0] + f2->info.stride[0] * y, width, step);
+    }
+  }
+
+  memset (hist, 0, sizeof (hist));
+  for (y = (band->y_start + hstep - 1) / hstep * hstep; y < band->y_end;
+      y += hstep) {
+    scene_change_hist_row (hist,
+        (guint8 *) f2->data[0] + f2->info.stride[0] * y, width, hstep);
+  }
+  for (i = 0; i < SC_HIST_BINS; i++)
+    band->hist[i] = hist[0][i] + hist[1][i] + hist[2][i] + hist[3][i];
+}
+
+static void
+gst_scene_change_band_func (gpointer data, gpointer user_data)
+{
+  GstSceneChange *scenechange = user_data;
+
+  gst_scene_change_compute_band (scenechange,
+      &scenechange->bands[GPOINTER_TO_UINT (data)]);
+
+  g_mutex_lock (&scenechange->lock);
+  if (--scenechange->n_pending == 0)
+    g_cond_signal (&scenechange->cond);
+  g_mutex_unlock (&scenechange->lock);
+}
+
+/* Returns the mean absolute luma difference of @f1 and @f2 on the analysis
+ * grid, and in @hist_diff the part of the luma histogram that changed since
+ * the previous frame. @f1 is NULL for the first frame, which only gets its
+ * histogram computed. */
 static double
-get_frame_score (GstVideoFrame * f1, GstVideoFrame * f2)
+get_frame_score (GstSceneChange * scenechange, GstVideoFrame * f1,
+    GstVideoFrame * f2, double *hist_diff)
 {
-  int i;
-  int j;
-  int score = 0;
-  int width, height;
-  guint8 *s1;
-  guint8 *s2;
-
-  width = f1->info.width;
-  height = f1->info.height;
-
-  for (j = 0; j < height; j++) {
-    s1 = (guint8 *) f1->data[0] + f1->info.stride[0] * j;
-    s2 = (guint8 *) f2->data[0] + f2->info.stride[0] * j;
-    for (i = 0; i < width; i++) {
-      score += ABS (s1[i] - s2[i]);
+  guint64 sad = 0;
+  guint32 hist[SC_HIST_BINS];
+  guint64 hist_total = 0, hist_changed = 0;
+  gint width, height, step, hstep, i, j;
+  guint n;
+
+  width = GST_VIDEO_FRAME_WIDTH (f2);
+  height = GST_VIDEO_FRAME_HEIGHT (f2);
+  step = scenechange->step;
+  hstep = MAX (step, SC_HIST_STEP);
+
+  scenechange->frame1 = f1;
+  scenechange->frame2 = f2;
+  for (n = 0; n < scenechange->n_bands; n++) {
+    scenechange->bands[n].y_start = height * n / scenechange->n_bands;
+    scenechange->bands[n].y_end = height * (n + 1) / scenechange->n_bands;
+  }
+
+  /* the streaming thread analyses the first band */
+  if (scenechange->pool) {
+    scenechange->n_pending = scenechange->n_bands - 1;
+    for (n = 1; n < scenechange->n_bands; n++)
+      g_thread_pool_push (scenechange->pool, GUINT_TO_POINTER (n), NULL);
+  }
+  gst_scene_change_compute_band (scenechange, &scenechange->bands[0]);
+  if (scenechange->pool) {
+    g_mutex_lock (&scenechange->lock);
+    while (scenechange->n_pending > 0)
+      g_cond_wait (&scenechange->cond, &scenechange->lock);
+    g_mutex_unlock (&scenechange->lock);
+  }
+
+  memset (hist, 0, sizeof (hist));
+  for (n = 0; n < scenechange->n_bands; n++) {
+    sad += scenechange->bands[n].sad;
+    for (j = 0; j < SC_HIST_BINS; j++)
+      hist[j] += scenechange->bands[n].hist[j];
+  }
+
+  *hist_diff = 0;
+  if (scenechange->have_hist) {
+    for (j = 0; j < SC_HIST_BINS; j++) {
+      hist_total += hist[j];
+      hist_changed += ABS ((gint64) hist[j] - scenechange->hist[j]);
     }
+    /* every moved sample is counted in two bins */
+    if (hist_total > 0)
+      *hist_diff = (double) hist_changed / (2 * hist_total);
   }
+  memcpy (scenechange->hist, hist, sizeof (hist));
+  scenechange->have_hist = TRUE;
+
+  i = (width + step - 1) / step;
+  j = (height + step - 1) / step;
+
+  return ((double) sad) / ((double) i * j);
+}
 
-  return ((double) score) / (width * height);
+static void
+gst_scene_change_post_message (GstSceneChange * scenechange,
+    GstBuffer * buffer, double score, double threshold, double hist_diff,
+    double confidence, gboolean change)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM_CAST (scenechange);
+  GstMessage *m;
+  guint64 duration, timestamp, running_time, stream_time;
+
+  timestamp = GST_BUFFER_TIMESTAMP (buffer);
+  duration = GST_BUFFER_DURATION (buffer);
+  running_time = gst_segment_to_running_time (&trans->segment, GST_FORMAT_TIME,
+      timestamp);
+  stream_time = gst_segment_to_stream_time (&trans->segment, GST_FORMAT_TIME,
+      timestamp);
+
+  m = gst_message_new_element (GST_OBJECT_CAST (scenechange),
+      gst_structure_new ("GstSceneChange",
+          "timestamp", G_TYPE_UINT64, timestamp,
+          "stream-time", G_TYPE_UINT64, stream_time,
+          "running-time", G_TYPE_UINT64, running_time,
+          "duration", G_TYPE_UINT64, duration,
+          "score", G_TYPE_DOUBLE, score,
+          "threshold", G_TYPE_DOUBLE, threshold,
+          "histogram-diff", G_TYPE_DOUBLE, hist_diff,
+          "confidence", G_TYPE_DOUBLE, confidence,
+          "scene-change", G_TYPE_BOOLEAN, change, NULL));
+
+  gst_element_post_message (GST_ELEMENT_CAST (scenechange), m);
 }
 
 static GstFlowReturn
@@ -174,16 +488,40 @@ gst_scene_change_transform_frame_ip (GstVideoFilter * filter,
   double score_max;
   double threshold;
   double score;
+  double hist_diff;
+  double confidence;
   gboolean change;
   gboolean ret;
   int i;
 
   GST_DEBUG_OBJECT (scenechange, "transform_frame_ip");
 
+  GST_OBJECT_LOCK (scenechange);
+  scenechange->step = scenechange->subsample;
+  GST_OBJECT_UNLOCK (scenechange);
+
+  /* start again after a change of the frame size */
+  if (scenechange->oldbuf
+      && (GST_VIDEO_INFO_WIDTH (&scenechange->oldinfo) !=
+          GST_VIDEO_FRAME_WIDTH (frame)
+          || GST_VIDEO_INFO_HEIGHT (&scenechange->oldinfo) !=
+          GST_VIDEO_FRAME_HEIGHT (frame))) {
+    gst_buffer_unref (scenechange->oldbuf);
+    scenechange->oldbuf = NULL;
+    scenechange->have_hist = FALSE;
+  }
+
   if (!scenechange->oldbuf) {
     scenechange->n_diffs = 0;
     memset (scenechange->diffs, 0, sizeof (double) * SC_N_DIFFS);
+    get_frame_score (scenechange, NULL, frame, &hist_diff);
+    /* the meta has to be added before we keep a reference to the buffer */
+    gst_buffer_add_scene_change_meta (frame->buffer, 0, 0, 0, 0, FALSE);
+    if (scenechange->post_messages)
+      gst_scene_change_post_message (scenechange, frame->buffer, 0, 0, 0, 0,
+          FALSE);
     scenechange->oldbuf = gst_buffer_ref (frame->buffer);
+    memcpy (&scenechange->oldinfo, &frame->info, sizeof (GstVideoInfo));
     return GST_FLOW_OK;
   }
 
@@ -195,14 +533,10 @@ gst_scene_change_transform_frame_ip (GstVideoFilter * filter,
     return GST_FLOW_ERROR;
   }
 
-  score = get_frame_score (&oldframe, frame);
+  score = get_frame_score (scenechange, &oldframe, frame, &hist_diff);
 
   gst_video_frame_unmap (&oldframe);
 
-  gst_buffer_unref (scenechange->oldbuf);
-  scenechange->oldbuf = gst_buffer_ref (frame->buffer);
-  memcpy (&scenechange->oldinfo, &frame->info, sizeof (GstVideoInfo));
-
   memmove (scenechange->diffs, scenechange->diffs + 1,
       sizeof (double) * (SC_N_DIFFS - 1));
   scenechange->diffs[SC_N_DIFFS - 1] = score;
@@ -233,6 +567,27 @@ gst_scene_change_transform_frame_ip (GstVideoFilter * filter,
     change = FALSE;
   }
 
+  /* maps the score to [0.5, 1] for scene changes and to [0, 0.5) for the
+   * other frames, the more the score is above the threshold the higher */
+  if (scenechange->n_diffs > 2 && score >= 5 && threshold > 0)
+    confidence = CLAMP ((score / threshold - 1.0) / 1.5, 0.0, 1.0);
+  else
+    confidence = 0;
+  if (change)
+    confidence = 0.5 + 0.5 * confidence;
+  else
+    confidence = MIN (0.5 * confidence, 0.499);
+
+  gst_buffer_add_scene_change_meta (frame->buffer, score, threshold,
+      hist_diff, confidence, change);
+  if (scenechange->post_messages)
+    gst_scene_change_post_message (scenechange, frame->buffer, score,
+        threshold, hist_diff, confidence, change);
+
+  gst_buffer_unref (scenechange->oldbuf);
+  scenechange->oldbuf = gst_buffer_ref (frame->buffer);
+  memcpy (&scenechange->oldinfo, &frame->info, sizeof (GstVideoInfo));
+
 #ifdef TESTING
   if (change != is_shot_change (scenechange->n_diffs)) {
     g_print ("%d %g %g %g %d\n", scenechange->n_diffs, score / threshold,
@@ -250,6 +605,9 @@ gst_scene_change_transform_frame_ip (GstVideoFilter * filter,
         gst_video_event_new_downstream_force_key_unit (GST_BUFFER_PTS
         (frame->buffer), GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, FALSE,
         scenechange->count++);
+    gst_structure_set (gst_event_writable_structure (event),
+        "scene-change-score", G_TYPE_DOUBLE, score,
+        "scene-change-confidence", G_TYPE_DOUBLE, confidence, NULL);
 
     gst_pad_push_event (GST_BASE_TRANSFORM_SRC_PAD (scenechange), event);
   }
@@ -257,10 +615,60 @@ gst_scene_change_transform_frame_ip (GstVideoFilter * filter,
   return GST_FLOW_OK;
 }
 
+static gboolean
+gst_scene_change_start (GstBaseTransform * trans)
+{
+  GstSceneChange *scenechange = GST_SCENE_CHANGE (trans);
+  GError *err = NULL;
+
+  scenechange->n_bands = scenechange->threads;
+  if (scenechange->n_bands == 0) {
+#if GLIB_CHECK_VERSION (2, 36, 0)
+    scenechange->n_bands = g_get_num_processors ();
+#else
+    scenechange->n_bands = 1;
+#endif
+  }
+  GST_DEBUG_OBJECT (scenechange, "analysing with %u threads",
+      scenechange->n_bands);
+
+  /* the streaming thread analyses the first band */
+  if (scenechange->n_bands > 1) {
+    scenechange->pool = g_thread_pool_new (gst_scene_change_band_func,
+        scenechange, scenechange->n_bands - 1, TRUE, &err);
+    if (!scenechange->pool) {
+      GST_WARNING_OBJECT (scenechange, "could not create threads: %s",
+          err->message);
+      g_clear_error (&err);
+      scenechange->n_bands = 1;
+    }
+  }
+  scenechange->bands = g_new0 (GstSceneChangeBand, scenechange->n_bands);
+
+  return TRUE;
+}
 
+static gboolean
+gst_scene_change_stop (GstBaseTransform * trans)
+{
+  GstSceneChange *scenechange = GST_SCENE_CHANGE (trans);
 
+  if (scenechange->pool) {
+    g_thread_pool_free (scenechange->pool, FALSE, TRUE);
+    scenechange->pool = NULL;
+  }
+  g_free (scenechange->bands);
+  scenechange->bands = NULL;
+  scenechange->n_bands = 0;
 
+  if (scenechange->oldbuf) {
+    gst_buffer_unref (scenechange->oldbuf);
+    scenechange->oldbuf = NULL;
+  }
+  scenechange->have_hist = FALSE;
 
+  return TRUE;
+}
 
 #ifdef TESTING
 /* This is from ds's personal collection.  No, you can't have it. */
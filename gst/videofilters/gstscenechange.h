@@ -23,6 +23,8 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
 
+#include "gstscenechangerow.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_SCENE_CHANGE   (gst_scene_change_get_type())
@@ -36,6 +38,14 @@ typedef struct _GstSceneChangeClass GstSceneChangeClass;
 
 #define SC_N_DIFFS 5
 
+/* the rows of a frame analysed by one thread */
+typedef struct
+{
+  gint y_start, y_end;
+  guint64 sad;
+  guint32 hist[SC_HIST_BINS];
+} GstSceneChangeBand;
+
 struct _GstSceneChange
 {
   GstVideoFilter base_scenechange;
@@ -45,6 +55,25 @@ struct _GstSceneChange
   GstBuffer *oldbuf;
   GstVideoInfo oldinfo;
   int count;
+
+  /* properties */
+  gint subsample;
+  guint threads;
+  gboolean post_messages;
+
+  /* luma histogram of the previous frame */
+  guint32 hist[SC_HIST_BINS];
+  gboolean have_hist;
+
+  GstSceneChangeBand *bands;
+  guint n_bands;
+  GThreadPool *pool;
+  GMutex lock;
+  GCond cond;
+  guint n_pending;
+  /* the frames being compared and the subsample step, for the threads */
+  GstVideoFrame *frame1, *frame2;
+  gint step;
 };
 
 struct _GstSceneChangeClass
@@ -0,0 +1,102 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstscenechangemeta.h"
+
+static gboolean
+gst_scene_change_meta_init (GstSceneChangeMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  meta->score = 0;
+  meta->threshold = 0;
+  meta->histogram_diff = 0;
+  meta->confidence = 0;
+  meta->scene_change = FALSE;
+
+  return TRUE;
+}
+
+/* the values describe the whole picture, they stay valid for copies and
+ * scaled or converted versions of it */
+static gboolean
+gst_scene_change_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstSceneChangeMeta *smeta = (GstSceneChangeMeta *) meta;
+
+  gst_buffer_add_scene_change_meta (dest, smeta->score, smeta->threshold,
+      smeta->histogram_diff, smeta->confidence, smeta->scene_change);
+
+  return TRUE;
+}
+
+GType
+gst_scene_change_meta_api_get_type (void)
+{
+  static volatile GType type;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstSceneChangeMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+const GstMetaInfo *
+gst_scene_change_meta_get_info (void)
+{
+  static const GstMetaInfo *scene_change_meta_info = NULL;
+
+  if (g_once_init_enter (&scene_change_meta_info)) {
+    const GstMetaInfo *meta =
+        gst_meta_register (GST_SCENE_CHANGE_META_API_TYPE,
+        "GstSceneChangeMeta", sizeof (GstSceneChangeMeta),
+        (GstMetaInitFunction) gst_scene_change_meta_init,
+        (GstMetaFreeFunction) NULL,
+        (GstMetaTransformFunction) gst_scene_change_meta_transform);
+    g_once_init_leave (&scene_change_meta_info, meta);
+  }
+
+  return scene_change_meta_info;
+}
+
+GstSceneChangeMeta *
+gst_buffer_add_scene_change_meta (GstBuffer * buffer, gdouble score,
+    gdouble threshold, gdouble histogram_diff, gdouble confidence,
+    gboolean scene_change)
+{
+  GstSceneChangeMeta *meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  meta = (GstSceneChangeMeta *) gst_buffer_add_meta (buffer,
+      GST_SCENE_CHANGE_META_INFO, NULL);
+
+  meta->score = score;
+  meta->threshold = threshold;
+  meta->histogram_diff = histogram_diff;
+  meta->confidence = confidence;
+  meta->scene_change = scene_change;
+
+  return meta;
+}
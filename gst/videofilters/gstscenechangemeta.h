@@ -0,0 +1,63 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_SCENE_CHANGE_META_H__
+#define __GST_SCENE_CHANGE_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstSceneChangeMeta GstSceneChangeMeta;
+
+G_GNUC_INTERNAL GType gst_scene_change_meta_api_get_type (void);
+#define GST_SCENE_CHANGE_META_API_TYPE  (gst_scene_change_meta_api_get_type())
+#define GST_SCENE_CHANGE_META_INFO  (gst_scene_change_meta_get_info())
+G_GNUC_INTERNAL const GstMetaInfo * gst_scene_change_meta_get_info (void);
+
+/* Results of the scene change analysis of a frame, attached to every buffer
+ * by the scenechange element. Private to this plugin; other elements get the
+ * same values from the "GstSceneChange" element messages or the fields of
+ * the "GstForceKeyUnit" event. */
+struct _GstSceneChangeMeta {
+  GstMeta            meta;
+
+  /* mean absolute difference of the luma samples to the previous frame,
+   * 0 to 255 */
+  gdouble            score;
+  /* the score above which a frame is compared with the previous ones */
+  gdouble            threshold;
+  /* the part of the luma histogram that changed, 0 to 1 */
+  gdouble            histogram_diff;
+  /* how likely the frame starts a new scene, 0 to 1. At least 0.5 when
+   * scene_change is set and below 0.5 otherwise */
+  gdouble            confidence;
+  /* TRUE if the frame was detected as the first of a new scene */
+  gboolean           scene_change;
+};
+
+#define gst_buffer_get_scene_change_meta(b) ((GstSceneChangeMeta*)gst_buffer_get_meta((b),GST_SCENE_CHANGE_META_API_TYPE))
+
+G_GNUC_INTERNAL GstSceneChangeMeta *
+gst_buffer_add_scene_change_meta (GstBuffer * buffer, gdouble score,
+                                  gdouble threshold, gdouble histogram_diff,
+                                  gdouble confidence, gboolean scene_change);
+
+G_END_DECLS
+
+#endif
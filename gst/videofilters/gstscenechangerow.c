@@ -0,0 +1,117 @@
+/* GStreamer
+ * Copyright (C) 2011 David Schleef <ds@schleef.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstscenechangerow.h"
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* sum of the absolute differences of every @step-th sample of two rows */
+guint64
+scene_change_sad_row (const guint8 * s1, const guint8 * s2, gint width,
+    gint step)
+{
+  guint64 sad = 0;
+  gint i = 0;
+
+#if defined (__SSE2__)
+  /* the samples that are skipped are masked out of both rows */
+  if (step == 1 || step == 2 || step == 4) {
+    __m128i mask, acc = _mm_setzero_si128 ();
+    guint64 sums[2];
+
+    if (step == 1)
+      mask = _mm_set1_epi8 (-1);
+    else if (step == 2)
+      mask = _mm_set1_epi16 (0x00ff);
+    else
+      mask = _mm_set1_epi32 (0x000000ff);
+
+    for (; i + 16 <= width; i += 16) {
+      __m128i a = _mm_loadu_si128 ((const __m128i *) (s1 + i));
+      __m128i b = _mm_loadu_si128 ((const __m128i *) (s2 + i));
+
+      acc = _mm_add_epi64 (acc,
+          _mm_sad_epu8 (_mm_and_si128 (a, mask), _mm_and_si128 (b, mask)));
+    }
+    _mm_storeu_si128 ((__m128i *) sums, acc);
+    sad = sums[0] + sums[1];
+  }
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+  if (step == 1 || step == 2 || step == 4) {
+    uint8x16_t mask;
+    uint32x4_t acc = vdupq_n_u32 (0);
+
+    if (step == 1)
+      mask = vdupq_n_u8 (0xff);
+    else if (step == 2)
+      mask = vreinterpretq_u8_u16 (vdupq_n_u16 (0x00ff));
+    else
+      mask = vreinterpretq_u8_u32 (vdupq_n_u32 (0x000000ff));
+
+    while (i + 16 <= width) {
+      /* the 16 bit sums can take 128 blocks of differences */
+      uint16x8_t acc16 = vdupq_n_u16 (0);
+      gint end = MIN (width - 15, i + 128 * 16);
+
+      for (; i < end; i += 16) {
+        uint8x16_t a = vandq_u8 (vld1q_u8 (s1 + i), mask);
+        uint8x16_t b = vandq_u8 (vld1q_u8 (s2 + i), mask);
+
+        acc16 = vpadalq_u8 (acc16, vabdq_u8 (a, b));
+      }
+      acc = vpadalq_u16 (acc, acc16);
+    }
+    sad = (guint64) vgetq_lane_u32 (acc, 0) + vgetq_lane_u32 (acc, 1) +
+        vgetq_lane_u32 (acc, 2) + vgetq_lane_u32 (acc, 3);
+  }
+#endif
+
+  /* i is a multiple of 16 here, so still a multiple of @step */
+  for (; i < width; i += step)
+    sad += ABS (s1[i] - s2[i]);
+
+  return sad;
+}
+
+/* adds every @step-th sample of a row to the histogram, spread over four
+ * tables so that runs of similar samples don't wait on the same counter */
+void
+scene_change_hist_row (guint32 hist[4][SC_HIST_BINS], const guint8 * s,
+    gint width, gint step)
+{
+  gint i = 0;
+
+  for (; i + 3 * step < width; i += 4 * step) {
+    hist[0][s[i] / (256 / SC_HIST_BINS)]++;
+    hist[1][s[i + step] / (256 / SC_HIST_BINS)]++;
+    hist[2][s[i + 2 * step] / (256 / SC_HIST_BINS)]++;
+    hist[3][s[i + 3 * step] / (256 / SC_HIST_BINS)]++;
+  }
+  for (; i < width; i += step)
+    hist[0][s[i] / (256 / SC_HIST_BINS)]++;
+}
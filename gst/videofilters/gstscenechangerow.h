@@ -0,0 +1,36 @@
+/* GStreamer
+ * Copyright (C) 2011 David Schleef <ds@schleef.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_SCENE_CHANGE_ROW_H_
+#define _GST_SCENE_CHANGE_ROW_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define SC_HIST_BINS 64
+
+guint64 scene_change_sad_row (const guint8 * s1, const guint8 * s2,
+    gint width, gint step);
+void scene_change_hist_row (guint32 hist[4][SC_HIST_BINS], const guint8 * s,
+    gint width, gint step);
+
+G_END_DECLS
+
+#endif
@@ -27,8 +27,6 @@
 #endif
 
 #include <gst/base/gstbytereader.h>
-#include <gst/base/gstbytewriter.h>
-#include <gst/base/gstadapter.h>
 #include <gst/video/video.h>
 #include "gsth264parse.h"
 
@@ -145,7 +143,7 @@ gst_h264_parse_class_init (GstH264ParseClass * klass)
 static void
 gst_h264_parse_init (GstH264Parse * h264parse)
 {
-  h264parse->frame_out = gst_adapter_new ();
+  h264parse->nals = g_array_new (FALSE, FALSE, sizeof (GstH264ParseNal));
   gst_base_parse_set_pts_interpolation (GST_BASE_PARSE (h264parse), FALSE);
 }
 
@@ -155,7 +153,7 @@ gst_h264_parse_finalize (GObject * object)
 {
   GstH264Parse *h264parse = GST_H264_PARSE (object);
 
-  g_object_unref (h264parse->frame_out);
+  g_array_free (h264parse->nals, TRUE);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -174,7 +172,7 @@ gst_h264_parse_reset_frame (GstH264Parse * h264parse)
   h264parse->sei_pos = -1;
   h264parse->keyframe = FALSE;
   h264parse->frame_start = FALSE;
-  gst_adapter_clear (h264parse->frame_out);
+  g_array_set_size (h264parse->nals, 0);
 }
 
 static void
@@ -372,33 +370,122 @@ gst_h264_parse_negotiate (GstH264Parse * h264parse, gint in_format,
   h264parse->transform = (in_format != h264parse->format);
 }
 
-static GstBuffer *
-gst_h264_parse_wrap_nal (GstH264Parse * h264parse, guint format, guint8 * data,
-    guint size)
+/* size of the start code or length in front of each output NAL */
+static guint
+gst_h264_parse_prefix_size (GstH264Parse * h264parse)
 {
-  GstBuffer *buf;
-  guint nl = h264parse->nal_length_size;
-  guint32 tmp;
+  if (h264parse->format == GST_H264_PARSE_FORMAT_AVC
+      || h264parse->format == GST_H264_PARSE_FORMAT_AVC3)
+    return h264parse->nal_length_size;
 
-  GST_DEBUG_OBJECT (h264parse, "nal length %d", size);
+  /* There are legit cases where nl in avc stream is 2, but byte-stream
+   * SC is still always 4 bytes. */
+  return 4;
+}
 
-  buf = gst_buffer_new_allocate (NULL, 4 + size, NULL);
-  if (format == GST_H264_PARSE_FORMAT_AVC
-      || format == GST_H264_PARSE_FORMAT_AVC3) {
-    tmp = GUINT32_TO_BE (size << (32 - 8 * nl));
+static void
+gst_h264_parse_write_prefix (GstH264Parse * h264parse, guint8 * data,
+    guint size)
+{
+  guint i, nl = gst_h264_parse_prefix_size (h264parse);
+
+  if (h264parse->format == GST_H264_PARSE_FORMAT_AVC
+      || h264parse->format == GST_H264_PARSE_FORMAT_AVC3) {
+    for (i = 0; i < nl; i++)
+      data[i] = size >> (8 * (nl - 1 - i));
   } else {
-    /* HACK: nl should always be 4 here, otherwise this won't work. 
-     * There are legit cases where nl in avc stream is 2, but byte-stream
-     * SC is still always 4 bytes. */
-    nl = 4;
-    tmp = GUINT32_TO_BE (1);
+    GST_WRITE_UINT32_BE (data, 1);
   }
+}
+
+/* appends @nal to @buf after a start code or length, sharing the memory of
+ * @nal */
+static void
+gst_h264_parse_append_nal (GstH264Parse * h264parse, GstBuffer * buf,
+    GstBuffer * nal)
+{
+  GstMemory *prefix;
+  GstMapInfo map;
+  gsize size = gst_buffer_get_size (nal);
 
-  gst_buffer_fill (buf, 0, &tmp, sizeof (guint32));
-  gst_buffer_fill (buf, nl, data, size);
-  gst_buffer_set_size (buf, size + nl);
+  GST_DEBUG_OBJECT (h264parse, "nal length %" G_GSIZE_FORMAT, size);
 
-  return buf;
+  prefix = gst_allocator_alloc (NULL, gst_h264_parse_prefix_size (h264parse),
+      NULL);
+  gst_memory_map (prefix, &map, GST_MAP_WRITE);
+  gst_h264_parse_write_prefix (h264parse, map.data, size);
+  gst_memory_unmap (prefix, &map);
+
+  gst_buffer_append_memory (buf, prefix);
+  gst_buffer_copy_into (buf, nal, GST_BUFFER_COPY_MEMORY, 0, size);
+}
+
+/* size of the NALs collected so far, once converted */
+static guint
+gst_h264_parse_get_nals_size (GstH264Parse * h264parse)
+{
+  guint i, size = 0, nl = gst_h264_parse_prefix_size (h264parse);
+
+  for (i = 0; i < h264parse->nals->len; i++)
+    size += nl + g_array_index (h264parse->nals, GstH264ParseNal, i).size;
+
+  return size;
+}
+
+/* Builds the converted AU from the collected NALs. The payloads are shared
+ * with @buffer, the input frame, and only the start codes or lengths are
+ * written, unless there are too many NALs to fit the memories in a buffer */
+static GstBuffer *
+gst_h264_parse_assemble_nals (GstH264Parse * h264parse, GstBuffer * buffer)
+{
+  GArray *nals = h264parse->nals;
+  guint i, nl = gst_h264_parse_prefix_size (h264parse);
+  GstBuffer *out;
+  GstMemory *prefixes;
+  GstMapInfo map;
+
+  if (nals->len * 2 > gst_buffer_get_max_memory ()) {
+    guint8 *data;
+
+    GST_LOG_OBJECT (h264parse, "copying %u NALs", nals->len);
+    out = gst_buffer_new_allocate (NULL,
+        gst_h264_parse_get_nals_size (h264parse), NULL);
+    gst_buffer_map (out, &map, GST_MAP_WRITE);
+    data = map.data;
+    for (i = 0; i < nals->len; i++) {
+      GstH264ParseNal *nal = &g_array_index (nals, GstH264ParseNal, i);
+
+      gst_h264_parse_write_prefix (h264parse, data, nal->size);
+      gst_buffer_extract (buffer, nal->offset, data + nl, nal->size);
+      data += nl + nal->size;
+    }
+    gst_buffer_unmap (out, &map);
+
+    return out;
+  }
+
+  /* all the prefixes in one memory */
+  prefixes = gst_allocator_alloc (NULL, nals->len * nl, NULL);
+  gst_memory_map (prefixes, &map, GST_MAP_WRITE);
+  for (i = 0; i < nals->len; i++) {
+    gst_h264_parse_write_prefix (h264parse, map.data + i * nl,
+        g_array_index (nals, GstH264ParseNal, i).size);
+  }
+  gst_memory_unmap (prefixes, &map);
+
+  out = gst_buffer_new ();
+  for (i = 0; i < nals->len; i++) {
+    GstH264ParseNal *nal = &g_array_index (nals, GstH264ParseNal, i);
+
+    GST_LOG_OBJECT (h264parse, "sharing NAL of type %u, size %u", nal->type,
+        nal->size);
+    gst_buffer_append_memory (out, gst_memory_share (prefixes, i * nl, nl));
+    gst_buffer_copy_into (out, buffer, GST_BUFFER_COPY_MEMORY, nal->offset,
+        nal->size);
+  }
+  gst_memory_unref (prefixes);
+
+  return out;
 }
 
 static void
@@ -574,7 +661,7 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       /* mark SEI pos */
       if (h264parse->sei_pos == -1) {
         if (h264parse->transform)
-          h264parse->sei_pos = gst_adapter_available (h264parse->frame_out);
+          h264parse->sei_pos = gst_h264_parse_get_nals_size (h264parse);
         else
           h264parse->sei_pos = nalu->sc_offset;
         GST_DEBUG_OBJECT (h264parse, "marking SEI in frame at offset %d",
@@ -618,7 +705,7 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       /* mind replacement buffer if applicable */
       if (h264parse->idr_pos == -1) {
         if (h264parse->transform)
-          h264parse->idr_pos = gst_adapter_available (h264parse->frame_out);
+          h264parse->idr_pos = gst_h264_parse_get_nals_size (h264parse);
         else
           h264parse->idr_pos = nalu->sc_offset;
         GST_DEBUG_OBJECT (h264parse, "marking IDR in frame at offset %d",
@@ -635,15 +722,16 @@ gst_h264_parse_process_nal (GstH264Parse * h264parse, GstH264NalUnit * nalu)
       gst_h264_parser_parse_nal (nalparser, nalu);
   }
 
-  /* if AVC output needed, collect properly prefixed nal in adapter,
-   * and use that to replace outgoing buffer data later on */
+  /* if AVC output needed, remember where the nal is, the outgoing buffer
+   * is assembled from the input with the proper prefixes later on */
   if (h264parse->transform) {
-    GstBuffer *buf;
+    GstH264ParseNal nal;
 
     GST_LOG_OBJECT (h264parse, "collecting NAL in AVC frame");
-    buf = gst_h264_parse_wrap_nal (h264parse, h264parse->format,
-        nalu->data + nalu->offset, nalu->size);
-    gst_adapter_push (h264parse->frame_out, buf);
+    nal.offset = nalu->offset;
+    nal.size = nalu->size;
+    nal.type = nalu->type;
+    g_array_append_val (h264parse->nals, nal);
   }
 }
 
@@ -745,6 +833,9 @@ gst_h264_parse_handle_frame_packetized (GstBaseParse * parse,
       tmp_frame.overhead = frame->overhead;
       tmp_frame.buffer = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL,
           nalu.offset, nalu.size);
+      /* the nal is all of the buffer of the split frame */
+      if (h264parse->nals->len > 0)
+        g_array_index (h264parse->nals, GstH264ParseNal, 0).offset = 0;
 
       /* note we don't need to come up with a sub-buffer, since
        * subsequent code only considers input buffer's metadata.
@@ -1529,7 +1620,6 @@ gst_h264_parse_parse_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
 {
   GstH264Parse *h264parse;
   GstBuffer *buffer;
-  guint av;
 
   h264parse = GST_H264_PARSE (parse);
   buffer = frame->buffer;
@@ -1549,11 +1639,11 @@ gst_h264_parse_parse_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
     GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
 
   /* replace with transformed AVC output if applicable */
-  av = gst_adapter_available (h264parse->frame_out);
-  if (av) {
+  if (h264parse->nals->len > 0) {
     GstBuffer *buf;
 
-    buf = gst_adapter_take_buffer (h264parse->frame_out, av);
+    buf = gst_h264_parse_assemble_nals (h264parse, buffer);
+    g_array_set_size (h264parse->nals, 0);
     gst_buffer_copy_into (buf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
     gst_buffer_replace (&frame->out_buffer, buf);
     gst_buffer_unref (buf);
@@ -1568,17 +1658,15 @@ static GstFlowReturn
 gst_h264_parse_push_codec_buffer (GstH264Parse * h264parse, GstBuffer * nal,
     GstClockTime ts)
 {
-  GstMapInfo map;
+  GstBuffer *buf;
 
-  gst_buffer_map (nal, &map, GST_MAP_READ);
-  nal = gst_h264_parse_wrap_nal (h264parse, h264parse->format,
-      map.data, map.size);
-  gst_buffer_unmap (nal, &map);
+  buf = gst_buffer_new ();
+  gst_h264_parse_append_nal (h264parse, buf, nal);
 
-  GST_BUFFER_TIMESTAMP (nal) = ts;
-  GST_BUFFER_DURATION (nal) = 0;
+  GST_BUFFER_TIMESTAMP (buf) = ts;
+  GST_BUFFER_DURATION (buf) = 0;
 
-  return gst_pad_push (GST_BASE_PARSE_SRC_PAD (h264parse), nal);
+  return gst_pad_push (GST_BASE_PARSE_SRC_PAD (h264parse), buf);
 }
 
 static GstEvent *
@@ -1744,54 +1832,29 @@ gst_h264_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
             }
           }
         } else {
-          /* insert config NALs into AU */
-          GstByteWriter bw;
+          /* insert config NALs into AU, the new buffer shares the memory
+           * of the AU and of the config NALs */
           GstBuffer *new_buf;
-          const gboolean bs = h264parse->format == GST_H264_PARSE_FORMAT_BYTE;
-          const gint nls = 4 - h264parse->nal_length_size;
-          gboolean ok;
 
-          gst_byte_writer_init_with_size (&bw, gst_buffer_get_size (buffer),
-              FALSE);
-          ok = gst_byte_writer_put_buffer (&bw, buffer, 0, h264parse->idr_pos);
+          new_buf = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_MEMORY, 0,
+              h264parse->idr_pos);
           GST_DEBUG_OBJECT (h264parse, "- inserting SPS/PPS");
           for (i = 0; i < GST_H264_MAX_SPS_COUNT; i++) {
             if ((codec_nal = h264parse->sps_nals[i])) {
-              gsize nal_size = gst_buffer_get_size (codec_nal);
               GST_DEBUG_OBJECT (h264parse, "inserting SPS nal");
-              if (bs) {
-                ok &= gst_byte_writer_put_uint32_be (&bw, 1);
-              } else {
-                ok &= gst_byte_writer_put_uint32_be (&bw,
-                    (nal_size << (nls * 8)));
-                ok &= gst_byte_writer_set_pos (&bw,
-                    gst_byte_writer_get_pos (&bw) - nls);
-              }
-
-              ok &= gst_byte_writer_put_buffer (&bw, codec_nal, 0, nal_size);
+              gst_h264_parse_append_nal (h264parse, new_buf, codec_nal);
               h264parse->last_report = new_ts;
             }
           }
           for (i = 0; i < GST_H264_MAX_PPS_COUNT; i++) {
             if ((codec_nal = h264parse->pps_nals[i])) {
-              gsize nal_size = gst_buffer_get_size (codec_nal);
               GST_DEBUG_OBJECT (h264parse, "inserting PPS nal");
-              if (bs) {
-                ok &= gst_byte_writer_put_uint32_be (&bw, 1);
-              } else {
-                ok &= gst_byte_writer_put_uint32_be (&bw,
-                    (nal_size << (nls * 8)));
-                ok &= gst_byte_writer_set_pos (&bw,
-                    gst_byte_writer_get_pos (&bw) - nls);
-              }
-              ok &= gst_byte_writer_put_buffer (&bw, codec_nal, 0, nal_size);
+              gst_h264_parse_append_nal (h264parse, new_buf, codec_nal);
               h264parse->last_report = new_ts;
             }
           }
-          ok &=
-              gst_byte_writer_put_buffer (&bw, buffer, h264parse->idr_pos, -1);
-          /* collect result and push */
-          new_buf = gst_byte_writer_reset_and_get_buffer (&bw);
+          gst_buffer_copy_into (new_buf, buffer, GST_BUFFER_COPY_MEMORY,
+              h264parse->idr_pos, -1);
           gst_buffer_copy_into (new_buf, buffer, GST_BUFFER_COPY_METADATA, 0,
               -1);
           /* should already be keyframe/IDR, but it may not have been,
@@ -1799,10 +1862,6 @@ gst_h264_parse_pre_push_frame (GstBaseParse * parse, GstBaseParseFrame * frame)
           GST_BUFFER_FLAG_UNSET (new_buf, GST_BUFFER_FLAG_DELTA_UNIT);
           gst_buffer_replace (&frame->out_buffer, new_buf);
           gst_buffer_unref (new_buf);
-          /* some result checking seems to make some compilers happy */
-          if (G_UNLIKELY (!ok)) {
-            GST_ERROR_OBJECT (h264parse, "failed to insert SPS/PPS");
-          }
         }
       }
       /* we pushed whatever we had */
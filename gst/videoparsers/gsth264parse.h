@@ -32,6 +32,7 @@
 G_BEGIN_DECLS
 
 typedef struct _H264Params H264Params;
+typedef struct _GstH264ParseNal GstH264ParseNal;
 
 #define GST_TYPE_H264_PARSE \
   (gst_h264_parse_get_type())
@@ -49,6 +50,14 @@ GType gst_h264_parse_get_type (void);
 typedef struct _GstH264Parse GstH264Parse;
 typedef struct _GstH264ParseClass GstH264ParseClass;
 
+/* a NAL of the current AU, in the input frame */
+struct _GstH264ParseNal
+{
+  guint offset;                 /* of the payload, after the start code or length */
+  guint size;
+  guint8 type;
+};
+
 struct _GstH264Parse
 {
   GstBaseParse baseparse;
@@ -101,7 +110,9 @@ struct _GstH264Parse
   /*guint next_sc_pos;*/
   gint idr_pos, sei_pos;
   gboolean update_caps;
-  GstAdapter *frame_out;
+  /* NALs of the current AU when converting, the output is assembled from
+   * these without copying the payloads */
+  GArray *nals;
   gboolean keyframe;
   gboolean frame_start;
   /* AU state */
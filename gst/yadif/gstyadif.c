@@ -34,6 +34,10 @@
  * This pipeline creates an interlaced test pattern, and then deinterlaces
  * it using the yadif filter.
  * </refsect2>
+ *
+ * Each frame is split into horizontal slices which are filtered in
+ * parallel by #GstYadif:threads threads. The line filter is chosen at
+ * runtime from the features of the CPU.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -69,13 +73,23 @@ static gboolean gst_yadif_stop (GstBaseTransform * trans);
 static GstFlowReturn gst_yadif_transform (GstBaseTransform * trans,
     GstBuffer * inbuf, GstBuffer * outbuf);
 
+static void gst_yadif_slice_func (gpointer data, gpointer user_data);
+
 enum
 {
   PROP_0,
-  PROP_MODE
+  PROP_MODE,
+  PROP_THREADS
 };
 
 #define DEFAULT_MODE GST_DEINTERLACE_MODE_AUTO
+#define DEFAULT_THREADS 0
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define YADIF_FORMATS "{Y42B,I420,Y444,I422_10LE,I420_10LE,Y444_10LE}"
+#else
+#define YADIF_FORMATS "{Y42B,I420,Y444,I422_10BE,I420_10BE,Y444_10BE}"
+#endif
 
 /* pad templates */
 
@@ -83,7 +97,7 @@ static GstStaticPadTemplate gst_yadif_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{Y42B,I420,Y444}")
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (YADIF_FORMATS)
         ",interlace-mode=(string){interleaved,mixed,progressive}")
     );
 
@@ -91,7 +105,7 @@ static GstStaticPadTemplate gst_yadif_src_template =
 GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{Y42B,I420,Y444}")
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (YADIF_FORMATS)
         ",interlace-mode=(string)progressive")
     );
 
@@ -160,6 +174,12 @@ gst_yadif_class_init (GstYadifClass * klass)
           DEFAULT_MODE,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Number of threads filtering slices of each frame, 0 for one per "
+          "processor. Takes effect when the element starts",
+          0, 64, DEFAULT_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -171,6 +191,10 @@ gst_yadif_init (GstYadif * yadif)
 
   yadif->srcpad = gst_pad_new_from_static_template (&gst_yadif_src_template,
       "src");
+
+  yadif->threads = DEFAULT_THREADS;
+  g_mutex_init (&yadif->lock);
+  g_cond_init (&yadif->cond);
 }
 
 void
@@ -183,6 +207,9 @@ gst_yadif_set_property (GObject * object, guint property_id,
     case PROP_MODE:
       yadif->mode = g_value_get_enum (value);
       break;
+    case PROP_THREADS:
+      yadif->threads = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -199,6 +226,9 @@ gst_yadif_get_property (GObject * object, guint property_id,
     case PROP_MODE:
       g_value_set_enum (value, yadif->mode);
       break;
+    case PROP_THREADS:
+      g_value_set_uint (value, yadif->threads);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -218,9 +248,10 @@ gst_yadif_dispose (GObject * object)
 void
 gst_yadif_finalize (GObject * object)
 {
-  /* GstYadif *yadif = GST_YADIF (object); */
+  GstYadif *yadif = GST_YADIF (object);
 
-  /* clean up object here */
+  g_mutex_clear (&yadif->lock);
+  g_cond_clear (&yadif->cond);
 
   G_OBJECT_CLASS (gst_yadif_parent_class)->finalize (object);
 }
@@ -286,6 +317,30 @@ gst_yadif_get_unit_size (GstBaseTransform * trans, GstCaps * caps, gsize * size)
 static gboolean
 gst_yadif_start (GstBaseTransform * trans)
 {
+  GstYadif *yadif = GST_YADIF (trans);
+  GError *err = NULL;
+
+  yadif->n_slices = yadif->threads;
+  if (yadif->n_slices == 0) {
+#if GLIB_CHECK_VERSION (2, 36, 0)
+    yadif->n_slices = g_get_num_processors ();
+#else
+    yadif->n_slices = 1;
+#endif
+  }
+  GST_DEBUG_OBJECT (yadif, "filtering with %u threads", yadif->n_slices);
+
+  /* the streaming thread filters the first slice */
+  if (yadif->n_slices > 1) {
+    yadif->pool = g_thread_pool_new (gst_yadif_slice_func, yadif,
+        yadif->n_slices - 1, TRUE, &err);
+    if (!yadif->pool) {
+      GST_WARNING_OBJECT (yadif, "could not create threads: %s",
+          err->message);
+      g_clear_error (&err);
+      yadif->n_slices = 1;
+    }
+  }
 
   return TRUE;
 }
@@ -293,11 +348,55 @@ gst_yadif_start (GstBaseTransform * trans)
 static gboolean
 gst_yadif_stop (GstBaseTransform * trans)
 {
+  GstYadif *yadif = GST_YADIF (trans);
+
+  if (yadif->pool) {
+    g_thread_pool_free (yadif->pool, FALSE, TRUE);
+    yadif->pool = NULL;
+  }
 
   return TRUE;
 }
 
-void yadif_filter (GstYadif * yadif, int parity, int tff);
+/* slices are pushed as their index + 1, NULL can't be pushed */
+static void
+gst_yadif_slice_func (gpointer data, gpointer user_data)
+{
+  GstYadif *yadif = user_data;
+
+  yadif_filter (yadif, yadif->parity, yadif->tff, GPOINTER_TO_UINT (data) - 1,
+      yadif->n_slices);
+
+  g_mutex_lock (&yadif->lock);
+  if (--yadif->n_pending == 0)
+    g_cond_signal (&yadif->cond);
+  g_mutex_unlock (&yadif->lock);
+}
+
+static void
+gst_yadif_filter_frame (GstYadif * yadif, int parity, int tff)
+{
+  guint i;
+
+  yadif->parity = parity;
+  yadif->tff = tff;
+
+  if (!yadif->pool) {
+    yadif_filter (yadif, parity, tff, 0, 1);
+    return;
+  }
+
+  yadif->n_pending = yadif->n_slices - 1;
+  for (i = 1; i < yadif->n_slices; i++)
+    g_thread_pool_push (yadif->pool, GUINT_TO_POINTER (i + 1), NULL);
+
+  yadif_filter (yadif, parity, tff, 0, yadif->n_slices);
+
+  g_mutex_lock (&yadif->lock);
+  while (yadif->n_pending > 0)
+    g_cond_wait (&yadif->cond, &yadif->lock);
+  g_mutex_unlock (&yadif->lock);
+}
 
 static GstFlowReturn
 gst_yadif_transform (GstBaseTransform * trans, GstBuffer * inbuf,
@@ -321,7 +420,7 @@ gst_yadif_transform (GstBaseTransform * trans, GstBuffer * inbuf,
   yadif->next_frame = yadif->cur_frame;
   yadif->prev_frame = yadif->cur_frame;
 
-  yadif_filter (yadif, parity, tff);
+  gst_yadif_filter_frame (yadif, parity, tff);
 
   gst_video_frame_unmap (&yadif->dest_frame);
   gst_video_frame_unmap (&yadif->cur_frame);
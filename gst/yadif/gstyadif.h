@@ -56,6 +56,15 @@ struct _GstYadif
   GstVideoFrame cur_frame;
   GstVideoFrame next_frame;
   GstVideoFrame dest_frame;
+
+  /* slice threads */
+  guint threads;                /* property, 0 for one per processor */
+  guint n_slices;
+  GThreadPool *pool;            /* n_slices - 1 threads, or NULL */
+  GMutex lock;
+  GCond cond;
+  guint n_pending;              /* slices being filtered by the pool */
+  int parity, tff;              /* of the frame being filtered */
 };
 
 struct _GstYadifClass
@@ -65,6 +74,18 @@ struct _GstYadifClass
 
 GType gst_yadif_get_type (void);
 
+typedef void (*GstYadifFilterLine) (guint8 * dst, guint8 * prev, guint8 * cur,
+    guint8 * next, int w, int prefs, int mrefs, int parity, int mode);
+
+void yadif_filter (GstYadif * yadif, int parity, int tff, int slice,
+    int n_slices);
+GstYadifFilterLine yadif_get_filter_line (int depth);
+GstYadifFilterLine yadif_get_filter_line_impl (int depth, const gchar * impl);
+void yadif_filter_line_c (guint8 * dst, guint8 * prev, guint8 * cur,
+    guint8 * next, int w, int prefs, int mrefs, int parity, int mode);
+void yadif_filter_line_c_16bit (guint16 * dst, guint16 * prev, guint16 * cur,
+    guint16 * next, int w, int prefs, int mrefs, int parity, int mode);
+
 G_END_DECLS
 
 #endif
@@ -86,8 +86,8 @@
         next2++; \
     }
 
-static void
-filter_line_c (guint8 * dst,
+void
+yadif_filter_line_c (guint8 * dst,
     guint8 * prev, guint8 * cur, guint8 * next,
     int w, int prefs, int mrefs, int parity, int mode)
 {
@@ -97,9 +97,8 @@ filter_line_c (guint8 * dst,
 
 FILTER}
 
-#if 0
-static void
-filter_line_c_16bit (guint16 * dst,
+void
+yadif_filter_line_c_16bit (guint16 * dst,
     guint16 * prev, guint16 * cur, guint16 * next,
     int w, int prefs, int mrefs, int parity, int mode)
 {
@@ -110,17 +109,11 @@ filter_line_c_16bit (guint16 * dst,
   prefs /= 2;
 
 FILTER}
-#endif
-
-void yadif_filter (GstYadif * yadif, int parity, int tff);
-#ifdef HAVE_CPU_X86_64
-void filter_line_x86_64 (guint8 * dst,
-    guint8 * prev, guint8 * cur, guint8 * next,
-    int w, int prefs, int mrefs, int parity, int mode);
-#endif
 
+/* Filters the rows of slice @slice out of @n_slices of every plane, slices
+ * don't depend on each other and can be filtered in parallel */
 void
-yadif_filter (GstYadif * yadif, int parity, int tff)
+yadif_filter (GstYadif * yadif, int parity, int tff, int slice, int n_slices)
 {
   int y, i;
   const GstVideoInfo *vi = &yadif->video_info;
@@ -135,26 +128,35 @@ yadif_filter (GstYadif * yadif, int parity, int tff)
     guint8 *cur_data = GST_VIDEO_FRAME_COMP_DATA (&yadif->cur_frame, i);
     guint8 *next_data = GST_VIDEO_FRAME_COMP_DATA (&yadif->next_frame, i);
     guint8 *dest_data = GST_VIDEO_FRAME_COMP_DATA (&yadif->dest_frame, i);
-
-    for (y = 0; y < h; y++) {
+    int depth = GST_VIDEO_FORMAT_INFO_DEPTH (vfi, i);
+    GstYadifFilterLine filter_line = yadif_get_filter_line (depth);
+    /* the vectorized filter does whole blocks of 16 pixels */
+    int simd_w = filter_line ? w & ~15 : 0;
+    int y_start = h * slice / n_slices;
+    int y_end = h * (slice + 1) / n_slices;
+
+    for (y = y_start; y < y_end; y++) {
       if ((y ^ parity) & 1) {
         guint8 *prev = prev_data + y * refs;
         guint8 *cur = cur_data + y * refs;
         guint8 *next = next_data + y * refs;
         guint8 *dst = dest_data + y * refs;
         int mode = ((y == 1) || (y + 2 == h)) ? 2 : yadif->mode;
-#if HAVE_CPU_X86_64
-        if (0) {
-          filter_line_c (dst, prev, cur, next, w,
-              y + 1 < h ? refs : -refs, y ? -refs : refs, parity ^ tff, mode);
-        } else {
-          filter_line_x86_64 (dst, prev, cur, next, w,
-              y + 1 < h ? refs : -refs, y ? -refs : refs, parity ^ tff, mode);
-        }
-#else
-        filter_line_c (dst, prev, cur, next, w,
-            y + 1 < h ? refs : -refs, y ? -refs : refs, parity ^ tff, mode);
-#endif
+        int prefs = y + 1 < h ? refs : -refs;
+        int mrefs = y ? -refs : refs;
+        int off = simd_w * df;
+
+        if (simd_w > 0)
+          filter_line (dst, prev, cur, next, simd_w, prefs, mrefs,
+              parity ^ tff, mode);
+        if (simd_w < w && depth > 8)
+          yadif_filter_line_c_16bit ((guint16 *) (dst + off),
+              (guint16 *) (prev + off), (guint16 *) (cur + off),
+              (guint16 *) (next + off), w - simd_w, prefs, mrefs,
+              parity ^ tff, mode);
+        else if (simd_w < w)
+          yadif_filter_line_c (dst + off, prev + off, cur + off, next + off,
+              w - simd_w, prefs, mrefs, parity ^ tff, mode);
       } else {
         guint8 *dst = dest_data + y * refs;
         guint8 *cur = cur_data + y * refs;
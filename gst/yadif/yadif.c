@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include "gstyadif.h"
 
 #if HAVE_CPU_X86_64
 
@@ -54,6 +55,13 @@ DECLARE_ASM_CONST (16, xmm_reg, pw_1) = {
 
 
 #define HAVE_SSE2_INLINE 1
+#define HAVE_SSSE3_INLINE 1
+
+/* target attributes on functions using AVX2 intrinsics need GCC 4.9 */
+#if defined (__GNUC__) && !defined (__clang__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_AVX2_INTRINSICS 1
+#endif
 
 #if HAVE_SSSE3_INLINE
 #define COMPILE_TEMPLATE_SSE2 1
@@ -78,30 +86,225 @@ DECLARE_ASM_CONST (16, xmm_reg, pw_1) = {
 #endif
 
 
-void filter_line_x86_64 (guint8 * dst,
-    guint8 * prev, guint8 * cur, guint8 * next,
-    int w, int prefs, int mrefs, int parity, int mode);
+#if HAVE_AVX2_INTRINSICS
+#include <immintrin.h>
 
-void
-filter_line_x86_64 (guint8 * dst,
-    guint8 * prev, guint8 * cur, guint8 * next,
-    int w, int prefs, int mrefs, int parity, int mode)
+#define AVX2_TARGET __attribute__ ((target ("avx2")))
+
+static inline AVX2_TARGET __m256i
+load_8 (const guint8 * p)
 {
-#if 0
-#if HAVE_MMXEXT_INLINE
-  if (cpu_flags & AV_CPU_FLAG_MMXEXT)
-    yadif->filter_line = yadif_filter_line_mmxext;
+  return _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) p));
+}
+
+static inline AVX2_TARGET void
+store_8 (guint8 * p, __m256i v)
+{
+  v = _mm256_permute4x64_epi64 (_mm256_packus_epi16 (v, v), 0x08);
+  _mm_storeu_si128 ((__m128i *) p, _mm256_castsi256_si128 (v));
+}
+
+static inline AVX2_TARGET __m256i
+load_16 (const guint16 * p)
+{
+  return _mm256_loadu_si256 ((const __m256i *) p);
+}
+
+static inline AVX2_TARGET void
+store_16 (guint16 * p, __m256i v)
+{
+  _mm256_storeu_si256 ((__m256i *) p, v);
+}
+
+static inline AVX2_TARGET __m256i
+absdiff (__m256i a, __m256i b)
+{
+  return _mm256_abs_epi16 (_mm256_sub_epi16 (a, b));
+}
+
+static inline AVX2_TARGET __m256i
+avg (__m256i a, __m256i b)
+{
+  return _mm256_srli_epi16 (_mm256_add_epi16 (a, b), 1);
+}
+
+/* The C filter on 16 pixels widened to 16 bits, for 8 bits and for up to
+ * 12 bits per component. Only whole blocks of 16 pixels are filtered, the
+ * caller does the rest of the line. */
+#define FILTER_AVX2(T, LOAD, STORE) { \
+  T *prev2 = parity ? prev : cur; \
+  T *next2 = parity ? cur : next; \
+  const __m256i one = _mm256_set1_epi16 (1); \
+  int x; \
+ \
+  for (x = 0; x + 16 <= w; x += 16) { \
+    __m256i c = LOAD (&cur[x + mrefs]); \
+    __m256i e = LOAD (&cur[x + prefs]); \
+    __m256i p2 = LOAD (&prev2[x]); \
+    __m256i n2 = LOAD (&next2[x]); \
+    __m256i d = avg (p2, n2); \
+    __m256i diff, pred, score, s, m; \
+ \
+    diff = _mm256_srli_epi16 (absdiff (p2, n2), 1); \
+    diff = _mm256_max_epi16 (diff, _mm256_srli_epi16 (_mm256_add_epi16 ( \
+                absdiff (LOAD (&prev[x + mrefs]), c), \
+                absdiff (LOAD (&prev[x + prefs]), e)), 1)); \
+    diff = _mm256_max_epi16 (diff, _mm256_srli_epi16 (_mm256_add_epi16 ( \
+                absdiff (LOAD (&next[x + mrefs]), c), \
+                absdiff (LOAD (&next[x + prefs]), e)), 1)); \
+ \
+    pred = avg (c, e); \
+    score = _mm256_add_epi16 (absdiff (LOAD (&cur[x + mrefs - 1]), \
+            LOAD (&cur[x + prefs - 1])), absdiff (c, e)); \
+    score = _mm256_add_epi16 (score, absdiff (LOAD (&cur[x + mrefs + 1]), \
+            LOAD (&cur[x + prefs + 1]))); \
+    score = _mm256_sub_epi16 (score, one); \
+ \
+    /* like the C version, direction 2 is only checked if direction 1 \
+     * was better */ \
+    CHECK_AVX2 (-1, LOAD, m = s); \
+    CHECK_AVX2 (-2, LOAD, m = _mm256_and_si256 (m, s)); \
+    CHECK_AVX2 (1, LOAD, m = s); \
+    CHECK_AVX2 (2, LOAD, m = _mm256_and_si256 (m, s)); \
+ \
+    if (mode < 2) { \
+      __m256i b = avg (LOAD (&prev2[x + 2 * mrefs]), \
+          LOAD (&next2[x + 2 * mrefs])); \
+      __m256i f = avg (LOAD (&prev2[x + 2 * prefs]), \
+          LOAD (&next2[x + 2 * prefs])); \
+      __m256i de = _mm256_sub_epi16 (d, e); \
+      __m256i dc = _mm256_sub_epi16 (d, c); \
+      __m256i bc = _mm256_sub_epi16 (b, c); \
+      __m256i fe = _mm256_sub_epi16 (f, e); \
+      __m256i max, min; \
+ \
+      max = _mm256_max_epi16 (_mm256_max_epi16 (de, dc), \
+          _mm256_min_epi16 (bc, fe)); \
+      min = _mm256_min_epi16 (_mm256_min_epi16 (de, dc), \
+          _mm256_max_epi16 (bc, fe)); \
+      diff = _mm256_max_epi16 (_mm256_max_epi16 (diff, min), \
+          _mm256_sub_epi16 (_mm256_setzero_si256 (), max)); \
+    } \
+ \
+    pred = _mm256_max_epi16 (pred, _mm256_sub_epi16 (d, diff)); \
+    pred = _mm256_min_epi16 (pred, _mm256_add_epi16 (d, diff)); \
+    STORE (&dst[x], pred); \
+  } \
+}
+
+#define CHECK_AVX2(j, LOAD, MASK) \
+  s = _mm256_add_epi16 (absdiff (LOAD (&cur[x + mrefs - 1 + (j)]), \
+          LOAD (&cur[x + prefs - 1 - (j)])), \
+      absdiff (LOAD (&cur[x + mrefs + (j)]), LOAD (&cur[x + prefs - (j)]))); \
+  s = _mm256_add_epi16 (s, absdiff (LOAD (&cur[x + mrefs + 1 + (j)]), \
+          LOAD (&cur[x + prefs + 1 - (j)]))); \
+  { \
+    __m256i t = s; \
+    s = _mm256_cmpgt_epi16 (score, t); \
+    MASK; \
+    score = _mm256_blendv_epi8 (score, t, m); \
+    pred = _mm256_blendv_epi8 (pred, avg (LOAD (&cur[x + mrefs + (j)]), \
+            LOAD (&cur[x + prefs - (j)])), m); \
+  }
+
+static AVX2_TARGET void
+yadif_filter_line_avx2 (guint8 * dst, guint8 * prev, guint8 * cur,
+    guint8 * next, int w, int prefs, int mrefs, int parity, int mode)
+{
+FILTER_AVX2 (guint8, load_8, store_8)}
+
+static AVX2_TARGET void
+yadif_filter_line_16bit_avx2 (guint8 * dst_data, guint8 * prev_data,
+    guint8 * cur_data, guint8 * next_data, int w, int prefs, int mrefs,
+    int parity, int mode)
+{
+  guint16 *dst = (guint16 *) dst_data;
+  guint16 *prev = (guint16 *) prev_data;
+  guint16 *cur = (guint16 *) cur_data;
+  guint16 *next = (guint16 *) next_data;
+
+  mrefs /= 2;
+  prefs /= 2;
+
+FILTER_AVX2 (guint16, load_16, store_16)}
+
+#undef CHECK_AVX2
+#undef FILTER_AVX2
 #endif
-#if HAVE_SSE2_INLINE
-  if (cpu_flags & AV_CPU_FLAG_SSE2)
-    yadif->filter_line = yadif_filter_line_sse2;
+
+static const gchar *filter_line_impls[] = { "avx2", "ssse3", "sse2" };
+
+static GstYadifFilterLine filter_line_8bit, filter_line_16bit;
+
+static gpointer
+yadif_init_filter_lines (gpointer data)
+{
+  guint i;
+
+  /* the implementations are listed fastest first */
+  for (i = 0; i < G_N_ELEMENTS (filter_line_impls); i++) {
+    if (filter_line_8bit == NULL)
+      filter_line_8bit = yadif_get_filter_line_impl (8, filter_line_impls[i]);
+    if (filter_line_16bit == NULL)
+      filter_line_16bit =
+          yadif_get_filter_line_impl (16, filter_line_impls[i]);
+  }
+
+  return NULL;
+}
+
 #endif
-#if HAVE_SSSE3_INLINE
-  if (cpu_flags & AV_CPU_FLAG_SSSE3)
-    yadif->filter_line = yadif_filter_line_ssse3;
+
+/**
+ * yadif_get_filter_line_impl:
+ * @depth: the number of bits per component
+ * @impl: the instruction set, "avx2", "ssse3" or "sse2"
+ *
+ * Returns: the filter of @impl for @depth, or %NULL if it wasn't built or
+ * the CPU doesn't support it
+ */
+GstYadifFilterLine
+yadif_get_filter_line_impl (int depth, const gchar * impl)
+{
+#if HAVE_CPU_X86_64
+  __builtin_cpu_init ();
+
+#if HAVE_AVX2_INTRINSICS
+  if (g_str_equal (impl, "avx2") && __builtin_cpu_supports ("avx2"))
+    return depth > 8 ? yadif_filter_line_16bit_avx2 : yadif_filter_line_avx2;
 #endif
+  /* the SSE templates only handle 8 bits */
+  if (depth > 8)
+    return NULL;
+  if (g_str_equal (impl, "ssse3") && __builtin_cpu_supports ("ssse3"))
+    return yadif_filter_line_ssse3;
+  if (g_str_equal (impl, "sse2"))
+    return yadif_filter_line_sse2;
 #endif
-  yadif_filter_line_sse2 (dst, prev, cur, next, w, prefs, mrefs, parity, mode);
+
+  return NULL;
 }
 
+/**
+ * yadif_get_filter_line:
+ * @depth: the number of bits per component
+ *
+ * Selects the fastest line filter the CPU supports. A vectorized filter only
+ * handles the largest multiple of 16 pixels of the line, the C filter does
+ * the rest.
+ *
+ * Returns: the filter, or %NULL if there is none for @depth
+ */
+GstYadifFilterLine
+yadif_get_filter_line (int depth)
+{
+#if HAVE_CPU_X86_64
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, yadif_init_filter_lines, NULL);
+
+  return depth > 8 ? filter_line_16bit : filter_line_8bit;
+#else
+  return NULL;
 #endif
+}
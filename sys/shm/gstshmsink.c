@@ -56,7 +56,12 @@ enum
   PROP_PERMS,
   PROP_SHM_SIZE,
   PROP_WAIT_FOR_CONNECTION,
-  PROP_BUFFER_TIME
+  PROP_BUFFER_TIME,
+  PROP_FRAGMENTATION,
+  PROP_ALLOC_WAITS,
+  PROP_ALLOC_LATENCY_AVG,
+  PROP_ALLOC_LATENCY_MAX,
+  PROP_RING_SLOTS
 };
 
 struct GstShmClient
@@ -67,6 +72,7 @@ struct GstShmClient
 
 #define DEFAULT_SIZE ( 256 * 1024 )
 #define DEFAULT_WAIT_FOR_CONNECTION (TRUE)
+#define DEFAULT_RING_SLOTS 0
 /* Default is user read/write, group read */
 #define DEFAULT_PERMS ( S_IRUSR | S_IWUSR | S_IRGRP )
 
@@ -99,6 +105,8 @@ static gboolean gst_shm_sink_propose_allocation (GstBaseSink * sink,
     GstQuery * query);
 
 static gpointer pollthread_func (gpointer data);
+static void gst_shm_sink_add_alloc_latency (GstShmSink * self,
+    GstClockTime latency);
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
@@ -300,9 +308,13 @@ gst_shm_sink_allocator_alloc (GstAllocator * allocator, gsize size,
 {
   GstShmSinkAllocator *self = GST_SHM_SINK_ALLOCATOR (allocator);
   GstMemory *memory = NULL;
+  GstClockTime start;
 
   GST_OBJECT_LOCK (self->sink);
+  start = gst_util_get_timestamp ();
   memory = gst_shm_sink_allocator_alloc_locked (self, size, params);
+  gst_shm_sink_add_alloc_latency (self->sink,
+      gst_util_get_timestamp () - start);
   GST_OBJECT_UNLOCK (self->sink);
 
   if (!memory) {
@@ -349,6 +361,7 @@ gst_shm_sink_init (GstShmSink * self)
   self->size = DEFAULT_SIZE;
   self->wait_for_connection = DEFAULT_WAIT_FOR_CONNECTION;
   self->perms = DEFAULT_PERMS;
+  self->ring_slots = DEFAULT_RING_SLOTS;
 
   gst_allocation_params_init (&self->params);
 }
@@ -410,6 +423,42 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
           -1, G_MAXINT64, -1,
           G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_FRAGMENTATION,
+      g_param_spec_double ("fragmentation",
+          "Fragmentation of the shm area",
+          "Fraction of the free space that is not part of the largest free"
+          " block (0 = not fragmented)",
+          0.0, 1.0, 0.0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOC_WAITS,
+      g_param_spec_uint64 ("alloc-waits",
+          "Allocation waits",
+          "Number of times rendering had to wait for space in the shm area",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOC_LATENCY_AVG,
+      g_param_spec_uint64 ("alloc-latency-avg",
+          "Average allocation latency",
+          "Average time in nanoseconds to get a block of the shm area,"
+          " including waiting for space",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOC_LATENCY_MAX,
+      g_param_spec_uint64 ("alloc-latency-max",
+          "Maximum allocation latency",
+          "Maximum time in nanoseconds to get a block of the shm area,"
+          " including waiting for space",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RING_SLOTS,
+      g_param_spec_uint ("ring-slots",
+          "Number of ring slots",
+          "Number of buffer descriptors in the ring shared with the readers,"
+          " buffers are then passed without any socket message"
+          " (0 = use the socket, only supported on Linux)",
+          0, 65536, DEFAULT_RING_SLOTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   signals[SIGNAL_CLIENT_CONNECTED] = g_signal_new ("client-connected",
       GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST, 0, NULL, NULL,
       g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
@@ -499,6 +548,15 @@ gst_shm_sink_set_property (GObject * object, guint prop_id,
       GST_OBJECT_UNLOCK (object);
       g_cond_broadcast (&self->cond);
       break;
+    case PROP_RING_SLOTS:
+      GST_OBJECT_LOCK (object);
+      if (self->pipe)
+        GST_WARNING_OBJECT (object, "Can not change the number of ring slots"
+            " while the element is running");
+      else
+        self->ring_slots = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (object);
+      break;
     default:
       break;
   }
@@ -528,6 +586,29 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
     case PROP_BUFFER_TIME:
       g_value_set_int64 (value, self->buffer_time);
       break;
+    case PROP_FRAGMENTATION:
+    {
+      size_t free_size = 0, largest_free = 0;
+
+      if (self->pipe)
+        sp_writer_get_alloc_stats (self->pipe, &free_size, &largest_free);
+      g_value_set_double (value, free_size ?
+          1.0 - (gdouble) largest_free / free_size : 0.0);
+      break;
+    }
+    case PROP_ALLOC_WAITS:
+      g_value_set_uint64 (value, self->alloc_waits);
+      break;
+    case PROP_ALLOC_LATENCY_AVG:
+      g_value_set_uint64 (value, self->alloc_count ?
+          self->alloc_latency_total / self->alloc_count : 0);
+      break;
+    case PROP_ALLOC_LATENCY_MAX:
+      g_value_set_uint64 (value, self->alloc_latency_max);
+      break;
+    case PROP_RING_SLOTS:
+      g_value_set_uint (value, self->ring_slots);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -546,6 +627,13 @@ gst_shm_sink_start (GstBaseSink * bsink)
 
   self->stop = FALSE;
 
+  GST_OBJECT_LOCK (self);
+  self->alloc_count = 0;
+  self->alloc_waits = 0;
+  self->alloc_latency_total = 0;
+  self->alloc_latency_max = 0;
+  GST_OBJECT_UNLOCK (self);
+
   if (!self->socket_path) {
     GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE,
         ("Could not open socket."), (NULL));
@@ -563,6 +651,11 @@ gst_shm_sink_start (GstBaseSink * bsink)
     return FALSE;
   }
 
+  if (self->ring_slots && sp_writer_enable_ring (self->pipe,
+          self->ring_slots) < 0)
+    GST_WARNING_OBJECT (self, "Could not create a ring of %u slots, using"
+        " the socket protocol", self->ring_slots);
+
   sp_set_data (self->pipe, self);
   g_free (self->socket_path);
   self->socket_path = g_strdup (sp_writer_get_path (self->pipe));
@@ -575,6 +668,13 @@ gst_shm_sink_start (GstBaseSink * bsink)
   gst_poll_add_fd (self->poll, &self->serverpollfd);
   gst_poll_fd_ctl_read (self->poll, &self->serverpollfd, TRUE);
 
+  gst_poll_fd_init (&self->ringpollfd);
+  self->ringpollfd.fd = sp_writer_get_ring_fd (self->pipe);
+  if (self->ringpollfd.fd >= 0) {
+    gst_poll_add_fd (self->poll, &self->ringpollfd);
+    gst_poll_fd_ctl_read (self->poll, &self->ringpollfd, TRUE);
+  }
+
   self->pollthread =
       g_thread_try_new ("gst-shmsink-poll-thread", pollthread_func, self, &err);
 
@@ -634,11 +734,26 @@ gst_shm_sink_stop (GstBaseSink * bsink)
   return TRUE;
 }
 
+/* called with the object lock */
+static void
+gst_shm_sink_add_alloc_latency (GstShmSink * self, GstClockTime latency)
+{
+  self->alloc_count++;
+  self->alloc_latency_total += latency;
+  if (latency > self->alloc_latency_max)
+    self->alloc_latency_max = latency;
+}
+
 static gboolean
 gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
 {
   ShmBuffer *b;
 
+  /* only the streaming thread publishes, so the ring can not fill up
+   * again before the buffer is sent */
+  if (sp_writer_ring_full (self->pipe))
+    return FALSE;
+
   if (time == GST_CLOCK_TIME_NONE || self->buffer_time == GST_CLOCK_TIME_NONE)
     return TRUE;
 
@@ -662,6 +777,8 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
   GstFlowReturn ret = GST_FLOW_OK;
   GstMemory *memory = NULL;
   GstBuffer *sendbuf = NULL;
+  GstClockTime start;
+  gboolean waited = FALSE;
 
   GST_OBJECT_LOCK (self);
   while (self->wait_for_connection && !self->clients) {
@@ -703,13 +820,19 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
       return GST_FLOW_ERROR;
     }
 
+    start = gst_util_get_timestamp ();
     while ((memory =
             gst_shm_sink_allocator_alloc_locked (self->allocator,
                 gst_buffer_get_size (buf), &self->params)) == NULL) {
+      if (!waited) {
+        self->alloc_waits++;
+        waited = TRUE;
+      }
       g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
       if (self->unlock)
         goto flushing;
     }
+    gst_shm_sink_add_alloc_latency (self, gst_util_get_timestamp () - start);
 
     while (self->wait_for_connection && !self->clients) {
       g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
@@ -832,6 +955,17 @@ pollthread_func (gpointer data)
       continue;
     }
 
+    if (self->ringpollfd.fd >= 0 &&
+        gst_poll_fd_can_read (self->poll, &self->ringpollfd)) {
+      GSList *list = NULL;
+
+      GST_OBJECT_LOCK (self);
+      sp_writer_ring_recv (self->pipe,
+          (sp_buffer_free_callback) free_buffer_locked, (void **) &list);
+      GST_OBJECT_UNLOCK (self);
+      g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+    }
+
   again:
     for (item = self->clients; item; item = item->next) {
       struct GstShmClient *gclient = item->data;
@@ -52,12 +52,14 @@ struct _GstShmSink
 
   guint perms;
   guint size;
+  guint ring_slots;
 
   GList *clients;
 
   GThread *pollthread;
   GstPoll *poll;
   GstPollFD serverpollfd;
+  GstPollFD ringpollfd;
 
   gboolean wait_for_connection;
   gboolean stop;
@@ -69,6 +71,12 @@ struct _GstShmSink
   GstShmSinkAllocator *allocator;
 
   GstAllocationParams params;
+
+  /* allocation statistics */
+  guint64 alloc_count;
+  guint64 alloc_waits;
+  GstClockTime alloc_latency_total;
+  GstClockTime alloc_latency_max;
 };
 
 struct _GstShmSinkClass
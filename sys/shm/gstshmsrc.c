@@ -148,6 +148,7 @@ gst_shm_src_init (GstShmSrc * self)
 {
   self->poll = gst_poll_new (TRUE);
   gst_poll_fd_init (&self->pollfd);
+  gst_poll_fd_init (&self->ringpollfd);
 }
 
 static void
@@ -264,6 +265,10 @@ gst_shm_src_stop_reading (GstShmSrc * self)
   gst_poll_remove_fd (self->poll, &self->pollfd);
   gst_poll_fd_init (&self->pollfd);
 
+  if (self->ringpollfd.fd >= 0)
+    gst_poll_remove_fd (self->poll, &self->ringpollfd);
+  gst_poll_fd_init (&self->ringpollfd);
+
   gst_poll_set_flushing (self->poll, TRUE);
 }
 
@@ -313,6 +318,15 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   struct GstShmBuffer *gsb;
 
   do {
+    /* In ring mode the buffers never go through the socket */
+    if (self->ringpollfd.fd >= 0) {
+      GST_OBJECT_LOCK (self);
+      rv = sp_client_recv_ring (self->pipe->pipe, &buf);
+      GST_OBJECT_UNLOCK (self);
+      if (buf)
+        break;
+    }
+
     if (gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE) < 0) {
       if (errno == EBUSY)
         return GST_FLOW_FLUSHING;
@@ -347,6 +361,14 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
             ("Error reading control data: %d", rv));
         return GST_FLOW_ERROR;
       }
+
+      if (self->ringpollfd.fd < 0 && sp_client_get_ring_fd (self->pipe->pipe)
+          >= 0) {
+        GST_DEBUG_OBJECT (self, "Writer uses a ring, switching to it");
+        self->ringpollfd.fd = sp_client_get_ring_fd (self->pipe->pipe);
+        gst_poll_add_fd (self->poll, &self->ringpollfd);
+        gst_poll_fd_ctl_read (self->poll, &self->ringpollfd, TRUE);
+      }
     }
   } while (buf == NULL);
 
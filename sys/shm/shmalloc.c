@@ -33,19 +33,45 @@
 #include <string.h>
 #include <assert.h>
 
+/* Number of block headers allocated at once for the header pool */
+#define SHM_ALLOC_HEADER_CHUNK_SIZE 64
+
+/* Free blocks are kept in segregated lists, the list of class i holds the
+ * blocks with a size in [2^i, 2^(i+1)) */
+#define SHM_ALLOC_N_CLASSES (sizeof (unsigned long) * 8)
+
+typedef struct _ShmAllocHeaderChunk ShmAllocHeaderChunk;
+
 /* This is the allocated space to hold multiple blocks */
 struct _ShmAllocSpace
 {
   /* The total size of this space */
   size_t size;
 
-  /* chained list of the blocks contained in this space */
+  /* chained list of all the blocks contained in this space, free or in use,
+   * sorted by offset. They always cover the whole space */
   ShmAllocBlock *blocks;
+
+  /* free blocks, segregated by size class, and a bitmap of the classes
+   * which have free blocks */
+  ShmAllocBlock *free_lists[SHM_ALLOC_N_CLASSES];
+  unsigned long free_classes;
+  /* total size of the free blocks */
+  unsigned long free_size;
+
+  /* the most recently allocated block, as it is usually the one looked up
+   * right after */
+  ShmAllocBlock *last_alloc;
+
+  /* pool of unused block headers, chained through next_free */
+  ShmAllocBlock *spare_headers;
+  ShmAllocHeaderChunk *header_chunks;
 };
 
 /* A single block of data */
 struct _ShmAllocBlock
 {
+  /* 0 for free blocks */
   int use_count;
 
   /* Pointer back to the AllocSpace where this block is */
@@ -56,10 +82,129 @@ struct _ShmAllocBlock
   /* The size of the block */
   unsigned long size;
 
-  /* Pointer to the next block in the chain */
+  /* The neighbours of this block in the space */
+  ShmAllocBlock *prev;
   ShmAllocBlock *next;
+
+  /* The neighbours of this block in its free list */
+  ShmAllocBlock *prev_free;
+  ShmAllocBlock *next_free;
 };
 
+struct _ShmAllocHeaderChunk
+{
+  ShmAllocHeaderChunk *next;
+  unsigned int n_headers;
+  /* This must ALWAYS stay last in the struct */
+  ShmAllocBlock headers[0];
+};
+
+static int
+shm_alloc_size_class (unsigned long size)
+{
+#ifdef __GNUC__
+  return SHM_ALLOC_N_CLASSES - 1 - __builtin_clzl (size);
+#else
+  int c = 0;
+
+  while (size >>= 1)
+    c++;
+
+  return c;
+#endif
+}
+
+static int
+shm_alloc_add_header_chunk (ShmAllocSpace * self, unsigned int n_headers)
+{
+  ShmAllocHeaderChunk *chunk;
+  unsigned int i;
+
+  chunk = spalloc_alloc (sizeof (ShmAllocHeaderChunk) +
+      sizeof (ShmAllocBlock) * n_headers);
+  if (!chunk)
+    return 0;
+
+  chunk->n_headers = n_headers;
+  chunk->next = self->header_chunks;
+  self->header_chunks = chunk;
+
+  for (i = 0; i < n_headers; i++) {
+    chunk->headers[i].next_free = self->spare_headers;
+    self->spare_headers = &chunk->headers[i];
+  }
+
+  return 1;
+}
+
+static ShmAllocBlock *
+shm_alloc_header_new (ShmAllocSpace * self)
+{
+  ShmAllocBlock *block;
+
+  if (!self->spare_headers &&
+      !shm_alloc_add_header_chunk (self, SHM_ALLOC_HEADER_CHUNK_SIZE))
+    return NULL;
+
+  block = self->spare_headers;
+  self->spare_headers = block->next_free;
+
+  memset (block, 0, sizeof (ShmAllocBlock));
+  block->space = self;
+
+  return block;
+}
+
+static void
+shm_alloc_header_free (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  block->next_free = self->spare_headers;
+  self->spare_headers = block;
+}
+
+static void
+shm_alloc_free_list_add (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  int c = shm_alloc_size_class (block->size);
+
+  block->prev_free = NULL;
+  block->next_free = self->free_lists[c];
+  if (block->next_free)
+    block->next_free->prev_free = block;
+  self->free_lists[c] = block;
+  self->free_classes |= 1UL << c;
+  self->free_size += block->size;
+}
+
+static void
+shm_alloc_free_list_remove (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  int c = shm_alloc_size_class (block->size);
+
+  if (block->prev_free)
+    block->prev_free->next_free = block->next_free;
+  else
+    self->free_lists[c] = block->next_free;
+  if (block->next_free)
+    block->next_free->prev_free = block->prev_free;
+  if (!self->free_lists[c])
+    self->free_classes &= ~(1UL << c);
+  self->free_size -= block->size;
+}
+
+/* remove @block from the chain of blocks and give its header back */
+static void
+shm_alloc_block_unlink (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  if (block->prev)
+    block->prev->next = block->next;
+  else
+    self->blocks = block->next;
+  if (block->next)
+    block->next->prev = block->prev;
+
+  shm_alloc_header_free (self, block);
+}
 
 ShmAllocSpace *
 shm_alloc_space_new (size_t size)
@@ -70,13 +215,36 @@ shm_alloc_space_new (size_t size)
 
   self->size = size;
 
+  if (!shm_alloc_add_header_chunk (self, SHM_ALLOC_HEADER_CHUNK_SIZE)) {
+    spalloc_free (ShmAllocSpace, self);
+    return NULL;
+  }
+
+  /* the whole space starts as a single free block */
+  if (size > 0) {
+    ShmAllocBlock *block = shm_alloc_header_new (self);
+
+    block->size = size;
+    self->blocks = block;
+    shm_alloc_free_list_add (self, block);
+  }
+
   return self;
 }
 
 void
 shm_alloc_space_free (ShmAllocSpace * self)
 {
-  assert (self && self->blocks == NULL);
+  ShmAllocHeaderChunk *chunk;
+
+  assert (self && self->free_size == self->size);
+
+  while ((chunk = self->header_chunks)) {
+    self->header_chunks = chunk->next;
+    spalloc_free1 (sizeof (ShmAllocHeaderChunk) +
+        sizeof (ShmAllocBlock) * chunk->n_headers, chunk);
+  }
+
   spalloc_free (ShmAllocSpace, self);
 }
 
@@ -84,43 +252,62 @@ shm_alloc_space_free (ShmAllocSpace * self)
 ShmAllocBlock *
 shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
 {
-  ShmAllocBlock *block;
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
-  unsigned long prev_end_offset = 0;
-
+  ShmAllocBlock *block = NULL;
+  ShmAllocBlock *item;
+  unsigned long larger;
+  int c;
 
-  for (item = self->blocks; item; item = item->next) {
-    unsigned long max_size = 0;
+  /* blocks are found by the offsets they contain, so they can't be empty */
+  if (size == 0)
+    size = 1;
 
-    max_size = item->offset - prev_end_offset;
+  if (size > self->free_size)
+    return NULL;
 
-    if (max_size >= size)
-      break;
+  /* The class of the requested size can also contain smaller blocks, take
+   * the best fitting one */
+  c = shm_alloc_size_class (size);
+  for (item = self->free_lists[c]; item; item = item->next_free) {
+    if (item->size >= size && (!block || item->size < block->size)) {
+      block = item;
+      if (block->size == size)
+        break;
+    }
+  }
 
-    prev_end_offset = item->offset + item->size;
-    prev_item = item;
+  /* Otherwise any block of the smallest larger class that has one fits */
+  if (!block && c + 1 < SHM_ALLOC_N_CLASSES) {
+    larger = self->free_classes & ~((2UL << c) - 1);
+    if (larger)
+      block = self->free_lists[shm_alloc_size_class (larger & -larger)];
   }
 
-  /* Return NULL if there is no big enough space, otherwise, there is space
-   * at the end */
-  assert (prev_end_offset <= self->size);
-  if (!item && self->size - prev_end_offset < size)
+  /* Return NULL if there is no big enough space */
+  if (!block)
     return NULL;
 
-  block = spalloc_new (ShmAllocBlock);
-  memset (block, 0, sizeof (ShmAllocBlock));
-  block->offset = prev_end_offset;
-  block->size = size;
-  block->use_count = 1;
-  block->space = self;
-
-  if (prev_item)
-    prev_item->next = block;
-  else
-    self->blocks = block;
+  shm_alloc_free_list_remove (self, block);
+
+  /* Split off the rest, if we can't get a header for it, the block is
+   * just a bit larger than requested */
+  if (block->size > size) {
+    ShmAllocBlock *rest = shm_alloc_header_new (self);
+
+    if (rest) {
+      rest->offset = block->offset + size;
+      rest->size = block->size - size;
+      rest->prev = block;
+      rest->next = block->next;
+      if (rest->next)
+        rest->next->prev = rest;
+      block->next = rest;
+      block->size = size;
+      shm_alloc_free_list_add (self, rest);
+    }
+  }
 
-  block->next = item;
+  block->use_count = 1;
+  self->last_alloc = block;
 
   return block;
 }
@@ -134,31 +321,43 @@ shm_alloc_space_alloc_block_get_offset (ShmAllocBlock * block)
 static void
 shm_alloc_space_free_block (ShmAllocBlock * block)
 {
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
   ShmAllocSpace *self = block->space;
+  ShmAllocBlock *item;
 
-  for (item = self->blocks; item; item = item->next) {
-    if (item == block) {
-      if (prev_item)
-        prev_item->next = item->next;
-      else
-        self->blocks = item->next;
-      break;
-    }
-    prev_item = item;
+  if (self->last_alloc == block)
+    self->last_alloc = NULL;
+
+  /* coalesce with free neighbours */
+  item = block->next;
+  if (item && item->use_count == 0) {
+    shm_alloc_free_list_remove (self, item);
+    block->size += item->size;
+    shm_alloc_block_unlink (self, item);
+  }
+
+  item = block->prev;
+  if (item && item->use_count == 0) {
+    shm_alloc_free_list_remove (self, item);
+    item->size += block->size;
+    shm_alloc_block_unlink (self, block);
+    block = item;
   }
 
-  spalloc_free (ShmAllocBlock, block);
+  shm_alloc_free_list_add (self, block);
 }
 
 ShmAllocBlock *
 shm_alloc_space_block_get (ShmAllocSpace * self, unsigned long offset)
 {
-  ShmAllocBlock *block = NULL;
+  ShmAllocBlock *block = self->last_alloc;
+
+  if (block && block->offset <= offset && (block->offset + block->size) > offset)
+    return block;
 
   for (block = self->blocks; block; block = block->next) {
-    if (block->offset <= offset && (block->offset + block->size) > offset)
+    if (block->offset > offset)
+      break;
+    if (block->use_count > 0 && (block->offset + block->size) > offset)
       return block;
   }
 
@@ -180,3 +379,25 @@ shm_alloc_space_block_dec (ShmAllocBlock * block)
   if (block->use_count <= 0)
     shm_alloc_space_free_block (block);
 }
+
+void
+shm_alloc_space_get_stats (ShmAllocSpace * self, unsigned long *free_size,
+    unsigned long *largest_free)
+{
+  ShmAllocBlock *item;
+  unsigned long largest = 0;
+
+  /* the largest free block is in the highest non-empty class */
+  if (self->free_classes) {
+    int c = shm_alloc_size_class (self->free_classes);
+
+    for (item = self->free_lists[c]; item; item = item->next_free)
+      if (item->size > largest)
+        largest = item->size;
+  }
+
+  if (free_size)
+    *free_size = self->free_size;
+  if (largest_free)
+    *largest_free = largest;
+}
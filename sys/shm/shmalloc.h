@@ -66,6 +66,9 @@ void shm_alloc_space_block_dec (ShmAllocBlock * block);
 ShmAllocBlock * shm_alloc_space_block_get (ShmAllocSpace * space,
     unsigned long offset);
 
+void shm_alloc_space_get_stats (ShmAllocSpace * self,
+    unsigned long *free_size, unsigned long *largest_free);
+
 
 #ifdef __cplusplus
 }
@@ -33,6 +33,10 @@
 #endif
 #endif
 
+#ifdef __linux__
+#define SHM_PIPE_HAVE_RING 1
+#endif
+
 #include "shmpipe.h"
 
 #include <sys/types.h>
@@ -47,6 +51,10 @@
 #include <sys/mman.h>
 #include <assert.h>
 
+#ifdef SHM_PIPE_HAVE_RING
+#include <sys/eventfd.h>
+#endif
+
 #include "shmalloc.h"
 
 /*
@@ -58,7 +66,7 @@
  * Size of path (followed by path)
  *
  * type 2: Close shm area:
- * No payload
+ * Ring head at the time of closing (only used in ring mode)
  *
  * type 3: shm buffer
  * offset
@@ -67,9 +75,23 @@
  * type 4: ack buffer
  * offset
  *
+ * type 5: new ring (the area id field carries the reader index)
+ * Ring length
+ * Cursor of the reader
+ * Ancillary data: ring area, reader eventfd and writer eventfd
+ *
  * Type 4 goes from the client to the server
  * The rest are from the server to the client
  * The client should never write in the SHM
+ *
+ * In ring mode, the buffers are not sent over the socket. The writer
+ * publishes them in a ring of descriptors in a separate shared area and
+ * every reader follows it with its own cursor. A reader releases a buffer
+ * by clearing its bit in the slot. The eventfds are only written to when
+ * the other side has said it is going to sleep, so a busy pipe does not
+ * do any syscall. Only the setup messages (types 1, 2 and 5) still go
+ * through the socket. The ring is only available on Linux, everywhere
+ * else the writer keeps using the socket.
  */
 
 
@@ -80,10 +102,15 @@ enum
   COMMAND_NEW_SHM_AREA = 1,
   COMMAND_CLOSE_SHM_AREA = 2,
   COMMAND_NEW_BUFFER = 3,
-  COMMAND_ACK_BUFFER = 4
+  COMMAND_ACK_BUFFER = 4,
+  COMMAND_NEW_RING = 5
 };
 
+#define SHM_RING_MAX_READERS 32
+#define SHM_RING_MAX_SLOTS (1 << 16)
+
 typedef struct _ShmArea ShmArea;
+typedef struct _ShmRing ShmRing;
 
 struct _ShmArea
 {
@@ -100,9 +127,66 @@ struct _ShmArea
 
   ShmAllocSpace *allocspace;
 
+  /* reader only: the writer closed this area, but the ring may still
+   * contain buffers from it up to ring_close_seq */
+  int ring_close_pending;
+  uint32_t ring_close_seq;
+
   ShmArea *next;
 };
 
+/* This is the layout of the ring area, it is mapped by the writer and all
+ * the readers, so it must only contain fixed size types */
+typedef struct
+{
+  /* bit mask of the readers that have not released this slot yet */
+  volatile uint32_t readers;
+  int32_t area_id;
+  uint64_t offset;
+  uint64_t size;
+} ShmRingSlot;
+
+typedef struct
+{
+  /* set by the reader before it sleeps on its eventfd */
+  volatile uint32_t waiting;
+  /* keep every reader on its own cache line */
+  char padding[60];
+} ShmRingReader;
+
+typedef struct
+{
+  uint32_t n_slots;
+  /* number of slots published so far, wraps around */
+  volatile uint32_t head;
+  /* set by the writer when it wants to be told about released slots */
+  volatile uint32_t writer_waiting;
+  char padding[52];
+  ShmRingReader readers[SHM_RING_MAX_READERS];
+  ShmRingSlot slots[0];
+} ShmRingHeader;
+
+struct _ShmRing
+{
+  ShmRingHeader *header;
+  size_t len;
+  uint32_t mask;
+
+  int shm_fd;
+  int writer_efd;
+
+  /* writer side */
+  uint32_t tail;
+  uint32_t readers_mask;
+  ShmBuffer **buffers;
+
+  /* reader side */
+  int reader;
+  int reader_efd;
+  uint32_t cursor;
+  char **bufs;
+};
+
 struct _ShmBuffer
 {
   int use_count;
@@ -139,6 +223,8 @@ struct _ShmPipe
   int num_clients;
   ShmClient *clients;
 
+  ShmRing *ring;
+
   mode_t perms;
 };
 
@@ -146,6 +232,10 @@ struct _ShmClient
 {
   int fd;
 
+  /* index in the ring, -1 if the client uses the socket protocol */
+  int ring_reader;
+  int ring_efd;
+
   ShmClient *next;
 };
 
@@ -178,6 +268,15 @@ struct CommandBuffer
     {
       unsigned long offset;
     } ack_buffer;
+    struct
+    {
+      unsigned int ring_head;
+    } close_shm_area;
+    struct
+    {
+      unsigned int size;
+      unsigned int cursor;
+    } new_ring;
   } payload;
 };
 
@@ -186,6 +285,11 @@ static void sp_close_shm (ShmArea * area);
 static int sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf,
     ShmBuffer * prev_buf, ShmClient * client, void **tag);
 static void sp_shm_area_dec (ShmPipe * self, ShmArea * area);
+static void sp_shmbuf_free (ShmPipe * self, ShmBuffer * buf,
+    ShmBuffer * prev_buf, void **tag);
+static void sp_close_ring (ShmRing * ring);
+static void sp_writer_ring_remove_reader (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void *user_data);
 
 
 
@@ -330,8 +434,12 @@ sp_open_shm (char *path, int id, mode_t perms, size_t size)
 
   area->id = id;
 
-  if (!path)
+  if (!path) {
     area->allocspace = shm_alloc_space_new (area->shm_area_len);
+    if (!area->allocspace)
+      RETURN_ERROR ("Could not allocate the block headers for %s\n",
+          area->shm_area_name);
+  }
 
   return area;
 }
@@ -439,6 +547,11 @@ sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
   while (self->clients)
     sp_writer_close_client (self, self->clients, callback, user_data);
 
+  if (self->ring) {
+    sp_close_ring (self->ring);
+    self->ring = NULL;
+  }
+
   sp_dec (self);
 }
 
@@ -504,6 +617,9 @@ sp_writer_resize (ShmPipe * self, size_t size)
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
 
+    /* ring readers may still find buffers of the old area in the ring */
+    if (self->ring)
+      cb.payload.close_shm_area.ring_head = self->ring->header->head;
     if (!send_command (client->fd, &cb, COMMAND_CLOSE_SHM_AREA,
             old_current->id))
       continue;
@@ -566,6 +682,448 @@ sp_writer_free_block (ShmBlock * block)
   spalloc_free (ShmBlock, block);
 }
 
+static int
+sp_count_bits (uint32_t v)
+{
+  int c = 0;
+
+  for (; v; v &= v - 1)
+    c++;
+
+  return c;
+}
+
+#ifdef SHM_PIPE_HAVE_RING
+
+static void
+sp_ring_signal (int efd)
+{
+  uint64_t one = 1;
+
+  /* This can only fail if the counter is about to overflow, in which
+   * case the other side has plenty of wakeups pending already */
+  while (write (efd, &one, sizeof (one)) < 0 && errno == EINTR);
+}
+
+static void
+sp_ring_clear_signal (int efd)
+{
+  uint64_t value;
+
+  while (read (efd, &value, sizeof (value)) < 0 && errno == EINTR);
+}
+
+static ShmRing *
+sp_ring_new (void)
+{
+  ShmRing *ring = spalloc_new (ShmRing);
+
+  memset (ring, 0, sizeof (ShmRing));
+  ring->header = MAP_FAILED;
+  ring->shm_fd = -1;
+  ring->writer_efd = -1;
+  ring->reader_efd = -1;
+  ring->reader = -1;
+
+  return ring;
+}
+
+static void
+sp_close_ring (ShmRing * ring)
+{
+  if (ring->header != MAP_FAILED)
+    munmap (ring->header, ring->len);
+
+  if (ring->shm_fd >= 0)
+    close (ring->shm_fd);
+  if (ring->writer_efd >= 0)
+    close (ring->writer_efd);
+  if (ring->reader_efd >= 0)
+    close (ring->reader_efd);
+
+  free (ring->buffers);
+  free (ring->bufs);
+
+  spalloc_free (ShmRing, ring);
+}
+
+static int
+sp_shmbuf_ring_dec (ShmPipe * self, ShmBuffer * buf, void **tag)
+{
+  ShmBuffer *item, *prev_buf = NULL;
+
+  for (item = self->buffers; item; item = item->next) {
+    if (item == buf)
+      break;
+    prev_buf = item;
+  }
+  assert (item);
+
+  buf->use_count--;
+
+  if (buf->use_count == 0) {
+    sp_shmbuf_free (self, buf, prev_buf, tag);
+    return 0;
+  }
+  return 1;
+}
+
+/* Asks the readers to signal the writer eventfd when they release a slot,
+ * slots released before the flag could be seen are signalled here */
+static void
+sp_writer_ring_arm (ShmRing * ring)
+{
+  ShmRingHeader *header = ring->header;
+  uint32_t seq;
+
+  header->writer_waiting = 1;
+  __sync_synchronize ();
+
+  for (seq = ring->tail; seq != header->head; seq++) {
+    uint32_t idx = seq & ring->mask;
+
+    if (ring->buffers[idx] && header->slots[idx].readers == 0) {
+      if (__sync_bool_compare_and_swap (&header->writer_waiting, 1, 0))
+        sp_ring_signal (ring->writer_efd);
+      break;
+    }
+  }
+}
+
+/* Drops the ring reference on the buffers that all readers have released,
+ * they can be released in any order but the slots are reused in order */
+static int
+sp_writer_ring_reclaim (ShmPipe * self, sp_buffer_free_callback callback,
+    void *user_data)
+{
+  ShmRing *ring = self->ring;
+  ShmRingHeader *header = ring->header;
+  uint32_t seq;
+  int n = 0;
+
+  for (seq = ring->tail; seq != header->head; seq++) {
+    uint32_t idx = seq & ring->mask;
+    ShmBuffer *sb = ring->buffers[idx];
+    void *tag = NULL;
+
+    if (sb == NULL || header->slots[idx].readers != 0)
+      continue;
+
+    /* the readers are done with the memory before they clear their bit */
+    __sync_synchronize ();
+
+    ring->buffers[idx] = NULL;
+    n++;
+
+    if (sp_shmbuf_ring_dec (self, sb, &tag) == 0 && callback)
+      callback (tag, user_data);
+  }
+
+  while (ring->tail != header->head &&
+      ring->buffers[ring->tail & ring->mask] == NULL)
+    ring->tail++;
+
+  if (ring->tail != header->head)
+    sp_writer_ring_arm (ring);
+
+  return n;
+}
+
+static int
+sp_writer_ring_publish (ShmPipe * self, ShmBuffer * sb)
+{
+  ShmRing *ring = self->ring;
+  ShmRingHeader *header;
+  ShmRingSlot *slot;
+  ShmClient *client;
+  uint32_t head, idx;
+
+  if (!ring || !ring->readers_mask)
+    return 0;
+
+  header = ring->header;
+  head = header->head;
+
+  /* The slowest reader is a whole ring behind, it misses this buffer */
+  if (head - ring->tail > ring->mask)
+    return 0;
+
+  idx = head & ring->mask;
+  slot = &header->slots[idx];
+  slot->area_id = sb->shm_area->id;
+  slot->offset = sb->offset;
+  slot->size = sb->size;
+  slot->readers = ring->readers_mask;
+  ring->buffers[idx] = sb;
+
+  /* the slot must be complete before the readers can see it */
+  __sync_synchronize ();
+  header->head = head + 1;
+  __sync_synchronize ();
+
+  for (client = self->clients; client; client = client->next) {
+    if (client->ring_reader >= 0 &&
+        __sync_bool_compare_and_swap (&header->readers[client->ring_reader].
+            waiting, 1, 0))
+      sp_ring_signal (client->ring_efd);
+  }
+
+  if (!header->writer_waiting)
+    sp_writer_ring_arm (ring);
+
+  return 1;
+}
+
+static int
+send_command_fds (int fd, struct CommandBuffer *cb, unsigned short int type,
+    int area_id, int *fds, int n_fds)
+{
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int) * 3)];
+  } control;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+
+  assert (n_fds <= 3);
+
+  cb->type = type;
+  cb->area_id = area_id;
+
+  memset (&msg, 0, sizeof (msg));
+  memset (&control, 0, sizeof (control));
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE (sizeof (int) * n_fds);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int) * n_fds);
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (int) * n_fds);
+
+  if (sendmsg (fd, &msg, MSG_NOSIGNAL) != sizeof (struct CommandBuffer))
+    return 0;
+
+  return 1;
+}
+
+static int
+recv_command_fds (int fd, struct CommandBuffer *cb, int *fds, int *n_fds)
+{
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int) * 3)];
+  } control;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  ssize_t retval;
+  int i;
+
+  *n_fds = 0;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  retval = recvmsg (fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  if (retval < 0)
+    return 0;
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+
+      memcpy (fds + *n_fds, CMSG_DATA (cmsg), sizeof (int) * n);
+      *n_fds += n;
+      break;
+    }
+  }
+
+  if (retval != sizeof (struct CommandBuffer)) {
+    for (i = 0; i < *n_fds; i++)
+      close (fds[i]);
+    *n_fds = 0;
+    return 0;
+  }
+
+  return 1;
+}
+
+static void
+sp_writer_ring_add_reader (ShmPipe * self, ShmClient * client)
+{
+  ShmRing *ring = self->ring;
+  struct CommandBuffer cb = { 0 };
+  int fds[3];
+  int r;
+
+  for (r = 0; r < SHM_RING_MAX_READERS; r++)
+    if (!(ring->readers_mask & (1U << r)))
+      break;
+
+  /* The extra readers just use the socket protocol */
+  if (r == SHM_RING_MAX_READERS)
+    return;
+
+  client->ring_efd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (client->ring_efd < 0)
+    return;
+
+  ring->header->readers[r].waiting = 0;
+
+  cb.payload.new_ring.size = ring->len;
+  cb.payload.new_ring.cursor = ring->header->head;
+  fds[0] = ring->shm_fd;
+  fds[1] = client->ring_efd;
+  fds[2] = ring->writer_efd;
+  if (!send_command_fds (client->fd, &cb, COMMAND_NEW_RING, r, fds, 3)) {
+    fprintf (stderr, "Sending new ring failed: %s", strerror (errno));
+    close (client->ring_efd);
+    client->ring_efd = -1;
+    return;
+  }
+
+  client->ring_reader = r;
+  ring->readers_mask |= 1U << r;
+}
+
+static void
+sp_writer_ring_remove_reader (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void *user_data)
+{
+  ShmRing *ring = self->ring;
+  uint32_t bit = 1U << client->ring_reader;
+  uint32_t seq;
+
+  ring->readers_mask &= ~bit;
+  for (seq = ring->tail; seq != ring->header->head; seq++)
+    __sync_fetch_and_and (&ring->header->slots[seq & ring->mask].readers, ~bit);
+  ring->header->readers[client->ring_reader].waiting = 0;
+
+  close (client->ring_efd);
+  client->ring_efd = -1;
+  client->ring_reader = -1;
+
+  sp_writer_ring_reclaim (self, callback, user_data);
+}
+
+static ShmRing *
+sp_client_open_ring (int *fds, int reader, size_t size, uint32_t cursor)
+{
+  ShmRing *ring = sp_ring_new ();
+
+  ring->shm_fd = fds[0];
+  ring->reader_efd = fds[1];
+  ring->writer_efd = fds[2];
+  ring->reader = reader;
+  ring->cursor = cursor;
+  ring->len = size;
+
+  if (reader < 0 || reader >= SHM_RING_MAX_READERS ||
+      size < sizeof (ShmRingHeader))
+    goto error;
+
+  /* The readers write their cursors and release bits in the ring */
+  ring->header = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      ring->shm_fd, 0);
+  if (ring->header == MAP_FAILED)
+    goto error;
+
+  close (ring->shm_fd);
+  ring->shm_fd = -1;
+
+  if (ring->header->n_slots == 0 ||
+      (ring->header->n_slots & (ring->header->n_slots - 1)) ||
+      size != sizeof (ShmRingHeader) +
+      ring->header->n_slots * sizeof (ShmRingSlot))
+    goto error;
+
+  ring->mask = ring->header->n_slots - 1;
+  ring->bufs = calloc (ring->header->n_slots, sizeof (char *));
+  if (!ring->bufs)
+    goto error;
+
+  return ring;
+
+error:
+  sp_close_ring (ring);
+  return NULL;
+}
+
+/* Closes the areas the writer has removed once the ring has gone past the
+ * last buffer that could come from them */
+static void
+sp_client_ring_close_areas (ShmPipe * self)
+{
+  ShmArea *area, *next;
+
+  for (area = self->shm_area; area; area = next) {
+    next = area->next;
+    if (area->ring_close_pending &&
+        area->ring_close_seq == self->ring->cursor) {
+      area->ring_close_pending = 0;
+      sp_shm_area_dec (self, area);
+    }
+  }
+}
+
+static int
+sp_client_ring_release (ShmPipe * self, char *buf)
+{
+  ShmRing *ring = self->ring;
+  uint32_t bit = 1U << ring->reader;
+  uint32_t i;
+
+  /* Only the most recent slots can still be held, look at them first */
+  for (i = 1; i <= ring->mask + 1; i++) {
+    uint32_t idx = (ring->cursor - i) & ring->mask;
+
+    if (ring->bufs[idx] == buf) {
+      ring->bufs[idx] = NULL;
+      if ((__sync_fetch_and_and (&ring->header->slots[idx].readers, ~bit) &
+              ~bit) == 0 &&
+          __sync_bool_compare_and_swap (&ring->header->writer_waiting, 1, 0))
+        sp_ring_signal (ring->writer_efd);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+#else
+
+static int
+sp_writer_ring_publish (ShmPipe * self, ShmBuffer * sb)
+{
+  return 0;
+}
+
+static void
+sp_writer_ring_remove_reader (ShmPipe * self, ShmClient * client,
+    sp_buffer_free_callback callback, void *user_data)
+{
+}
+
+static void
+sp_close_ring (ShmRing * ring)
+{
+}
+
+#endif
+
 /* Returns the number of client this has successfully been sent to */
 
 int
@@ -579,6 +1137,7 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   ShmAllocBlock *ablock = NULL;
   int i = 0;
   int c = 0;
+  int ring_readers = 0;
 
   if (self->num_clients == 0)
     return 0;
@@ -608,6 +1167,10 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
 
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
+
+    if (client->ring_reader >= 0)
+      continue;
+
     cb.payload.buffer.offset = offset;
     cb.payload.buffer.size = bsize;
     if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER, self->shm_area->id))
@@ -616,7 +1179,11 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
     c++;
   }
 
-  if (c == 0) {
+  /* The ring holds a single reference for all of its readers */
+  if (sp_writer_ring_publish (self, sb))
+    ring_readers = sp_count_bits (self->ring->readers_mask);
+
+  if (c == 0 && ring_readers == 0) {
     spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * sb->num_clients, sb);
     return 0;
   }
@@ -624,12 +1191,12 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   sp_shm_area_inc (area);
   shm_alloc_space_block_inc (ablock);
 
-  sb->use_count = c;
+  sb->use_count = c + (ring_readers ? 1 : 0);
 
   sb->next = self->buffers;
   self->buffers = sb;
 
-  return c;
+  return c + ring_readers;
 }
 
 static int
@@ -653,9 +1220,23 @@ sp_client_recv (ShmPipe * self, char **buf)
   ShmArea *area;
   struct CommandBuffer cb;
   int retval;
+#ifdef SHM_PIPE_HAVE_RING
+  int fds[3];
+  int n_fds = 0;
+  int i;
+
+  if (!recv_command_fds (self->main_socket, &cb, fds, &n_fds))
+    return -1;
 
+  if (cb.type != COMMAND_NEW_RING) {
+    for (i = 0; i < n_fds; i++)
+      close (fds[i]);
+    n_fds = 0;
+  }
+#else
   if (!recv_command (self->main_socket, &cb))
     return -1;
+#endif
 
   switch (cb.type) {
     case COMMAND_NEW_SHM_AREA:
@@ -683,7 +1264,13 @@ sp_client_recv (ShmPipe * self, char **buf)
     case COMMAND_CLOSE_SHM_AREA:
       for (area = self->shm_area; area; area = area->next) {
         if (area->id == cb.area_id) {
-          sp_shm_area_dec (self, area);
+          if (self->ring &&
+              self->ring->cursor != cb.payload.close_shm_area.ring_head) {
+            area->ring_close_pending = 1;
+            area->ring_close_seq = cb.payload.close_shm_area.ring_head;
+          } else {
+            sp_shm_area_dec (self, area);
+          }
           break;
         }
       }
@@ -700,6 +1287,21 @@ sp_client_recv (ShmPipe * self, char **buf)
       }
       return -23;
 
+#ifdef SHM_PIPE_HAVE_RING
+    case COMMAND_NEW_RING:
+      if (n_fds != 3 || self->ring) {
+        for (i = 0; i < n_fds; i++)
+          close (fds[i]);
+        return -5;
+      }
+
+      self->ring = sp_client_open_ring (fds, cb.area_id,
+          cb.payload.new_ring.size, cb.payload.new_ring.cursor);
+      if (!self->ring)
+        return -6;
+      break;
+#endif
+
     default:
       return -99;
   }
@@ -707,6 +1309,71 @@ sp_client_recv (ShmPipe * self, char **buf)
   return 0;
 }
 
+long int
+sp_client_recv_ring (ShmPipe * self, char **buf)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  ShmRing *ring = self->ring;
+  ShmRingHeader *header;
+  ShmRingSlot *slot;
+  ShmArea *area;
+  uint32_t idx;
+  long int size;
+
+  if (!ring)
+    return 0;
+
+  header = ring->header;
+
+  if (ring->cursor == header->head) {
+    /* Nothing to read, tell the writer we are going to sleep. The flag
+     * must be visible before the last look at the head, the writer does
+     * the opposite */
+    sp_ring_clear_signal (ring->reader_efd);
+    header->readers[ring->reader].waiting = 1;
+    __sync_synchronize ();
+    if (ring->cursor == header->head)
+      return 0;
+    header->readers[ring->reader].waiting = 0;
+  }
+
+  /* the slot was written before the head */
+  __sync_synchronize ();
+
+  idx = ring->cursor & ring->mask;
+  slot = &header->slots[idx];
+
+  for (area = self->shm_area; area; area = area->next)
+    if (area->id == slot->area_id)
+      break;
+
+  /* The new area is still on its way through the socket */
+  if (!area)
+    return 0;
+
+  *buf = area->shm_area_buf + slot->offset;
+  size = slot->size;
+  sp_shm_area_inc (area);
+  ring->bufs[idx] = *buf;
+  ring->cursor++;
+
+  sp_client_ring_close_areas (self);
+
+  return size;
+#else
+  return 0;
+#endif
+}
+
+int
+sp_client_get_ring_fd (ShmPipe * self)
+{
+  if (self->ring)
+    return self->ring->reader_efd;
+
+  return -1;
+}
+
 int
 sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
 {
@@ -758,6 +1425,11 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
 
   sp_shm_area_dec (self, shm_area);
 
+#ifdef SHM_PIPE_HAVE_RING
+  if (self->ring)
+    return sp_client_ring_release (self, buf);
+#endif
+
   cb.payload.ack_buffer.offset = offset;
   return send_command (self->main_socket, &cb, COMMAND_ACK_BUFFER,
       self->shm_area->id);
@@ -831,6 +1503,13 @@ sp_writer_accept_client (ShmPipe * self)
 
   client = spalloc_new (ShmClient);
   client->fd = fd;
+  client->ring_reader = -1;
+  client->ring_efd = -1;
+
+#ifdef SHM_PIPE_HAVE_RING
+  if (self->ring)
+    sp_writer_ring_add_reader (self, client);
+#endif
 
   /* Prepend ot linked list */
   client->next = self->clients;
@@ -869,22 +1548,29 @@ sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
   buf->use_count--;
 
   if (buf->use_count == 0) {
-    /* Remove from linked list */
-    if (prev_buf)
-      prev_buf->next = buf->next;
-    else
-      self->buffers = buf->next;
-
-    if (tag)
-      *tag = buf->tag;
-    shm_alloc_space_block_dec (buf->ablock);
-    sp_shm_area_dec (self, buf->shm_area);
-    spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * buf->num_clients, buf);
+    sp_shmbuf_free (self, buf, prev_buf, tag);
     return 0;
   }
   return 1;
 }
 
+static void
+sp_shmbuf_free (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
+    void **tag)
+{
+  /* Remove from linked list */
+  if (prev_buf)
+    prev_buf->next = buf->next;
+  else
+    self->buffers = buf->next;
+
+  if (tag)
+    *tag = buf->tag;
+  shm_alloc_space_block_dec (buf->ablock);
+  sp_shm_area_dec (self, buf->shm_area);
+  spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * buf->num_clients, buf);
+}
+
 void
 sp_writer_close_client (ShmPipe * self, ShmClient * client,
     sp_buffer_free_callback callback, void *user_data)
@@ -894,6 +1580,9 @@ sp_writer_close_client (ShmPipe * self, ShmClient * client,
 
   close (client->fd);
 
+  if (client->ring_reader >= 0)
+    sp_writer_ring_remove_reader (self, client, callback, user_data);
+
 again:
   for (buffer = self->buffers; buffer; buffer = buffer->next) {
     int i;
@@ -979,3 +1668,116 @@ sp_writer_get_max_buf_size (ShmPipe * self)
 
   return self->shm_area->shm_area_len;
 }
+
+void
+sp_writer_get_alloc_stats (ShmPipe * self, size_t * free_size,
+    size_t * largest_free)
+{
+  unsigned long f = 0, l = 0;
+
+  if (self->shm_area && self->shm_area->allocspace)
+    shm_alloc_space_get_stats (self->shm_area->allocspace, &f, &l);
+
+  if (free_size)
+    *free_size = f;
+  if (largest_free)
+    *largest_free = l;
+}
+
+int
+sp_writer_enable_ring (ShmPipe * self, unsigned int n_slots)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  ShmRing *ring;
+  char tmppath[32];
+  uint32_t n = 1;
+  int i = 0;
+
+  if (self->ring || self->clients || n_slots == 0)
+    return -1;
+
+  while (n < n_slots && n < SHM_RING_MAX_SLOTS)
+    n <<= 1;
+
+  ring = sp_ring_new ();
+  ring->mask = n - 1;
+  ring->len = sizeof (ShmRingHeader) + n * sizeof (ShmRingSlot);
+
+  /* The ring is only ever passed around as a file descriptor, so the name
+   * can go away at once */
+  do {
+    snprintf (tmppath, sizeof (tmppath), "/shmring.%5d.%5d", getpid (), i++);
+    ring->shm_fd = shm_open (tmppath, O_RDWR | O_CREAT | O_EXCL,
+        S_IRUSR | S_IWUSR);
+  } while (ring->shm_fd < 0 && errno == EEXIST);
+
+  if (ring->shm_fd < 0)
+    goto error;
+  shm_unlink (tmppath);
+
+  if (ftruncate (ring->shm_fd, ring->len))
+    goto error;
+
+  ring->header = mmap (NULL, ring->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+      ring->shm_fd, 0);
+  if (ring->header == MAP_FAILED)
+    goto error;
+  ring->header->n_slots = n;
+
+  ring->writer_efd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ring->writer_efd < 0)
+    goto error;
+
+  ring->buffers = calloc (n, sizeof (ShmBuffer *));
+  if (!ring->buffers)
+    goto error;
+
+  self->ring = ring;
+
+  return 0;
+
+error:
+  fprintf (stderr, "Could not create the shm ring (%d): %s\n", errno,
+      strerror (errno));
+  sp_close_ring (ring);
+  return -1;
+#else
+  return -1;
+#endif
+}
+
+int
+sp_writer_get_ring_fd (ShmPipe * self)
+{
+  if (self->ring)
+    return self->ring->writer_efd;
+
+  return -1;
+}
+
+int
+sp_writer_ring_full (ShmPipe * self)
+{
+  ShmRing *ring = self->ring;
+
+  if (!ring || !ring->readers_mask)
+    return 0;
+
+  return ring->header->head - ring->tail > ring->mask;
+}
+
+int
+sp_writer_ring_recv (ShmPipe * self, sp_buffer_free_callback callback,
+    void *user_data)
+{
+#ifdef SHM_PIPE_HAVE_RING
+  if (!self->ring)
+    return 0;
+
+  sp_ring_clear_signal (self->ring->writer_efd);
+
+  return sp_writer_ring_reclaim (self, callback, user_data);
+#else
+  return 0;
+#endif
+}
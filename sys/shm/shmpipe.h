@@ -56,6 +56,18 @@
  * buffers are no longer valid. If was valid buffer was received, the
  * client must release it with sp_client_recv_finish() when it is done
  * reading from it.
+ *
+ * On Linux, the writer can call sp_writer_enable_ring() right after
+ * creating the pipe. Buffers are then published in a ring of descriptors
+ * in shared memory instead of being sent over the socket. The writer must
+ * also select() on sp_writer_get_ring_fd() and call sp_writer_ring_recv()
+ * when it is readable, this frees the buffers that all readers have
+ * released. sp_writer_ring_full() tells if the slowest reader is a whole
+ * ring behind, in which case the writer should wait before sending. Once
+ * sp_client_get_ring_fd() returns a valid fd, the reader must call
+ * sp_client_recv_ring() before waiting, and wait for both the socket and
+ * that fd. It returns the size of a buffer or 0 if there is none, the
+ * buffer is released with sp_client_recv_finish() as usual.
  */
 
 
@@ -99,6 +111,14 @@ int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void * tag);
 char *sp_writer_block_get_buf (ShmBlock *block);
 ShmPipe *sp_writer_block_get_pipe (ShmBlock *block);
 size_t sp_writer_get_max_buf_size (ShmPipe * self);
+void sp_writer_get_alloc_stats (ShmPipe * self, size_t * free_size,
+    size_t * largest_free);
+
+int sp_writer_enable_ring (ShmPipe * self, unsigned int n_slots);
+int sp_writer_get_ring_fd (ShmPipe * self);
+int sp_writer_ring_full (ShmPipe * self);
+int sp_writer_ring_recv (ShmPipe * self, sp_buffer_free_callback callback,
+    void * user_data);
 
 ShmClient * sp_writer_accept_client (ShmPipe * self);
 void sp_writer_close_client (ShmPipe *self, ShmClient * client,
@@ -114,6 +134,8 @@ void *sp_writer_buf_get_tag (ShmBuffer * buffer);
 ShmPipe *sp_client_open (const char *path);
 long int sp_client_recv (ShmPipe * self, char **buf);
 int sp_client_recv_finish (ShmPipe * self, char *buf);
+long int sp_client_recv_ring (ShmPipe * self, char **buf);
+int sp_client_get_ring_fd (ShmPipe * self);
 void sp_client_close (ShmPipe * self);
 
 #ifdef __cplusplus
@@ -0,0 +1,299 @@
+/* GStreamer
+ *
+ * abrreplay.c: replay download traces through the bitrate adaptation of
+ * the adaptive demuxers and score the playback
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Simulates a player downloading fixed duration fragments over a network
+ * whose throughput follows a trace, and counts stalls and bitrate switches.
+ * Each trace is played with the single sample policy the demuxers used
+ * before (last download rate times the bandwidth usage) and with
+ * GstBandwidthEstimator.
+ *
+ * A trace file has one "<duration in ms> <throughput in kbit/s>" pair per
+ * line, lines starting with '#' are ignored. Without arguments a few
+ * synthetic traces are replayed. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/uridownloader/gstbandwidthestimator.h>
+
+#define FRAGMENT_DURATION (2 * GST_SECOND)
+#define N_FRAGMENTS 300
+#define MAX_BUFFER (30 * GST_SECOND)
+#define START_BUFFER (FRAGMENT_DURATION)
+#define BANDWIDTH_USAGE 0.8
+
+static const guint64 variants[] = {
+  300000, 700000, 1500000, 3000000, 6000000
+};
+
+typedef struct
+{
+  GstClockTime duration;
+  guint64 bitrate;
+} TraceStep;
+
+typedef struct
+{
+  const gchar *name;
+  GArray *steps;                /* TraceStep, the trace loops */
+} Trace;
+
+typedef struct
+{
+  guint stalls;
+  GstClockTime stall_time;
+  guint switches;
+  guint64 bitrate_sum;
+} Score;
+
+/* returns the time needed to download @bytes starting at @now */
+static GstClockTime
+trace_download (Trace * trace, GstClockTime now, guint64 bytes)
+{
+  GstClockTime total = 0, period = 0, pos, elapsed = 0;
+  gdouble bits = bytes * 8.0;
+  guint i;
+
+  for (i = 0; i < trace->steps->len; i++)
+    period += g_array_index (trace->steps, TraceStep, i).duration;
+
+  pos = now % period;
+  i = 0;
+  while (pos >= g_array_index (trace->steps, TraceStep, i).duration) {
+    pos -= g_array_index (trace->steps, TraceStep, i).duration;
+    i++;
+  }
+
+  while (bits > 0) {
+    TraceStep *step = &g_array_index (trace->steps, TraceStep, i);
+    GstClockTime left = step->duration - pos;
+    gdouble step_bits = (gdouble) step->bitrate * left / GST_SECOND;
+
+    if (step_bits >= bits) {
+      elapsed = bits * GST_SECOND / MAX (step->bitrate, 1);
+      total += elapsed;
+      break;
+    }
+    bits -= step_bits;
+    total += left;
+    pos = 0;
+    i = (i + 1) % trace->steps->len;
+  }
+
+  return total;
+}
+
+static guint
+select_variant (guint64 target)
+{
+  guint i, ret = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (variants); i++)
+    if (variants[i] <= target)
+      ret = i;
+
+  return ret;
+}
+
+static void
+replay (Trace * trace, gboolean use_estimator, Score * score)
+{
+  GstBandwidthEstimator est;
+  GstClockTime now = 0, buffer = 0;
+  gboolean playing = FALSE;
+  guint current = 0, i;
+
+  memset (score, 0, sizeof (Score));
+  gst_bandwidth_estimator_init (&est);
+
+  for (i = 0; i < N_FRAGMENTS; i++) {
+    guint64 bytes = variants[current] / 8 * FRAGMENT_DURATION / GST_SECOND;
+    GstClockTime dl = trace_download (trace, now, bytes);
+    guint64 target;
+    guint next;
+
+    /* playback drains the buffer while downloading */
+    if (playing) {
+      if (dl > buffer) {
+        score->stalls++;
+        score->stall_time += dl - buffer;
+        buffer = 0;
+        playing = FALSE;
+      } else {
+        buffer -= dl;
+      }
+    }
+    now += dl;
+    buffer += FRAGMENT_DURATION;
+    score->bitrate_sum += variants[current];
+    if (buffer >= START_BUFFER)
+      playing = TRUE;
+
+    /* wait for room in the buffer */
+    if (buffer > MAX_BUFFER) {
+      now += buffer - MAX_BUFFER;
+      buffer = MAX_BUFFER;
+    }
+
+    if (use_estimator) {
+      gst_bandwidth_estimator_add_sample (&est, bytes, dl);
+      target = gst_bandwidth_estimator_get_target_bitrate (&est,
+          BANDWIDTH_USAGE, variants[current], buffer);
+    } else {
+      target = (gdouble) bytes * 8 * GST_SECOND / MAX (dl, 1) * BANDWIDTH_USAGE;
+    }
+
+    next = select_variant (target);
+    if (next != current)
+      score->switches++;
+    current = next;
+  }
+
+  gst_bandwidth_estimator_deinit (&est);
+}
+
+static void
+run_trace (Trace * trace)
+{
+  Score single, estimator;
+
+  replay (trace, FALSE, &single);
+  replay (trace, TRUE, &estimator);
+
+  g_print ("%-12s single sample: %3u stalls (%7.1f s) %4u switches %6"
+      G_GUINT64_FORMAT " kbit/s\n", trace->name, single.stalls,
+      (gdouble) single.stall_time / GST_SECOND, single.switches,
+      single.bitrate_sum / N_FRAGMENTS / 1000);
+  g_print ("%-12s estimator:     %3u stalls (%7.1f s) %4u switches %6"
+      G_GUINT64_FORMAT " kbit/s\n", "", estimator.stalls,
+      (gdouble) estimator.stall_time / GST_SECOND, estimator.switches,
+      estimator.bitrate_sum / N_FRAGMENTS / 1000);
+}
+
+static void
+trace_add (Trace * trace, GstClockTime duration, guint64 bitrate)
+{
+  TraceStep step = { duration, bitrate };
+
+  g_array_append_val (trace->steps, step);
+}
+
+static Trace *
+trace_new (const gchar * name)
+{
+  Trace *trace = g_new0 (Trace, 1);
+
+  trace->name = name;
+  trace->steps = g_array_new (FALSE, FALSE, sizeof (TraceStep));
+
+  return trace;
+}
+
+static void
+trace_free (Trace * trace)
+{
+  g_array_free (trace->steps, TRUE);
+  g_free (trace);
+}
+
+static Trace *
+trace_load (const gchar * filename)
+{
+  GError *err = NULL;
+  gchar *contents, **lines;
+  Trace *trace;
+  guint i;
+
+  if (!g_file_get_contents (filename, &contents, NULL, &err))
+    g_error ("Could not read %s: %s", filename, err->message);
+
+  trace = trace_new (filename);
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; lines[i]; i++) {
+    guint64 ms, kbps;
+    gchar *end;
+
+    g_strstrip (lines[i]);
+    if (lines[i][0] == '\0' || lines[i][0] == '#')
+      continue;
+    ms = g_ascii_strtoull (lines[i], &end, 10);
+    kbps = g_ascii_strtoull (end, NULL, 10);
+    if (ms > 0)
+      trace_add (trace, ms * GST_MSECOND, kbps * 1000);
+  }
+  g_strfreev (lines);
+  g_free (contents);
+
+  if (trace->steps->len == 0)
+    g_error ("%s contains no trace", filename);
+
+  return trace;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  Trace *trace;
+  GRand *rand;
+  gint i;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1) {
+    for (i = 1; i < argc; i++) {
+      trace = trace_load (argv[i]);
+      run_trace (trace);
+      trace_free (trace);
+    }
+    return 0;
+  }
+
+  trace = trace_new ("stable");
+  trace_add (trace, GST_SECOND, 4000000);
+  run_trace (trace);
+  trace_free (trace);
+
+  trace = trace_new ("step");
+  trace_add (trace, 120 * GST_SECOND, 8000000);
+  trace_add (trace, 60 * GST_SECOND, 1000000);
+  run_trace (trace);
+  trace_free (trace);
+
+  /* throughput changing every 500ms, with occasional bursts */
+  rand = g_rand_new_with_seed (0xabc);
+  trace = trace_new ("fluctuating");
+  for (i = 0; i < 600; i++) {
+    guint64 bitrate = g_rand_int_range (rand, 1000, 5000) * 1000;
+
+    if (g_rand_int_range (rand, 0, 20) == 0)
+      bitrate *= 8;
+    trace_add (trace, 500 * GST_MSECOND, bitrate);
+  }
+  run_trace (trace);
+  trace_free (trace);
+  g_rand_free (rand);
+
+  return 0;
+}
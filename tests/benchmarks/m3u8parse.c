@@ -0,0 +1,129 @@
+/* GStreamer
+ *
+ * m3u8parse.c: measure the parsing of large HLS media playlists
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Generates live playlists of a few thousand segments, each refresh
+ * removing the oldest segments and appending new ones, and times
+ * gst_m3u8_client_update() on them. Every refresh is parsed once by a
+ * client that saw the previous refresh, which only parses the appended
+ * segments, and once by a new client, which parses the whole playlist.
+ *
+ * The number of segments and of refreshes can be passed on the command
+ * line. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <gst/gst.h>
+#include "m3u8.h"
+
+GST_DEBUG_CATEGORY (fragmented_debug);
+
+#define PLAYLIST_URI "http://example.com/live/channel/index.m3u8"
+#define DEFAULT_N_SEGMENTS 5000
+#define DEFAULT_N_REFRESHES 200
+/* segments added per refresh */
+#define STEP 1
+
+static gchar *
+make_playlist (guint first, guint n_segments)
+{
+  GString *s = g_string_sized_new (n_segments * 48);
+  guint i;
+
+  g_string_append (s, "#EXTM3U\n#EXT-X-VERSION:3\n"
+      "#EXT-X-TARGETDURATION:2\n");
+  g_string_append_printf (s, "#EXT-X-MEDIA-SEQUENCE:%u\n", first);
+  for (i = first; i < first + n_segments; i++)
+    g_string_append_printf (s, "#EXTINF:2.000,\nsegment-%08u.ts\n", i);
+
+  return g_string_free (s, FALSE);
+}
+
+/* Returns the time in seconds taken to feed @playlists to one client, or to
+ * a new client for each of them */
+static gdouble
+run (gchar ** playlists, guint n, gboolean incremental)
+{
+  GstM3U8Client *client = NULL;
+  GTimer *timer;
+  gdouble elapsed = 0;
+  guint i;
+
+  timer = g_timer_new ();
+  for (i = 0; i < n; i++) {
+    gchar *data = g_strdup (playlists[i]);
+
+    if (!incremental || client == NULL) {
+      if (client)
+        gst_m3u8_client_free (client);
+      client = gst_m3u8_client_new (PLAYLIST_URI);
+    }
+
+    /* the client takes the playlist */
+    g_timer_start (timer);
+    if (!gst_m3u8_client_update (client, data))
+      g_error ("Could not parse refresh %u", i);
+    elapsed += g_timer_elapsed (timer, NULL);
+  }
+
+  g_assert (client->current->files->len > 0);
+  gst_m3u8_client_free (client);
+  g_timer_destroy (timer);
+
+  return elapsed;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  guint n_segments = DEFAULT_N_SEGMENTS, n_refreshes = DEFAULT_N_REFRESHES;
+  gchar **playlists;
+  gdouble full, incremental;
+  guint i;
+
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (fragmented_debug, "fragmented", 0, "m3u8parse");
+
+  if (argc > 1)
+    n_segments = atoi (argv[1]);
+  if (argc > 2)
+    n_refreshes = atoi (argv[2]);
+  if (n_segments == 0 || n_refreshes == 0)
+    g_error ("usage: %s [segments] [refreshes]", argv[0]);
+
+  playlists = g_new0 (gchar *, n_refreshes + 1);
+  for (i = 0; i < n_refreshes; i++)
+    playlists[i] = make_playlist (i * STEP, n_segments);
+
+  full = run (playlists, n_refreshes, FALSE);
+  incremental = run (playlists, n_refreshes, TRUE);
+
+  g_print ("%u segments, %u refreshes\n", n_segments, n_refreshes);
+  g_print ("full parse:        %8.3f ms per refresh\n",
+      full * 1000 / n_refreshes);
+  g_print ("incremental parse: %8.3f ms per refresh\n",
+      incremental * 1000 / n_refreshes);
+
+  g_strfreev (playlists);
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+/* GStreamer
+ *
+ * mpegtsmux.c: measure the packet throughput of the MPEG-TS muxer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Muxes a synthetic 50 Mbit/s H.264 elementary stream and reports the
+ * number of TS packets produced per second, for a few output alignments.
+ * The muxer does not look into the H.264 payload, so the zero-filled
+ * buffers of fakesrc are good enough here. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+#define DEFAULT_N_BUFFERS 20000
+#define BUFFER_SIZE 32768
+#define DATA_RATE (50000000 / 8)
+
+static void
+handoff_cb (GstElement * sink, GstBuffer * buf, GstPad * pad,
+    guint64 * n_bytes)
+{
+  *n_bytes += gst_buffer_get_size (buf);
+}
+
+static void
+run_benchmark (gint alignment, gboolean m2ts, guint n_buffers)
+{
+  GstElement *pipeline, *mux, *sink;
+  GstMessage *msg;
+  GstClockTime start, end;
+  guint64 n_bytes = 0, n_packets;
+  gint packet_size = m2ts ? 192 : 188;
+  gdouble secs;
+  gchar *desc;
+
+  desc = g_strdup_printf ("fakesrc num-buffers=%u sizetype=fixed "
+      "sizemax=%d datarate=%d ! "
+      "video/x-h264,stream-format=byte-stream ! "
+      "mpegtsmux name=mux ! fakesink name=sink signal-handoffs=true "
+      "sync=false", n_buffers, BUFFER_SIZE, DATA_RATE);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_assert (pipeline);
+  g_free (desc);
+
+  mux = gst_bin_get_by_name (GST_BIN (pipeline), "mux");
+  g_object_set (mux, "alignment", alignment, "m2ts-mode", m2ts, NULL);
+  gst_object_unref (mux);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff_cb), &n_bytes);
+  gst_object_unref (sink);
+
+  start = gst_util_get_timestamp ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  msg = gst_bus_poll (GST_ELEMENT_BUS (pipeline),
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR, GST_CLOCK_TIME_NONE);
+  end = gst_util_get_timestamp ();
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR)
+    g_printerr ("pipeline error, results are not meaningful\n");
+  gst_message_unref (msg);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  n_packets = n_bytes / packet_size;
+  secs = (gdouble) (end - start) / GST_SECOND;
+  g_print ("%-4s alignment %3d: %10" G_GUINT64_FORMAT " packets in %8.3f s: "
+      "%12.0f packets/s\n", m2ts ? "m2ts" : "ts", alignment, n_packets, secs,
+      n_packets / secs);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  guint n_buffers = DEFAULT_N_BUFFERS;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1)
+    n_buffers = g_ascii_strtoull (argv[1], NULL, 10);
+
+  run_benchmark (0, FALSE, n_buffers);
+  run_benchmark (7, FALSE, n_buffers);
+  run_benchmark (1024, FALSE, n_buffers);
+  run_benchmark (-1, TRUE, n_buffers);
+
+  return 0;
+}
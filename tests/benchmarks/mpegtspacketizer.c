@@ -0,0 +1,187 @@
+/* GStreamer
+ *
+ * mpegtspacketizer.c: measure the packet throughput of the MPEG-TS
+ * packetizer on clean and corrupted input
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Runs "filesrc ! queue ! tsparse ! fakesink" over a capture and reports
+ * the number of packets per second. The queue forces tsparse into push
+ * mode so that only the packetizer and the base class are measured.
+ *
+ * Without arguments a synthetic capture is generated, once clean and once
+ * with bit errors and garbage inserted between packets (which exercises
+ * the resync code). A real capture can be passed on the command line. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#define PACKET_SIZE 188
+#define DEFAULT_N_PACKETS (256 * 1024)
+
+static void
+write_packet (guint8 * data, guint16 pid, gboolean pusi, guint8 cc)
+{
+  data[0] = 0x47;
+  data[1] = (pusi ? 0x40 : 0x00) | ((pid >> 8) & 0x1f);
+  data[2] = pid & 0xff;
+  data[3] = 0x10 | (cc & 0x0f);
+  memset (data + 4, 0xa5, PACKET_SIZE - 4);
+
+  if (pusi) {
+    /* minimal PES header */
+    data[4] = 0x00;
+    data[5] = 0x00;
+    data[6] = 0x01;
+    data[7] = 0xe0;
+    data[8] = 0x00;
+    data[9] = 0x00;
+  }
+}
+
+static gchar *
+generate_capture (guint n_packets, gboolean corrupt)
+{
+  GError *err = NULL;
+  GByteArray *array;
+  GRand *rand;
+  guint8 packet[PACKET_SIZE];
+  gchar *filename;
+  guint8 cc = 0;
+  guint i;
+  gint fd;
+
+  fd = g_file_open_tmp ("tsbench-XXXXXX.ts", &filename, &err);
+  if (fd < 0)
+    g_error ("Could not create temporary file: %s", err->message);
+  close (fd);
+
+  rand = g_rand_new_with_seed (0x47);
+  array = g_byte_array_sized_new (n_packets * PACKET_SIZE);
+
+  for (i = 0; i < n_packets; i++) {
+    if (i % 10 == 9) {
+      /* null packet */
+      write_packet (packet, 0x1fff, FALSE, 0);
+    } else {
+      write_packet (packet, 0x101, i % 500 == 0, cc++);
+    }
+
+    if (corrupt) {
+      /* flip a random bit in one packet out of 50, including the sync
+       * byte, and insert up to one packet of garbage every 200 packets */
+      if (g_rand_int_range (rand, 0, 50) == 0)
+        packet[g_rand_int_range (rand, 0, PACKET_SIZE)] ^=
+            1 << g_rand_int_range (rand, 0, 8);
+      if (g_rand_int_range (rand, 0, 200) == 0) {
+        guint8 garbage[PACKET_SIZE];
+        guint j, len = g_rand_int_range (rand, 1, PACKET_SIZE);
+
+        for (j = 0; j < len; j++)
+          garbage[j] = g_rand_int_range (rand, 0, 256);
+        g_byte_array_append (array, garbage, len);
+      }
+    }
+
+    g_byte_array_append (array, packet, PACKET_SIZE);
+  }
+
+  if (!g_file_set_contents (filename, (const gchar *) array->data, array->len,
+          &err))
+    g_error ("Could not write capture: %s", err->message);
+
+  g_byte_array_free (array, TRUE);
+  g_rand_free (rand);
+
+  return filename;
+}
+
+static void
+run_benchmark (const gchar * name, const gchar * filename)
+{
+  GstElement *pipeline, *src;
+  GstMessage *msg;
+  GstClockTime start, end;
+  GStatBuf st;
+  gdouble secs;
+  guint64 n_packets;
+
+  if (g_stat (filename, &st) < 0)
+    g_error ("Could not stat %s", filename);
+  n_packets = st.st_size / PACKET_SIZE;
+
+  pipeline = gst_parse_launch ("filesrc name=src blocksize=65536 ! "
+      "queue max-size-buffers=0 max-size-time=0 max-size-bytes=0 ! "
+      "tsparse ! fakesink", NULL);
+  g_assert (pipeline);
+
+  src = gst_bin_get_by_name (GST_BIN (pipeline), "src");
+  g_object_set (src, "location", filename, NULL);
+  gst_object_unref (src);
+
+  start = gst_util_get_timestamp ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  msg = gst_bus_poll (GST_ELEMENT_BUS (pipeline),
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR, GST_CLOCK_TIME_NONE);
+  end = gst_util_get_timestamp ();
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR)
+    g_printerr ("%s: pipeline error, results are not meaningful\n", name);
+  gst_message_unref (msg);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  secs = (gdouble) (end - start) / GST_SECOND;
+  g_print ("%-10s %10" G_GUINT64_FORMAT " packets in %8.3f s: %12.0f "
+      "packets/s (%.1f Mbit/s)\n", name, n_packets, secs, n_packets / secs,
+      n_packets * PACKET_SIZE * 8 / secs / 1000000.0);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  gchar *filename;
+  gint i;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1) {
+    for (i = 1; i < argc; i++)
+      run_benchmark (argv[i], argv[i]);
+    return 0;
+  }
+
+  filename = generate_capture (DEFAULT_N_PACKETS, FALSE);
+  run_benchmark ("clean", filename);
+  g_unlink (filename);
+  g_free (filename);
+
+  filename = generate_capture (DEFAULT_N_PACKETS, TRUE);
+  run_benchmark ("corrupted", filename);
+  g_unlink (filename);
+  g_free (filename);
+
+  return 0;
+}
@@ -0,0 +1,272 @@
+/* GStreamer
+ *
+ * scenechange.c: measure the frame analysis of the scenechange element
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Pushes synthetic 1080p and 4K I420 frames through scenechange with
+ * different subsample and threads settings and reports the time spent per
+ * frame, next to the time of the per-pixel loop the element used before.
+ * The frames are panned pictures with a cut every few frames, the number of
+ * detected scene changes is printed for each setting.
+ *
+ * The number of frames pushed per setting can be passed on the command
+ * line. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include "gstscenechange.h"
+#include "gstscenechangemeta.h"
+
+#define DEFAULT_N_FRAMES 200
+/* the pictures cycle through this many frames, with a cut in the middle */
+#define N_PICTURES 8
+
+typedef struct
+{
+  GstVideoInfo info;
+  guint8 *pictures[N_PICTURES];
+  guint n_changes;
+} Stream;
+
+static GstPadProbeReturn
+count_changes (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  Stream *stream = user_data;
+  GstSceneChangeMeta *meta;
+
+  meta = gst_buffer_get_scene_change_meta (GST_PAD_PROBE_INFO_BUFFER (info));
+  if (meta && meta->scene_change)
+    stream->n_changes++;
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* a smooth picture with some noise, panned by @offset pixels */
+static void
+fill_picture (Stream * stream, guint8 * data, guint seed, gint offset,
+    GRand * rand)
+{
+  GstVideoInfo *info = &stream->info;
+  gint x, y, width, height, stride;
+  guint8 *p;
+
+  width = GST_VIDEO_INFO_WIDTH (info);
+  height = GST_VIDEO_INFO_HEIGHT (info);
+  stride = GST_VIDEO_INFO_PLANE_STRIDE (info, 0);
+  for (y = 0; y < height; y++) {
+    p = data + y * stride;
+    for (x = 0; x < width; x++) {
+      gint v = ((x + offset) * seed / 7 + y * (seed + 3) / 5) % 220 + 16;
+
+      p[x] = v + g_rand_int_range (rand, 0, 8);
+    }
+  }
+
+  /* chroma doesn't matter */
+  for (y = 1; y < 3; y++) {
+    memset (data + GST_VIDEO_INFO_PLANE_OFFSET (info, y), 128,
+        GST_VIDEO_INFO_PLANE_STRIDE (info, y) *
+        GST_VIDEO_INFO_COMP_HEIGHT (info, y));
+  }
+}
+
+static void
+stream_init (Stream * stream, gint width, gint height)
+{
+  GRand *rand;
+  guint i;
+
+  gst_video_info_init (&stream->info);
+  gst_video_info_set_format (&stream->info, GST_VIDEO_FORMAT_I420, width,
+      height);
+
+  rand = g_rand_new_with_seed (0x5c);
+  for (i = 0; i < N_PICTURES; i++) {
+    stream->pictures[i] = g_malloc (GST_VIDEO_INFO_SIZE (&stream->info));
+    fill_picture (stream, stream->pictures[i], i < N_PICTURES / 2 ? 3 : 11,
+        i * 4, rand);
+  }
+  g_rand_free (rand);
+}
+
+static void
+stream_clear (Stream * stream)
+{
+  guint i;
+
+  for (i = 0; i < N_PICTURES; i++)
+    g_free (stream->pictures[i]);
+}
+
+/* the per-pixel loop scenechange used before, for comparison */
+static gdouble
+run_reference (Stream * stream, guint n_frames)
+{
+  GTimer *timer;
+  gint width, height, stride;
+  gdouble score = 0, elapsed;
+  guint n;
+
+  width = GST_VIDEO_INFO_WIDTH (&stream->info);
+  height = GST_VIDEO_INFO_HEIGHT (&stream->info);
+  stride = GST_VIDEO_INFO_PLANE_STRIDE (&stream->info, 0);
+
+  timer = g_timer_new ();
+  for (n = 1; n < n_frames; n++) {
+    const guint8 *f1 = stream->pictures[(n - 1) % N_PICTURES];
+    const guint8 *f2 = stream->pictures[n % N_PICTURES];
+    guint64 sad = 0;
+    gint i, j;
+
+    for (j = 0; j < height; j++) {
+      for (i = 0; i < width; i++)
+        sad += ABS (f1[j * stride + i] - f2[j * stride + i]);
+    }
+    score += (gdouble) sad / (width * height);
+  }
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  /* keeps the loop from being optimized away */
+  if (score < 0)
+    g_print ("%f\n", score);
+
+  return elapsed;
+}
+
+static gdouble
+run_element (Stream * stream, guint n_frames, gint subsample, guint threads)
+{
+  GstElement *pipeline, *scenechange, *sink;
+  GstPad *srcpad, *sinkpad;
+  GstSegment segment;
+  GstCaps *caps;
+  GTimer *timer;
+  gdouble elapsed;
+  guint n;
+
+  pipeline = gst_pipeline_new (NULL);
+  scenechange = gst_element_factory_make ("scenechange", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (scenechange, "subsample", subsample, "threads", threads, NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), scenechange, sink, NULL);
+  gst_element_link (scenechange, sink);
+
+  srcpad = gst_pad_new ("src", GST_PAD_SRC);
+  sinkpad = gst_element_get_static_pad (scenechange, "sink");
+  gst_pad_link (srcpad, sinkpad);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_object_unref (sinkpad);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER, count_changes, stream,
+      NULL);
+  gst_object_unref (sinkpad);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  caps = gst_video_info_to_caps (&stream->info);
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("scenechange"));
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  stream->n_changes = 0;
+  timer = g_timer_new ();
+  for (n = 0; n < n_frames; n++) {
+    GstBuffer *buf;
+
+    /* a new buffer each time, so that scenechange doesn't have to copy the
+     * picture to make it writable */
+    buf = gst_buffer_new_wrapped_full (0, stream->pictures[n % N_PICTURES],
+        GST_VIDEO_INFO_SIZE (&stream->info), 0,
+        GST_VIDEO_INFO_SIZE (&stream->info), NULL, NULL);
+    GST_BUFFER_PTS (buf) = n * GST_SECOND / 25;
+    if (gst_pad_push (srcpad, buf) != GST_FLOW_OK)
+      g_error ("Could not push frame %u", n);
+  }
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (srcpad);
+  gst_object_unref (pipeline);
+
+  return elapsed;
+}
+
+static void
+run_benchmark (const gchar * name, gint width, gint height, guint n_frames)
+{
+  static const gint subsamples[] = { 1, 2, 4 };
+  Stream stream;
+  gdouble secs;
+  guint i, threads;
+
+  stream_init (&stream, width, height);
+
+  g_print ("%s, %u frames\n", name, n_frames);
+  secs = run_reference (&stream, n_frames);
+  g_print ("  %-26s %8.3f ms per frame\n", "per-pixel loop:",
+      secs * 1000 / n_frames);
+
+  for (threads = 1; threads <= 4; threads *= 4) {
+    for (i = 0; i < G_N_ELEMENTS (subsamples); i++) {
+      gchar *label;
+
+      secs = run_element (&stream, n_frames, subsamples[i], threads);
+      label = g_strdup_printf ("subsample %d, %u threads:", subsamples[i],
+          threads);
+      g_print ("  %-26s %8.3f ms per frame, %u scene changes\n", label,
+          secs * 1000 / n_frames, stream.n_changes);
+      g_free (label);
+    }
+  }
+
+  stream_clear (&stream);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  guint n_frames = DEFAULT_N_FRAMES;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1)
+    n_frames = atoi (argv[1]);
+  if (n_frames < 2)
+    g_error ("usage: %s [frames]", argv[0]);
+
+  if (!gst_element_register (NULL, "scenechange", GST_RANK_NONE,
+          GST_TYPE_SCENE_CHANGE))
+    g_error ("Could not register scenechange");
+
+  run_benchmark ("1080p", 1920, 1080, n_frames);
+  run_benchmark ("2160p", 3840, 2160, n_frames);
+
+  return 0;
+}
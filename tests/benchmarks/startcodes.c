@@ -0,0 +1,153 @@
+/* GStreamer
+ *
+ * startcodes.c: measure the start code search of the codec parsers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Finds all the start codes of elementary streams (H.264, MPEG video,
+ * VC-1, MPEG-4 part 2) with gst_byte_reader_masked_scan_uint32(), which the
+ * parsers used before, and with scan_for_start_codes(), checks that both
+ * find the same ones and reports the throughput of each.
+ *
+ * Elementary streams can be passed on the command line, without arguments
+ * a synthetic stream with NALs of random sizes and content is used. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <gst/gst.h>
+#include <gst/base/gstbytereader.h>
+#include "startcode.h"
+
+#define DEFAULT_SIZE (64 * 1024 * 1024)
+#define N_RUNS 5
+
+static gint
+scan_byte_reader (const guint8 * data, guint size)
+{
+  GstByteReader br;
+
+  gst_byte_reader_init (&br, data, size);
+  return gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
+      0, size);
+}
+
+/* Returns the number of start codes in @data, and the best time of a few
+ * runs in @secs */
+static guint
+count_start_codes (const guint8 * data, gsize size,
+    gint (*scan) (const guint8 *, guint), gdouble * secs)
+{
+  GTimer *timer;
+  guint n = 0, run;
+
+  timer = g_timer_new ();
+  *secs = G_MAXDOUBLE;
+  for (run = 0; run < N_RUNS; run++) {
+    gsize offset = 0;
+    gint off;
+
+    n = 0;
+    g_timer_start (timer);
+    while ((off = scan (data + offset, size - offset)) >= 0) {
+      n++;
+      offset += off + 3;
+    }
+    *secs = MIN (*secs, g_timer_elapsed (timer, NULL));
+  }
+  g_timer_destroy (timer);
+
+  return n;
+}
+
+static void
+run_benchmark (const gchar * name, const guint8 * data, gsize size)
+{
+  gdouble ref_secs, secs;
+  guint ref_n, n;
+
+  ref_n = count_start_codes (data, size, scan_byte_reader, &ref_secs);
+  n = count_start_codes (data, size, scan_for_start_codes, &secs);
+  if (n != ref_n)
+    g_error ("%s: found %u start codes instead of %u", name, n, ref_n);
+
+  g_print ("%s: %" G_GSIZE_FORMAT " bytes, %u start codes\n", name, size, n);
+  g_print ("  byte reader: %8.3f GB/s\n", size / ref_secs / 1e9);
+  g_print ("  scanner:     %8.3f GB/s\n", size / secs / 1e9);
+}
+
+/* NALs of a few hundred bytes to a few hundred kilobytes, the payload has
+ * the emulation prevention bytes a real stream has */
+static guint8 *
+generate_stream (gsize size)
+{
+  GRand *rand;
+  guint8 *data;
+  gsize i = 0;
+
+  rand = g_rand_new_with_seed (0x264);
+  data = g_malloc (size);
+  while (i < size) {
+    gsize end = i + 4 + g_rand_int_range (rand, 200, 200000);
+    guint zeros = 0;
+
+    end = MIN (end, size);
+    for (; i < end; i++) {
+      /* 00 00 0x is escaped as 00 00 03 0x */
+      data[i] = zeros >= 2 ? 3 : g_rand_int_range (rand, 0, 256);
+      zeros = data[i] ? 0 : zeros + 1;
+    }
+    if (size - i >= 4) {
+      data[i++] = 0;
+      data[i++] = 0;
+      data[i++] = 1;
+      data[i++] = 0x65;
+    }
+  }
+  g_rand_free (rand);
+
+  return data;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  GError *err = NULL;
+  gchar *contents;
+  gsize size;
+  gint i;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1) {
+    for (i = 1; i < argc; i++) {
+      if (!g_file_get_contents (argv[i], &contents, &size, &err))
+        g_error ("Could not read %s: %s", argv[i], err->message);
+      run_benchmark (argv[i], (guint8 *) contents, size);
+      g_free (contents);
+    }
+    return 0;
+  }
+
+  contents = (gchar *) generate_stream (DEFAULT_SIZE);
+  run_benchmark ("synthetic", (guint8 *) contents, DEFAULT_SIZE);
+  g_free (contents);
+
+  return 0;
+}
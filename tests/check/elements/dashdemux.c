@@ -0,0 +1,389 @@
+/* GStreamer
+ *
+ * unit test for dashdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include <gst/base/gstpushsrc.h>
+
+#define TS_PACKET_SIZE 188
+#define SEGMENT_PACKETS 10
+#define N_SEGMENTS 20
+
+#define MANIFEST_URI "dashtest://test/manifest.mpd"
+#define URI_PREFIX "dashtest://test/"
+
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/dash+xml"));
+
+static GMutex test_lock;
+static GCond test_cond;
+
+/* live manifest, reloaded before each fragment download */
+static gchar *manifest;
+static gchar *updated_manifest;
+static const gchar *const *manifest_updates;
+static guint update_idx;
+static guint n_manifest_fetches;
+
+static gchar *
+create_manifest (const gchar * comment)
+{
+  GString *mpd;
+  guint i;
+
+  mpd = g_string_new ("<?xml version=\"1.0\"?>\n"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"dynamic\"\n"
+      "    minimumUpdatePeriod=\"PT0S\" mediaPresentationDuration=\"PT20S\"\n"
+      "    minBufferTime=\"PT1S\"\n"
+      "    profiles=\"urn:mpeg:dash:profile:isoff-live:2011\">\n"
+      "  <Period id=\"1\" start=\"PT0S\">\n"
+      "    <AdaptationSet mimeType=\"video/mp2t\">\n"
+      "      <Representation id=\"1\" bandwidth=\"100000\">\n"
+      "        <SegmentList duration=\"1\">\n");
+  for (i = 0; i < N_SEGMENTS; i++)
+    g_string_append_printf (mpd,
+        "          <SegmentURL media=\"seg%u.ts\"/>\n", i);
+  g_string_append_printf (mpd, "        </SegmentList>\n"
+      "      </Representation>\n"
+      "    </AdaptationSet>\n"
+      "  </Period>\n"
+      "  <!-- %s -->\n"
+      "</MPD>\n", comment);
+
+  return g_string_free (mpd, FALSE);
+}
+
+/* Source for the dashtest:// URIs: the manifest updates listed in
+ * manifest_updates (the last one is repeated) and segments made of MPEG-TS
+ * packets */
+typedef struct
+{
+  GstPushSrc parent;
+
+  gchar *uri;
+  gboolean done;
+} TestSrc;
+
+typedef GstPushSrcClass TestSrcClass;
+
+static GstStaticPadTemplate test_src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void test_src_uri_handler_init (gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestSrc, test_src, GST_TYPE_PUSH_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER, test_src_uri_handler_init));
+
+static gboolean
+test_src_start (GstBaseSrc * bsrc)
+{
+  ((TestSrc *) bsrc)->done = FALSE;
+
+  return TRUE;
+}
+
+static GstFlowReturn
+test_src_create (GstPushSrc * psrc, GstBuffer ** buf)
+{
+  TestSrc *src = (TestSrc *) psrc;
+
+  if (src->done)
+    return GST_FLOW_EOS;
+  src->done = TRUE;
+
+  if (strcmp (src->uri, MANIFEST_URI) == 0) {
+    const gchar *data;
+
+    g_mutex_lock (&test_lock);
+    data = manifest_updates[update_idx];
+    if (manifest_updates[update_idx + 1])
+      update_idx++;
+    n_manifest_fetches++;
+    g_cond_broadcast (&test_cond);
+    g_mutex_unlock (&test_lock);
+
+    *buf = gst_buffer_new_wrapped (g_strdup (data), strlen (data));
+  } else {
+    GstMapInfo map;
+    guint i;
+
+    *buf = gst_buffer_new_allocate (NULL, SEGMENT_PACKETS * TS_PACKET_SIZE,
+        NULL);
+    gst_buffer_map (*buf, &map, GST_MAP_WRITE);
+    memset (map.data, 0xff, map.size);
+    for (i = 0; i < SEGMENT_PACKETS; i++) {
+      guint8 *p = map.data + i * TS_PACKET_SIZE;
+
+      /* null packets */
+      p[0] = 0x47;
+      p[1] = 0x1f;
+      p[2] = 0xff;
+      p[3] = 0x10;
+    }
+    gst_buffer_unmap (*buf, &map);
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void
+test_src_finalize (GObject * object)
+{
+  g_free (((TestSrc *) object)->uri);
+
+  G_OBJECT_CLASS (test_src_parent_class)->finalize (object);
+}
+
+static void
+test_src_class_init (TestSrcClass * klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  G_OBJECT_CLASS (klass)->finalize = test_src_finalize;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&test_src_template));
+  gst_element_class_set_static_metadata (element_class, "DASH test source",
+      "Source", "Serves the test manifests and segments", "test");
+
+  GST_BASE_SRC_CLASS (klass)->start = test_src_start;
+  GST_PUSH_SRC_CLASS (klass)->create = test_src_create;
+}
+
+static void
+test_src_init (TestSrc * src)
+{
+}
+
+static GstURIType
+test_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+test_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "dashtest", NULL };
+
+  return protocols;
+}
+
+static gchar *
+test_src_uri_get_uri (GstURIHandler * handler)
+{
+  return g_strdup (((TestSrc *) handler)->uri);
+}
+
+static gboolean
+test_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  TestSrc *src = (TestSrc *) handler;
+
+  if (!g_str_has_prefix (uri, URI_PREFIX)) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid URI %s", uri);
+    return FALSE;
+  }
+
+  g_free (src->uri);
+  src->uri = g_strdup (uri);
+
+  return TRUE;
+}
+
+static void
+test_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = test_src_uri_get_type;
+  iface->get_protocols = test_src_uri_get_protocols;
+  iface->get_uri = test_src_uri_get_uri;
+  iface->set_uri = test_src_uri_set_uri;
+}
+
+static gboolean
+src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  if (GST_QUERY_TYPE (query) == GST_QUERY_URI) {
+    gst_query_set_uri (query, MANIFEST_URI);
+    return TRUE;
+  }
+
+  return gst_pad_query_default (pad, parent, query);
+}
+
+static GstFlowReturn
+sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static void
+pad_added (GstElement * demux, GstPad * pad, gpointer user_data)
+{
+  if (!gst_pad_is_linked (mysinkpad))
+    fail_unless_equals_int (gst_pad_link (pad, mysinkpad), GST_PAD_LINK_OK);
+}
+
+static GstElement *
+setup_dashdemux (const gchar * const *updates, GstBus * bus)
+{
+  GstElement *demux;
+
+  demux = gst_check_setup_element ("dashdemux");
+  gst_element_set_bus (demux, bus);
+  mysrcpad = gst_check_setup_src_pad (demux, &srctemplate);
+  gst_pad_set_query_function (mysrcpad, src_query);
+  mysinkpad = gst_pad_new_from_static_template (&sinktemplate, "sink");
+  gst_pad_set_chain_function (mysinkpad, sink_chain);
+  gst_pad_set_active (mysinkpad, TRUE);
+  g_signal_connect (demux, "pad-added", G_CALLBACK (pad_added), NULL);
+
+  manifest_updates = updates;
+  update_idx = 0;
+  n_manifest_fetches = 0;
+
+  gst_pad_set_active (mysrcpad, TRUE);
+  fail_unless (gst_element_set_state (demux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  return demux;
+}
+
+static void
+cleanup_dashdemux (GstElement * demux)
+{
+  gst_element_set_state (demux, GST_STATE_NULL);
+  gst_element_set_bus (demux, NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_check_teardown_src_pad (demux);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_object_unref (mysinkpad);
+  gst_check_teardown_element (demux);
+}
+
+static void
+push_manifest (const gchar * data)
+{
+  GstSegment segment;
+  GstCaps *caps;
+
+  fail_unless (gst_pad_push_event (mysrcpad,
+          gst_event_new_stream_start ("test")));
+  caps = gst_caps_new_empty_simple ("application/dash+xml");
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_caps (caps)));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_segment (&segment)));
+
+  fail_unless_equals_int (gst_pad_push (mysrcpad,
+          gst_buffer_new_wrapped (g_strdup (data), strlen (data))),
+      GST_FLOW_OK);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+}
+
+static void
+wait_for_manifest_fetches (guint n)
+{
+  g_mutex_lock (&test_lock);
+  while (n_manifest_fetches < n)
+    g_cond_wait (&test_cond, &test_lock);
+  g_mutex_unlock (&test_lock);
+}
+
+/* Each manifest that is actually used posts a duration message */
+static guint
+count_manifest_updates (GstBus * bus)
+{
+  GstMessage *msg;
+  guint n = 0;
+
+  while ((msg = gst_bus_pop_filtered (bus, GST_MESSAGE_DURATION_CHANGED))) {
+    n++;
+    gst_message_unref (msg);
+  }
+
+  return n;
+}
+
+GST_START_TEST (test_manifest_update_checksum)
+{
+  const gchar *updates[5];
+  GstElement *demux;
+  GstBus *bus;
+
+  /* The identical manifest is skipped, the invalid one must not be
+   * remembered: reloading the manifest in use after it is skipped as well.
+   * Only the changed manifest replaces the current one */
+  updates[0] = manifest;
+  updates[1] = "invalid manifest";
+  updates[2] = manifest;
+  updates[3] = updated_manifest;
+  updates[4] = NULL;
+
+  bus = gst_bus_new ();
+  demux = setup_dashdemux (updates, bus);
+  push_manifest (manifest);
+
+  /* the fifth fetch starts once the fourth update was handled */
+  wait_for_manifest_fetches (5);
+  fail_unless_equals_int (count_manifest_updates (bus), 1);
+
+  cleanup_dashdemux (demux);
+  gst_object_unref (bus);
+}
+
+GST_END_TEST;
+
+static Suite *
+dashdemux_suite (void)
+{
+  Suite *s = suite_create ("dashdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  gst_element_register (NULL, "dashtestsrc", GST_RANK_PRIMARY,
+      test_src_get_type ());
+  manifest = create_manifest ("first");
+  updated_manifest = create_manifest ("updated");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_manifest_update_checksum);
+
+  return s;
+}
+
+GST_CHECK_MAIN (dashdemux);
@@ -0,0 +1,347 @@
+/* GStreamer
+ *
+ * unit test for fieldanalysis
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <gst/check/gstcheck.h>
+#include <gst/video/video.h>
+
+#include "gstfieldanalysiscomb.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+#define N_FRAMES 12
+
+#define VIDEO_CAPS_STRING "video/x-raw, " \
+                          "format = (string) I420, " \
+                          "width = (int) 320, " \
+                          "height = (int) 240, " \
+                          "framerate = (fraction) 30000/1001"
+
+/* For ease of programming we use globals to keep refs for our floating
+ * src and sink pads we create; otherwise we always have to do get_pad,
+ * get_peer, and then remove references in every test function */
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS_STRING));
+
+/* the block scores of a row of blocks as the per-sample loops of the element
+ * computed them, @lines are the lines of the woven frame */
+static void
+reference_block_scores (FieldAnalysisCombMethod method, guint8 ** lines,
+    gint top, gint block_height, gint incr, gint width, gint block_width,
+    gint64 spatial_thresh, guint * block_scores)
+{
+  guint8 *comb_mask = g_malloc (width);
+  gint i, j;
+
+  for (j = top; j < top + block_height; j++) {
+    const guint8 *fjm2 = lines[j - 2], *fjm1 = lines[j - 1], *fj = lines[j];
+    const guint8 *fjp1 = lines[j + 1], *fjp2 = lines[j + 2];
+
+    for (i = 0; i < width; i++) {
+      const gint idx = i * incr;
+      const gint res_idx = (i - 1) / block_width;
+      gint diff1, diff2;
+
+      diff1 = fj[idx] - fjm1[idx];
+      diff2 = fj[idx] - fjp1[idx];
+      if ((diff1 > spatial_thresh && diff2 > spatial_thresh)
+          || (diff1 < -spatial_thresh && diff2 < -spatial_thresh)) {
+        if (method == METHOD_32DETECT) {
+          comb_mask[i] = abs (fj[idx] - fjm2[idx]) < 10
+              && abs (fj[idx] - fjm1[idx]) > 15;
+        } else if (method == METHOD_IS_COMBED) {
+          comb_mask[i] = (fjm1[idx] - fj[idx]) * (fjp1[idx] - fj[idx]) >
+              spatial_thresh * spatial_thresh;
+        } else {
+          comb_mask[i] = abs (fjm2[idx] + (fj[idx] << 2) + fjp2[idx] -
+              3 * (fjm1[idx] + fjp1[idx])) > 6 * spatial_thresh;
+        }
+      } else {
+        comb_mask[i] = FALSE;
+      }
+
+      if (i == 0)
+        continue;
+
+      if (i == 1 && comb_mask[i - 1] && comb_mask[i]) {
+        /* left edge */
+        block_scores[res_idx]++;
+      } else if (i == width - 1) {
+        /* right edge */
+        if ((i < 2 || comb_mask[i - 2]) && comb_mask[i - 1] && comb_mask[i])
+          block_scores[res_idx]++;
+        if (comb_mask[i - 1] && comb_mask[i])
+          block_scores[i / block_width]++;
+      } else if (i >= 2 && comb_mask[i - 2] && comb_mask[i - 1]
+          && comb_mask[i]) {
+        block_scores[res_idx]++;
+      }
+    }
+  }
+
+  g_free (comb_mask);
+}
+
+GST_START_TEST (test_comb_kernels)
+{
+  static const gint block_widths[] = { 4, 5, 13, 16, 32 };
+  static const gint64 thresholds[] = { 0, 3, 9, 20, 255, 300, 100000 };
+  GRand *rand;
+  gint iter;
+
+  rand = g_rand_new_with_seed (0xf1e1d);
+  for (iter = 0; iter < 3000; iter++) {
+    const FieldAnalysisCombMethod method = iter % 3;
+    const gint incr = 1 + (iter / 3) % 2;
+    const gint block_width =
+        block_widths[g_rand_int_range (rand, 0, G_N_ELEMENTS (block_widths))];
+    const gint n_blocks = g_rand_int_range (rand, 1, 7);
+    const gint width = n_blocks * block_width;
+    const gint block_height = g_rand_int_range (rand, 1, 9);
+    const gint64 spatial_thresh =
+        thresholds[g_rand_int_range (rand, 0, G_N_ELEMENTS (thresholds))];
+    const gint style = g_rand_int_range (rand, 0, 3);
+    guint expected[6] = { 0, }, scores[6] = { 0, };
+    guint8 *lines[12], *comb_mask;
+    gint i, y;
+
+    for (y = 0; y < block_height + 4; y++) {
+      lines[y] = g_malloc (width * incr);
+      for (i = 0; i < width * incr; i++) {
+        if (style == 0) {
+          lines[y][i] = g_rand_int_range (rand, 0, 256);
+        } else if (style == 1) {
+          /* strongly combed */
+          lines[y][i] = (y & 1) ? g_rand_int_range (rand, 200, 220) :
+              g_rand_int_range (rand, 20, 40);
+        } else {
+          /* weakly combed, similar lines in each field */
+          lines[y][i] = (y & 1) ? g_rand_int_range (rand, 100, 130) :
+              g_rand_int_range (rand, 60, 68);
+        }
+      }
+    }
+    comb_mask = g_malloc (width + 2);
+
+    reference_block_scores (method, lines, 2, block_height, incr, width,
+        block_width, spatial_thresh, expected);
+    for (y = 2; y < block_height + 2; y++) {
+      const guint8 *const row[5] = { lines[y - 2], lines[y - 1], lines[y],
+        lines[y + 1], lines[y + 2]
+      };
+
+      fieldanalysis_comb_mask_row (method, comb_mask, row, incr, width,
+          spatial_thresh);
+      fieldanalysis_comb_score_row (scores, comb_mask, width, block_width);
+    }
+
+    for (i = 0; i < n_blocks; i++) {
+      fail_unless_equals_int (scores[i], expected[i]);
+    }
+
+    g_free (comb_mask);
+    for (y = 0; y < block_height + 4; y++)
+      g_free (lines[y]);
+  }
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+/* vertical bars moving to the right by @speed pixels per field, the bottom
+ * field is a field later than the top field when @interlaced is set */
+static GstBuffer *
+create_frame (GstVideoInfo * info, gint n, gint speed, gboolean interlaced)
+{
+  GstVideoFrame frame;
+  GstBuffer *buf;
+  gint x, y;
+
+  buf = gst_buffer_new_and_alloc (GST_VIDEO_INFO_SIZE (info));
+  fail_unless (gst_video_frame_map (&frame, info, buf, GST_MAP_WRITE));
+
+  for (y = 0; y < HEIGHT; y++) {
+    guint8 *line = GST_VIDEO_FRAME_COMP_DATA (&frame, 0) +
+        y * GST_VIDEO_FRAME_COMP_STRIDE (&frame, 0);
+    gint shift = speed * (2 * n + (interlaced && (y & 1)));
+
+    for (x = 0; x < WIDTH; x++)
+      line[x] = ((x + shift) / 12) % 2 ? 200 : 40;
+  }
+  for (y = 1; y < 3; y++) {
+    memset (GST_VIDEO_FRAME_COMP_DATA (&frame, y), 128,
+        GST_VIDEO_FRAME_COMP_STRIDE (&frame, y) *
+        GST_VIDEO_FRAME_COMP_HEIGHT (&frame, y));
+  }
+  gst_video_frame_unmap (&frame);
+
+  GST_BUFFER_PTS (buf) = gst_util_uint64_scale (n, GST_SECOND * 1001, 30000);
+  GST_BUFFER_DURATION (buf) = gst_util_uint64_scale (1, GST_SECOND * 1001,
+      30000);
+
+  return buf;
+}
+
+#define BUFFER_FLAGS (GST_VIDEO_BUFFER_FLAG_INTERLACED | \
+    GST_VIDEO_BUFFER_FLAG_TFF | GST_VIDEO_BUFFER_FLAG_RFF | \
+    GST_VIDEO_BUFFER_FLAG_ONEFIELD)
+
+/* returns the flags of the output buffers */
+static GArray *
+analyse_frames (const gchar * frame_metric, const gchar * comb_method,
+    guint threads, gint speed, gboolean interlaced)
+{
+  GstElement *fieldanalysis;
+  GstVideoInfo info;
+  GstCaps *caps;
+  GArray *flags;
+  GList *l;
+  gint n;
+
+  fieldanalysis = gst_check_setup_element ("fieldanalysis");
+  g_object_set (fieldanalysis, "threads", threads, NULL);
+  gst_util_set_object_arg (G_OBJECT (fieldanalysis), "frame-metric",
+      frame_metric);
+  gst_util_set_object_arg (G_OBJECT (fieldanalysis), "comb-method",
+      comb_method);
+  mysrcpad = gst_check_setup_src_pad (fieldanalysis, &srctemplate);
+  mysinkpad = gst_check_setup_sink_pad (fieldanalysis, &sinktemplate);
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+
+  fail_unless (gst_element_set_state (fieldanalysis,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_check_setup_events (mysrcpad, fieldanalysis, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  for (n = 0; n < N_FRAMES; n++) {
+    fail_unless_equals_int (gst_pad_push (mysrcpad, create_frame (&info, n,
+                speed, interlaced)), GST_FLOW_OK);
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  flags = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (l = buffers; l; l = l->next) {
+    guint f = GST_BUFFER_FLAGS (l->data) & BUFFER_FLAGS;
+
+    g_array_append_val (flags, f);
+  }
+  gst_check_drop_buffers ();
+
+  gst_element_set_state (fieldanalysis, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_teardown_src_pad (fieldanalysis);
+  gst_check_teardown_sink_pad (fieldanalysis);
+  gst_check_teardown_element (fieldanalysis);
+
+  return flags;
+}
+
+static guint
+count_interlaced (GArray * flags)
+{
+  guint i, n = 0;
+
+  for (i = 0; i < flags->len; i++) {
+    if (g_array_index (flags, guint, i) & GST_VIDEO_BUFFER_FLAG_INTERLACED)
+      n++;
+  }
+
+  return n;
+}
+
+/* the decisions don't depend on the number of threads computing the metrics */
+static void
+check_threads (const gchar * frame_metric, const gchar * comb_method)
+{
+  gint speed;
+
+  /* the bars need to move by a few pixels per field for the combs to be wide
+   * enough for the windowed comb detection */
+  for (speed = 0; speed <= 8; speed += 4) {
+    GArray *single, *multi;
+    guint i;
+
+    single = analyse_frames (frame_metric, comb_method, 1, speed, speed > 0);
+    multi = analyse_frames (frame_metric, comb_method, 4, speed, speed > 0);
+
+    fail_unless_equals_int (multi->len, single->len);
+    for (i = 0; i < single->len; i++) {
+      fail_unless_equals_int (g_array_index (multi, guint, i),
+          g_array_index (single, guint, i));
+    }
+
+    /* still progressive frames are never flagged as interlaced, moving
+     * interlaced ones are */
+    if (speed == 0)
+      fail_unless_equals_int (count_interlaced (single), 0);
+    else
+      fail_unless (count_interlaced (single) > 0);
+
+    g_array_unref (single);
+    g_array_unref (multi);
+  }
+}
+
+GST_START_TEST (test_threads_5_tap)
+{
+  check_threads ("5-tap", "5-tap");
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_threads_windowed_comb)
+{
+  check_threads ("windowed-comb", "32-detect");
+  check_threads ("windowed-comb", "isCombed");
+  check_threads ("windowed-comb", "5-tap");
+}
+
+GST_END_TEST;
+
+static Suite *
+fieldanalysis_suite (void)
+{
+  Suite *s = suite_create ("fieldanalysis");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_comb_kernels);
+  tcase_add_test (tc_chain, test_threads_5_tap);
+  tcase_add_test (tc_chain, test_threads_windowed_comb);
+
+  return s;
+}
+
+GST_CHECK_MAIN (fieldanalysis);
@@ -348,6 +348,80 @@ h264parse_packetized_suite (void)
   return s;
 }
 
+/* byte-stream to avc conversion should share the NAL payloads of the input
+ * in the output instead of copying them */
+GST_START_TEST (test_parse_convert_shared)
+{
+  GstElement *h264parse;
+  GstPad *srcpad, *sinkpad;
+  GstBuffer *buf;
+  GstCaps *caps;
+  GstSegment segment;
+  guint8 *data, len[4];
+  gsize size;
+
+  h264parse = gst_check_setup_element ("h264parse");
+  srcpad = gst_check_setup_src_pad (h264parse, &srctemplate);
+  sinkpad = gst_check_setup_sink_pad (h264parse, &sinktemplate_avc_au);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_pad_set_active (sinkpad, TRUE);
+  fail_unless_equals_int (gst_element_set_state (h264parse, GST_STATE_PLAYING),
+      GST_STATE_CHANGE_SUCCESS);
+
+  fail_unless (gst_pad_push_event (srcpad,
+          gst_event_new_stream_start ("test")));
+  caps = gst_caps_from_string (SRC_CAPS_TMPL);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_caps (caps)));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+
+  size = sizeof (h264_sps) + sizeof (h264_pps) + sizeof (h264_idrframe);
+  data = g_malloc (size);
+  memcpy (data, h264_sps, sizeof (h264_sps));
+  memcpy (data + sizeof (h264_sps), h264_pps, sizeof (h264_pps));
+  memcpy (data + sizeof (h264_sps) + sizeof (h264_pps), h264_idrframe,
+      sizeof (h264_idrframe));
+  buf = gst_buffer_new_wrapped (data, size);
+  fail_unless_equals_int (gst_pad_push (srcpad, buf), GST_FLOW_OK);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_eos ()));
+
+  fail_unless (buffers != NULL);
+  buf = GST_BUFFER (g_list_last (buffers)->data);
+  fail_unless (gst_buffer_n_memory (buf) > 1);
+
+  /* the frame is last, with its length instead of the start code */
+  size = gst_buffer_get_size (buf);
+  fail_unless (size > sizeof (h264_idrframe));
+  gst_buffer_extract (buf, size - sizeof (h264_idrframe), len, 4);
+  fail_unless_equals_int (GST_READ_UINT32_BE (len),
+      sizeof (h264_idrframe) - 4);
+  fail_unless (gst_buffer_memcmp (buf, size - sizeof (h264_idrframe) + 4,
+          h264_idrframe + 4, sizeof (h264_idrframe) - 4) == 0);
+
+  gst_check_drop_buffers ();
+  gst_element_set_state (h264parse, GST_STATE_NULL);
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_check_teardown_src_pad (h264parse);
+  gst_check_teardown_sink_pad (h264parse);
+  gst_check_teardown_element (h264parse);
+}
+
+GST_END_TEST;
+
+static Suite *
+h264parse_convert_suite (void)
+{
+  Suite *s = suite_create ("h264parse_convert");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_parse_convert_shared);
+
+  return s;
+}
+
 
 /*
  * TODO:
@@ -438,5 +512,11 @@ main (int argc, char **argv)
   nf += srunner_ntests_failed (sr);
   srunner_free (sr);
 
+  s = h264parse_convert_suite ();
+  sr = srunner_create (s);
+  srunner_run_all (sr, CK_NORMAL);
+  nf += srunner_ntests_failed (sr);
+  srunner_free (sr);
+
   return nf;
 }
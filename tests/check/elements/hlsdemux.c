@@ -0,0 +1,597 @@
+/* GStreamer
+ *
+ * unit test for hlsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include <gst/base/gstpushsrc.h>
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+
+#define BLOCK_SIZE 4096
+#define MAX_FRAGMENTS 4
+
+/* hlsdemux queues at most 2 MB of downloaded data, add the buffers held
+ * between the source and the sink */
+#define MAX_QUEUED_SIZE (2 * 1024 * 1024 + 4 * BLOCK_SIZE)
+
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-hls"));
+
+static GMutex test_lock;
+static GCond test_cond;
+
+/* served fragments */
+static guint64 fragment_size;
+static gint fail_fragment;
+static guint64 fail_after;
+static guint attempts[MAX_FRAGMENTS];
+static guint64 bytes_served;
+static gsize chunk_size;
+
+/* AES-128 encryption of the fragments */
+static const guint8 test_key[16] = {
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+  0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+
+static const guint8 test_iv[16] = {
+  0x0f, 0x0e, 0x0d, 0x0c, 0x0b, 0x0a, 0x09, 0x08,
+  0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 0x00
+};
+
+static guint8 *encrypted[MAX_FRAGMENTS];
+static gsize encrypted_size;
+
+/* output */
+static gboolean gate_closed;
+static gboolean got_eos;
+static gboolean data_ok;
+static guint64 n_out_bytes;
+
+/* Fragments start with a magic for typefinding, followed by a pattern
+ * depending on the fragment so that misplaced data is detected */
+static guint8
+fragment_byte (guint fragment, guint64 offset)
+{
+  if (offset < 4)
+    return "HLST"[offset];
+
+  return (fragment * 31 + offset) & 0xff;
+}
+
+static void
+test_type_find (GstTypeFind * tf, gpointer user_data)
+{
+  const guint8 *data = gst_type_find_peek (tf, 0, 4);
+
+  if (data && memcmp (data, "HLST", 4) == 0)
+    gst_type_find_suggest_simple (tf, GST_TYPE_FIND_MAXIMUM,
+        "application/x-hls-test", NULL);
+}
+
+/* Encrypts the fragments with AES-128 in CBC mode and PKCS#7 padding, as
+ * served when the playlist has an EXT-X-KEY */
+static void
+encrypt_fragments (void)
+{
+  gnutls_cipher_hd_t aes_ctx;
+  gnutls_datum_t key_d, iv_d;
+  guint8 padding;
+  guint i;
+  gsize j;
+
+  padding = 16 - fragment_size % 16;
+  encrypted_size = fragment_size + padding;
+
+  for (i = 0; i < MAX_FRAGMENTS; i++) {
+    encrypted[i] = g_malloc (encrypted_size);
+    for (j = 0; j < fragment_size; j++)
+      encrypted[i][j] = fragment_byte (i, j);
+    memset (encrypted[i] + fragment_size, padding, padding);
+
+    key_d.data = (guint8 *) test_key;
+    key_d.size = sizeof (test_key);
+    iv_d.data = (guint8 *) test_iv;
+    iv_d.size = sizeof (test_iv);
+    fail_unless_equals_int (gnutls_cipher_init (&aes_ctx,
+            GNUTLS_CIPHER_AES_128_CBC, &key_d, &iv_d), 0);
+    fail_unless_equals_int (gnutls_cipher_encrypt (aes_ctx, encrypted[i],
+            encrypted_size), 0);
+    gnutls_cipher_deinit (aes_ctx);
+  }
+}
+
+static void
+free_encrypted_fragments (void)
+{
+  guint i;
+
+  for (i = 0; i < MAX_FRAGMENTS; i++) {
+    g_free (encrypted[i]);
+    encrypted[i] = NULL;
+  }
+}
+
+/* Source for the hlstest://fragment/<n> and hlstest://key URIs of the test
+ * playlists. When fail_fragment is set, the first download of that
+ * fragment fails after fail_after bytes */
+typedef struct
+{
+  GstPushSrc parent;
+
+  gboolean key;
+  guint fragment;
+  guint64 offset;
+} TestSrc;
+
+typedef GstPushSrcClass TestSrcClass;
+
+static GstStaticPadTemplate test_src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void test_src_uri_handler_init (gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestSrc, test_src, GST_TYPE_PUSH_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER, test_src_uri_handler_init));
+
+static gboolean
+test_src_start (GstBaseSrc * bsrc)
+{
+  TestSrc *src = (TestSrc *) bsrc;
+
+  src->offset = 0;
+  if (src->key)
+    return TRUE;
+
+  g_mutex_lock (&test_lock);
+  attempts[src->fragment]++;
+  g_mutex_unlock (&test_lock);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+test_src_create (GstPushSrc * psrc, GstBuffer ** buf)
+{
+  TestSrc *src = (TestSrc *) psrc;
+  GstMapInfo map;
+  gboolean fail;
+  guint64 total;
+  gsize size, i;
+
+  if (src->key)
+    total = sizeof (test_key);
+  else if (encrypted[src->fragment])
+    total = encrypted_size;
+  else
+    total = fragment_size;
+
+  if (src->offset >= total)
+    return GST_FLOW_EOS;
+
+  g_mutex_lock (&test_lock);
+  fail = !src->key && src->fragment == fail_fragment
+      && attempts[src->fragment] == 1 && src->offset >= fail_after;
+  g_mutex_unlock (&test_lock);
+
+  if (fail) {
+    GST_ELEMENT_ERROR (src, RESOURCE, READ, (NULL), ("simulated failure"));
+    return GST_FLOW_ERROR;
+  }
+
+  size = MIN (chunk_size, total - src->offset);
+  *buf = gst_buffer_new_allocate (NULL, size, NULL);
+  gst_buffer_map (*buf, &map, GST_MAP_WRITE);
+  if (src->key)
+    memcpy (map.data, test_key + src->offset, size);
+  else if (encrypted[src->fragment])
+    memcpy (map.data, encrypted[src->fragment] + src->offset, size);
+  else
+    for (i = 0; i < size; i++)
+      map.data[i] = fragment_byte (src->fragment, src->offset + i);
+  gst_buffer_unmap (*buf, &map);
+  src->offset += size;
+
+  if (src->key)
+    return GST_FLOW_OK;
+
+  g_mutex_lock (&test_lock);
+  bytes_served += size;
+  g_mutex_unlock (&test_lock);
+
+  return GST_FLOW_OK;
+}
+
+static void
+test_src_class_init (TestSrcClass * klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&test_src_template));
+  gst_element_class_set_static_metadata (element_class, "HLS test source",
+      "Source", "Serves the fragments of the test playlists", "test");
+
+  GST_BASE_SRC_CLASS (klass)->start = test_src_start;
+  GST_PUSH_SRC_CLASS (klass)->create = test_src_create;
+}
+
+static void
+test_src_init (TestSrc * src)
+{
+}
+
+static GstURIType
+test_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+test_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "hlstest", NULL };
+
+  return protocols;
+}
+
+static gchar *
+test_src_uri_get_uri (GstURIHandler * handler)
+{
+  TestSrc *src = (TestSrc *) handler;
+
+  if (src->key)
+    return g_strdup ("hlstest://key");
+
+  return g_strdup_printf ("hlstest://fragment/%u", src->fragment);
+}
+
+static gboolean
+test_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  TestSrc *src = (TestSrc *) handler;
+
+  src->key = (strcmp (uri, "hlstest://key") == 0);
+  if (src->key)
+    return TRUE;
+
+  if (sscanf (uri, "hlstest://fragment/%u", &src->fragment) != 1
+      || src->fragment >= MAX_FRAGMENTS) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid URI %s", uri);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+test_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = test_src_uri_get_type;
+  iface->get_protocols = test_src_uri_get_protocols;
+  iface->get_uri = test_src_uri_get_uri;
+  iface->set_uri = test_src_uri_set_uri;
+}
+
+static GstFlowReturn
+sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstMapInfo map;
+  gsize i;
+
+  g_mutex_lock (&test_lock);
+  while (gate_closed)
+    g_cond_wait (&test_cond, &test_lock);
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  for (i = 0; i < map.size; i++) {
+    guint64 pos = n_out_bytes + i;
+
+    if (map.data[i] != fragment_byte (pos / fragment_size,
+            pos % fragment_size))
+      data_ok = FALSE;
+  }
+  n_out_bytes += map.size;
+  gst_buffer_unmap (buffer, &map);
+  g_mutex_unlock (&test_lock);
+
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+    g_mutex_lock (&test_lock);
+    got_eos = TRUE;
+    g_cond_broadcast (&test_cond);
+    g_mutex_unlock (&test_lock);
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static void
+pad_added (GstElement * demux, GstPad * pad, gpointer user_data)
+{
+  fail_unless_equals_int (gst_pad_link (pad, mysinkpad), GST_PAD_LINK_OK);
+}
+
+static GstElement *
+setup_hlsdemux (guint64 size)
+{
+  GstElement *demux;
+
+  demux = gst_check_setup_element ("hlsdemux");
+  g_object_set (demux, "progressive", TRUE, "fragments-cache", 2,
+      "fragments-in-flight", 1, NULL);
+  mysrcpad = gst_check_setup_src_pad (demux, &srctemplate);
+  mysinkpad = gst_pad_new_from_static_template (&sinktemplate, "sink");
+  gst_pad_set_chain_function (mysinkpad, sink_chain);
+  gst_pad_set_event_function (mysinkpad, sink_event);
+  gst_pad_set_active (mysinkpad, TRUE);
+  g_signal_connect (demux, "pad-added", G_CALLBACK (pad_added), NULL);
+
+  fragment_size = size;
+  fail_fragment = -1;
+  fail_after = 0;
+  memset (attempts, 0, sizeof (attempts));
+  bytes_served = 0;
+  chunk_size = BLOCK_SIZE;
+  gate_closed = FALSE;
+  got_eos = FALSE;
+  data_ok = TRUE;
+  n_out_bytes = 0;
+
+  gst_pad_set_active (mysrcpad, TRUE);
+  fail_unless (gst_element_set_state (demux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  return demux;
+}
+
+static void
+cleanup_hlsdemux (GstElement * demux)
+{
+  gst_element_set_state (demux, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_check_teardown_src_pad (demux);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_object_unref (mysinkpad);
+  gst_check_teardown_element (demux);
+  free_encrypted_fragments ();
+}
+
+/* Pushes a VOD playlist with @n_fragments fragments, encrypted ones if
+ * encrypt_fragments() was called */
+static void
+push_playlist (guint n_fragments)
+{
+  GString *playlist;
+  GstSegment segment;
+  GstBuffer *buffer;
+  GstCaps *caps;
+  gsize size;
+  guint i;
+
+  playlist = g_string_new ("#EXTM3U\n#EXT-X-TARGETDURATION:1\n");
+  if (encrypted[0]) {
+    g_string_append (playlist,
+        "#EXT-X-KEY:METHOD=AES-128,URI=\"hlstest://key\",IV=0x");
+    for (i = 0; i < sizeof (test_iv); i++)
+      g_string_append_printf (playlist, "%02x", test_iv[i]);
+    g_string_append (playlist, "\n");
+  }
+  for (i = 0; i < n_fragments; i++)
+    g_string_append_printf (playlist, "#EXTINF:1,\nhlstest://fragment/%u\n",
+        i);
+  g_string_append (playlist, "#EXT-X-ENDLIST\n");
+
+  fail_unless (gst_pad_push_event (mysrcpad,
+          gst_event_new_stream_start ("test")));
+  caps = gst_caps_new_empty_simple ("application/x-hls");
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_caps (caps)));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_segment (&segment)));
+
+  size = playlist->len;
+  buffer = gst_buffer_new_wrapped (g_string_free (playlist, FALSE), size);
+  fail_unless_equals_int (gst_pad_push (mysrcpad, buffer), GST_FLOW_OK);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+}
+
+static void
+wait_for_eos (void)
+{
+  g_mutex_lock (&test_lock);
+  while (!got_eos)
+    g_cond_wait (&test_cond, &test_lock);
+  g_mutex_unlock (&test_lock);
+}
+
+/* Waits until the source stopped producing data */
+static guint64
+wait_for_download_stall (void)
+{
+  guint64 served, last = 0;
+  guint stable = 0, i;
+
+  for (i = 0; i < 200 && stable < 5; i++) {
+    g_usleep (20 * G_TIME_SPAN_MILLISECOND);
+    g_mutex_lock (&test_lock);
+    served = bytes_served;
+    g_mutex_unlock (&test_lock);
+    if (served == last)
+      stable++;
+    else
+      stable = 0;
+    last = served;
+  }
+
+  return last;
+}
+
+GST_START_TEST (test_progressive)
+{
+  GstElement *demux;
+
+  demux = setup_hlsdemux (100000);
+  push_playlist (3);
+  wait_for_eos ();
+
+  fail_unless_equals_uint64 (n_out_bytes, 3 * 100000);
+  fail_unless (data_ok);
+  fail_unless_equals_int (attempts[0], 1);
+  fail_unless_equals_int (attempts[1], 1);
+  fail_unless_equals_int (attempts[2], 1);
+
+  cleanup_hlsdemux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_progressive_queue_limit)
+{
+  GstElement *demux;
+  guint64 served;
+
+  demux = setup_hlsdemux (8 * 1024 * 1024);
+  gate_closed = TRUE;
+  push_playlist (2);
+
+  /* nothing is pushed downstream, the download has to stop once the queue
+   * is full */
+  served = wait_for_download_stall ();
+  fail_unless (served > 0);
+  fail_unless (served <= MAX_QUEUED_SIZE,
+      "%" G_GUINT64_FORMAT " bytes downloaded while downstream is blocked",
+      served);
+
+  g_mutex_lock (&test_lock);
+  gate_closed = FALSE;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+  wait_for_eos ();
+
+  fail_unless_equals_uint64 (n_out_bytes, 2 * 8 * 1024 * 1024);
+  fail_unless (data_ok);
+
+  cleanup_hlsdemux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_progressive_resume)
+{
+  GstElement *demux;
+
+  demux = setup_hlsdemux (100000);
+  /* the first two fragments are cached at startup, where failures are
+   * fatal, so the third one fails after part of it was pushed */
+  fail_fragment = 2;
+  fail_after = 10 * BLOCK_SIZE;
+  push_playlist (3);
+  wait_for_eos ();
+
+  /* the fragment was downloaded again and only the rest of it was pushed */
+  fail_unless_equals_int (attempts[2], 2);
+  fail_unless_equals_uint64 (n_out_bytes, 3 * 100000);
+  fail_unless (data_ok);
+
+  cleanup_hlsdemux (demux);
+}
+
+GST_END_TEST;
+
+/* The encrypted data arrives in chunks that are not a multiple of the AES
+ * block size, the decryption carries the partial blocks over, holds the
+ * last block back until the end of the fragment and removes the padding */
+static void
+check_encrypted (guint64 size)
+{
+  GstElement *demux;
+
+  demux = setup_hlsdemux (size);
+  chunk_size = 1000;
+  encrypt_fragments ();
+  push_playlist (3);
+  wait_for_eos ();
+
+  fail_unless_equals_uint64 (n_out_bytes, 3 * size);
+  fail_unless (data_ok);
+
+  cleanup_hlsdemux (demux);
+}
+
+GST_START_TEST (test_progressive_encrypted)
+{
+  /* padded with 13 bytes */
+  check_encrypted (100003);
+  /* a multiple of the block size is padded with a whole block */
+  check_encrypted (100000);
+  /* a fragment smaller than a chunk */
+  check_encrypted (100);
+}
+
+GST_END_TEST;
+
+static Suite *
+hlsdemux_suite (void)
+{
+  Suite *s = suite_create ("hlsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  gst_element_register (NULL, "hlstestsrc", GST_RANK_PRIMARY,
+      test_src_get_type ());
+  gst_type_find_register (NULL, "application/x-hls-test",
+      GST_RANK_PRIMARY + 1, test_type_find, NULL, NULL, NULL, NULL);
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_progressive);
+  tcase_add_test (tc_chain, test_progressive_queue_limit);
+  tcase_add_test (tc_chain, test_progressive_resume);
+  tcase_add_test (tc_chain, test_progressive_encrypted);
+
+  return s;
+}
+
+GST_CHECK_MAIN (hlsdemux);
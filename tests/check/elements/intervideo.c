@@ -0,0 +1,265 @@
+/* GStreamer
+ *
+ * unit test for intervideosink and intervideosrc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/base/gstbasesrc.h>
+
+#define VIDEO_CAPS_STRING "video/x-raw, format=(string)I420, " \
+    "width=(int)16, height=(int)16, framerate=(fraction)30/1"
+#define FRAME_SIZE (16 * 16 * 3 / 2)
+
+/* frames kept by the surface for its sources */
+#define SLOTS 8
+
+static GstPad *mysrcpad;
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS_STRING));
+
+static GstElement *
+setup_intervideosink (const gchar * channel)
+{
+  GstElement *sink;
+  GstCaps *caps;
+
+  sink = gst_check_setup_element ("intervideosink");
+  g_object_set (sink, "channel", channel, "sync", FALSE, NULL);
+  mysrcpad = gst_check_setup_src_pad (sink, &srctemplate);
+  gst_pad_set_active (mysrcpad, TRUE);
+  fail_unless (gst_element_set_state (sink,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, sink, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  return sink;
+}
+
+static void
+cleanup_intervideosink (GstElement * sink)
+{
+  gst_element_set_state (sink, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_check_teardown_src_pad (sink);
+  gst_check_teardown_element (sink);
+}
+
+/* The sources are live, so their streaming thread does not produce any
+ * frame in PAUSED and the test calls create() itself */
+static GstElement *
+setup_intervideosrc (const gchar * channel, gboolean all_frames,
+    gboolean wait_for_frame)
+{
+  GstElement *src;
+  GstCaps *caps;
+  gint i;
+
+  src = gst_check_setup_element ("intervideosrc");
+  g_object_set (src, "channel", channel, "all-frames", all_frames,
+      "wait-for-frame", wait_for_frame, NULL);
+  fail_unless_equals_int (gst_element_set_state (src, GST_STATE_PAUSED),
+      GST_STATE_CHANGE_NO_PREROLL);
+
+  /* wait for the caps the black frames are made for */
+  for (i = 0; i < 100; i++) {
+    caps = gst_pad_get_current_caps (GST_BASE_SRC_PAD (src));
+    if (caps)
+      break;
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+  }
+  fail_unless (caps != NULL);
+  gst_caps_unref (caps);
+
+  return src;
+}
+
+static void
+cleanup_intervideosrc (GstElement * src)
+{
+  gst_element_set_state (src, GST_STATE_NULL);
+  gst_check_teardown_element (src);
+}
+
+/* renders a frame starting with @id */
+static void
+push_frame (guint8 id)
+{
+  GstBuffer *buffer;
+
+  buffer = gst_buffer_new_and_alloc (FRAME_SIZE);
+  gst_buffer_memset (buffer, 0, 0, FRAME_SIZE);
+  gst_buffer_memset (buffer, 0, id, 1);
+  fail_unless_equals_int (gst_pad_push (mysrcpad, buffer), GST_FLOW_OK);
+}
+
+static GstFlowReturn
+create_frame (GstElement * src, GstBuffer ** buffer)
+{
+  GstBaseSrc *basesrc = GST_BASE_SRC (src);
+
+  *buffer = NULL;
+  return GST_BASE_SRC_GET_CLASS (basesrc)->create (basesrc, 0, 0, buffer);
+}
+
+/* Gets the next frame of @src and checks that it is the frame @id */
+static void
+check_frame (GstElement * src, guint8 id)
+{
+  GstBuffer *buffer;
+  guint8 data;
+
+  fail_unless_equals_int (create_frame (src, &buffer), GST_FLOW_OK);
+  fail_unless_equals_int (gst_buffer_get_size (buffer), FRAME_SIZE);
+  gst_buffer_extract (buffer, 0, &data, 1);
+  fail_unless_equals_int (data, id);
+  gst_buffer_unref (buffer);
+}
+
+static void
+check_counters (GstElement * src, guint64 drop, guint64 duplicate)
+{
+  guint64 val;
+
+  g_object_get (src, "drop", &val, NULL);
+  fail_unless_equals_uint64 (val, drop);
+  g_object_get (src, "duplicate", &val, NULL);
+  fail_unless_equals_uint64 (val, duplicate);
+}
+
+GST_START_TEST (test_readers)
+{
+  GstElement *sink, *all_src, *latest_src;
+  guint8 i;
+
+  sink = setup_intervideosink ("readers");
+  all_src = setup_intervideosrc ("readers", TRUE, FALSE);
+  latest_src = setup_intervideosrc ("readers", FALSE, FALSE);
+
+  for (i = 1; i <= 5; i++)
+    push_frame (i);
+
+  /* each source reads the frames on its own */
+  for (i = 1; i <= 5; i++)
+    check_frame (all_src, i);
+  check_counters (all_src, 0, 0);
+
+  /* by default the newest frame is taken, the others are dropped */
+  check_frame (latest_src, 5);
+  check_counters (latest_src, 4, 0);
+
+  /* without a new frame the last one is sent again */
+  check_frame (all_src, 5);
+  check_counters (all_src, 0, 1);
+  check_frame (latest_src, 5);
+  check_counters (latest_src, 4, 1);
+
+  /* frames overwritten in the ring are dropped */
+  for (i = 6; i <= 15; i++)
+    push_frame (i);
+  for (i = 15 - SLOTS + 1; i <= 15; i++)
+    check_frame (all_src, i);
+  check_counters (all_src, 15 - 5 - SLOTS, 1);
+  check_frame (latest_src, 15);
+  check_counters (latest_src, 4 + 9, 1);
+
+  cleanup_intervideosrc (latest_src);
+  cleanup_intervideosrc (all_src);
+  cleanup_intervideosink (sink);
+}
+
+GST_END_TEST;
+
+static GstBuffer *waited_buffer;
+static GstFlowReturn waited_ret;
+
+static gpointer
+create_thread (gpointer src)
+{
+  waited_ret = create_frame (src, &waited_buffer);
+
+  return NULL;
+}
+
+GST_START_TEST (test_wait_for_frame)
+{
+  GstElement *sink, *src;
+  GThread *thread;
+  guint8 data;
+
+  sink = setup_intervideosink ("wait");
+  src = setup_intervideosrc ("wait", FALSE, TRUE);
+
+  /* waits for a new frame */
+  waited_buffer = NULL;
+  thread = g_thread_new ("create", create_thread, src);
+  g_usleep (100 * G_TIME_SPAN_MILLISECOND);
+  fail_unless (waited_buffer == NULL);
+  push_frame (1);
+  g_thread_join (thread);
+
+  fail_unless_equals_int (waited_ret, GST_FLOW_OK);
+  fail_unless (waited_buffer != NULL);
+  gst_buffer_extract (waited_buffer, 0, &data, 1);
+  fail_unless_equals_int (data, 1);
+  gst_buffer_unref (waited_buffer);
+
+  /* and does not send the last one again */
+  waited_buffer = NULL;
+  thread = g_thread_new ("create", create_thread, src);
+  g_usleep (100 * G_TIME_SPAN_MILLISECOND);
+  fail_unless (waited_buffer == NULL);
+
+  /* unlock makes it return */
+  fail_unless (GST_BASE_SRC_GET_CLASS (src)->unlock (GST_BASE_SRC (src)));
+  g_thread_join (thread);
+  fail_unless_equals_int (waited_ret, GST_FLOW_FLUSHING);
+  fail_unless (waited_buffer == NULL);
+  fail_unless (GST_BASE_SRC_GET_CLASS (src)->unlock_stop (GST_BASE_SRC
+          (src)));
+
+  /* a frame that is already there is returned at once */
+  push_frame (2);
+  check_frame (src, 2);
+  check_counters (src, 0, 0);
+
+  cleanup_intervideosrc (src);
+  cleanup_intervideosink (sink);
+}
+
+GST_END_TEST;
+
+static Suite *
+intervideo_suite (void)
+{
+  Suite *s = suite_create ("intervideo");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_readers);
+  tcase_add_test (tc_chain, test_wait_for_frame);
+
+  return s;
+}
+
+GST_CHECK_MAIN (intervideo);
@@ -0,0 +1,385 @@
+/* GStreamer
+ *
+ * unit test for mpegpsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/check/gstcheck.h>
+
+/* One MPEG audio PES packet per pack, with the PTS equal to the SCR. The
+ * packs of the first half are much bigger than the ones of the second half,
+ * so that interpolating between the first and the last SCR doesn't land on
+ * the right pack. */
+#define N_PACKS 100
+#define PACK_HEADER_SIZE 14
+#define PES_HEADER_SIZE 14
+#define BIG_PAYLOAD_SIZE 4000
+#define SMALL_PAYLOAD_SIZE 500
+#define MUX_RATE 2000
+#define SCR_BASE 90000
+#define SCR_STEP 9000
+
+#define INDEX_FILE_MAGIC "MPSINDX1"
+#define INDEX_FILE_HEADER_SIZE 36
+
+#define PS_CAPS_STRING "video/mpeg, " \
+                       "mpegversion = (int) 2, " \
+                       "systemstream = (boolean) true"
+
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (PS_CAPS_STRING));
+
+static guint8 *ps_data;
+static gsize ps_size;
+static guint64 pack_offsets[N_PACKS];
+
+/* What is pulled from mysrcpad and arrives on mysinkpad, protected by
+ * test_lock. While gate_closed is set, the chain function blocks until the
+ * pad is flushed. */
+static GMutex test_lock;
+static GCond test_cond;
+static gboolean gate_closed;
+static gboolean chain_blocked;
+static gboolean sink_flushing;
+static gboolean got_eos;
+static GstClockTime first_ts;
+static guint64 min_pull_offset;
+
+static void
+write_ts (guint8 * data, guint8 prefix, guint64 ts)
+{
+  data[0] = (prefix << 4) | ((ts >> 29) & 0x0e) | 0x01;
+  data[1] = (ts >> 22) & 0xff;
+  data[2] = ((ts >> 14) & 0xfe) | 0x01;
+  data[3] = (ts >> 7) & 0xff;
+  data[4] = ((ts << 1) & 0xfe) | 0x01;
+}
+
+static guint8 *
+write_pack (guint8 * data, guint64 scr, guint payload_size)
+{
+  guint32 scr1;
+
+  /* MPEG-2 pack header without stuffing */
+  GST_WRITE_UINT32_BE (data, 0x000001ba);
+  scr1 = 0x44000400 | ((scr >> 3) & 0x38000000) |
+      ((scr >> 4) & 0x03fff800) | ((scr >> 5) & 0x000003ff);
+  GST_WRITE_UINT32_BE (data + 4, scr1);
+  data[8] = ((scr & 0x1f) << 3) | 0x04;
+  data[9] = 0x01;
+  GST_WRITE_UINT32_BE (data + 10, (MUX_RATE << 10) | 0x3f8);
+  data += PACK_HEADER_SIZE;
+
+  /* PES packet of the first MPEG audio stream with a PTS */
+  GST_WRITE_UINT32_BE (data, 0x000001c0);
+  GST_WRITE_UINT16_BE (data + 4, PES_HEADER_SIZE - 6 + payload_size);
+  data[6] = 0x80;
+  data[7] = 0x80;
+  data[8] = 5;
+  write_ts (data + 9, 0x2, scr);
+  data += PES_HEADER_SIZE;
+
+  memset (data, 0xff, payload_size);
+  return data + payload_size;
+}
+
+static guint
+payload_size (guint pack)
+{
+  return pack < N_PACKS / 2 ? BIG_PAYLOAD_SIZE : SMALL_PAYLOAD_SIZE;
+}
+
+static void
+create_stream (void)
+{
+  guint8 *data;
+  guint i;
+
+  ps_size = 0;
+  for (i = 0; i < N_PACKS; i++)
+    ps_size += PACK_HEADER_SIZE + PES_HEADER_SIZE + payload_size (i);
+
+  data = ps_data = g_malloc (ps_size);
+  for (i = 0; i < N_PACKS; i++) {
+    pack_offsets[i] = data - ps_data;
+    data = write_pack (data, SCR_BASE + i * SCR_STEP, payload_size (i));
+  }
+  fail_unless_equals_uint64 (data - ps_data, ps_size);
+}
+
+static GstFlowReturn
+src_getrange (GstPad * pad, GstObject * parent, guint64 offset, guint length,
+    GstBuffer ** buffer)
+{
+  if (offset >= ps_size)
+    return GST_FLOW_EOS;
+  length = MIN (length, ps_size - offset);
+
+  g_mutex_lock (&test_lock);
+  min_pull_offset = MIN (min_pull_offset, offset);
+  g_mutex_unlock (&test_lock);
+
+  *buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+      ps_data + offset, length, 0, length, NULL, NULL);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  gboolean res = FALSE;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_DURATION:{
+      GstFormat fmt;
+
+      gst_query_parse_duration (query, &fmt, NULL);
+      if (fmt != GST_FORMAT_BYTES)
+        break;
+
+      gst_query_set_duration (query, fmt, ps_size);
+      res = TRUE;
+      break;
+    }
+    case GST_QUERY_SCHEDULING:{
+      gst_query_set_scheduling (query, GST_SCHEDULING_FLAG_SEEKABLE, 1, -1, 0);
+      gst_query_add_scheduling_mode (query, GST_PAD_MODE_PULL);
+      res = TRUE;
+      break;
+    }
+    default:
+      res = gst_pad_query_default (pad, parent, query);
+      break;
+  }
+
+  return res;
+}
+
+static GstFlowReturn
+sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  g_mutex_lock (&test_lock);
+  while (gate_closed && !sink_flushing) {
+    chain_blocked = TRUE;
+    g_cond_broadcast (&test_cond);
+    g_cond_wait (&test_cond, &test_lock);
+  }
+  chain_blocked = FALSE;
+  if (sink_flushing) {
+    g_mutex_unlock (&test_lock);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_FLUSHING;
+  }
+
+  if (first_ts == GST_CLOCK_TIME_NONE)
+    first_ts = GST_BUFFER_PTS (buffer);
+  g_mutex_unlock (&test_lock);
+
+  gst_buffer_unref (buffer);
+  return GST_FLOW_OK;
+}
+
+static gboolean
+sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  g_mutex_lock (&test_lock);
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      sink_flushing = TRUE;
+      g_cond_broadcast (&test_cond);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      sink_flushing = FALSE;
+      first_ts = GST_CLOCK_TIME_NONE;
+      break;
+    case GST_EVENT_EOS:
+      got_eos = TRUE;
+      g_cond_broadcast (&test_cond);
+      break;
+    default:
+      break;
+  }
+  g_mutex_unlock (&test_lock);
+
+  gst_event_unref (event);
+  return TRUE;
+}
+
+static void
+pad_added (GstElement * element, GstPad * pad, gpointer user_data)
+{
+  fail_unless (gst_pad_link (pad, mysinkpad) == GST_PAD_LINK_OK);
+}
+
+static GstElement *
+setup_demux (const gchar * index_location, gboolean scan_index)
+{
+  GstElement *demux;
+  GstPad *sinkpad;
+
+  gate_closed = FALSE;
+  chain_blocked = FALSE;
+  sink_flushing = FALSE;
+  got_eos = FALSE;
+  first_ts = GST_CLOCK_TIME_NONE;
+  min_pull_offset = G_MAXUINT64;
+
+  demux = gst_element_factory_make ("mpegpsdemux", NULL);
+  fail_unless (demux != NULL);
+  g_object_set (demux, "index-location", index_location,
+      "scan-index", scan_index, NULL);
+  g_signal_connect (demux, "pad-added", G_CALLBACK (pad_added), NULL);
+
+  mysinkpad = gst_pad_new_from_static_template (&sinktemplate, "sink");
+  gst_pad_set_chain_function (mysinkpad, sink_chain);
+  gst_pad_set_event_function (mysinkpad, sink_event);
+
+  mysrcpad = gst_pad_new_from_static_template (&srctemplate, "src");
+  gst_pad_set_getrange_function (mysrcpad, src_getrange);
+  gst_pad_set_query_function (mysrcpad, src_query);
+
+  sinkpad = gst_element_get_static_pad (demux, "sink");
+  fail_unless (gst_pad_link (mysrcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+
+  gst_pad_set_active (mysinkpad, TRUE);
+  gst_pad_set_active (mysrcpad, TRUE);
+
+  return demux;
+}
+
+static void
+cleanup_demux (GstElement * demux)
+{
+  /* open the gate so that the streaming thread can stop */
+  g_mutex_lock (&test_lock);
+  gate_closed = FALSE;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+
+  gst_element_set_state (demux, GST_STATE_NULL);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_pad_set_active (mysrcpad, FALSE);
+
+  gst_object_unref (demux);
+  gst_object_unref (mysinkpad);
+  gst_object_unref (mysrcpad);
+}
+
+static void
+wait_for_eos (void)
+{
+  g_mutex_lock (&test_lock);
+  while (!got_eos)
+    g_cond_wait (&test_cond, &test_lock);
+  g_mutex_unlock (&test_lock);
+}
+
+GST_START_TEST (test_seek_index)
+{
+  GstElement *demux;
+  gchar *location, *contents;
+  gsize size;
+  gint fd;
+
+  create_stream ();
+
+  fd = g_file_open_tmp ("mpegpsdemux-index-XXXXXX", &location, NULL);
+  fail_unless (fd >= 0);
+  close (fd);
+  g_unlink (location);
+
+  /* play through, the index is saved on the way to READY */
+  demux = setup_demux (location, TRUE);
+  fail_unless_equals_int (gst_element_set_state (demux, GST_STATE_PLAYING),
+      GST_STATE_CHANGE_SUCCESS);
+  wait_for_eos ();
+  cleanup_demux (demux);
+
+  fail_unless (g_file_get_contents (location, &contents, &size, NULL));
+  fail_unless (size >= INDEX_FILE_HEADER_SIZE);
+  fail_unless (memcmp (contents, INDEX_FILE_MAGIC,
+          strlen (INDEX_FILE_MAGIC)) == 0);
+  /* one point every half second of the 10 seconds */
+  fail_unless (GST_READ_UINT32_BE (contents + 32) >= N_PACKS / 10);
+  g_free (contents);
+
+  /* hold the first buffer so that the loaded index is all there is, and
+   * seek to the pack 73 */
+  demux = setup_demux (location, FALSE);
+  gate_closed = TRUE;
+  fail_unless_equals_int (gst_element_set_state (demux, GST_STATE_PLAYING),
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_mutex_lock (&test_lock);
+  while (!chain_blocked)
+    g_cond_wait (&test_cond, &test_lock);
+  min_pull_offset = G_MAXUINT64;
+  g_mutex_unlock (&test_lock);
+
+  fail_unless (gst_element_send_event (demux,
+          gst_event_new_seek (1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
+              GST_SEEK_TYPE_SET, 7300 * GST_MSECOND, GST_SEEK_TYPE_NONE, -1)));
+
+  /* the search stayed between the index points around the target, without
+   * the index it would have started at the interpolated offset in the big
+   * packs of the first half */
+  g_mutex_lock (&test_lock);
+  fail_unless (min_pull_offset >= pack_offsets[70]);
+  gate_closed = FALSE;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+
+  wait_for_eos ();
+  fail_unless (first_ts >= 7000 * GST_MSECOND);
+  fail_unless (first_ts <= 7300 * GST_MSECOND);
+  cleanup_demux (demux);
+
+  g_unlink (location);
+  g_free (location);
+  g_free (ps_data);
+  ps_data = NULL;
+}
+
+GST_END_TEST;
+
+static Suite *
+mpegpsdemux_suite (void)
+{
+  Suite *s = suite_create ("mpegpsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_seek_index);
+
+  return s;
+}
+
+GST_CHECK_MAIN (mpegpsdemux);
@@ -21,6 +21,7 @@
 #include <gst/check/gstcheck.h>
 #include <string.h>
 #include <gst/video/video.h>
+#include <gst/base/gstadapter.h>
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -712,6 +713,272 @@ GST_START_TEST (test_multiple_state_change)
 
 GST_END_TEST;
 
+GST_START_TEST (test_align)
+{
+  GstElement *mux;
+  gchar *padname;
+  GstBuffer *inbuffer;
+  GstCaps *caps;
+  GList *l;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "alignment", 7, NULL);
+
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* large enough for several aligned output buffers, which get pushed as
+   * one buffer list */
+  inbuffer = gst_buffer_new_and_alloc (8000);
+  gst_buffer_memset (inbuffer, 0, 0, 8000);
+  GST_BUFFER_PTS (inbuffer) = 0;
+  fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  fail_unless (g_list_length (buffers) > 1);
+
+  /* the remainder is padded with null packets on EOS */
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  for (l = buffers; l; l = l->next) {
+    GstBuffer *buf = l->data;
+    GstMapInfo map;
+    gsize i;
+
+    gst_buffer_map (buf, &map, GST_MAP_READ);
+    fail_unless_equals_int (map.size, 7 * 188);
+    for (i = 0; i < map.size; i += 188)
+      fail_unless (map.data[i] == 0x47);
+    gst_buffer_unmap (buf, &map);
+  }
+
+  g_list_foreach (buffers, (GFunc) gst_mini_object_unref, NULL);
+  g_list_free (buffers);
+  buffers = NULL;
+
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
+#define CBR_BITRATE 2000000
+
+GST_START_TEST (test_cbr)
+{
+  GstElement *mux;
+  gchar *padname;
+  GstBuffer *inbuffer;
+  GstCaps *caps;
+  GstAdapter *adapter;
+  GList *l;
+  const guint8 *data;
+  guint64 pos, first_pos = 0, last_pos = 0;
+  gint64 first_pcr = -1, last_pcr = -1;
+  guint n_null = 0, n_pat = 0, n_pcr = 0;
+  gsize size;
+  gint i;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "bitrate", (guint64) CBR_BITRATE, NULL);
+
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* 25 frames of 1000 bytes in one second, well below the bitrate */
+  for (i = 0; i < 25; i++) {
+    inbuffer = gst_buffer_new_and_alloc (1000);
+    gst_buffer_memset (inbuffer, 0, 0, 1000);
+    GST_BUFFER_PTS (inbuffer) = i * 40 * GST_MSECOND;
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  adapter = gst_adapter_new ();
+  for (l = buffers; l; l = l->next)
+    gst_adapter_push (adapter, gst_buffer_ref (l->data));
+  size = gst_adapter_available (adapter);
+  fail_unless (size % 188 == 0);
+  data = gst_adapter_map (adapter, size);
+
+  for (pos = 0; pos < size; pos += 188) {
+    const guint8 *packet = data + pos;
+    guint pid = GST_READ_UINT16_BE (packet + 1) & 0x1fff;
+
+    fail_unless (packet[0] == 0x47);
+    if (pid == 0x1fff)
+      n_null++;
+    else if (pid == 0)
+      n_pat++;
+
+    /* adaptation field with PCR */
+    if ((packet[3] & 0x20) && packet[4] > 0 && (packet[5] & 0x10)) {
+      guint64 pcr_base;
+      gint64 pcr;
+
+      pcr_base = ((guint64) GST_READ_UINT32_BE (packet + 6) << 1) |
+          (packet[10] >> 7);
+      pcr = pcr_base * 300 + (((packet[10] & 0x01) << 8) | packet[11]);
+
+      if (first_pcr == -1) {
+        first_pcr = pcr;
+        first_pos = pos;
+      } else {
+        gint64 expected;
+
+        /* PCR follows the byte position exactly, up to rounding */
+        expected = first_pcr + gst_util_uint64_scale ((pos - first_pos) * 8,
+            27000000, CBR_BITRATE);
+        fail_unless (ABS (pcr - expected) <= 1,
+            "PCR %" G_GINT64_FORMAT " at %" G_GUINT64_FORMAT ", expected %"
+            G_GINT64_FORMAT, pcr, pos, expected);
+        /* and is repeated often enough */
+        fail_unless (pcr - last_pcr <= 27000000 / 10);
+      }
+      last_pcr = pcr;
+      last_pos = pos;
+      n_pcr++;
+    }
+  }
+
+  /* about one second of output at the configured rate, stuffed with null
+   * packets and with PAT/PCR spread over it */
+  fail_unless (n_pcr >= 20);
+  fail_unless (n_pat >= 9);
+  fail_unless (n_null > 0);
+  fail_unless (last_pos - first_pos >= CBR_BITRATE / 8 * 9 / 10);
+  fail_unless (size <= CBR_BITRATE / 8 * 11 / 10);
+
+  gst_adapter_unmap (adapter);
+  g_object_unref (adapter);
+
+  g_list_foreach (buffers, (GFunc) gst_mini_object_unref, NULL);
+  g_list_free (buffers);
+  buffers = NULL;
+
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_cbr_timestamp_jump)
+{
+  GstElement *mux;
+  gchar *padname;
+  GstBuffer *inbuffer;
+  GstCaps *caps;
+  GstAdapter *adapter;
+  GList *l;
+  const guint8 *data;
+  guint64 pos, first_pos = 0;
+  gint64 first_pcr = -1, last_pcr = -1;
+  gint64 pcrs[2] = { -1, -1 }, prev_pcrs[2] = { -1, -1 };
+  guint n_discont = 0;
+  gsize size;
+  gint i;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  g_object_set (mux, "bitrate", (guint64) CBR_BITRATE, NULL);
+
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  /* can't be changed while streaming */
+  g_object_set (mux, "bitrate", (guint64) CBR_BITRATE * 2, NULL);
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* one second, then back to the start, then ten seconds ahead */
+  for (i = 0; i < 45; i++) {
+    GstClockTime pts;
+
+    if (i < 25)
+      pts = i * 40 * GST_MSECOND;
+    else if (i < 35)
+      pts = (i - 25) * 40 * GST_MSECOND;
+    else
+      pts = 10 * GST_SECOND + (i - 35) * 40 * GST_MSECOND;
+
+    inbuffer = gst_buffer_new_and_alloc (1000);
+    gst_buffer_memset (inbuffer, 0, 0, 1000);
+    GST_BUFFER_PTS (inbuffer) = pts;
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  adapter = gst_adapter_new ();
+  for (l = buffers; l; l = l->next)
+    gst_adapter_push (adapter, gst_buffer_ref (l->data));
+  size = gst_adapter_available (adapter);
+  fail_unless (size % 188 == 0);
+  data = gst_adapter_map (adapter, size);
+
+  for (pos = 0; pos < size; pos += 188) {
+    const guint8 *packet = data + pos;
+    guint64 pcr_base;
+    gint64 pcr, expected;
+
+    fail_unless (packet[0] == 0x47);
+    if (!(packet[3] & 0x20) || packet[4] == 0 || !(packet[5] & 0x10))
+      continue;
+
+    pcr_base = ((guint64) GST_READ_UINT32_BE (packet + 6) << 1) |
+        (packet[10] >> 7);
+    pcr = pcr_base * 300 + (((packet[10] & 0x01) << 8) | packet[11]);
+
+    if (packet[5] & 0x80) {
+      /* discontinuity_indicator, the PCR starts over from here */
+      fail_unless (n_discont < 2);
+      prev_pcrs[n_discont] = last_pcr;
+      pcrs[n_discont] = pcr;
+      n_discont++;
+      first_pcr = pcr;
+      first_pos = pos;
+    } else if (first_pcr == -1) {
+      first_pcr = pcr;
+      first_pos = pos;
+    } else {
+      expected = first_pcr + gst_util_uint64_scale ((pos - first_pos) * 8,
+          27000000, CBR_BITRATE);
+      fail_unless (ABS (pcr - expected) <= 1,
+          "PCR %" G_GINT64_FORMAT " at %" G_GUINT64_FORMAT ", expected %"
+          G_GINT64_FORMAT, pcr, pos, expected);
+    }
+    last_pcr = pcr;
+  }
+
+  /* the backward jump resynced at once instead of running a second late,
+   * and the forward one instead of stuffing ten seconds */
+  fail_unless_equals_int (n_discont, 2);
+  fail_unless (pcrs[0] < prev_pcrs[0] - 27000000 / 2);
+  fail_unless (pcrs[1] > prev_pcrs[1] + 27000000 * 5);
+  fail_unless (size <= CBR_BITRATE / 8 * 3);
+
+  gst_adapter_unmap (adapter);
+  g_object_unref (adapter);
+
+  g_list_foreach (buffers, (GFunc) gst_mini_object_unref, NULL);
+  g_list_free (buffers);
+  buffers = NULL;
+
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
 static Suite *
 mpegtsmux_suite (void)
 {
@@ -726,6 +993,9 @@ mpegtsmux_suite (void)
   tcase_add_test (tc_chain, test_force_key_unit_event_upstream);
   tcase_add_test (tc_chain, test_propagate_flow_status);
   tcase_add_test (tc_chain, test_multiple_state_change);
+  tcase_add_test (tc_chain, test_align);
+  tcase_add_test (tc_chain, test_cbr);
+  tcase_add_test (tc_chain, test_cbr_timestamp_jump);
 
   return s;
 }
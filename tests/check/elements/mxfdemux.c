@@ -24,11 +24,54 @@
 #include <string.h>
 #include "mxfdemux.h"
 
+/* Parts of mxf_file that are reused to build a file with several body
+ * partitions, each with its own index table segment */
+#define HEADER_METADATA_END 4137
+#define ESSENCE_ELEMENT_OFFSET 19995
+#define FOOTER_PARTITION_OFFSET 20031
+#define INDEX_SEGMENT_OFFSET 20171
+#define RANDOM_INDEX_PACK_OFFSET 20271
+
+#define PARTITION_PACK_SIZE 140
+#define INDEX_SEGMENT_SIZE 100
+#define ESSENCE_ELEMENT_SIZE 36
+
+/* the durations of the sequences and source clips of the header metadata */
+static const guint duration_offsets[] = {
+  2246, 2369, 2607, 2707, 3281, 3404, 3642, 3742
+};
+
+#define N_BODY_PARTITIONS 4
+#define EDIT_UNITS_PER_PARTITION 8
+#define N_EDIT_UNITS (N_BODY_PARTITIONS * EDIT_UNITS_PER_PARTITION)
+#define EDIT_UNIT_DURATION (200 * GST_MSECOND)
+
 static GstPad *mysrcpad, *mysinkpad;
 static GMainLoop *loop = NULL;
 static gboolean have_eos = FALSE;
 static gboolean have_data = FALSE;
 
+/* The file read in pull mode */
+static const guint8 *file_data;
+static gsize file_size;
+
+static GMutex test_lock;
+static GCond test_cond;
+/* While set, the first buffer blocks in the chain function until the pad
+ * is flushed */
+static gboolean gate_closed = FALSE;
+static gboolean sink_flushing = FALSE;
+static guint n_buffers = 0;
+static GstClockTime next_timestamp = 0;
+
+/* Offsets of the index table segments of the body partitions and whether
+ * they were pulled as a whole before any data was output */
+static guint64 index_segment_offsets[N_BODY_PARTITIONS];
+static gboolean index_pulled[N_BODY_PARTITIONS];
+/* While set, the offset of the first pull is kept */
+static gboolean record_pulls = FALSE;
+static gint64 first_pull_offset = -1;
+
 static GstStaticPadTemplate mysrctemplate =
 GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("application/mxf"));
@@ -69,12 +112,24 @@ _sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
   fail_unless (gst_buffer_memcmp (buffer, 0, mxf_essence,
           sizeof (mxf_essence)) == 0);
 
-  fail_unless (GST_BUFFER_TIMESTAMP (buffer) == 0);
-  fail_unless (GST_BUFFER_DURATION (buffer) == 200 * GST_MSECOND);
+  fail_unless (GST_BUFFER_TIMESTAMP (buffer) == next_timestamp);
+  fail_unless (GST_BUFFER_DURATION (buffer) == EDIT_UNIT_DURATION);
 
   gst_buffer_unref (buffer);
 
+  g_mutex_lock (&test_lock);
+  next_timestamp += EDIT_UNIT_DURATION;
+  n_buffers++;
   have_data = TRUE;
+  g_cond_broadcast (&test_cond);
+  while (gate_closed && !sink_flushing)
+    g_cond_wait (&test_cond, &test_lock);
+  if (sink_flushing) {
+    g_mutex_unlock (&test_lock);
+    return GST_FLOW_FLUSHING;
+  }
+  g_mutex_unlock (&test_lock);
+
   return GST_FLOW_OK;
 }
 
@@ -94,6 +149,17 @@ _sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
       if (loop)
         g_main_loop_quit (loop);
       break;
+    case GST_EVENT_FLUSH_START:
+      g_mutex_lock (&test_lock);
+      sink_flushing = TRUE;
+      g_cond_broadcast (&test_cond);
+      g_mutex_unlock (&test_lock);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      g_mutex_lock (&test_lock);
+      sink_flushing = FALSE;
+      g_mutex_unlock (&test_lock);
+      break;
     case GST_EVENT_CAPS:
     {
       GstCaps *caps;
@@ -134,11 +200,23 @@ static GstFlowReturn
 _src_getrange (GstPad * pad, GstObject * parent, guint64 offset, guint length,
     GstBuffer ** buffer)
 {
-  if (offset + length > sizeof (mxf_file))
+  guint i;
+
+  if (offset + length > file_size)
     return GST_FLOW_EOS;
 
+  g_mutex_lock (&test_lock);
+  for (i = 0; i < N_BODY_PARTITIONS; i++) {
+    if (offset == index_segment_offsets[i] && length >= INDEX_SEGMENT_SIZE
+        && !have_data)
+      index_pulled[i] = TRUE;
+  }
+  if (record_pulls && first_pull_offset == -1)
+    first_pull_offset = offset;
+  g_mutex_unlock (&test_lock);
+
   *buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
-      (guint8 *) (mxf_file + offset), length, 0, length, NULL, NULL);
+      (guint8 *) (file_data + offset), length, 0, length, NULL, NULL);
 
   return GST_FLOW_OK;
 }
@@ -156,7 +234,7 @@ _src_query (GstPad * pad, GstObject * parent, GstQuery * query)
       if (fmt != GST_FORMAT_BYTES)
         break;
 
-      gst_query_set_duration (query, fmt, sizeof (mxf_file));
+      gst_query_set_duration (query, fmt, file_size);
       res = TRUE;
       break;
     }
@@ -184,18 +262,125 @@ _create_src_pad_pull (void)
   return mysrcpad;
 }
 
-GST_START_TEST (test_pull)
+static void
+write_partition_pack (guint8 * p, guint8 kind, guint64 this_partition,
+    guint64 prev_partition, guint64 footer_partition, guint64 index_byte_count,
+    guint32 index_sid, guint64 body_offset, guint32 body_sid)
+{
+  memcpy (p, mxf_file + FOOTER_PARTITION_OFFSET, PARTITION_PACK_SIZE);
+  p[13] = kind;
+  /* closed and complete */
+  p[14] = 0x04;
+  GST_WRITE_UINT64_BE (p + 28, this_partition);
+  GST_WRITE_UINT64_BE (p + 36, prev_partition);
+  GST_WRITE_UINT64_BE (p + 44, footer_partition);
+  GST_WRITE_UINT64_BE (p + 52, 0);
+  GST_WRITE_UINT64_BE (p + 60, index_byte_count);
+  GST_WRITE_UINT32_BE (p + 68, index_sid);
+  GST_WRITE_UINT64_BE (p + 72, body_offset);
+  GST_WRITE_UINT32_BE (p + 80, body_sid);
+}
+
+/* Builds a file with the header metadata of mxf_file and N_EDIT_UNITS
+ * copies of its essence element, spread over N_BODY_PARTITIONS body
+ * partitions. Each body partition starts with the index table segment of
+ * its edit units, the footer partition has no index. */
+static guint8 *
+create_partitioned_file (gsize * size)
+{
+  guint8 *data, *p;
+  guint64 prev = 0, footer;
+  guint i, j, rip_size;
+
+  footer = HEADER_METADATA_END + N_BODY_PARTITIONS * (PARTITION_PACK_SIZE +
+      INDEX_SEGMENT_SIZE + EDIT_UNITS_PER_PARTITION * ESSENCE_ELEMENT_SIZE);
+  rip_size = 20 + (N_BODY_PARTITIONS + 2) * 12 + 4;
+  *size = footer + PARTITION_PACK_SIZE + rip_size;
+  data = p = g_malloc0 (*size);
+
+  /* header partition with the header metadata and no essence */
+  memcpy (p, mxf_file, HEADER_METADATA_END);
+  GST_WRITE_UINT64_BE (p + 44, footer);
+  GST_WRITE_UINT64_BE (p + 52, HEADER_METADATA_END - PARTITION_PACK_SIZE);
+  GST_WRITE_UINT64_BE (p + 60, 0);
+  GST_WRITE_UINT32_BE (p + 80, 0);
+  for (i = 0; i < G_N_ELEMENTS (duration_offsets); i++)
+    GST_WRITE_UINT64_BE (p + duration_offsets[i], N_EDIT_UNITS);
+  p += HEADER_METADATA_END;
+
+  for (i = 0; i < N_BODY_PARTITIONS; i++) {
+    guint64 this_partition = p - data;
+
+    write_partition_pack (p, 0x03, this_partition, prev, footer,
+        INDEX_SEGMENT_SIZE, 0x81,
+        i * EDIT_UNITS_PER_PARTITION * ESSENCE_ELEMENT_SIZE, 1);
+    p += PARTITION_PACK_SIZE;
+    prev = this_partition;
+
+    /* constant size edit units, so no index entries are needed */
+    index_segment_offsets[i] = p - data;
+    memcpy (p, mxf_file + INDEX_SEGMENT_OFFSET, INDEX_SEGMENT_SIZE);
+    p[39] ^= i + 1;
+    GST_WRITE_UINT64_BE (p + 56, i * EDIT_UNITS_PER_PARTITION);
+    GST_WRITE_UINT64_BE (p + 68, EDIT_UNITS_PER_PARTITION);
+    GST_WRITE_UINT32_BE (p + 80, ESSENCE_ELEMENT_SIZE);
+    p += INDEX_SEGMENT_SIZE;
+
+    for (j = 0; j < EDIT_UNITS_PER_PARTITION; j++) {
+      memcpy (p, mxf_file + ESSENCE_ELEMENT_OFFSET, ESSENCE_ELEMENT_SIZE);
+      p += ESSENCE_ELEMENT_SIZE;
+    }
+  }
+
+  write_partition_pack (p, 0x04, footer, prev, footer, 0, 0, 0, 0);
+  p += PARTITION_PACK_SIZE;
+
+  /* random index pack listing all partitions */
+  memcpy (p, mxf_file + RANDOM_INDEX_PACK_OFFSET, 16);
+  p[16] = 0x83;
+  GST_WRITE_UINT24_BE (p + 17, rip_size - 20);
+  p += 20;
+  GST_WRITE_UINT32_BE (p, 0);
+  GST_WRITE_UINT64_BE (p + 4, 0);
+  p += 12;
+  for (i = 0; i < N_BODY_PARTITIONS; i++) {
+    GST_WRITE_UINT32_BE (p, 1);
+    GST_WRITE_UINT64_BE (p + 4, index_segment_offsets[i] -
+        PARTITION_PACK_SIZE);
+    p += 12;
+  }
+  GST_WRITE_UINT32_BE (p, 0);
+  GST_WRITE_UINT64_BE (p + 4, footer);
+  p += 12;
+  GST_WRITE_UINT32_BE (p, rip_size);
+
+  return data;
+}
+
+static GstElement *
+setup_pull_test (const guint8 * data, gsize size, gboolean prescan_index)
 {
-  GstStateChangeReturn sret;
   GstElement *mxfdemux;
   GstPad *sinkpad;
+  guint i;
 
+  file_data = data;
+  file_size = size;
   have_eos = FALSE;
   have_data = FALSE;
+  gate_closed = FALSE;
+  sink_flushing = FALSE;
+  n_buffers = 0;
+  next_timestamp = 0;
+  record_pulls = FALSE;
+  first_pull_offset = -1;
+  for (i = 0; i < N_BODY_PARTITIONS; i++)
+    index_pulled[i] = FALSE;
   loop = g_main_loop_new (NULL, FALSE);
 
   mxfdemux = gst_element_factory_make ("mxfdemux", NULL);
   fail_unless (mxfdemux != NULL);
+  g_object_set (mxfdemux, "prescan-index", prescan_index, NULL);
   g_signal_connect (mxfdemux, "pad-added", G_CALLBACK (_pad_added), NULL);
   sinkpad = gst_element_get_static_pad (mxfdemux, "sink");
   fail_unless (sinkpad != NULL);
@@ -211,14 +396,12 @@ GST_START_TEST (test_pull)
   gst_pad_set_active (mysinkpad, TRUE);
   gst_pad_set_active (mysrcpad, TRUE);
 
-  GST_INFO ("Setting to PLAYING");
-  sret = gst_element_set_state (mxfdemux, GST_STATE_PLAYING);
-  fail_unless_equals_int (sret, GST_STATE_CHANGE_SUCCESS);
-
-  g_main_loop_run (loop);
-  fail_unless (have_eos == TRUE);
-  fail_unless (have_data == TRUE);
+  return mxfdemux;
+}
 
+static void
+cleanup_pull_test (GstElement * mxfdemux)
+{
   gst_element_set_state (mxfdemux, GST_STATE_NULL);
   gst_pad_set_active (mysinkpad, FALSE);
   gst_pad_set_active (mysrcpad, FALSE);
@@ -230,6 +413,122 @@ GST_START_TEST (test_pull)
   loop = NULL;
 }
 
+static void
+run_pull_test (gboolean prescan_index)
+{
+  GstStateChangeReturn sret;
+  GstElement *mxfdemux;
+
+  mxfdemux = setup_pull_test (mxf_file, sizeof (mxf_file), prescan_index);
+
+  GST_INFO ("Setting to PLAYING");
+  sret = gst_element_set_state (mxfdemux, GST_STATE_PLAYING);
+  fail_unless_equals_int (sret, GST_STATE_CHANGE_SUCCESS);
+
+  g_main_loop_run (loop);
+  fail_unless (have_eos == TRUE);
+  fail_unless (have_data == TRUE);
+
+  cleanup_pull_test (mxfdemux);
+}
+
+GST_START_TEST (test_pull)
+{
+  run_pull_test (FALSE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_pull_prescan_index)
+{
+  run_pull_test (TRUE);
+}
+
+GST_END_TEST;
+
+/* Plays the first edit unit of the partitioned file and then seeks to
+ * @target, before the rest of the file was read. Returns the offset of the
+ * first pull after the seek. */
+static gint64
+run_partitioned_seek_test (gboolean prescan_index, guint target)
+{
+  GstStateChangeReturn sret;
+  GstElement *mxfdemux;
+  guint8 *data;
+  gsize size;
+  gint64 offset;
+  guint i;
+
+  data = create_partitioned_file (&size);
+  mxfdemux = setup_pull_test (data, size, prescan_index);
+
+  gate_closed = TRUE;
+  sret = gst_element_set_state (mxfdemux, GST_STATE_PLAYING);
+  fail_unless_equals_int (sret, GST_STATE_CHANGE_SUCCESS);
+
+  /* the streaming thread then waits in the chain function until the seek
+   * flushes it */
+  g_mutex_lock (&test_lock);
+  while (!have_data)
+    g_cond_wait (&test_cond, &test_lock);
+  g_mutex_unlock (&test_lock);
+  fail_unless_equals_int (n_buffers, 1);
+
+  /* the prescan reads each index table segment in one go before any data
+   * is output, playing reads them piecewise */
+  for (i = 0; i < N_BODY_PARTITIONS; i++)
+    fail_unless_equals_int (index_pulled[i], prescan_index);
+
+  g_mutex_lock (&test_lock);
+  have_eos = FALSE;
+  n_buffers = 0;
+  next_timestamp = target * EDIT_UNIT_DURATION;
+  record_pulls = TRUE;
+  gate_closed = FALSE;
+  g_mutex_unlock (&test_lock);
+
+  fail_unless (gst_element_send_event (mxfdemux,
+          gst_event_new_seek (1.0, GST_FORMAT_TIME,
+              GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
+              GST_SEEK_TYPE_SET, target * EDIT_UNIT_DURATION,
+              GST_SEEK_TYPE_NONE, -1)));
+  g_main_loop_run (loop);
+  fail_unless (have_eos == TRUE);
+  fail_unless_equals_int (n_buffers, N_EDIT_UNITS - target);
+
+  offset = first_pull_offset;
+
+  cleanup_pull_test (mxfdemux);
+  g_free (data);
+
+  return offset;
+}
+
+/* The essence element of edit unit @n of the partitioned file */
+static guint64
+partitioned_file_element_offset (guint n)
+{
+  return index_segment_offsets[n / EDIT_UNITS_PER_PARTITION] +
+      INDEX_SEGMENT_SIZE + (n % EDIT_UNITS_PER_PARTITION) *
+      ESSENCE_ELEMENT_SIZE;
+}
+
+GST_START_TEST (test_pull_prescan_index_seek)
+{
+  guint target = N_EDIT_UNITS - 3;
+  gint64 offset;
+
+  /* with the prescanned index the seek pulls the target element right
+   * away */
+  offset = run_partitioned_seek_test (TRUE, target);
+  fail_unless_equals_int64 (offset, partitioned_file_element_offset (target));
+
+  /* while without it the essence has to be scanned up to the target */
+  offset = run_partitioned_seek_test (FALSE, target);
+  fail_unless (offset != -1);
+  fail_unless (offset < partitioned_file_element_offset (target));
+}
+
 GST_END_TEST;
 
 GST_START_TEST (test_push)
@@ -241,6 +540,10 @@ GST_START_TEST (test_push)
 
   have_data = FALSE;
   have_eos = FALSE;
+  gate_closed = FALSE;
+  sink_flushing = FALSE;
+  n_buffers = 0;
+  next_timestamp = 0;
 
   mxfdemux = gst_element_factory_make ("mxfdemux", NULL);
   fail_unless (mxfdemux != NULL);
@@ -301,6 +604,8 @@ mxfdemux_suite (void)
   suite_add_tcase (s, tc_chain);
   tcase_set_timeout (tc_chain, 180);
   tcase_add_test (tc_chain, test_pull);
+  tcase_add_test (tc_chain, test_pull_prescan_index);
+  tcase_add_test (tc_chain, test_pull_prescan_index_seek);
   tcase_add_test (tc_chain, test_push);
 
   return s;
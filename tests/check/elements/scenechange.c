@@ -0,0 +1,275 @@
+/* GStreamer
+ *
+ * unit test for scenechange
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include <gst/video/video.h>
+#include "gstscenechangerow.h"
+
+/* the rows are long enough for several blocks of the vector code and are
+ * read from every offset, so that the loads are not aligned */
+#define MAX_WIDTH 1000
+#define N_RUNS 100
+
+#define VIDEO_CAPS_STRING "video/x-raw, format=(string)I420, " \
+    "width=(int)64, height=(int)16, framerate=(fraction)25/1"
+#define FRAME_SIZE (64 * 16 * 3 / 2)
+
+static const gint steps[] = { 1, 2, 3, 4 };
+
+static void
+fill_random (guint8 * data, gint size)
+{
+  gint i;
+
+  for (i = 0; i < size; i++)
+    data[i] = g_random_int_range (0, 256);
+}
+
+static gint
+random_width (void)
+{
+  /* mostly short rows, which leave a tail for the scalar loop */
+  if (g_random_boolean ())
+    return g_random_int_range (1, 48);
+  return g_random_int_range (1, MAX_WIDTH - 16);
+}
+
+GST_START_TEST (test_sad_row)
+{
+  guint8 *s1, *s2;
+  guint64 sad, sad_c;
+  gint run, i, j, width, offset;
+
+  s1 = g_malloc (MAX_WIDTH);
+  s2 = g_malloc (MAX_WIDTH);
+
+  for (run = 0; run < N_RUNS; run++) {
+    fill_random (s1, MAX_WIDTH);
+    fill_random (s2, MAX_WIDTH);
+    width = random_width ();
+    offset = g_random_int_range (0, 16);
+
+    for (i = 0; i < G_N_ELEMENTS (steps); i++) {
+      sad = scene_change_sad_row (s1 + offset, s2 + offset, width, steps[i]);
+
+      sad_c = 0;
+      for (j = 0; j < width; j += steps[i])
+        sad_c += ABS (s1[offset + j] - s2[offset + j]);
+
+      fail_unless_equals_uint64 (sad, sad_c);
+    }
+  }
+
+  /* the largest differences */
+  memset (s1, 0, MAX_WIDTH);
+  memset (s2, 255, MAX_WIDTH);
+  for (i = 0; i < G_N_ELEMENTS (steps); i++) {
+    fail_unless_equals_uint64 (scene_change_sad_row (s1, s2, MAX_WIDTH,
+            steps[i]), (guint64) 255 * ((MAX_WIDTH + steps[i] - 1) / steps[i]));
+  }
+
+  g_free (s1);
+  g_free (s2);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_hist_row)
+{
+  guint32 hist[4][SC_HIST_BINS];
+  guint32 hist_c[SC_HIST_BINS];
+  guint8 *s;
+  gint run, i, j, width;
+
+  s = g_malloc (MAX_WIDTH);
+
+  for (run = 0; run < N_RUNS; run++) {
+    fill_random (s, MAX_WIDTH);
+    width = random_width ();
+
+    for (i = 0; i < G_N_ELEMENTS (steps); i++) {
+      memset (hist, 0, sizeof (hist));
+      scene_change_hist_row (hist, s, width, steps[i]);
+
+      memset (hist_c, 0, sizeof (hist_c));
+      for (j = 0; j < width; j += steps[i])
+        hist_c[s[j] * SC_HIST_BINS / 256]++;
+
+      for (j = 0; j < SC_HIST_BINS; j++) {
+        fail_unless_equals_int (hist[0][j] + hist[1][j] + hist[2][j] +
+            hist[3][j], hist_c[j]);
+      }
+    }
+  }
+
+  g_free (s);
+}
+
+GST_END_TEST;
+
+static GstPad *mysrcpad, *mysinkpad;
+static GstEvent *force_key_unit;
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS_STRING));
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VIDEO_CAPS_STRING));
+
+static gboolean
+sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  if (gst_video_event_is_force_key_unit (event)) {
+    gst_event_replace (&force_key_unit, event);
+    gst_event_unref (event);
+    return TRUE;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static void
+push_frame (guint8 luma, gint n)
+{
+  GstBuffer *buffer;
+
+  buffer = gst_buffer_new_and_alloc (FRAME_SIZE);
+  gst_buffer_memset (buffer, 0, 128, FRAME_SIZE);
+  gst_buffer_memset (buffer, 0, luma, 64 * 16);
+  GST_BUFFER_TIMESTAMP (buffer) = n * GST_SECOND / 25;
+  GST_BUFFER_DURATION (buffer) = GST_SECOND / 25;
+  fail_unless_equals_int (gst_pad_push (mysrcpad, buffer), GST_FLOW_OK);
+}
+
+static void
+check_message (GstBus * bus, gint n, gdouble score, gboolean change)
+{
+  GstMessage *message;
+  const GstStructure *s;
+  GstClockTime timestamp;
+  gdouble value;
+  gboolean scene_change;
+
+  message = gst_bus_pop_filtered (bus, GST_MESSAGE_ELEMENT);
+  fail_unless (message != NULL);
+  s = gst_message_get_structure (message);
+  fail_unless (gst_structure_has_name (s, "GstSceneChange"));
+
+  fail_unless (gst_structure_get_clock_time (s, "timestamp", &timestamp));
+  fail_unless_equals_uint64 (timestamp, n * GST_SECOND / 25);
+  fail_unless (gst_structure_get_clock_time (s, "running-time", &timestamp));
+  fail_unless_equals_uint64 (timestamp, n * GST_SECOND / 25);
+  fail_unless (gst_structure_get_double (s, "score", &value));
+  fail_unless (value == score, "score %g, expected %g", value, score);
+  fail_unless (gst_structure_get_double (s, "confidence", &value));
+  if (change)
+    fail_unless (value >= 0.5);
+  else
+    fail_unless (value < 0.5);
+  fail_unless (gst_structure_get_boolean (s, "scene-change", &scene_change));
+  fail_unless_equals_int (scene_change, change);
+
+  gst_message_unref (message);
+}
+
+GST_START_TEST (test_messages)
+{
+  GstElement *scenechange;
+  GstBus *bus;
+  GstCaps *caps;
+  const GstStructure *s;
+  gdouble value;
+  gint n;
+
+  scenechange = gst_check_setup_element ("scenechange");
+  g_object_set (scenechange, "post-messages", TRUE, NULL);
+  mysrcpad = gst_check_setup_src_pad (scenechange, &srctemplate);
+  mysinkpad = gst_check_setup_sink_pad (scenechange, &sinktemplate);
+  gst_pad_set_event_function (mysinkpad, sink_event);
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+
+  bus = gst_bus_new ();
+  gst_element_set_bus (scenechange, bus);
+
+  fail_unless (gst_element_set_state (scenechange,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, scenechange, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* a still picture and then a cut to a white one */
+  for (n = 0; n < 5; n++) {
+    push_frame (16, n);
+    check_message (bus, n, 0, FALSE);
+  }
+  fail_unless (force_key_unit == NULL);
+
+  push_frame (235, n);
+  check_message (bus, n, 235 - 16, TRUE);
+
+  fail_unless (force_key_unit != NULL);
+  s = gst_event_get_structure (force_key_unit);
+  fail_unless (gst_structure_get_double (s, "scene-change-score", &value));
+  fail_unless (value == 235 - 16);
+  fail_unless (gst_structure_get_double (s, "scene-change-confidence",
+          &value));
+  fail_unless (value >= 0.5);
+  gst_event_replace (&force_key_unit, NULL);
+
+  /* and no messages once they are disabled */
+  g_object_set (scenechange, "post-messages", FALSE, NULL);
+  push_frame (235, ++n);
+  fail_unless (gst_bus_pop_filtered (bus, GST_MESSAGE_ELEMENT) == NULL);
+
+  gst_element_set_bus (scenechange, NULL);
+  gst_object_unref (bus);
+  gst_element_set_state (scenechange, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_drop_buffers ();
+  gst_check_teardown_src_pad (scenechange);
+  gst_check_teardown_sink_pad (scenechange);
+  gst_check_teardown_element (scenechange);
+}
+
+GST_END_TEST;
+
+static Suite *
+scenechange_suite (void)
+{
+  Suite *s = suite_create ("scenechange");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_sad_row);
+  tcase_add_test (tc_chain, test_hist_row);
+  tcase_add_test (tc_chain, test_messages);
+
+  return s;
+}
+
+GST_CHECK_MAIN (scenechange);
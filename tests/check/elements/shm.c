@@ -42,13 +42,15 @@ GstElement *src, *sink;
 GstPad *sinkpad, *srcpad;
 
 static void
-setup_shm (void)
+setup_shm_full (guint ring_slots)
 {
   gchar *socket_path = NULL;
 
   sink = gst_check_setup_element ("shmsink");
   src = gst_check_setup_element ("shmsrc");
 
+  g_object_set (sink, "ring-slots", ring_slots, NULL);
+
   srcpad = gst_check_setup_src_pad (sink, &src_template);
   sinkpad = gst_check_setup_sink_pad (src, &sink_template);
 
@@ -69,6 +71,18 @@ setup_shm (void)
       GST_STATE_CHANGE_SUCCESS);
 }
 
+static void
+setup_shm (void)
+{
+  setup_shm_full (0);
+}
+
+static void
+setup_shm_ring (void)
+{
+  setup_shm_full (4);
+}
+
 static void
 teardown_shm (void)
 {
@@ -165,6 +179,95 @@ GST_START_TEST (test_shm_alloc)
 
 GST_END_TEST;
 
+GST_START_TEST (test_shm_alloc_stats)
+{
+  GstQuery *query;
+  GstCaps *caps = gst_caps_new_empty_simple ("application/x-test");
+  GstAllocator *alloc;
+  GstAllocationParams params;
+  GstMemory *mem[8];
+  gdouble fragmentation;
+  guint64 latency_avg, latency_max;
+  guint i;
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+
+  query = gst_query_new_allocation (caps, FALSE);
+  gst_caps_unref (caps);
+  fail_unless (gst_pad_peer_query (srcpad, query));
+  gst_query_parse_nth_allocation_param (query, 0, &alloc, &params);
+  fail_unless (alloc != NULL);
+  gst_query_unref (query);
+
+  g_object_get (sink, "fragmentation", &fragmentation, NULL);
+  fail_unless (fragmentation == 0.0);
+
+  /* small and large blocks mixed, then free every other one */
+  for (i = 0; i < G_N_ELEMENTS (mem); i++) {
+    mem[i] = gst_allocator_alloc (alloc, i % 2 ? 16 * 1024 : 1000, &params);
+    fail_unless (mem[i] != NULL);
+    fail_unless (mem[i]->allocator == alloc);
+  }
+  for (i = 0; i < G_N_ELEMENTS (mem); i += 2)
+    gst_memory_unref (mem[i]);
+
+  g_object_get (sink, "fragmentation", &fragmentation, NULL);
+  fail_unless (fragmentation > 0.0 && fragmentation < 1.0);
+
+  /* freed neighbours are merged again */
+  for (i = 1; i < G_N_ELEMENTS (mem); i += 2)
+    gst_memory_unref (mem[i]);
+
+  g_object_get (sink, "fragmentation", &fragmentation, "alloc-latency-avg",
+      &latency_avg, "alloc-latency-max", &latency_max, NULL);
+  fail_unless (fragmentation == 0.0);
+  fail_unless (latency_avg <= latency_max);
+
+  gst_object_unref (alloc);
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_ring)
+{
+  GstBuffer *buf;
+  GstMapInfo map;
+  GstSegment segment;
+  guint i;
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  /* go around the 4 slots of the ring a few times, every buffer has to be
+   * released before the writer can reuse its slot */
+  for (i = 0; i < 20; i++) {
+    buf = gst_buffer_new_allocate (NULL, 1000 + i, NULL);
+    gst_buffer_memset (buf, 0, i, 1000 + i);
+    fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+
+    g_mutex_lock (&check_mutex);
+    while (buffers == NULL)
+      g_cond_wait (&check_cond, &check_mutex);
+    g_mutex_unlock (&check_mutex);
+    fail_unless (g_list_length (buffers) == 1);
+
+    buf = buffers->data;
+    fail_unless (gst_buffer_get_size (buf) == 1000 + i);
+    gst_buffer_map (buf, &map, GST_MAP_READ);
+    fail_unless (map.data[0] == i && map.data[999 + i] == i);
+    gst_buffer_unmap (buf, &map);
+
+    gst_check_drop_buffers ();
+  }
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
 static Suite *
 shm_suite (void)
 {
@@ -175,6 +278,12 @@ shm_suite (void)
   tcase_add_checked_fixture (tc, setup_shm, NULL);
   tcase_add_test (tc, test_shm_sysmem_alloc);
   tcase_add_test (tc, test_shm_alloc);
+  tcase_add_test (tc, test_shm_alloc_stats);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("ring");
+  tcase_add_checked_fixture (tc, setup_shm_ring, NULL);
+  tcase_add_test (tc, test_shm_ring);
   suite_add_tcase (s, tc);
 
   return s;
@@ -0,0 +1,784 @@
+/* GStreamer
+ *
+ * unit test for tsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <gst/check/gstcheck.h>
+
+#define TS_PACKET_SIZE 188
+#define PID_PMT 0x100
+#define PID_AUDIO 0x101
+#define PID_VIDEO 0x102
+
+/* each PES packet carries this many bytes of payload and takes 6 packets */
+#define PES_PAYLOAD_SIZE 1000
+#define N_PES 40
+
+/* a video PES packet too big to be shared, like any HD frame */
+#define LARGE_PES_PAYLOAD_SIZE 100000
+#define N_LARGE_PES 4
+
+#define TS_CAPS_STRING "video/mpegts, " \
+                       "systemstream = (boolean) true, " \
+                       "packetsize = (int) 188"
+
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (TS_CAPS_STRING));
+
+/* What arrives on mysinkpad, protected by test_lock. While gate_closed is
+ * set, the chain function blocks until the pad is flushed. */
+static GMutex test_lock;
+static GCond test_cond;
+static gboolean gate_closed;
+static gboolean sink_flushing;
+static gboolean got_eos;
+static guint n_out_buffers;
+static guint64 n_out_bytes;
+static guint n_corrupt_buffers;
+static GThread *output_thread;
+
+static guint32
+crc32_mpeg (const guint8 * data, guint len)
+{
+  guint32 crc = 0xffffffff;
+  guint i, j;
+
+  for (i = 0; i < len; i++) {
+    crc ^= (guint32) data[i] << 24;
+    for (j = 0; j < 8; j++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+  }
+  return crc;
+}
+
+/* Writes a packet with a PSI section of @len bytes, CRC excluded */
+static void
+write_section_packet (guint8 * p, guint16 pid, guint8 * section, guint len)
+{
+  GST_WRITE_UINT32_BE (section + len, crc32_mpeg (section, len));
+
+  memset (p, 0xff, TS_PACKET_SIZE);
+  p[0] = 0x47;
+  p[1] = 0x40 | (pid >> 8);
+  p[2] = pid & 0xff;
+  p[3] = 0x10;
+  p[4] = 0;                     /* pointer field */
+  memcpy (p + 5, section, len + 4);
+}
+
+/* Splits @pes into packets of @pid, the last one padded with an adaptation
+ * field. Returns the number of packets written. */
+static guint
+write_pes_packets (guint8 * p, guint16 pid, const guint8 * pes, guint size,
+    guint8 * cc)
+{
+  guint n = 0;
+
+  while (size > 0) {
+    guint chunk = MIN (size, TS_PACKET_SIZE - 4);
+
+    p[0] = 0x47;
+    p[1] = (n == 0 ? 0x40 : 0x00) | (pid >> 8);
+    p[2] = pid & 0xff;
+    if (chunk == TS_PACKET_SIZE - 4) {
+      p[3] = 0x10 | (*cc & 0xf);
+      memcpy (p + 4, pes, chunk);
+    } else {
+      guint af_len = TS_PACKET_SIZE - 5 - chunk;
+
+      p[3] = 0x30 | (*cc & 0xf);
+      p[4] = af_len;
+      if (af_len > 0) {
+        p[5] = 0;
+        memset (p + 6, 0xff, af_len - 1);
+      }
+      memcpy (p + 5 + af_len, pes, chunk);
+    }
+    (*cc)++;
+    pes += chunk;
+    size -= chunk;
+    p += TS_PACKET_SIZE;
+    n++;
+  }
+
+  return n;
+}
+
+/* Writes a PAT and a PMT with one stream of @stream_type in @pid, which also
+ * carries the PCR. Returns the number of packets written. */
+static guint
+write_tables (guint8 * p, guint8 stream_type, guint16 pid)
+{
+  guint8 section[32];
+
+  /* PAT: program 1 in PID_PMT */
+  section[0] = 0x00;
+  section[1] = 0xb0;
+  section[2] = 13;
+  GST_WRITE_UINT16_BE (section + 3, 1);
+  section[5] = 0xc1;
+  section[6] = section[7] = 0;
+  GST_WRITE_UINT16_BE (section + 8, 1);
+  GST_WRITE_UINT16_BE (section + 10, 0xe000 | PID_PMT);
+  write_section_packet (p, 0, section, 12);
+  p += TS_PACKET_SIZE;
+
+  /* PMT */
+  section[0] = 0x02;
+  section[1] = 0xb0;
+  section[2] = 18;
+  GST_WRITE_UINT16_BE (section + 3, 1);
+  section[5] = 0xc1;
+  section[6] = section[7] = 0;
+  GST_WRITE_UINT16_BE (section + 8, 0xe000 | pid);
+  GST_WRITE_UINT16_BE (section + 10, 0xf000);
+  section[12] = stream_type;
+  GST_WRITE_UINT16_BE (section + 13, 0xe000 | pid);
+  GST_WRITE_UINT16_BE (section + 15, 0xf000);
+  write_section_packet (p, PID_PMT, section, 17);
+
+  return 2;
+}
+
+/* Writes the header of a PES packet of @stream_id with a PTS, 0 as
+ * @payload_size leaves its length unbounded */
+static void
+write_pes_header (guint8 * pes, guint8 stream_id, guint payload_size,
+    guint64 pts)
+{
+  pes[0] = pes[1] = 0;
+  pes[2] = 1;
+  pes[3] = stream_id;
+  GST_WRITE_UINT16_BE (pes + 4, payload_size ? payload_size + 8 : 0);
+  pes[6] = 0x80;
+  pes[7] = 0x80;
+  pes[8] = 5;
+  pes[9] = 0x21 | ((pts >> 29) & 0x0e);
+  pes[10] = (pts >> 22) & 0xff;
+  pes[11] = ((pts >> 14) & 0xfe) | 1;
+  pes[12] = (pts >> 7) & 0xff;
+  pes[13] = ((pts << 1) & 0xfe) | 1;
+}
+
+/* A transport stream with a PAT, a PMT with one MPEG audio stream and
+ * @n_pes PES packets of PES_PAYLOAD_SIZE bytes of payload. If @skip_pes is
+ * valid, the continuity counter of that PES packet has a gap. */
+static GstBuffer *
+create_stream (guint n_pes, gint skip_pes)
+{
+  guint8 pes[PES_PAYLOAD_SIZE + 14];
+  guint8 *data, *p, cc = 0;
+  guint i, j, size;
+
+  size = (2 + n_pes * 6) * TS_PACKET_SIZE;
+  data = p = g_malloc (size);
+
+  p += write_tables (p, 0x03, PID_AUDIO) * TS_PACKET_SIZE;
+
+  for (i = 0; i < n_pes; i++) {
+    write_pes_header (pes, 0xc0, PES_PAYLOAD_SIZE, 90000 + i * 2160);
+    for (j = 0; j < PES_PAYLOAD_SIZE; j++)
+      pes[14 + j] = i + j;
+
+    if ((gint) i == skip_pes) {
+      /* lose the third packet of this one */
+      guint8 tmp[6 * TS_PACKET_SIZE];
+
+      write_pes_packets (tmp, PID_AUDIO, pes, sizeof (pes), &cc);
+      memcpy (p, tmp, 2 * TS_PACKET_SIZE);
+      memcpy (p + 2 * TS_PACKET_SIZE, tmp + 3 * TS_PACKET_SIZE,
+          3 * TS_PACKET_SIZE);
+      p += 5 * TS_PACKET_SIZE;
+      size -= TS_PACKET_SIZE;
+    } else {
+      p += write_pes_packets (p, PID_AUDIO, pes, sizeof (pes),
+          &cc) * TS_PACKET_SIZE;
+    }
+  }
+
+  return gst_buffer_new_wrapped (data, size);
+}
+
+/* A transport stream with a PAT, a PMT with one H.264 stream and @n_pes
+ * PES packets of unbounded length with LARGE_PES_PAYLOAD_SIZE bytes of
+ * payload each */
+static GstBuffer *
+create_video_stream (guint n_pes)
+{
+  guint8 *pes, *data, *p, cc = 0;
+  guint i, j, n_packets;
+
+  pes = g_malloc (LARGE_PES_PAYLOAD_SIZE + 14);
+  n_packets = (LARGE_PES_PAYLOAD_SIZE + 14 + TS_PACKET_SIZE - 5) /
+      (TS_PACKET_SIZE - 4);
+  data = p = g_malloc ((2 + n_pes * n_packets) * TS_PACKET_SIZE);
+
+  p += write_tables (p, 0x1b, PID_VIDEO) * TS_PACKET_SIZE;
+
+  for (i = 0; i < n_pes; i++) {
+    write_pes_header (pes, 0xe0, 0, 90000 + i * 3600);
+    for (j = 0; j < LARGE_PES_PAYLOAD_SIZE; j++)
+      pes[14 + j] = i + j;
+    p += write_pes_packets (p, PID_VIDEO, pes, LARGE_PES_PAYLOAD_SIZE + 14,
+        &cc) * TS_PACKET_SIZE;
+  }
+  g_free (pes);
+
+  return gst_buffer_new_wrapped (data, p - data);
+}
+
+static GstFlowReturn
+sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  g_mutex_lock (&test_lock);
+  while (gate_closed && !sink_flushing)
+    g_cond_wait (&test_cond, &test_lock);
+
+  if (sink_flushing) {
+    ret = GST_FLOW_FLUSHING;
+  } else {
+    GstMapInfo map;
+    gsize i;
+
+    output_thread = g_thread_self ();
+    n_out_buffers++;
+    n_out_bytes += gst_buffer_get_size (buffer);
+
+    /* the payloads are made of increasing bytes */
+    gst_buffer_map (buffer, &map, GST_MAP_READ);
+    for (i = 1; i < map.size; i++) {
+      if ((guint8) (map.data[i] - map.data[0]) != (guint8) i) {
+        n_corrupt_buffers++;
+        break;
+      }
+    }
+    gst_buffer_unmap (buffer, &map);
+    g_cond_broadcast (&test_cond);
+  }
+  g_mutex_unlock (&test_lock);
+
+  gst_buffer_unref (buffer);
+
+  return ret;
+}
+
+static gboolean
+sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  g_mutex_lock (&test_lock);
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      sink_flushing = TRUE;
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      sink_flushing = FALSE;
+      break;
+    case GST_EVENT_EOS:
+      got_eos = TRUE;
+      break;
+    default:
+      break;
+  }
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static void
+pad_added (GstElement * demux, GstPad * pad, gpointer user_data)
+{
+  fail_unless_equals_int (gst_pad_link (pad, mysinkpad), GST_PAD_LINK_OK);
+}
+
+static GstElement *
+setup_tsdemux (void)
+{
+  GstElement *demux;
+  GstSegment segment;
+
+  demux = gst_check_setup_element ("tsdemux");
+  mysrcpad = gst_check_setup_src_pad (demux, &srctemplate);
+  mysinkpad = gst_pad_new_from_static_template (&sinktemplate, "sink");
+  gst_pad_set_chain_function (mysinkpad, sink_chain);
+  gst_pad_set_event_function (mysinkpad, sink_event);
+  gst_pad_set_active (mysinkpad, TRUE);
+  g_signal_connect (demux, "pad-added", G_CALLBACK (pad_added), NULL);
+
+  gate_closed = FALSE;
+  sink_flushing = FALSE;
+  got_eos = FALSE;
+  n_out_buffers = 0;
+  n_out_bytes = 0;
+  n_corrupt_buffers = 0;
+  output_thread = NULL;
+
+  gst_pad_set_active (mysrcpad, TRUE);
+  fail_unless (gst_element_set_state (demux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  fail_unless (gst_pad_push_event (mysrcpad,
+          gst_event_new_stream_start ("test")));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_segment (&segment)));
+
+  return demux;
+}
+
+static void
+cleanup_tsdemux (GstElement * demux)
+{
+  gst_element_set_state (demux, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_check_teardown_src_pad (demux);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_object_unref (mysinkpad);
+  gst_check_teardown_element (demux);
+}
+
+/* Pushes the stream in chunks of 7 packets until it is done or a push
+ * fails */
+static GstFlowReturn
+push_stream (GstBuffer * stream)
+{
+  gsize size = gst_buffer_get_size (stream), offset;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  for (offset = 0; offset < size && ret == GST_FLOW_OK;
+      offset += 7 * TS_PACKET_SIZE) {
+    GstBuffer *buf;
+
+    buf = gst_buffer_copy_region (stream, GST_BUFFER_COPY_ALL, offset,
+        MIN (7 * TS_PACKET_SIZE, size - offset));
+    GST_BUFFER_OFFSET (buf) = offset;
+    ret = gst_pad_push (mysrcpad, buf);
+  }
+
+  return ret;
+}
+
+/* push_stream() from another thread */
+typedef struct
+{
+  GstBuffer *stream;
+  GstFlowReturn ret;
+  volatile gint done;
+} Pusher;
+
+static gpointer
+pusher_func (Pusher * pusher)
+{
+  pusher->ret = push_stream (pusher->stream);
+  g_atomic_int_set (&pusher->done, 1);
+
+  return NULL;
+}
+
+static GThread *
+start_pusher (Pusher * pusher, GstBuffer * stream)
+{
+  pusher->stream = stream;
+  pusher->done = 0;
+
+  return g_thread_new ("pusher", (GThreadFunc) pusher_func, pusher);
+}
+
+static void
+open_gate (void)
+{
+  g_mutex_lock (&test_lock);
+  gate_closed = FALSE;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+}
+
+static void
+push_eos_and_wait (void)
+{
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  g_mutex_lock (&test_lock);
+  while (!got_eos)
+    g_cond_wait (&test_cond, &test_lock);
+  g_mutex_unlock (&test_lock);
+}
+
+/* Whether the pusher is still busy after a while */
+static gboolean
+pusher_blocks (Pusher * pusher)
+{
+  guint i;
+
+  for (i = 0; i < 50 && !g_atomic_int_get (&pusher->done); i++)
+    g_usleep (10 * 1000);
+
+  return !g_atomic_int_get (&pusher->done);
+}
+
+GST_START_TEST (test_threaded_output)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+
+  demux = setup_tsdemux ();
+  g_object_set (demux, "threaded-output", TRUE, NULL);
+
+  stream = create_stream (N_PES, -1);
+  fail_unless_equals_int (push_stream (stream), GST_FLOW_OK);
+  push_eos_and_wait ();
+
+  fail_unless_equals_int (n_out_buffers, N_PES);
+  fail_unless_equals_uint64 (n_out_bytes, N_PES * PES_PAYLOAD_SIZE);
+  /* pushed from the output task, not from the streaming thread */
+  fail_unless (output_thread != NULL);
+  fail_unless (output_thread != g_thread_self ());
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_threaded_output_queue_limit)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+  GThread *thread;
+  Pusher pusher;
+
+  demux = setup_tsdemux ();
+  /* room for about 4 PES packets */
+  g_object_set (demux, "threaded-output", TRUE,
+      "output-queue-size", 4 * PES_PAYLOAD_SIZE, NULL);
+
+  gate_closed = TRUE;
+  stream = create_stream (N_PES, -1);
+  thread = start_pusher (&pusher, stream);
+
+  /* downstream doesn't take anything, so the streaming thread has to block
+   * on the full queue */
+  fail_unless (pusher_blocks (&pusher));
+  fail_unless_equals_int (n_out_buffers, 0);
+
+  open_gate ();
+  g_thread_join (thread);
+  fail_unless_equals_int (pusher.ret, GST_FLOW_OK);
+  push_eos_and_wait ();
+
+  fail_unless_equals_int (n_out_buffers, N_PES);
+  fail_unless_equals_uint64 (n_out_bytes, N_PES * PES_PAYLOAD_SIZE);
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_threaded_output_unlimited_queue)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+  GThread *thread;
+  Pusher pusher;
+
+  demux = setup_tsdemux ();
+  g_object_set (demux, "threaded-output", TRUE, "output-queue-size", 0, NULL);
+
+  /* with no limit, everything is queued while downstream blocks */
+  gate_closed = TRUE;
+  stream = create_stream (N_PES, -1);
+  thread = start_pusher (&pusher, stream);
+  g_thread_join (thread);
+  fail_unless_equals_int (pusher.ret, GST_FLOW_OK);
+  fail_unless_equals_int (n_out_buffers, 0);
+
+  open_gate ();
+  push_eos_and_wait ();
+
+  fail_unless_equals_int (n_out_buffers, N_PES);
+  fail_unless_equals_uint64 (n_out_bytes, N_PES * PES_PAYLOAD_SIZE);
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_threaded_output_flush)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+  GstSegment segment;
+  GThread *thread;
+  Pusher pusher;
+
+  demux = setup_tsdemux ();
+  g_object_set (demux, "threaded-output", TRUE,
+      "output-queue-size", 4 * PES_PAYLOAD_SIZE, NULL);
+
+  gate_closed = TRUE;
+  stream = create_stream (N_PES, -1);
+  thread = start_pusher (&pusher, stream);
+  fail_unless (pusher_blocks (&pusher));
+
+  /* a flush unblocks both the streaming thread and the output task */
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_flush_start ()));
+  g_thread_join (thread);
+  fail_unless_equals_int (pusher.ret, GST_FLOW_FLUSHING);
+  fail_unless_equals_int (n_out_buffers, 0);
+
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_flush_stop (TRUE)));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_segment (&segment)));
+
+  /* nothing from before the flush comes out, all of the new data does */
+  open_gate ();
+  fail_unless_equals_int (push_stream (stream), GST_FLOW_OK);
+  push_eos_and_wait ();
+
+  fail_unless_equals_int (n_out_buffers, N_PES);
+  fail_unless_equals_uint64 (n_out_bytes, N_PES * PES_PAYLOAD_SIZE);
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+static void
+check_stats (GstElement * demux, gboolean shared)
+{
+  guint64 bytes_shared, bytes_copied;
+
+  g_object_get (demux, "bytes-shared", &bytes_shared, "bytes-copied",
+      &bytes_copied, NULL);
+
+  fail_unless_equals_int (n_corrupt_buffers, 0);
+
+  /* every output byte is accounted for exactly once */
+  fail_unless_equals_uint64 (bytes_shared + bytes_copied, n_out_bytes);
+  if (shared)
+    fail_unless (bytes_shared > 0);
+  else
+    fail_unless_equals_uint64 (bytes_shared, 0);
+}
+
+GST_START_TEST (test_zero_copy_stats)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+
+  demux = setup_tsdemux ();
+  g_object_set (demux, "zero-copy", TRUE, NULL);
+
+  stream = create_stream (N_PES, -1);
+  fail_unless_equals_int (push_stream (stream), GST_FLOW_OK);
+  push_eos_and_wait ();
+
+  fail_unless_equals_int (n_out_buffers, N_PES);
+  fail_unless_equals_uint64 (n_out_bytes, N_PES * PES_PAYLOAD_SIZE);
+  check_stats (demux, TRUE);
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_zero_copy_stats_discont)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+
+  demux = setup_tsdemux ();
+  g_object_set (demux, "zero-copy", TRUE, NULL);
+
+  /* the bytes already gathered for the broken PES packet are dropped and
+   * must not be counted for the next one */
+  stream = create_stream (N_PES, N_PES / 2);
+  fail_unless_equals_int (push_stream (stream), GST_FLOW_OK);
+  push_eos_and_wait ();
+
+  fail_unless_equals_int (n_out_buffers, N_PES - 1);
+  fail_unless_equals_uint64 (n_out_bytes, (N_PES - 1) * PES_PAYLOAD_SIZE);
+  check_stats (demux, TRUE);
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_zero_copy_large_pes)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+  guint64 bytes_shared, bytes_copied;
+
+  demux = setup_tsdemux ();
+  g_object_set (demux, "zero-copy", TRUE, NULL);
+
+  stream = create_video_stream (N_LARGE_PES);
+  fail_unless_equals_int (push_stream (stream), GST_FLOW_OK);
+  push_eos_and_wait ();
+
+  fail_unless_equals_int (n_out_buffers, N_LARGE_PES);
+  fail_unless_equals_uint64 (n_out_bytes,
+      N_LARGE_PES * LARGE_PES_PAYLOAD_SIZE);
+  fail_unless_equals_int (n_corrupt_buffers, 0);
+
+  /* too many TS packets to be shared, they are all copied */
+  g_object_get (demux, "bytes-shared", &bytes_shared, "bytes-copied",
+      &bytes_copied, NULL);
+  fail_unless_equals_uint64 (bytes_shared, 0);
+  fail_unless_equals_uint64 (bytes_copied, n_out_bytes);
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_copy_stats)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+
+  demux = setup_tsdemux ();
+  g_object_set (demux, "zero-copy", FALSE, NULL);
+
+  stream = create_stream (N_PES, N_PES / 2);
+  fail_unless_equals_int (push_stream (stream), GST_FLOW_OK);
+  push_eos_and_wait ();
+
+  fail_unless_equals_int (n_out_buffers, N_PES - 1);
+  check_stats (demux, FALSE);
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+/* Bytes without any sync byte, pushed in pieces smaller than the adapter
+ * windows the packetizer scans */
+#define GARBAGE_SIZE 8000
+#define GARBAGE_PIECE_SIZE 1000
+
+static void
+push_garbage (guint64 * offset)
+{
+  guint i, j;
+
+  for (i = 0; i < GARBAGE_SIZE; i += GARBAGE_PIECE_SIZE) {
+    guint8 *data = g_malloc (GARBAGE_PIECE_SIZE);
+    GstBuffer *buf;
+
+    for (j = 0; j < GARBAGE_PIECE_SIZE; j++) {
+      data[j] = (i + j) * 13 + 5;
+      if (data[j] == 0x47)
+        data[j] = 0x48;
+    }
+    buf = gst_buffer_new_wrapped (data, GARBAGE_PIECE_SIZE);
+    GST_BUFFER_OFFSET (buf) = *offset;
+    *offset += GARBAGE_PIECE_SIZE;
+    fail_unless_equals_int (gst_pad_push (mysrcpad, buf), GST_FLOW_OK);
+  }
+}
+
+static void
+push_region (GstBuffer * stream, gsize start, gsize size, guint64 * offset)
+{
+  GstBuffer *buf;
+
+  buf = gst_buffer_copy_region (stream, GST_BUFFER_COPY_ALL, start, size);
+  GST_BUFFER_OFFSET (buf) = *offset;
+  *offset += size;
+  fail_unless_equals_int (gst_pad_push (mysrcpad, buf), GST_FLOW_OK);
+}
+
+GST_START_TEST (test_resync_after_garbage)
+{
+  GstElement *demux;
+  GstBuffer *stream;
+  guint64 offset = 0;
+  gsize size, head;
+
+  demux = setup_tsdemux ();
+
+  stream = create_stream (N_PES, -1);
+  size = gst_buffer_get_size (stream);
+  /* the PAT, the PMT and the first two PES packets */
+  head = (2 + 2 * 6) * TS_PACKET_SIZE;
+
+  /* garbage before the packet size is known, and after it when resyncing */
+  push_garbage (&offset);
+  push_region (stream, 0, head, &offset);
+  push_garbage (&offset);
+  push_region (stream, head, size - head, &offset);
+
+  /* the whole stream came out of the last push, only the last PES packet
+   * may wait for EOS */
+  fail_unless (n_out_buffers >= N_PES - 1);
+
+  push_eos_and_wait ();
+  fail_unless_equals_int (n_out_buffers, N_PES);
+  fail_unless_equals_uint64 (n_out_bytes, N_PES * PES_PAYLOAD_SIZE);
+
+  gst_buffer_unref (stream);
+  cleanup_tsdemux (demux);
+}
+
+GST_END_TEST;
+
+static Suite *
+tsdemux_suite (void)
+{
+  Suite *s = suite_create ("tsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_threaded_output);
+  tcase_add_test (tc_chain, test_threaded_output_queue_limit);
+  tcase_add_test (tc_chain, test_threaded_output_unlimited_queue);
+  tcase_add_test (tc_chain, test_threaded_output_flush);
+  tcase_add_test (tc_chain, test_zero_copy_stats);
+  tcase_add_test (tc_chain, test_zero_copy_stats_discont);
+  tcase_add_test (tc_chain, test_zero_copy_large_pes);
+  tcase_add_test (tc_chain, test_copy_stats);
+  tcase_add_test (tc_chain, test_resync_after_garbage);
+
+  return s;
+}
+
+GST_CHECK_MAIN (tsdemux);
@@ -0,0 +1,142 @@
+/* GStreamer
+ *
+ * unit test for yadif
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include "gstyadif.h"
+
+/* The line is filtered in the middle of five rows, the filter also reads
+ * the two rows above and below it and up to three pixels left and right */
+#define WIDTH 64
+#define BORDER 16
+#define STRIDE (BORDER + WIDTH + BORDER)
+#define N_ROWS 5
+#define N_RUNS 100
+
+static const gchar *impls[] = { "avx2", "ssse3", "sse2" };
+
+static void
+fill_random (guint8 * data, gint depth)
+{
+  gint i;
+
+  if (depth > 8) {
+    guint16 *data16 = (guint16 *) data;
+
+    for (i = 0; i < N_ROWS * STRIDE; i++)
+      data16[i] = g_random_int_range (0, 1 << depth);
+  } else {
+    for (i = 0; i < N_ROWS * STRIDE; i++)
+      data[i] = g_random_int_range (0, 1 << depth);
+  }
+}
+
+static void
+check_filter_line (const gchar * impl, gint depth)
+{
+  GstYadifFilterLine filter_line;
+  gint bpp = depth > 8 ? 2 : 1;
+  gint refs = STRIDE * bpp;
+  gint offset = 2 * refs + BORDER * bpp;
+  guint8 *prev, *cur, *next, *dst, *dst_c;
+  gint run, parity, mode;
+
+  filter_line = yadif_get_filter_line_impl (depth, impl);
+  if (filter_line == NULL) {
+    GST_INFO ("no %s filter for %d bits", impl, depth);
+    return;
+  }
+
+  prev = g_malloc (N_ROWS * refs);
+  cur = g_malloc (N_ROWS * refs);
+  next = g_malloc (N_ROWS * refs);
+  dst = g_malloc (refs);
+  dst_c = g_malloc (refs);
+
+  for (run = 0; run < N_RUNS; run++) {
+    fill_random (prev, depth);
+    fill_random (cur, depth);
+    fill_random (next, depth);
+
+    for (parity = 0; parity < 2; parity++) {
+      for (mode = 0; mode < 4; mode++) {
+        memset (dst, 0, refs);
+        memset (dst_c, 0, refs);
+
+        filter_line (dst + BORDER * bpp, prev + offset, cur + offset,
+            next + offset, WIDTH, refs, -refs, parity, mode);
+        if (depth > 8)
+          yadif_filter_line_c_16bit ((guint16 *) (dst_c + BORDER * bpp),
+              (guint16 *) (prev + offset), (guint16 *) (cur + offset),
+              (guint16 *) (next + offset), WIDTH, refs, -refs, parity, mode);
+        else
+          yadif_filter_line_c (dst_c + BORDER * bpp, prev + offset,
+              cur + offset, next + offset, WIDTH, refs, -refs, parity, mode);
+
+        fail_unless (memcmp (dst, dst_c, refs) == 0,
+            "%s filter differs for %d bits, parity %d, mode %d", impl, depth,
+            parity, mode);
+      }
+    }
+  }
+
+  g_free (prev);
+  g_free (cur);
+  g_free (next);
+  g_free (dst);
+  g_free (dst_c);
+}
+
+GST_START_TEST (test_filter_line_8bit)
+{
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (impls); i++)
+    check_filter_line (impls[i], 8);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_filter_line_16bit)
+{
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+    check_filter_line (impls[i], 10);
+    check_filter_line (impls[i], 12);
+  }
+}
+
+GST_END_TEST;
+
+static Suite *
+yadif_suite (void)
+{
+  Suite *s = suite_create ("yadif");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_filter_line_8bit);
+  tcase_add_test (tc_chain, test_filter_line_16bit);
+
+  return s;
+}
+
+GST_CHECK_MAIN (yadif);
@@ -0,0 +1,266 @@
+/* GStreamer
+ *
+ * unit test for the bandwidth estimator of the adaptive demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/uridownloader/gstbandwidthestimator.h>
+
+#define MBPS 1000000
+
+/* adds a download of @duration at @bitrate */
+static void
+add_download (GstBandwidthEstimator * est, guint64 bitrate,
+    GstClockTime duration)
+{
+  gst_bandwidth_estimator_add_sample (est,
+      gst_util_uint64_scale (bitrate / 8, duration, GST_SECOND), duration);
+}
+
+GST_START_TEST (test_estimate_constant)
+{
+  GstBandwidthEstimator est;
+  guint64 estimate;
+  gint i;
+
+  gst_bandwidth_estimator_init (&est);
+  fail_unless_equals_uint64 (gst_bandwidth_estimator_get_estimate (&est), 0);
+
+  for (i = 0; i < 10; i++)
+    add_download (&est, 4 * MBPS, GST_SECOND);
+
+  estimate = gst_bandwidth_estimator_get_estimate (&est);
+  /* the averages are corrected for their initial value */
+  fail_unless (estimate > 4 * MBPS * 0.99 && estimate < 4 * MBPS * 1.01,
+      "estimate %" G_GUINT64_FORMAT, estimate);
+
+  gst_bandwidth_estimator_reset (&est);
+  fail_unless_equals_uint64 (gst_bandwidth_estimator_get_estimate (&est), 0);
+
+  gst_bandwidth_estimator_deinit (&est);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_estimate_outlier)
+{
+  GstBandwidthEstimator est;
+  guint64 estimate;
+  gint i;
+
+  gst_bandwidth_estimator_init (&est);
+
+  for (i = 0; i < 10; i++)
+    add_download (&est, 2 * MBPS, 2 * GST_SECOND);
+  /* one fast download (e.g. from a cache) must not raise the estimate */
+  add_download (&est, 50 * MBPS, 100 * GST_MSECOND);
+
+  estimate = gst_bandwidth_estimator_get_estimate (&est);
+  fail_unless (estimate < 2 * MBPS * 1.05, "estimate %" G_GUINT64_FORMAT,
+      estimate);
+
+  /* but a drop is followed quickly */
+  for (i = 0; i < 3; i++)
+    add_download (&est, MBPS / 2, 2 * GST_SECOND);
+  estimate = gst_bandwidth_estimator_get_estimate (&est);
+  fail_unless (estimate < MBPS, "estimate %" G_GUINT64_FORMAT, estimate);
+
+  gst_bandwidth_estimator_deinit (&est);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_estimate_overlapping)
+{
+  GstBandwidthEstimator est;
+  GstBandwidthEstimatorDownload audio, video;
+  GstClockTime now = 10 * GST_SECOND;
+  guint64 estimate;
+  gint i;
+
+  gst_bandwidth_estimator_init (&est);
+
+  /* an 8 Mbit/s link shared by two downloads running at the same time,
+   * each one only gets half of it */
+  for (i = 0; i < 10; i++) {
+    gst_bandwidth_estimator_download_start (&est, &audio, now);
+    gst_bandwidth_estimator_download_start (&est, &video, now);
+    now += GST_SECOND;
+    gst_bandwidth_estimator_download_stop (&est, &audio, 4 * MBPS / 8, now);
+    gst_bandwidth_estimator_download_stop (&est, &video, 4 * MBPS / 8, now);
+  }
+
+  estimate = gst_bandwidth_estimator_get_estimate (&est);
+  fail_unless (estimate > 8 * MBPS * 0.99 && estimate < 8 * MBPS * 1.01,
+      "estimate %" G_GUINT64_FORMAT, estimate);
+
+  /* the second download only overlaps the second half of the first one */
+  gst_bandwidth_estimator_reset (&est);
+  for (i = 0; i < 10; i++) {
+    gst_bandwidth_estimator_download_start (&est, &video, now);
+    now += GST_SECOND;
+    gst_bandwidth_estimator_download_start (&est, &audio, now);
+    now += GST_SECOND;
+    gst_bandwidth_estimator_download_stop (&est, &video, 12 * MBPS / 8, now);
+    gst_bandwidth_estimator_download_stop (&est, &audio, 4 * MBPS / 8, now);
+  }
+
+  /* the first download is counted as shared by 1.5 downloads on average,
+   * so the estimate is at least the link rate */
+  estimate = gst_bandwidth_estimator_get_estimate (&est);
+  fail_unless (estimate > 8 * MBPS * 0.99 && estimate < 8 * MBPS * 1.2,
+      "estimate %" G_GUINT64_FORMAT, estimate);
+
+  /* a download alone is not scaled */
+  gst_bandwidth_estimator_reset (&est);
+  for (i = 0; i < 10; i++) {
+    gst_bandwidth_estimator_download_start (&est, &video, now);
+    now += GST_SECOND;
+    gst_bandwidth_estimator_download_stop (&est, &video, 8 * MBPS / 8, now);
+  }
+
+  estimate = gst_bandwidth_estimator_get_estimate (&est);
+  fail_unless (estimate > 8 * MBPS * 0.99 && estimate < 8 * MBPS * 1.01,
+      "estimate %" G_GUINT64_FORMAT, estimate);
+
+  gst_bandwidth_estimator_deinit (&est);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_target_hysteresis)
+{
+  GstBandwidthEstimator est;
+  gint i;
+
+  gst_bandwidth_estimator_init (&est);
+  gst_bandwidth_estimator_set_hysteresis (&est, 0.2);
+
+  /* no estimate, keep the current bitrate */
+  fail_unless_equals_uint64 (gst_bandwidth_estimator_get_target_bitrate (&est,
+          1.0, MBPS, GST_CLOCK_TIME_NONE), MBPS);
+
+  for (i = 0; i < 10; i++)
+    add_download (&est, 1.1 * MBPS, GST_SECOND);
+
+  /* 10% above the current bitrate is not enough to switch up */
+  fail_unless_equals_uint64 (gst_bandwidth_estimator_get_target_bitrate (&est,
+          1.0, MBPS, GST_CLOCK_TIME_NONE), MBPS);
+  /* with a lower current bitrate it is */
+  fail_unless (gst_bandwidth_estimator_get_target_bitrate (&est, 1.0,
+          MBPS / 2, GST_CLOCK_TIME_NONE) > MBPS);
+  /* switching down happens at once */
+  fail_unless (gst_bandwidth_estimator_get_target_bitrate (&est, 1.0,
+          2 * MBPS, GST_CLOCK_TIME_NONE) < 2 * MBPS);
+  /* the usage factor is applied */
+  fail_unless (gst_bandwidth_estimator_get_target_bitrate (&est, 0.5,
+          MBPS, GST_CLOCK_TIME_NONE) < MBPS);
+
+  gst_bandwidth_estimator_deinit (&est);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_target_buffer_level)
+{
+  GstBandwidthEstimator est;
+  guint64 target;
+  gint i;
+
+  gst_bandwidth_estimator_init (&est);
+  gst_bandwidth_estimator_set_hysteresis (&est, 0.0);
+  gst_bandwidth_estimator_set_low_buffer_time (&est, 10 * GST_SECOND);
+
+  for (i = 0; i < 10; i++)
+    add_download (&est, 4 * MBPS, GST_SECOND);
+
+  /* enough buffer, switch up */
+  target = gst_bandwidth_estimator_get_target_bitrate (&est, 1.0, MBPS,
+      20 * GST_SECOND);
+  fail_unless (target > 3 * MBPS, "target %" G_GUINT64_FORMAT, target);
+
+  /* low buffer, don't switch up */
+  target = gst_bandwidth_estimator_get_target_bitrate (&est, 1.0, MBPS,
+      5 * GST_SECOND);
+  fail_unless_equals_uint64 (target, MBPS);
+
+  /* low buffer, the target is scaled down with the level */
+  target = gst_bandwidth_estimator_get_target_bitrate (&est, 1.0, 4 * MBPS,
+      5 * GST_SECOND);
+  fail_unless (target > 1.9 * MBPS && target < 2.1 * MBPS,
+      "target %" G_GUINT64_FORMAT, target);
+
+  /* empty buffer, lowest bitrate */
+  target = gst_bandwidth_estimator_get_target_bitrate (&est, 1.0, 4 * MBPS, 0);
+  fail_unless_equals_uint64 (target, 0);
+
+  gst_bandwidth_estimator_deinit (&est);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_stats)
+{
+  GstBandwidthEstimator est;
+  GstStructure *s;
+  guint64 val;
+
+  gst_bandwidth_estimator_init (&est);
+  add_download (&est, 3 * MBPS, GST_SECOND);
+
+  s = gst_bandwidth_estimator_get_stats (&est, "bandwidth-estimate");
+  fail_unless (gst_structure_has_name (s, "bandwidth-estimate"));
+  fail_unless (gst_structure_get_uint64 (s, "samples", &val));
+  fail_unless_equals_uint64 (val, 1);
+  fail_unless (gst_structure_get_uint64 (s, "last", &val));
+  fail_unless_equals_uint64 (val, 3 * MBPS);
+  fail_unless (gst_structure_get_uint64 (s, "estimate", &val));
+  fail_unless_equals_uint64 (val,
+      gst_bandwidth_estimator_get_estimate (&est));
+  fail_unless (gst_structure_has_field (s, "fast-average"));
+  fail_unless (gst_structure_has_field (s, "slow-average"));
+  fail_unless (gst_structure_has_field (s, "percentile"));
+  gst_structure_free (s);
+
+  gst_bandwidth_estimator_deinit (&est);
+}
+
+GST_END_TEST;
+
+static Suite *
+bandwidthestimator_suite (void)
+{
+  Suite *s = suite_create ("bandwidthestimator");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_estimate_constant);
+  tcase_add_test (tc_chain, test_estimate_outlier);
+  tcase_add_test (tc_chain, test_estimate_overlapping);
+  tcase_add_test (tc_chain, test_target_hysteresis);
+  tcase_add_test (tc_chain, test_target_buffer_level);
+  tcase_add_test (tc_chain, test_stats);
+
+  return s;
+}
+
+GST_CHECK_MAIN (bandwidthestimator);
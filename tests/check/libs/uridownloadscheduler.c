@@ -0,0 +1,512 @@
+/* GStreamer
+ *
+ * unit test for the download scheduler of the adaptive demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include <gst/base/gstpushsrc.h>
+#include <gst/uridownloader/gsturidownloadscheduler.h>
+
+#define N_STREAMS 2
+#define N_REQUESTS 8
+
+#define MARKER_DATA GUINT_TO_POINTER (100)
+
+static GMutex test_lock;
+static GCond test_cond;
+
+/* downloads of the test source, per stream and request */
+static gboolean held[N_STREAMS][N_REQUESTS];
+static guint n_running[N_STREAMS];
+static guint max_running[N_STREAMS];
+static guint n_served;
+
+/* user data dropped by the scheduler */
+static guint n_freed;
+
+static void
+reset_counters (void)
+{
+  memset (held, 0, sizeof (held));
+  memset (n_running, 0, sizeof (n_running));
+  memset (max_running, 0, sizeof (max_running));
+  n_served = 0;
+  n_freed = 0;
+}
+
+/* Source for the schedtest://<stream>/<n> URIs. It serves "<stream>/<n>" in
+ * one buffer, once the request is not held anymore */
+typedef struct
+{
+  GstPushSrc parent;
+
+  guint stream;
+  guint n;
+  gboolean served;
+  gboolean flushing;
+} TestSrc;
+
+typedef GstPushSrcClass TestSrcClass;
+
+static GstStaticPadTemplate test_src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void test_src_uri_handler_init (gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestSrc, test_src, GST_TYPE_PUSH_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER, test_src_uri_handler_init));
+
+static gboolean
+test_src_start (GstBaseSrc * bsrc)
+{
+  TestSrc *src = (TestSrc *) bsrc;
+
+  g_mutex_lock (&test_lock);
+  src->served = FALSE;
+  n_running[src->stream]++;
+  max_running[src->stream] = MAX (max_running[src->stream],
+      n_running[src->stream]);
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+
+  return TRUE;
+}
+
+static gboolean
+test_src_stop (GstBaseSrc * bsrc)
+{
+  TestSrc *src = (TestSrc *) bsrc;
+
+  g_mutex_lock (&test_lock);
+  n_running[src->stream]--;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+
+  return TRUE;
+}
+
+static gboolean
+test_src_unlock (GstBaseSrc * bsrc)
+{
+  TestSrc *src = (TestSrc *) bsrc;
+
+  g_mutex_lock (&test_lock);
+  src->flushing = TRUE;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+
+  return TRUE;
+}
+
+static gboolean
+test_src_unlock_stop (GstBaseSrc * bsrc)
+{
+  TestSrc *src = (TestSrc *) bsrc;
+
+  g_mutex_lock (&test_lock);
+  src->flushing = FALSE;
+  g_mutex_unlock (&test_lock);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+test_src_create (GstPushSrc * psrc, GstBuffer ** buf)
+{
+  TestSrc *src = (TestSrc *) psrc;
+  gchar *data;
+
+  if (src->served)
+    return GST_FLOW_EOS;
+
+  g_mutex_lock (&test_lock);
+  while (held[src->stream][src->n] && !src->flushing)
+    g_cond_wait (&test_cond, &test_lock);
+  if (src->flushing) {
+    g_mutex_unlock (&test_lock);
+    return GST_FLOW_FLUSHING;
+  }
+  n_served++;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+
+  data = g_strdup_printf ("%u/%u", src->stream, src->n);
+  *buf = gst_buffer_new_wrapped (data, strlen (data));
+  src->served = TRUE;
+
+  return GST_FLOW_OK;
+}
+
+static void
+test_src_class_init (TestSrcClass * klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *base_src_class = GST_BASE_SRC_CLASS (klass);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&test_src_template));
+  gst_element_class_set_static_metadata (element_class,
+      "Download scheduler test source", "Source",
+      "Serves the test requests", "test");
+
+  base_src_class->start = test_src_start;
+  base_src_class->stop = test_src_stop;
+  base_src_class->unlock = test_src_unlock;
+  base_src_class->unlock_stop = test_src_unlock_stop;
+  GST_PUSH_SRC_CLASS (klass)->create = test_src_create;
+}
+
+static void
+test_src_init (TestSrc * src)
+{
+}
+
+static GstURIType
+test_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+test_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "schedtest", NULL };
+
+  return protocols;
+}
+
+static gchar *
+test_src_uri_get_uri (GstURIHandler * handler)
+{
+  TestSrc *src = (TestSrc *) handler;
+
+  return g_strdup_printf ("schedtest://%u/%u", src->stream, src->n);
+}
+
+static gboolean
+test_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  TestSrc *src = (TestSrc *) handler;
+
+  if (sscanf (uri, "schedtest://%u/%u", &src->stream, &src->n) != 2
+      || src->stream >= N_STREAMS || src->n >= N_REQUESTS) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid URI %s", uri);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+test_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = test_src_uri_get_type;
+  iface->get_protocols = test_src_uri_get_protocols;
+  iface->get_uri = test_src_uri_get_uri;
+  iface->set_uri = test_src_uri_set_uri;
+}
+
+static void
+free_request_data (gpointer user_data)
+{
+  g_mutex_lock (&test_lock);
+  n_freed++;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+}
+
+/* queues request @n of @stream, with n + 1 as user data */
+static void
+push_request (GstUriDownloadScheduler * scheduler, guint stream, guint n)
+{
+  gchar *uri = g_strdup_printf ("schedtest://%u/%u", stream, n);
+
+  gst_uri_download_scheduler_push (scheduler, stream, uri, 0, -1,
+      GUINT_TO_POINTER (n + 1), free_request_data);
+  g_free (uri);
+}
+
+/* pops the head of @stream, which must be request @n */
+static void
+pop_request (GstUriDownloadScheduler * scheduler, guint stream, guint n)
+{
+  GstFragment *fragment = NULL;
+  gpointer user_data = NULL;
+  GstBuffer *buffer;
+  gchar *expected;
+
+  fail_unless (gst_uri_download_scheduler_pop (scheduler, stream, TRUE,
+          &fragment, &user_data));
+  fail_unless_equals_int (GPOINTER_TO_UINT (user_data), n + 1);
+  fail_unless (fragment != NULL);
+
+  buffer = gst_fragment_get_buffer (fragment);
+  fail_unless (buffer != NULL);
+  expected = g_strdup_printf ("%u/%u", stream, n);
+  fail_unless_equals_int (gst_buffer_get_size (buffer), strlen (expected));
+  fail_unless (gst_buffer_memcmp (buffer, 0, expected, strlen (expected)) == 0);
+  g_free (expected);
+  gst_buffer_unref (buffer);
+  g_object_unref (fragment);
+}
+
+static void
+hold_stream (guint stream, gboolean hold)
+{
+  guint i;
+
+  g_mutex_lock (&test_lock);
+  for (i = 0; i < N_REQUESTS; i++)
+    held[stream][i] = hold;
+  g_cond_broadcast (&test_cond);
+  g_mutex_unlock (&test_lock);
+}
+
+static void
+wait_served (guint n)
+{
+  g_mutex_lock (&test_lock);
+  while (n_served < n)
+    g_cond_wait (&test_cond, &test_lock);
+  g_mutex_unlock (&test_lock);
+}
+
+static void
+wait_running (guint stream, guint n)
+{
+  g_mutex_lock (&test_lock);
+  while (n_running[stream] != n)
+    g_cond_wait (&test_cond, &test_lock);
+  g_mutex_unlock (&test_lock);
+}
+
+static void
+wait_freed (guint n)
+{
+  g_mutex_lock (&test_lock);
+  while (n_freed < n)
+    g_cond_wait (&test_cond, &test_lock);
+  g_mutex_unlock (&test_lock);
+}
+
+GST_START_TEST (test_order)
+{
+  GstUriDownloadScheduler *scheduler;
+  GstFragment *fragment;
+  gpointer user_data;
+  guint i;
+
+  reset_counters ();
+  scheduler = gst_uri_download_scheduler_new ();
+  gst_uri_download_scheduler_set_limits (scheduler, 4, 0);
+
+  /* the first download only completes after all the others */
+  held[0][0] = TRUE;
+  for (i = 0; i < 3; i++)
+    push_request (scheduler, 0, i);
+  gst_uri_download_scheduler_push (scheduler, 0, NULL, 0, -1, MARKER_DATA,
+      NULL);
+  for (i = 3; i < 6; i++)
+    push_request (scheduler, 0, i);
+  fail_unless_equals_int (gst_uri_download_scheduler_get_n_pending (scheduler,
+          0), 7);
+
+  wait_served (5);
+  fail_if (gst_uri_download_scheduler_pop (scheduler, 0, FALSE, &fragment,
+          &user_data));
+
+  /* everything comes out in the order it was queued */
+  hold_stream (0, FALSE);
+  for (i = 0; i < 3; i++)
+    pop_request (scheduler, 0, i);
+  fail_unless (gst_uri_download_scheduler_pop (scheduler, 0, TRUE, &fragment,
+          &user_data));
+  fail_unless (fragment == NULL);
+  fail_unless (user_data == MARKER_DATA);
+  for (i = 3; i < 6; i++)
+    pop_request (scheduler, 0, i);
+
+  fail_unless_equals_int (gst_uri_download_scheduler_get_n_pending (scheduler,
+          0), 0);
+  fail_unless_equals_int (n_freed, 0);
+
+  gst_object_unref (scheduler);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_concurrency_limit)
+{
+  GstUriDownloadScheduler *scheduler;
+  guint i, j;
+
+  reset_counters ();
+  scheduler = gst_uri_download_scheduler_new ();
+  gst_uri_download_scheduler_set_limits (scheduler, 2, 0);
+
+  hold_stream (0, TRUE);
+  hold_stream (1, TRUE);
+  for (i = 0; i < 5; i++)
+    for (j = 0; j < N_STREAMS; j++)
+      push_request (scheduler, j, i);
+
+  /* the limit applies to each stream */
+  wait_running (0, 2);
+  wait_running (1, 2);
+  g_usleep (50 * 1000);
+  fail_unless_equals_int (max_running[0], 2);
+  fail_unless_equals_int (max_running[1], 2);
+
+  hold_stream (0, FALSE);
+  hold_stream (1, FALSE);
+  for (i = 0; i < 5; i++)
+    for (j = 0; j < N_STREAMS; j++)
+      pop_request (scheduler, j, i);
+
+  fail_unless_equals_int (max_running[0], 2);
+  fail_unless_equals_int (max_running[1], 2);
+
+  gst_object_unref (scheduler);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_flush)
+{
+  GstUriDownloadScheduler *scheduler;
+  guint i;
+
+  reset_counters ();
+  scheduler = gst_uri_download_scheduler_new ();
+  gst_uri_download_scheduler_set_limits (scheduler, 1, 0);
+
+  hold_stream (0, TRUE);
+  hold_stream (1, TRUE);
+  for (i = 0; i < 3; i++) {
+    push_request (scheduler, 0, i);
+    push_request (scheduler, 1, i);
+  }
+  wait_running (0, 1);
+  wait_running (1, 1);
+
+  /* the running download of stream 0 is aborted and all of its requests are
+   * dropped, stream 1 is not affected */
+  gst_uri_download_scheduler_flush (scheduler, 0);
+  wait_running (0, 0);
+  wait_freed (3);
+  fail_unless_equals_int (gst_uri_download_scheduler_get_n_pending (scheduler,
+          0), 0);
+  fail_unless_equals_int (gst_uri_download_scheduler_get_n_pending (scheduler,
+          1), 3);
+
+  hold_stream (1, FALSE);
+  for (i = 0; i < 3; i++)
+    pop_request (scheduler, 1, i);
+  fail_unless_equals_int (n_freed, 3);
+
+  gst_object_unref (scheduler);
+}
+
+GST_END_TEST;
+
+static gpointer
+pop_func (GstUriDownloadScheduler * scheduler)
+{
+  GstFragment *fragment = NULL;
+  gpointer user_data = NULL;
+
+  return GINT_TO_POINTER (gst_uri_download_scheduler_pop (scheduler, 0, TRUE,
+          &fragment, &user_data));
+}
+
+GST_START_TEST (test_cancel)
+{
+  GstUriDownloadScheduler *scheduler;
+  GThread *thread;
+  guint i;
+
+  reset_counters ();
+  scheduler = gst_uri_download_scheduler_new ();
+  gst_uri_download_scheduler_set_limits (scheduler, 1, 0);
+
+  hold_stream (0, TRUE);
+  for (i = 0; i < 3; i++)
+    push_request (scheduler, 0, i);
+  wait_running (0, 1);
+
+  /* a consumer waiting for the head of the stream is woken up */
+  thread = g_thread_new ("pop", (GThreadFunc) pop_func, scheduler);
+  g_usleep (20 * 1000);
+  gst_uri_download_scheduler_cancel (scheduler);
+  fail_if (GPOINTER_TO_INT (g_thread_join (thread)));
+
+  wait_running (0, 0);
+  wait_freed (3);
+  fail_unless_equals_int (gst_uri_download_scheduler_get_n_pending (scheduler,
+          0), 0);
+  fail_unless (!gst_uri_download_scheduler_wait (scheduler, -1));
+
+  /* nothing starts until the scheduler is reset */
+  hold_stream (0, FALSE);
+  push_request (scheduler, 0, 3);
+  g_usleep (20 * 1000);
+  fail_unless_equals_int (n_served, 0);
+  gst_uri_download_scheduler_flush (scheduler, 0);
+  wait_freed (4);
+
+  gst_uri_download_scheduler_reset (scheduler);
+  push_request (scheduler, 0, 4);
+  pop_request (scheduler, 0, 4);
+  fail_unless_equals_int (n_served, 1);
+
+  gst_object_unref (scheduler);
+}
+
+GST_END_TEST;
+
+static Suite *
+uridownloadscheduler_suite (void)
+{
+  Suite *s = suite_create ("uridownloadscheduler");
+  TCase *tc_chain = tcase_create ("general");
+
+  gst_element_register (NULL, "schedtestsrc", GST_RANK_PRIMARY,
+      test_src_get_type ());
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_order);
+  tcase_add_test (tc_chain, test_concurrency_limit);
+  tcase_add_test (tc_chain, test_flush);
+  tcase_add_test (tc_chain, test_cancel);
+
+  return s;
+}
+
+GST_CHECK_MAIN (uridownloadscheduler);